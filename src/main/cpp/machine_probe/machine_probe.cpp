@@ -0,0 +1,644 @@
+/* ---------------------------------------------------------------------- */
+/* machine_probe.cpp :                                                    */
+/* Measures the roofline and the memory hierarchy of the machine it runs  */
+/* on: peak FMA throughput of one core, read / write bandwidth and load   */
+/* latency (pointer chase) of L1, L2, L3 and DRAM, the same for DRAM of   */
+/* every NUMA node, and the per-page cost of the mmap operations behind   */
+/* mmap.impl.MMapUtils (page faults, madvise, mincore, msync). The        */
+/* results are written as a Java properties file that can be read at     */
+/* startup through mmap.impl.MachineProfile.                              */
+/*                                                                        */
+/* Linux / g++ or clang++ only. Build:                                    */
+/*   g++ -O2 -std=c++11 -o machine_probe machine_probe.cpp -lpthread      */
+/* Usage:                                                                 */
+/*   machine_probe [profile file] [scratch directory]                     */
+/* The scratch directory should be on the file system of the mapped      */
+/* files (default: the current directory).                                */
+/* ---------------------------------------------------------------------- */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#if defined (__x86_64__) || defined (__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define PROBE_X86 1
+#endif
+
+
+#define KBYTE 1024L
+#define MBYTE (1024L * 1024L)
+
+/* Minimum duration of a single measurement */
+#define MIN_SECONDS 0.2
+
+/* mbind(2) policy, see <numaif.h> (not included to avoid a libnuma dependency) */
+#define PROBE_MPOL_BIND 2
+
+
+typedef std::chrono::steady_clock probe_clock;
+
+static double seconds_since(probe_clock::time_point start) {
+    return std::chrono::duration<double>(probe_clock::now() - start).count();
+}
+
+/* Sink for results that must not be optimized away */
+static volatile uint64_t sink;
+
+
+/* ------------------------------ topology ------------------------------ */
+
+struct topology {
+    int instrset;       // same numbering as net.volcanite.util.CPU
+    bool fma;
+    bool avx2;
+    bool avx512f;
+    bool sha;
+    long cpus;
+    long l1d;
+    long l2;
+    long l3;
+    std::vector<int> nodes;
+    std::vector<std::vector<int> > node_cpus;
+};
+
+static bool read_line(const std::string& path, std::string& line) {
+    FILE* f = fopen(path.c_str(), "r");
+    if (f == NULL) {
+        return false;
+    }
+    char buf[4096];
+    bool ok = fgets(buf, sizeof(buf), f) != NULL;
+    fclose(f);
+    if (ok) {
+        line = buf;
+        while (!line.empty() && (line[line.size() - 1] == '\n' || line[line.size() - 1] == ' ')) {
+            line.erase(line.size() - 1);
+        }
+    }
+    return ok;
+}
+
+/* Parses a sysfs list like "0-3,8,10-11" */
+static std::vector<int> parse_list(const std::string& list) {
+    std::vector<int> result;
+    const char* p = list.c_str();
+    while (*p != '\0') {
+        char* end;
+        long from = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        long to = from;
+        p = end;
+        if (*p == '-') {
+            to = strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for (long i = from; i <= to; ++i) {
+            result.push_back((int) i);
+        }
+        if (*p == ',') {
+            ++p;
+        }
+    }
+    return result;
+}
+
+static void detect_caches(topology& t) {
+    t.l1d = 32 * KBYTE;
+    t.l2 = 1 * MBYTE;
+    t.l3 = 8 * MBYTE;
+    for (int i = 0; i < 8; ++i) {
+        std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(i) + "/";
+        std::string level, type, size;
+        if (!read_line(dir + "level", level) || !read_line(dir + "type", type)
+                || !read_line(dir + "size", size)) {
+            continue;
+        }
+        long bytes = strtol(size.c_str(), NULL, 10);
+        char unit = size.empty() ? 'K' : size[size.size() - 1];
+        bytes *= (unit == 'M') ? MBYTE : (unit == 'G') ? 1024 * MBYTE : KBYTE;
+        if (level == "1" && type == "Data") {
+            t.l1d = bytes;
+        } else if (level == "2") {
+            t.l2 = bytes;
+        } else if (level == "3") {
+            t.l3 = bytes;
+        }
+    }
+}
+
+static void detect_isa(topology& t) {
+    t.instrset = 0;
+    t.fma = t.avx2 = t.avx512f = t.sha = false;
+#if defined (PROBE_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))    t.instrset = 2;
+    if (__builtin_cpu_supports("sse3"))    t.instrset = 3;
+    if (__builtin_cpu_supports("ssse3"))   t.instrset = 4;
+    if (__builtin_cpu_supports("sse4.1"))  t.instrset = 5;
+    if (__builtin_cpu_supports("sse4.2"))  t.instrset = 6;
+    if (__builtin_cpu_supports("avx"))     t.instrset = 7;
+    if (__builtin_cpu_supports("avx2"))    t.instrset = 8;
+    if (__builtin_cpu_supports("avx512f")) t.instrset = 9;
+    if (__builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512bw")
+            && __builtin_cpu_supports("avx512dq")) {
+        t.instrset = 10;
+    }
+    t.fma = __builtin_cpu_supports("fma");
+    t.avx2 = __builtin_cpu_supports("avx2");
+    t.avx512f = __builtin_cpu_supports("avx512f");
+    unsigned int a, b, c, d;
+    if (__get_cpuid_count(7, 0, &a, &b, &c, &d)) {
+        t.sha = (b & (1u << 29)) != 0;
+    }
+#endif
+}
+
+static void detect_topology(topology& t) {
+    detect_isa(t);
+    detect_caches(t);
+    t.cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    std::string online;
+    if (read_line("/sys/devices/system/node/online", online)) {
+        t.nodes = parse_list(online);
+    }
+    if (t.nodes.empty()) {
+        t.nodes.push_back(0);
+    }
+    for (size_t i = 0; i < t.nodes.size(); ++i) {
+        std::string cpus;
+        std::string path = "/sys/devices/system/node/node" + std::to_string(t.nodes[i]) + "/cpulist";
+        std::vector<int> list;
+        if (read_line(path, cpus)) {
+            list = parse_list(cpus);
+        }
+        if (list.empty()) {
+            for (long c = 0; c < t.cpus; ++c) {
+                list.push_back((int) c);
+            }
+        }
+        t.node_cpus.push_back(list);
+    }
+}
+
+static bool pin_to(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        CPU_SET(cpus[i], &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+
+/* ------------------------------- memory ------------------------------- */
+
+/*
+ * Anonymous memory, bound to the given NUMA node (node < 0: first touch)
+ * and pre-faulted.
+ */
+static char* alloc_on_node(size_t size, int node) {
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+#if defined (SYS_mbind)
+    if (node >= 0 && node < 64) {
+        unsigned long mask = 1UL << node;
+        // failure (no NUMA support) leaves us with first touch placement
+        syscall(SYS_mbind, p, size, PROBE_MPOL_BIND, &mask, 64UL, 0UL);
+    }
+#endif
+    memset(p, 1, size);
+    return (char*) p;
+}
+
+
+/* ------------------------------- kernels ------------------------------ */
+
+#if defined (PROBE_X86)
+
+__attribute__((target("avx512f")))
+static double fma_avx512(uint64_t iters) {
+    __m512d b = _mm512_set1_pd(0.9999999);
+    __m512d c = _mm512_set1_pd(1e-9);
+    __m512d a0 = _mm512_set1_pd(1.0), a1 = a0, a2 = a0, a3 = a0, a4 = a0, a5 = a0;
+    __m512d a6 = a0, a7 = a0, a8 = a0, a9 = a0, a10 = a0, a11 = a0;
+    for (uint64_t i = 0; i < iters; ++i) {
+        a0 = _mm512_fmadd_pd(a0, b, c); a1 = _mm512_fmadd_pd(a1, b, c);
+        a2 = _mm512_fmadd_pd(a2, b, c); a3 = _mm512_fmadd_pd(a3, b, c);
+        a4 = _mm512_fmadd_pd(a4, b, c); a5 = _mm512_fmadd_pd(a5, b, c);
+        a6 = _mm512_fmadd_pd(a6, b, c); a7 = _mm512_fmadd_pd(a7, b, c);
+        a8 = _mm512_fmadd_pd(a8, b, c); a9 = _mm512_fmadd_pd(a9, b, c);
+        a10 = _mm512_fmadd_pd(a10, b, c); a11 = _mm512_fmadd_pd(a11, b, c);
+    }
+    __m512d s = _mm512_add_pd(_mm512_add_pd(_mm512_add_pd(a0, a1), _mm512_add_pd(a2, a3)),
+                              _mm512_add_pd(_mm512_add_pd(a4, a5), _mm512_add_pd(a6, a7)));
+    s = _mm512_add_pd(s, _mm512_add_pd(_mm512_add_pd(a8, a9), _mm512_add_pd(a10, a11)));
+    double r[8];
+    _mm512_storeu_pd(r, s);
+    return r[0] + r[1] + r[2] + r[3] + r[4] + r[5] + r[6] + r[7];
+}
+
+__attribute__((target("avx2,fma")))
+static double fma_avx2(uint64_t iters) {
+    __m256d b = _mm256_set1_pd(0.9999999);
+    __m256d c = _mm256_set1_pd(1e-9);
+    __m256d a0 = _mm256_set1_pd(1.0), a1 = a0, a2 = a0, a3 = a0, a4 = a0, a5 = a0;
+    __m256d a6 = a0, a7 = a0, a8 = a0, a9 = a0, a10 = a0, a11 = a0;
+    for (uint64_t i = 0; i < iters; ++i) {
+        a0 = _mm256_fmadd_pd(a0, b, c); a1 = _mm256_fmadd_pd(a1, b, c);
+        a2 = _mm256_fmadd_pd(a2, b, c); a3 = _mm256_fmadd_pd(a3, b, c);
+        a4 = _mm256_fmadd_pd(a4, b, c); a5 = _mm256_fmadd_pd(a5, b, c);
+        a6 = _mm256_fmadd_pd(a6, b, c); a7 = _mm256_fmadd_pd(a7, b, c);
+        a8 = _mm256_fmadd_pd(a8, b, c); a9 = _mm256_fmadd_pd(a9, b, c);
+        a10 = _mm256_fmadd_pd(a10, b, c); a11 = _mm256_fmadd_pd(a11, b, c);
+    }
+    __m256d s = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3)),
+                              _mm256_add_pd(_mm256_add_pd(a4, a5), _mm256_add_pd(a6, a7)));
+    s = _mm256_add_pd(s, _mm256_add_pd(_mm256_add_pd(a8, a9), _mm256_add_pd(a10, a11)));
+    double r[4];
+    _mm256_storeu_pd(r, s);
+    return r[0] + r[1] + r[2] + r[3];
+}
+
+__attribute__((target("avx2")))
+static uint64_t read_avx2(const char* p, size_t size) {
+    __m256i s0 = _mm256_setzero_si256(), s1 = s0, s2 = s0, s3 = s0;
+    for (size_t i = 0; i < size; i += 128) {
+        s0 = _mm256_add_epi64(s0, _mm256_load_si256((const __m256i*) (p + i)));
+        s1 = _mm256_add_epi64(s1, _mm256_load_si256((const __m256i*) (p + i + 32)));
+        s2 = _mm256_add_epi64(s2, _mm256_load_si256((const __m256i*) (p + i + 64)));
+        s3 = _mm256_add_epi64(s3, _mm256_load_si256((const __m256i*) (p + i + 96)));
+    }
+    __m256i s = _mm256_add_epi64(_mm256_add_epi64(s0, s1), _mm256_add_epi64(s2, s3));
+    return (uint64_t) _mm256_extract_epi64(s, 0) + (uint64_t) _mm256_extract_epi64(s, 3);
+}
+
+__attribute__((target("avx2")))
+static void write_avx2(char* p, size_t size, uint64_t value) {
+    __m256i v = _mm256_set1_epi64x((long long) value);
+    for (size_t i = 0; i < size; i += 128) {
+        _mm256_store_si256((__m256i*) (p + i), v);
+        _mm256_store_si256((__m256i*) (p + i + 32), v);
+        _mm256_store_si256((__m256i*) (p + i + 64), v);
+        _mm256_store_si256((__m256i*) (p + i + 96), v);
+    }
+}
+
+#endif /* PROBE_X86 */
+
+static double fma_scalar(uint64_t iters) {
+    double b = 0.9999999, c = 1e-9;
+    double a0 = 1.0, a1 = a0, a2 = a0, a3 = a0, a4 = a0, a5 = a0, a6 = a0, a7 = a0;
+    for (uint64_t i = 0; i < iters; ++i) {
+        a0 = a0 * b + c; a1 = a1 * b + c; a2 = a2 * b + c; a3 = a3 * b + c;
+        a4 = a4 * b + c; a5 = a5 * b + c; a6 = a6 * b + c; a7 = a7 * b + c;
+    }
+    return a0 + a1 + a2 + a3 + a4 + a5 + a6 + a7;
+}
+
+static uint64_t read_scalar(const char* p, size_t size) {
+    const uint64_t* q = (const uint64_t*) p;
+    uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (size_t i = 0; i < size / 8; i += 4) {
+        s0 += q[i]; s1 += q[i + 1]; s2 += q[i + 2]; s3 += q[i + 3];
+    }
+    return s0 + s1 + s2 + s3;
+}
+
+static void write_scalar(char* p, size_t size, uint64_t value) {
+    uint64_t* q = (uint64_t*) p;
+    for (size_t i = 0; i < size / 8; ++i) {
+        q[i] = value;
+    }
+}
+
+
+/* ----------------------------- measurements --------------------------- */
+
+/* Peak double precision FLOP/s of one core */
+static double measure_flops(const topology& t) {
+    uint64_t iters = 1000000;
+    for (;;) {
+        probe_clock::time_point start = probe_clock::now();
+        double r;
+        double flops_per_iter;
+#if defined (PROBE_X86)
+        if (t.avx512f) {
+            r = fma_avx512(iters);
+            flops_per_iter = 12.0 * 8.0 * 2.0;
+        } else if (t.avx2 && t.fma) {
+            r = fma_avx2(iters);
+            flops_per_iter = 12.0 * 4.0 * 2.0;
+        } else
+#endif
+        {
+            r = fma_scalar(iters);
+            flops_per_iter = 8.0 * 2.0;
+        }
+        double secs = seconds_since(start);
+        sink += (uint64_t) r;
+        if (secs >= MIN_SECONDS) {
+            return (double) iters * flops_per_iter / secs;
+        }
+        iters *= 2;
+    }
+}
+
+/* Read (write == false) or write bandwidth in bytes/s over size bytes */
+static double measure_bandwidth(const topology& t, char* p, size_t size, bool write) {
+    size = size & ~(size_t) 127;
+    uint64_t passes = 1;
+    for (;;) {
+        probe_clock::time_point start = probe_clock::now();
+        for (uint64_t i = 0; i < passes; ++i) {
+#if defined (PROBE_X86)
+            if (t.avx2) {
+                if (write) {
+                    write_avx2(p, size, i);
+                } else {
+                    sink += read_avx2(p, size);
+                }
+                continue;
+            }
+#endif
+            if (write) {
+                write_scalar(p, size, i);
+            } else {
+                sink += read_scalar(p, size);
+            }
+        }
+        double secs = seconds_since(start);
+        if (secs >= MIN_SECONDS) {
+            return (double) passes * (double) size / secs;
+        }
+        passes *= 2;
+    }
+}
+
+/* Load-to-use latency in ns: chase a random cyclic permutation of cache lines */
+static double measure_latency(char* p, size_t size) {
+    const size_t line = 64;
+    size_t n = size / line;
+    if (n < 2) {
+        return 0.0;
+    }
+    std::vector<size_t> perm(n);
+    for (size_t i = 0; i < n; ++i) {
+        perm[i] = i;
+    }
+    // Sattolo's algorithm yields a single cycle through all lines
+    uint64_t rnd = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = n - 1; i > 0; --i) {
+        rnd ^= rnd << 13;
+        rnd ^= rnd >> 7;
+        rnd ^= rnd << 17;
+        size_t j = (size_t) (rnd % i);
+        size_t tmp = perm[i];
+        perm[i] = perm[j];
+        perm[j] = tmp;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        *(char**) (p + perm[i] * line) = p + perm[(i + 1) % n] * line;
+    }
+
+    uint64_t steps = n < 1000000 ? 1000000 : n;
+    char** q = (char**) p;
+    for (;;) {
+        probe_clock::time_point start = probe_clock::now();
+        for (uint64_t i = 0; i < steps; ++i) {
+            q = (char**) *q;
+        }
+        double secs = seconds_since(start);
+        sink += (uint64_t) (uintptr_t) q;
+        if (secs >= MIN_SECONDS) {
+            return secs * 1e9 / (double) steps;
+        }
+        steps *= 2;
+    }
+}
+
+struct level_result {
+    double read_bw;
+    double write_bw;
+    double latency_ns;
+};
+
+static level_result measure_level(const topology& t, size_t size, int node) {
+    level_result r;
+    char* p = alloc_on_node(size, node);
+    if (p == NULL) {
+        r.read_bw = r.write_bw = r.latency_ns = 0.0;
+        return r;
+    }
+    r.read_bw = measure_bandwidth(t, p, size, false);
+    r.write_bw = measure_bandwidth(t, p, size, true);
+    r.latency_ns = measure_latency(p, size);
+    munmap(p, size);
+    return r;
+}
+
+struct mmap_result {
+    double fault_minor_ns;
+    double fault_major_ns;
+    double willneed_ns;
+    double dontneed_ns;
+    double mincore_ns;
+    double msync_ns;
+};
+
+static double per_page(probe_clock::time_point start, size_t pages) {
+    return seconds_since(start) * 1e9 / (double) pages;
+}
+
+static uint64_t touch_pages(const char* p, size_t pages, long ps) {
+    uint64_t x = 0;
+    for (size_t i = 0; i < pages; ++i) {
+        x += (unsigned char) p[i * ps];
+    }
+    return x;
+}
+
+/*
+ * Per-page costs of the calls behind MMapUtils (load0 = MADV_WILLNEED,
+ * unload0 = MADV_DONTNEED, isLoaded0 = mincore, force0 = msync) and of
+ * minor (page cache hit) and major (read from the file) faults.
+ */
+static bool measure_mmap(const char* dir, size_t size, mmap_result& r) {
+    std::string path = std::string(dir) + "/machine_probe.XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+    int fd = mkstemp(&name[0]);
+    if (fd == -1) {
+        return false;
+    }
+    unlink(&name[0]);
+
+    long ps = sysconf(_SC_PAGESIZE);
+    size_t pages = size / ps;
+    std::vector<char> block(MBYTE, 7);
+    for (size_t off = 0; off < size; off += MBYTE) {
+        if (pwrite(fd, &block[0], MBYTE, (off_t) off) != MBYTE) {
+            close(fd);
+            return false;
+        }
+    }
+    fsync(fd);
+
+    char* p = (char*) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    std::vector<unsigned char> vec(pages);
+
+    probe_clock::time_point start = probe_clock::now();
+    sink += touch_pages(p, pages, ps);
+    r.fault_minor_ns = per_page(start, pages);
+
+    start = probe_clock::now();
+    mincore(p, size, &vec[0]);
+    r.mincore_ns = per_page(start, pages);
+
+    start = probe_clock::now();
+    madvise(p, size, MADV_DONTNEED);
+    r.dontneed_ns = per_page(start, pages);
+
+    start = probe_clock::now();
+    madvise(p, size, MADV_WILLNEED);
+    r.willneed_ns = per_page(start, pages);
+
+    memset(p, 3, size);
+    start = probe_clock::now();
+    msync(p, size, MS_SYNC);
+    r.msync_ns = per_page(start, pages);
+
+    // drop the (now clean) pages from the page cache, then fault them in again
+    madvise(p, size, MADV_DONTNEED);
+    posix_fadvise(fd, 0, (off_t) size, POSIX_FADV_DONTNEED);
+    start = probe_clock::now();
+    sink += touch_pages(p, pages, ps);
+    r.fault_major_ns = per_page(start, pages);
+
+    munmap(p, size);
+    close(fd);
+    return true;
+}
+
+
+/* -------------------------------- output ------------------------------ */
+
+/* Measurements, 6 significant digits */
+static void put(FILE* out, const char* key, double value) {
+    fprintf(out, "%s=%.6g\n", key, value);
+}
+
+/* Counts and sizes, exact */
+static void put(FILE* out, const char* key, long long value) {
+    fprintf(out, "%s=%lld\n", key, value);
+}
+
+static void put(FILE* out, const std::string& key, double value) {
+    put(out, key.c_str(), value);
+}
+
+static void put_level(FILE* out, const std::string& prefix, const level_result& r) {
+    put(out, prefix + ".read_bytes_per_sec", r.read_bw);
+    put(out, prefix + ".write_bytes_per_sec", r.write_bw);
+    put(out, prefix + ".latency_ns", r.latency_ns);
+}
+
+
+int main(int argc, char** argv) {
+    const char* profile = (argc > 1) ? argv[1] : "machine_profile.properties";
+    const char* scratch = (argc > 2) ? argv[2] : ".";
+
+    topology t;
+    detect_topology(t);
+    pin_to(t.node_cpus[0]);
+
+    fprintf(stderr, "measuring peak FLOP/s ...\n");
+    double flops = measure_flops(t);
+
+    long dram = 4 * t.l3;
+    if (dram < 256 * MBYTE) {
+        dram = 256 * MBYTE;
+    }
+    fprintf(stderr, "measuring L1 / L2 / L3 / DRAM ...\n");
+    level_result l1 = measure_level(t, t.l1d / 2, -1);
+    level_result l2 = measure_level(t, (t.l1d + t.l2) / 2, -1);
+    level_result l3 = measure_level(t, (t.l2 + t.l3) / 2, -1);
+    level_result mem = measure_level(t, dram, -1);
+
+    // local DRAM of every node, plus DRAM of every node as seen from node 0
+    std::vector<level_result> local;
+    std::vector<level_result> remote;
+    for (size_t i = 0; i < t.nodes.size() && t.nodes.size() > 1; ++i) {
+        fprintf(stderr, "measuring NUMA node %d ...\n", t.nodes[i]);
+        pin_to(t.node_cpus[i]);
+        local.push_back(measure_level(t, dram, t.nodes[i]));
+        pin_to(t.node_cpus[0]);
+        remote.push_back(measure_level(t, dram, t.nodes[i]));
+    }
+
+    fprintf(stderr, "measuring mmap page costs ...\n");
+    mmap_result mr = mmap_result();
+    bool mapped = measure_mmap(scratch, 64 * MBYTE, mr);
+
+    FILE* out = fopen(profile, "w");
+    if (out == NULL) {
+        fprintf(stderr, "can't write %s: %s\n", profile, strerror(errno));
+        return 1;
+    }
+    fprintf(out, "# machine profile written by machine_probe\n");
+    put(out, "isa.instrset", (long long) t.instrset);
+    fprintf(out, "isa.fma=%s\n", t.fma ? "true" : "false");
+    fprintf(out, "isa.avx2=%s\n", t.avx2 ? "true" : "false");
+    fprintf(out, "isa.avx512f=%s\n", t.avx512f ? "true" : "false");
+    fprintf(out, "isa.sha=%s\n", t.sha ? "true" : "false");
+    put(out, "cpu.count", (long long) t.cpus);
+    put(out, "cache.l1d.bytes", (long long) t.l1d);
+    put(out, "cache.l2.bytes", (long long) t.l2);
+    put(out, "cache.l3.bytes", (long long) t.l3);
+    put(out, "numa.nodes", (long long) t.nodes.size());
+    put(out, "flops.fma_per_core", flops);
+    put_level(out, "l1", l1);
+    put_level(out, "l2", l2);
+    put_level(out, "l3", l3);
+    put_level(out, "dram", mem);
+    if (mem.read_bw > 0.0) {
+        // arithmetic intensity (FLOP/byte) above which a kernel is compute bound
+        put(out, "roofline.ridge_flops_per_byte", flops / mem.read_bw);
+    }
+    for (size_t i = 0; i < local.size(); ++i) {
+        std::string node = "numa.node" + std::to_string(t.nodes[i]);
+        put_level(out, node + ".local", local[i]);
+        put_level(out, node + ".from_node" + std::to_string(t.nodes[0]), remote[i]);
+    }
+    if (mapped) {
+        put(out, "mmap.fault_minor_ns_per_page", mr.fault_minor_ns);
+        put(out, "mmap.fault_major_ns_per_page", mr.fault_major_ns);
+        put(out, "mmap.willneed_ns_per_page", mr.willneed_ns);
+        put(out, "mmap.dontneed_ns_per_page", mr.dontneed_ns);
+        put(out, "mmap.mincore_ns_per_page", mr.mincore_ns);
+        put(out, "mmap.msync_ns_per_page", mr.msync_ns);
+    }
+    fclose(out);
+    fprintf(stderr, "wrote %s\n", profile);
+    return 0;
+}
@@ -0,0 +1,18 @@
+package disk;
+
+public interface BatchConsumer {
+
+    /**
+     * Get the next batch of messages from the queue. Implementors must throw
+     * an exception if they don't want these messages to be permanently
+     * removed from the queue. The batch is only valid during this call.
+     * 
+     * @param batch
+     *            the eldest messages in the queue (at least one)
+     * @throws Throwable
+     *             the implementation may throw anything it wants to throw to
+     *             indicate that it can't (yet) process the batch and it
+     *             therefore must not be removed from the queue
+     */
+    void acceptMessages(QueueFile.Batch batch) throws Throwable;
+}
@@ -0,0 +1,160 @@
+package disk;
+
+import java.util.Arrays;
+
+/**
+ * The in-memory position index of a {@link QueueFile}: the file position of
+ * every {@code stride}-th element (by absolute element sequence number,
+ * counted from the open of the queue) and the sequence number of its first
+ * message. Entries are appended when elements are added and dropped when
+ * their elements are removed, so finding element (or message) {@code k} is
+ * an index lookup plus a walk of less than {@code stride} elements.
+ * <p>
+ * The index isn't persisted, it is rebuilt by a native walk when the queue
+ * is opened. Not thread-safe, guarded by the lock of the queue.
+ */
+final class PositionIndex {
+
+    private final int stride;
+
+    /** Circular arrays of the entries. */
+    private long[] positions;
+    private long[] messageSeqs;
+    private int start;
+    private int size;
+
+    /** The element sequence number of the entry at {@link #start}. */
+    private long firstSeq;
+
+    PositionIndex(int stride) {
+        if (stride <= 0) {
+            throw new IllegalArgumentException("stride: " + stride);
+        }
+        this.stride = stride;
+        this.positions = new long[16];
+        this.messageSeqs = new long[16];
+    }
+
+    int stride() {
+        return stride;
+    }
+
+    int size() {
+        return size;
+    }
+
+    /** Records the element {@code elementSeq} if it falls on the stride. */
+    void append(long elementSeq, long position, long messageSeq) {
+        if (elementSeq % stride != 0L) {
+            return;
+        }
+        if (size == 0) {
+            start = 0;
+            firstSeq = elementSeq;
+        } else if (elementSeq != firstSeq + (long) size * stride) {
+            throw new IllegalStateException("Index gap at element " + elementSeq);
+        }
+        if (size == positions.length) {
+            grow();
+        }
+        int i = slot(size);
+        positions[i] = position;
+        messageSeqs[i] = messageSeq;
+        size++;
+    }
+
+    /** Drops the entries of elements before {@code headSeq}. */
+    void trim(long headSeq) {
+        while (size > 0 && firstSeq < headSeq) {
+            start = slot(1);
+            size--;
+            firstSeq += stride;
+        }
+    }
+
+    void clear() {
+        start = 0;
+        size = 0;
+    }
+
+    /**
+     * Adds {@code delta} to all positions below {@code limit} (the ring
+     * buffer has been expanded and its wrapped part has been moved).
+     */
+    void relocate(long limit, long delta) {
+        for (int k = 0; k < size; ++k) {
+            int i = slot(k);
+            if (positions[i] < limit) {
+                positions[i] += delta;
+            }
+        }
+    }
+
+    /**
+     * The entry of the nearest element at or before {@code elementSeq} or -1
+     * if there is none.
+     */
+    int floorByElement(long elementSeq) {
+        if (size == 0 || elementSeq < firstSeq) {
+            return -1;
+        }
+        return (int) Math.min((elementSeq - firstSeq) / stride, size - 1);
+    }
+
+    /**
+     * The entry of the nearest element whose first message is at or before
+     * {@code messageSeq} or -1 if there is none.
+     */
+    int floorByMessage(long messageSeq) {
+        int lo = 0;
+        int hi = size - 1;
+        int found = -1;
+        while (lo <= hi) {
+            int mid = (lo + hi) >>> 1;
+            if (messageSeqs[slot(mid)] <= messageSeq) {
+                found = mid;
+                lo = mid + 1;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        return found;
+    }
+
+    long elementSeq(int entry) {
+        return firstSeq + (long) entry * stride;
+    }
+
+    long position(int entry) {
+        return positions[slot(entry)];
+    }
+
+    long messageSeq(int entry) {
+        return messageSeqs[slot(entry)];
+    }
+
+    private int slot(int entry) {
+        int i = start + entry;
+        return (i < positions.length) ? i : i - positions.length;
+    }
+
+    private void grow() {
+        int capacity = positions.length << 1;
+        long[] p = new long[capacity];
+        long[] m = new long[capacity];
+        for (int k = 0; k < size; ++k) {
+            int i = slot(k);
+            p[k] = positions[i];
+            m[k] = messageSeqs[i];
+        }
+        positions = p;
+        messageSeqs = m;
+        start = 0;
+    }
+
+    @Override
+    public String toString() {
+        return getClass().getSimpleName() + "[stride=" + stride + ", size=" + size + ", first=" + firstSeq
+                + ", positions=" + Arrays.toString(Arrays.copyOf(positions, Math.min(size, 8))) + "]";
+    }
+}
@@ -0,0 +1,307 @@
+package disk;
+
+import java.io.Closeable;
+import java.io.File;
+import java.io.FileNotFoundException;
+import java.io.IOException;
+import java.io.RandomAccessFile;
+
+import disk.SegmentedQueueFile.Position;
+import disk.SegmentedQueueFile.Segment;
+import mmap.impl.Crc32C;
+import mmap.impl.MMapUtils;
+import mmap.impl.VectoredIO;
+
+/**
+ * A named, persistent read position in a {@link SegmentedQueueFile}. Several
+ * cursors consume the same queue independently of each other: messages are
+ * read with {@link #poll()} and acknowledged with {@link #commit()}, which
+ * persists the position. {@link #rewind()} returns to the last committed
+ * position (e.g. after a failed delivery), and so does a cursor that is
+ * reopened after a crash. The segments of the queue are only deleted once
+ * every cursor has committed a position past them.
+ *
+ * <p>
+ * Reads don't take the lock of the queue. A cursor reads the segment files
+ * through its own file handles, up to the end of the committed frames that
+ * the queue publishes after each addition; frames never move once they are
+ * written. Only {@link #commit()} briefly takes the lock to let the queue
+ * reclaim data.
+ *
+ * <pre>
+ * Cursor file (28 bytes):
+ *   1 bit            Versioned indicator [1 = versioned]
+ *   31 bits          Version, 1
+ *   8 bytes          Segment number
+ *   8 bytes          Frame offset in the segment
+ *   4 bytes          Number of consumed messages of the frame
+ *   4 bytes          CRC-32C of the preceding 24 bytes
+ * </pre>
+ */
+public final class QueueCursor implements Closeable {
+
+    /**
+     * Leading bit set to 1 indicating a versioned file and the version of 1.
+     */
+    private static final int CURSOR_VERSION = 0x80000001;
+
+    /** The cursor file length in bytes. */
+    private static final int CURSOR_LENGTH = 28;
+
+    private final SegmentedQueueFile queue;
+    private final String name;
+    private final File file;
+    private final RandomAccessFile raf;
+
+    /** The raw file descriptor of {@link #raf} or -1. */
+    private final long fd;
+
+    /** In-memory buffer. Big enough to hold the cursor file. */
+    private final byte[] buffer = new byte[CURSOR_LENGTH];
+
+    /** The last committed position. */
+    private Position committed;
+
+    /** The read position. */
+    private long segmentNumber;
+    private long offset;
+    private int consumed;
+
+    /** The segment at the read position or null. */
+    private Segment segment;
+
+    /** The messages of the frame at the read position or null. */
+    private byte[][] messages;
+
+    /** The length of that frame (including its length prefix). */
+    private int frameLength;
+
+    private volatile boolean closed;
+
+    /** Atomically creates a cursor file. */
+    static void initialize(File file, Position position) throws IOException {
+        File tempFile = new File(file.getPath() + ".tmp");
+        byte[] cursor = new byte[CURSOR_LENGTH];
+        encode(cursor, position);
+        try (RandomAccessFile raf = new RandomAccessFile(tempFile, "rwd")) {
+            raf.setLength(0L);
+            raf.write(cursor);
+        }
+        // A rename is atomic
+        if (!tempFile.renameTo(file)) {
+            throw new IOException("Rename failed!");
+        }
+    }
+
+    /** Reads the position from a cursor file. */
+    static Position load(File file) throws IOException {
+        byte[] cursor = new byte[CURSOR_LENGTH];
+        try (RandomAccessFile raf = new RandomAccessFile(file, "r")) {
+            if (raf.length() < CURSOR_LENGTH) {
+                throw new IOException("Cursor file is corrupt. Length: " + raf.length() + " in " + file);
+            }
+            raf.readFully(cursor);
+        }
+        int version = QueueFile.readInt(cursor, 0) & 0x7FFFFFFF;
+        if (version != 1) {
+            throw new IOException("Unable to read version " + version + " format. Supported version is 1");
+        }
+        if (QueueFile.readInt(cursor, CURSOR_LENGTH - 4) != Crc32C.compute(cursor, 0, CURSOR_LENGTH - 4)) {
+            throw new IOException("Cursor file is corrupt. Checksum mismatch in " + file);
+        }
+        return new Position(QueueFile.readLong(cursor, 4), QueueFile.readLong(cursor, 12),
+                QueueFile.readInt(cursor, 20));
+    }
+
+    private static void encode(byte[] cursor, Position position) {
+        QueueFile.writeInt(cursor, 0, CURSOR_VERSION);
+        QueueFile.writeLong(cursor, 4, position.segment);
+        QueueFile.writeLong(cursor, 12, position.offset);
+        QueueFile.writeInt(cursor, 20, position.consumed);
+        QueueFile.writeInt(cursor, CURSOR_LENGTH - 4, Crc32C.compute(cursor, 0, CURSOR_LENGTH - 4));
+    }
+
+    QueueCursor(SegmentedQueueFile queue, String name, File file, Position position) throws IOException {
+        this.queue = queue;
+        this.name = name;
+        this.file = file;
+        this.raf = new RandomAccessFile(file, "rwd");
+        this.fd = VectoredIO.isAvailable() ? MMapUtils.getFileDescriptor(raf.getFD()) : -1L;
+        this.committed = position;
+        this.segmentNumber = position.segment;
+        this.offset = position.offset;
+        this.consumed = position.consumed;
+    }
+
+    /** The name of this cursor. */
+    public String name() {
+        return name;
+    }
+
+    /**
+     * Reads the next message and advances the read position (but not the
+     * committed position).
+     *
+     * @return the next message or {@code null} if this cursor has reached the
+     *         end of the queue
+     */
+    public synchronized byte[] poll() throws IOException {
+        checkOpen();
+        if (messages == null && !nextFrame()) {
+            return null;
+        }
+        byte[] message = messages[consumed++];
+        if (consumed == messages.length) {
+            offset += frameLength;
+            consumed = 0;
+            messages = null;
+        }
+        return message;
+    }
+
+    /**
+     * Reads the frame at the read position (moving on to the next segment at
+     * the end of a segment). Returns false at the end of the queue.
+     */
+    private boolean nextFrame() throws IOException {
+        Position end = queue.end();
+        while (segmentNumber < end.segment || (segmentNumber == end.segment && offset < end.offset)) {
+            Segment s = segment();
+            if (s == null && segmentNumber >= end.segment) {
+                throw new IOException("Missing segment " + queue.segmentFile(segmentNumber));
+            }
+            if (s == null || (segmentNumber < end.segment && SegmentedQueueFile.atSegmentEnd(s, offset, buffer))) {
+                // a missing segment has been consumed and deleted
+                closeSegment();
+                segmentNumber++;
+                offset = 0L;
+                consumed = 0;
+                continue;
+            }
+            byte[] frame = SegmentedQueueFile.readFrame(s, offset, buffer);
+            byte[][] m = (frame == null) ? null : QueueFile.messages(frame);
+            if (m == null || consumed >= m.length) {
+                throw new IOException("Corrupt frame at offset " + offset + " in " + s.file);
+            }
+            messages = m;
+            frameLength = frame.length;
+            return true;
+        }
+        return false;
+    }
+
+    /** The segment at the read position or null if it doesn't exist anymore. */
+    private Segment segment() throws IOException {
+        if (segment != null && segment.number == segmentNumber) {
+            return segment;
+        }
+        closeSegment();
+        File segmentFile = queue.segmentFile(segmentNumber);
+        RandomAccessFile segmentRaf;
+        try {
+            segmentRaf = new RandomAccessFile(segmentFile, "r");
+        } catch (FileNotFoundException e) {
+            return null;
+        }
+        try {
+            segment = new Segment(segmentNumber, segmentFile, segmentRaf);
+        } catch (IOException e) {
+            segmentRaf.close();
+            throw e;
+        }
+        return segment;
+    }
+
+    private void closeSegment() throws IOException {
+        if (segment != null) {
+            Segment s = segment;
+            segment = null;
+            s.close();
+        }
+    }
+
+    /**
+     * Persists the read position. The messages read so far are acknowledged
+     * and won't be delivered to this cursor again.
+     */
+    public synchronized void commit() throws IOException {
+        checkOpen();
+        Position position = new Position(segmentNumber, offset, consumed);
+        if (position.equals(committed)) {
+            return;
+        }
+        encode(buffer, position);
+        if (fd >= 0L) {
+            // The file is opened with O_DSYNC ("rwd"), no RWF_DSYNC needed
+            VectoredIO.write(fd, 0L, buffer, 0, CURSOR_LENGTH, false);
+        } else {
+            raf.seek(0L);
+            raf.write(buffer, 0, CURSOR_LENGTH);
+        }
+        committed = position;
+        queue.committed(name, position);
+    }
+
+    /**
+     * Returns to the last committed position: the messages read since then
+     * will be delivered again.
+     */
+    public synchronized void rewind() throws IOException {
+        checkOpen();
+        segmentNumber = committed.segment;
+        offset = committed.offset;
+        consumed = committed.consumed;
+        messages = null;
+    }
+
+    private void checkOpen() throws IOException {
+        if (closed) {
+            throw new ClosedQueueFileException("Closed cursor " + name + " : " + file);
+        }
+    }
+
+    /**
+     * Closes this cursor. The committed position is kept; messages read but
+     * not committed will be delivered again by the next instance.
+     */
+    @Override
+    public synchronized void close() throws IOException {
+        if (!closed) {
+            detach();
+            queue.closed(name);
+        }
+    }
+
+    /**
+     * Closes the files (the queue is being closed). Takes the lock of this
+     * cursor so that a concurrent {@link #commit()} can't write to a closed
+     * (and possibly reused) descriptor.
+     */
+    synchronized void detach() throws IOException {
+        if (closed) {
+            return;
+        }
+        closed = true;
+        try {
+            closeSegment();
+        } finally {
+            raf.close();
+        }
+    }
+
+    public boolean isClosed() {
+        return closed;
+    }
+
+    @Override
+    //@formatter:off
+    public synchronized String toString() {
+        return "QueueCursor{"
+             + "name=" + name
+             + ", closed=" + closed
+             + ", committed=" + committed
+             + ", position=" + segmentNumber + ":" + offset + "+" + consumed
+             + '}';
+    }
+    //@formatter:on
+}
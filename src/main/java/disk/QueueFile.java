@@ -20,14 +20,26 @@ import java.io.File;
 import java.io.FileNotFoundException;
 import java.io.IOException;
 import java.io.RandomAccessFile;
+import java.nio.ByteBuffer;
 import java.nio.channels.ClosedByInterruptException;
 import java.nio.channels.FileChannel;
+import java.util.Arrays;
+import java.util.Collections;
 import java.util.ConcurrentModificationException;
 import java.util.Iterator;
+import java.util.List;
 import java.util.NoSuchElementException;
 import java.util.Objects;
 import java.util.logging.Logger;
 
+import mmap.impl.Crc32C;
+import mmap.impl.FrameScanner;
+import mmap.impl.MMapUtils;
+import mmap.impl.MachineProfile;
+import mmap.impl.Native;
+import mmap.impl.SeqLock;
+import mmap.impl.VectoredIO;
+
 /**
  * A reliable, efficient, file-based, FIFO queue. Additions and removals are
  * O(1). All operations are atomic. Writes are synchronous; data will be written
@@ -43,6 +55,32 @@ import java.util.logging.Logger;
  * the segment will contain garbage and the file will be corrupt.
  * 
  * <p>
+ * Queues created with {@link Builder#build(boolean, boolean) framed = true}
+ * use the version 2 format instead: every element is a frame of one or more
+ * messages protected by a CRC-32C. A batch added through
+ * {@link #addMessages(List)} is a single frame that is written with a
+ * single write. On open, the frames are verified by a native scan and the
+ * queue is truncated at the first torn frame, so a crash in the middle of a
+ * write loses the unfinished batch but doesn't corrupt the file. Removals
+ * are persisted per frame: after a crash, the already consumed messages of a
+ * partially consumed head frame are delivered again.
+ * 
+ * <p>
+ * The committed header is also published in native memory under a sequence
+ * lock ({@link SeqLock}): {@link #snapshot()} and {@link #peekMessage()} read
+ * it without taking the lock of the queue, so readers don't contend with
+ * each other or with writers; only writers serialize.
+ * 
+ * <p>
+ * {@link #get(int)} reads and {@link #skip(int)} removes messages anywhere
+ * in the queue; with a position index ({@link Builder#indexStride(int)})
+ * both only walk a bounded number of elements.
+ * 
+ * <p>
+ * A {@link SegmentedQueueFile} stores the same frames in a rolling sequence
+ * of segment files and never has to copy data to grow.
+ * 
+ * <p>
  * https://github.com/square/tape/blob/master/tape/src/main/java/com/squareup/tape2/QueueFile.java
  * <p>
  * Commit 9fa0a3eee397acc02cb7f08153e7dc72d9e31270
@@ -60,12 +98,39 @@ public final class QueueFile implements Closeable {
      */
     private static final int VERSIONED_HEADER = 0x80000001;
 
+    /** Leading bit set to 1 and version 2: the framed format. */
+    private static final int FRAMED_HEADER = 0x80000002;
+
     /** The header length in bytes: Always 32 byte. */
     private static final int HEADER_LENGTH = 32;
 
     /** Initial file size in bytes. 128 file system blocks (= 512 KiB). */
     private static final int INITIAL_LENGTH = 128 * 4096;
 
+    /** Upper bound of the buffer of a batch read. */
+    private static final int MAX_BATCH_BUFFER = Integer.MAX_VALUE - 8;
+
+    /**
+     * Values of the published header: file length, element count, head and
+     * tail position and the consumed messages of the head frame.
+     */
+    private static final int SNAPSHOT_VALUES = 5;
+
+    /** Optimistic lock-free reads before {@link #peekMessage()} takes the lock. */
+    private static final int OPTIMISTIC_READS = 4;
+
+    /**
+     * Default read-ahead window of {@link #forEachAccept(MessageConsumer)}:
+     * 256 file system blocks (= 1 MiB), less if the machine profile reports a
+     * smaller L2 cache (at least 16 blocks) so that the consumer still finds
+     * a window in the cache.
+     */
+    private static final int DEFAULT_READ_AHEAD = (int) Math.max(16 * 4096,
+            Math.min(MachineProfile.getLong("cache.l2.bytes", 256 * 4096), 256 * 4096) & ~4095L);
+
+    /** Values of a {@link #locate} result. */
+    private static final int LOCATE_VALUES = 4;
+
     /**
      * The underlying file. Uses a ring buffer to store entries. Designed so
      * that a modification isn't committed or visible until we write the header.
@@ -75,7 +140,7 @@ public final class QueueFile implements Closeable {
      * (i.e. if setting the file length succeeds but the process dies before the
      * data can be copied).
      * <p>
-     * This implementation supports version 1 of the on-disk format.
+     * This implementation supports versions 1 and 2 of the on-disk format.
      * 
      * <pre>
      * Format:
@@ -84,19 +149,35 @@ public final class QueueFile implements Closeable {
      * 
      * Header (32 bytes):
      *   1 bit            Versioned indicator [1 = versioned]
-     *   31 bits          Version, always 1
+     *   31 bits          Version, 1 or 2 (framed)
      *   8 bytes          File length
-     *   4 bytes          Element count
+     *   4 bytes          Element (frame) count
      *   8 bytes          Head element position
      *   8 bytes          Tail element position
      * 
      * Element:
      *   4 bytes          Data length
      *   ...              Data
+     * 
+     * Frame (version 2, an element whose data is):
+     *   4 bytes          Message count (at least 1)
+     *   4 bytes          CRC-32C of data length, message count and messages
+     *   ...              Messages (4 bytes length + data each)
      * </pre>
      */
     private final RandomAccessFile raf;
 
+    /**
+     * The raw file descriptor of {@link #raf} for positional vectored I/O or
+     * -1 if {@link VectoredIO} isn't available.
+     */
+    private final long fd;
+
+    /** Segment lists for vectored writes (length prefix and data). */
+    private final Object[] segmentBases = new Object[2];
+    private final long[] segmentOffsets = new long[2];
+    private final int[] segmentLengths = new int[2];
+
     /** Keep file around for error reporting. */
     final File file;
 
@@ -106,6 +187,21 @@ public final class QueueFile implements Closeable {
     /** Number of elements. */
     volatile int elementCount;
 
+    /** Whether the elements are checksummed frames of messages (version 2). */
+    private final boolean framed;
+
+    /**
+     * Number of messages in a framed queue (without the consumed messages of
+     * the head frame).
+     */
+    private volatile int messageCount;
+
+    /** The messages of the head frame (framed queue) or null if not read yet. */
+    private byte[][] headMessages;
+
+    /** Number of messages of the head frame that have been removed. */
+    private int headConsumed;
+
     /** Pointer to first (or eldest) element. */
     Element first;
 
@@ -115,6 +211,31 @@ public final class QueueFile implements Closeable {
     /** In-memory buffer. Big enough to hold the header. */
     private final byte[] header = new byte[HEADER_LENGTH];
 
+    /**
+     * Native memory that holds the published header ({@link SeqLock} record
+     * at {@link #snapshotAddress}, 0 if {@code SeqLock} isn't available).
+     * Data of the elements in a published header is only modified after a
+     * later header has been published, so a reader whose sequence didn't
+     * change while it read an element has read consistent data.
+     */
+    private final ByteBuffer snapshotMemory;
+    private final long snapshotAddress;
+    private final long[] snapshotValues = new long[SNAPSHOT_VALUES];
+
+    /** Sequence of the published header if {@code SeqLock} isn't available. */
+    private long publishedSequence;
+
+    /**
+     * The number of elements (messages) added since this queue was opened,
+     * plus the elements (messages) it had then. The sequence number of an
+     * element (message) counts from the head at open time.
+     */
+    private long appendedElements;
+    private long appendedMessages;
+
+    /** The position index or null if it is disabled. */
+    private final PositionIndex index;
+
     /**
      * The number of times this file has been structurally modified. It is
      * incremented during {@link #remove(int)} and
@@ -136,13 +257,17 @@ public final class QueueFile implements Closeable {
     private volatile boolean closed = false;
 
     static RandomAccessFile initializeFromFile(File file) throws IOException {
+        return initializeFromFile(file, false);
+    }
+
+    static RandomAccessFile initializeFromFile(File file, boolean framed) throws IOException {
         if (!file.exists()) {
             // Use a temp file so we don't leave a partially-initialized file
             File tempFile = new File(file.getPath() + ".tmp");
             try (RandomAccessFile raf = open(tempFile)) {
                 raf.setLength(INITIAL_LENGTH);
                 raf.seek(0);
-                raf.writeInt(VERSIONED_HEADER);
+                raf.writeInt(framed ? FRAMED_HEADER : VERSIONED_HEADER);
                 raf.writeLong(INITIAL_LENGTH);
             }
             // A rename is atomic
@@ -169,9 +294,21 @@ public final class QueueFile implements Closeable {
     }
 
     QueueFile(File file, RandomAccessFile raf, boolean overwriteWithZeros) throws IOException {
+        this(file, raf, overwriteWithZeros, 0);
+    }
+
+    QueueFile(File file, RandomAccessFile raf, boolean overwriteWithZeros, int indexStride) throws IOException {
         this.file = file;
         this.raf = raf;
         this.overwriteWithZeros = overwriteWithZeros;
+        this.fd = VectoredIO.isAvailable() ? MMapUtils.getFileDescriptor(raf.getFD()) : -1L;
+        if (SeqLock.isAvailable()) {
+            snapshotMemory = ByteBuffer.allocateDirect((int) SeqLock.size(SNAPSHOT_VALUES) + 8);
+            snapshotAddress = (Native.address(snapshotMemory) + 7L) & ~7L;
+        } else {
+            snapshotMemory = null;
+            snapshotAddress = 0L;
+        }
 
         long rafLength = raf.length();
         if (!isPowerOfTwo(rafLength)) {
@@ -187,10 +324,10 @@ public final class QueueFile implements Closeable {
         long lastOffset;
 
         int version = readInt(header, 0) & 0x7FFFFFFF;
-        if (version != 1) {
-            throw new IOException(
-                    "Unable to read version " + version + " format. The one and only supported version is 1");
+        if (version != 1 && version != 2) {
+            throw new IOException("Unable to read version " + version + " format. Supported versions are 1 and 2");
         }
+        framed = (version == 2);
         fileLength = readLong(header, 4);
         elementCount = readInt(header, 12);
         firstOffset = readLong(header, 16);
@@ -224,13 +361,26 @@ public final class QueueFile implements Closeable {
 
         first = readElement(firstOffset);
         last = readElement(lastOffset);
+
+        if (framed) {
+            recover();
+        }
+        appendedElements = elementCount;
+        appendedMessages = framed ? messageCount : elementCount;
+        if (indexStride > 0) {
+            index = new PositionIndex(indexStride);
+            buildIndex();
+        } else {
+            index = null;
+        }
+        publishHeader();
     }
 
     /**
      * Stores an {@code int} in the {@code byte[]}. The behavior is equivalent
      * to calling {@link RandomAccessFile#writeInt}.
      */
-    private static void writeInt(byte[] buffer, int off, int value) {
+    static void writeInt(byte[] buffer, int off, int value) {
         buffer[off] = (byte) (value >> 24);
         buffer[off + 1] = (byte) (value >> 16);
         buffer[off + 2] = (byte) (value >> 8);
@@ -239,7 +389,7 @@ public final class QueueFile implements Closeable {
 
     /** Reads an {@code int} from the {@code byte[]}. */
     //@formatter:off
-    private static int readInt(byte[] buffer, int off) {
+    static int readInt(byte[] buffer, int off) {
         return ((buffer[off] & 0xff) << 24)
              + ((buffer[off + 1] & 0xff) << 16)
              + ((buffer[off + 2] & 0xff) << 8)
@@ -251,7 +401,7 @@ public final class QueueFile implements Closeable {
      * Stores a {@code long} in the {@code byte[]}. The behavior is equivalent
      * to calling {@link RandomAccessFile#writeLong}.
      */
-    private static void writeLong(byte[] buffer, int off, long value) {
+    static void writeLong(byte[] buffer, int off, long value) {
         buffer[off] = (byte) (value >> 56);
         buffer[off + 1] = (byte) (value >> 48);
         buffer[off + 2] = (byte) (value >> 40);
@@ -264,7 +414,7 @@ public final class QueueFile implements Closeable {
 
     /** Reads a {@code long} from the {@code byte[]}. */
     //@formatter:off
-    private static long readLong(byte[] buffer, int off) {
+    static long readLong(byte[] buffer, int off) {
         return ((buffer[off] & 0xffL) << 56)
              + ((buffer[off + 1] & 0xffL) << 48)
              + ((buffer[off + 2] & 0xffL) << 40)
@@ -285,15 +435,38 @@ public final class QueueFile implements Closeable {
      */
     private void writeHeader(long fileLength, int elementCount, long firstPosition, long lastPosition)
             throws IOException {
-        raf.seek(0L);
-
-        writeInt(header, 0, VERSIONED_HEADER);
+        writeInt(header, 0, framed ? FRAMED_HEADER : VERSIONED_HEADER);
         writeLong(header, 4, fileLength);
         writeInt(header, 12, elementCount);
         writeLong(header, 16, firstPosition);
         writeLong(header, 24, lastPosition);
 
-        raf.write(header, 0, HEADER_LENGTH);
+        if (fd >= 0L) {
+            // The file is opened with O_DSYNC ("rwd"), no RWF_DSYNC needed
+            VectoredIO.write(fd, 0L, header, 0, HEADER_LENGTH, false);
+        } else {
+            raf.seek(0L);
+            raf.write(header, 0, HEADER_LENGTH);
+        }
+    }
+
+    /**
+     * Publishes the header (and the consumed messages of the head frame) from
+     * the member fields for lock-free readers. Must be called after every
+     * header write once the fields have been updated, before any data of the
+     * previous header's elements is modified.
+     */
+    private void publishHeader() {
+        if (snapshotAddress != 0L) {
+            snapshotValues[0] = fileLength;
+            snapshotValues[1] = elementCount;
+            snapshotValues[2] = first.position;
+            snapshotValues[3] = last.position;
+            snapshotValues[4] = headConsumed;
+            SeqLock.write(snapshotAddress, snapshotValues, SNAPSHOT_VALUES);
+        } else {
+            publishedSequence += 2L;
+        }
     }
 
     Element readElement(long position) throws IOException {
@@ -305,6 +478,172 @@ public final class QueueFile implements Closeable {
         return new Element(position, length);
     }
 
+    /**
+     * Reads the frame (including its length prefix) at position and verifies
+     * its checksum. Returns null if the frame is torn or corrupt.
+     */
+    private byte[] readFrame(long position) throws IOException {
+        if (position < HEADER_LENGTH || position >= fileLength) {
+            return null;
+        }
+        ringRead(position, header, 0, Element.ELEM_HEADER_LEN);
+        int length = readInt(header, 0);
+        if (length < FrameScanner.FRAME_HEADER_LENGTH - Element.ELEM_HEADER_LEN
+                || length > fileLength - HEADER_LENGTH - Element.ELEM_HEADER_LEN) {
+            return null;
+        }
+        byte[] frame = new byte[Element.ELEM_HEADER_LEN + length];
+        ringRead(position, frame, 0, frame.length);
+        return (readInt(frame, 8) == frameChecksum(frame)) ? frame : null;
+    }
+
+    /** The checksum of a frame: everything except the checksum field itself. */
+    static int frameChecksum(byte[] frame) {
+        int crc = Crc32C.compute(frame, 0, 8);
+        return Crc32C.update(crc, frame, FrameScanner.FRAME_HEADER_LENGTH,
+                frame.length - FrameScanner.FRAME_HEADER_LENGTH);
+    }
+
+    /** Splits a frame into its messages. Returns null if it is malformed. */
+    static byte[][] messages(byte[] frame) {
+        int count = readInt(frame, 4);
+        if (count <= 0 || count > (frame.length - FrameScanner.FRAME_HEADER_LENGTH) / Element.ELEM_HEADER_LEN) {
+            return null;
+        }
+        byte[][] messages = new byte[count][];
+        int off = FrameScanner.FRAME_HEADER_LENGTH;
+        for (int i = 0; i < count; ++i) {
+            if (frame.length - off < Element.ELEM_HEADER_LEN) {
+                return null;
+            }
+            int length = readInt(frame, off);
+            off += Element.ELEM_HEADER_LEN;
+            if (length < 0 || length > frame.length - off) {
+                return null;
+            }
+            messages[i] = Arrays.copyOfRange(frame, off, off + length);
+            off += length;
+        }
+        return (off == frame.length) ? messages : null;
+    }
+
+    /**
+     * Verifies the frames of a framed queue and truncates the queue at the
+     * first torn or corrupt frame (e.g. a frame whose write was interrupted
+     * by a crash).
+     */
+    private void recover() throws IOException {
+        long[] result = new long[4];
+        int frames = -1;
+        if (FrameScanner.isAvailable()) {
+            frames = FrameScanner.scan(MMapUtils.getFileDescriptor(raf.getFD()), fileLength, HEADER_LENGTH,
+                    first.position, elementCount, result);
+        }
+        if (frames < 0) {
+            frames = scanFrames(result);
+        }
+        if (frames < elementCount) {
+            logger.warning("Truncating " + file + " at torn frame " + frames + " of " + elementCount);
+            if (frames == 0) {
+                writeHeader(fileLength, 0, 0L, 0L);
+                first = Element.NULL;
+                last = Element.NULL;
+            } else {
+                long lastPosition = result[FrameScanner.LAST_POSITION];
+                writeHeader(fileLength, frames, first.position, lastPosition);
+                last = new Element(lastPosition, (int) result[FrameScanner.LAST_LENGTH]);
+            }
+            elementCount = frames;
+        }
+        messageCount = (int) result[FrameScanner.MESSAGES];
+    }
+
+    /** The Java equivalent of {@link FrameScanner#scan}. */
+    private int scanFrames(long[] result) throws IOException {
+        long position = first.position;
+        int frames = 0;
+        long messages = 0L;
+        long lastPosition = 0L;
+        int lastLength = 0;
+        while (frames < elementCount) {
+            byte[] frame = readFrame(position);
+            byte[][] m = (frame == null) ? null : messages(frame);
+            if (m == null) {
+                break;
+            }
+            frames++;
+            messages += m.length;
+            lastPosition = position;
+            lastLength = frame.length - Element.ELEM_HEADER_LEN;
+            position = wrapPosition(position + frame.length);
+        }
+        result[FrameScanner.FRAMES] = frames;
+        result[FrameScanner.MESSAGES] = messages;
+        result[FrameScanner.LAST_POSITION] = lastPosition;
+        result[FrameScanner.LAST_LENGTH] = lastLength;
+        return frames;
+    }
+
+    /**
+     * Builds the position index of the elements with a native walk (a Java
+     * walk if that isn't possible).
+     */
+    private void buildIndex() throws IOException {
+        int stride = index.stride();
+        int entries = (int) ((elementCount + (long) stride - 1) / stride);
+        long[] positions = new long[entries];
+        long[] messages = new long[entries];
+        int walked = -1;
+        if (FrameScanner.isAvailable()) {
+            walked = FrameScanner.index(MMapUtils.getFileDescriptor(raf.getFD()), fileLength, HEADER_LENGTH,
+                    first.position, elementCount, stride, framed, positions, messages);
+        }
+        if (walked < 0) {
+            walked = indexElements(stride, positions, messages);
+        }
+        if (walked < elementCount) {
+            throw new IOException("File is corrupt. Implausible length of element " + walked + " of " + elementCount
+                    + " in " + file);
+        }
+        for (int i = 0; i < entries; ++i) {
+            index.append((long) i * stride, positions[i], messages[i]);
+        }
+    }
+
+    /** The Java equivalent of {@link FrameScanner#index}. */
+    private int indexElements(int stride, long[] positions, long[] messages) throws IOException {
+        long position = first.position;
+        long before = 0L;
+        int i = 0;
+        for (; i < elementCount; ++i) {
+            ringRead(position, header, 0, framed ? 8 : Element.ELEM_HEADER_LEN);
+            int length = readInt(header, 0);
+            if (length < 0 || length > fileLength - HEADER_LENGTH - Element.ELEM_HEADER_LEN) {
+                break;
+            }
+            if (i % stride == 0) {
+                positions[i / stride] = position;
+                messages[i / stride] = before;
+            }
+            before += framed ? readInt(header, 4) : 1;
+            position = wrapPosition(position + Element.ELEM_HEADER_LEN + length);
+        }
+        return i;
+    }
+
+    /** The messages of the head frame of a framed queue. */
+    private byte[][] headMessages() throws IOException {
+        if (headMessages == null) {
+            byte[] frame = readFrame(first.position);
+            byte[][] messages = (frame == null) ? null : messages(frame);
+            if (messages == null) {
+                throw new IOException("Corrupt frame at position " + first.position + " in " + file);
+            }
+            headMessages = messages;
+        }
+        return headMessages;
+    }
+
     /** Wraps the position if it exceeds the end of the file. */
     long wrapPosition(long position) {
         return position < fileLength ? position : HEADER_LENGTH + position - fileLength;
@@ -324,21 +663,65 @@ public final class QueueFile implements Closeable {
     private void ringWrite(long position, byte[] buffer, int offset, int count) throws IOException {
         position = wrapPosition(position);
         if (position + count <= fileLength) {
-            raf.seek(position);
-            raf.write(buffer, offset, count);
+            write(position, buffer, offset, count);
         } else {
             // The write overlaps the EOF.
             // # of bytes to write before the EOF. Guaranteed to be less than
             // Integer.MAX_VALUE
             int beforeEof = (int) (fileLength - position);
+            write(position, buffer, offset, beforeEof);
+            write(HEADER_LENGTH, buffer, offset + beforeEof, count - beforeEof);
+        }
+    }
+
+    /**
+     * Writes an element (length prefix and data) to position in file. If the
+     * element doesn't wrap this is a single vectored write.
+     */
+    private void ringWrite(long position, byte[] prefix, byte[] data, int offset, int count) throws IOException {
+        position = wrapPosition(position);
+        if (fd >= 0L && position + Element.ELEM_HEADER_LEN + count <= fileLength) {
+            segmentBases[0] = prefix;
+            segmentOffsets[0] = 0L;
+            segmentLengths[0] = Element.ELEM_HEADER_LEN;
+            segmentBases[1] = data;
+            segmentOffsets[1] = offset;
+            segmentLengths[1] = count;
+            try {
+                VectoredIO.write(fd, position, segmentBases, segmentOffsets, segmentLengths, 2, false);
+            } finally {
+                segmentBases[1] = null;
+            }
+        } else {
+            ringWrite(position, prefix, 0, Element.ELEM_HEADER_LEN);
+            ringWrite(position + Element.ELEM_HEADER_LEN, data, offset, count);
+        }
+    }
+
+    /** Writes count bytes from buffer to position (no wrap). */
+    private void write(long position, byte[] buffer, int offset, int count) throws IOException {
+        if (fd >= 0L) {
+            VectoredIO.write(fd, position, buffer, offset, count, false);
+        } else {
+            raf.seek(position);
+            raf.write(buffer, offset, count);
+        }
+    }
+
+    /** Reads count bytes from position into buffer (no wrap). */
+    private void read(long position, byte[] buffer, int offset, int count) throws IOException {
+        if (fd >= 0L) {
+            VectoredIO.readFully(fd, position, buffer, offset, count);
+        } else {
             raf.seek(position);
-            raf.write(buffer, offset, beforeEof);
-            raf.seek(HEADER_LENGTH);
-            raf.write(buffer, offset + beforeEof, count - beforeEof);
+            raf.readFully(buffer, offset, count);
         }
     }
 
     private void ringErase(long position, long length) throws IOException {
+        if (fd >= 0L && ringZeroRange(position, length)) {
+            return;
+        }
         while (length > 0L) {
             int chunk = (int) Math.min(length, zeroBytes.length);
             ringWrite(position, zeroBytes, 0, chunk);
@@ -347,6 +730,17 @@ public final class QueueFile implements Closeable {
         }
     }
 
+    /** Zeroes a range without writing it. Returns false if not supported. */
+    private boolean ringZeroRange(long position, long length) throws IOException {
+        position = wrapPosition(position);
+        if (position + length <= fileLength) {
+            return VectoredIO.zeroRange(fd, position, length);
+        }
+        long beforeEof = fileLength - position;
+        return VectoredIO.zeroRange(fd, position, beforeEof)
+                && VectoredIO.zeroRange(fd, HEADER_LENGTH, length - beforeEof);
+    }
+
     /**
      * Reads count bytes into buffer from file. Wraps if necessary.
      * 
@@ -360,17 +754,14 @@ public final class QueueFile implements Closeable {
     void ringRead(long position, byte[] buffer, int offset, int count) throws IOException {
         position = wrapPosition(position);
         if (position + count <= fileLength) {
-            raf.seek(position);
-            raf.readFully(buffer, offset, count);
+            read(position, buffer, offset, count);
         } else {
             // The read overlaps the EOF.
             // # of bytes to read before the EOF. Guaranteed to be less than
             // Integer.MAX_VALUE
             int beforeEof = (int) (fileLength - position);
-            raf.seek(position);
-            raf.readFully(buffer, offset, beforeEof);
-            raf.seek(HEADER_LENGTH);
-            raf.readFully(buffer, offset + beforeEof, count - beforeEof);
+            read(position, buffer, offset, beforeEof);
+            read(HEADER_LENGTH, buffer, offset + beforeEof, count - beforeEof);
         }
     }
 
@@ -385,7 +776,110 @@ public final class QueueFile implements Closeable {
             return;
         }
         checkOpen();
-        add(data, 0, data.length);
+        if (framed) {
+            addFrame(Collections.singletonList(data));
+        } else {
+            add(data, 0, data.length);
+        }
+    }
+
+    /**
+     * Adds the given messages to the end of the queue ({@code null} entries
+     * are skipped). In a framed queue the messages are added atomically as a
+     * single frame with a single write, otherwise they are added one by one.
+     * 
+     * @param messages
+     *            the messages to copy bytes from
+     */
+    public synchronized void addMessages(List<byte[]> messages) throws IOException {
+        if (messages == null) {
+            return;
+        }
+        checkOpen();
+        if (framed) {
+            addFrame(messages);
+        } else {
+            for (byte[] data : messages) {
+                if (data != null) {
+                    add(data, 0, data.length);
+                }
+            }
+        }
+    }
+
+    /** Adds the non-null messages as a single frame. */
+    private void addFrame(List<byte[]> messages) throws IOException {
+        byte[] frame = encodeFrame(messages);
+        if (frame == null) {
+            return;
+        }
+        int count = readInt(frame, 4);
+        int length = frame.length - Element.ELEM_HEADER_LEN;
+        expandIfNecessary(length);
+
+        // Insert the frame after the current last element
+        boolean wasEmpty = isEmpty();
+        long position = wasEmpty ? HEADER_LENGTH : wrapPosition(last.position + Element.ELEM_HEADER_LEN + last.length);
+        Element newLast = new Element(position, length);
+        ringWrite(newLast.position, frame, 0, frame.length);
+
+        // Commit the addition. If wasEmpty, then first == last
+        long firstPosition = wasEmpty ? newLast.position : first.position;
+        writeHeader(fileLength, elementCount + 1, firstPosition, newLast.position);
+        last = newLast;
+        elementCount++;
+        messageCount += count;
+        modCount++;
+        if (wasEmpty) {
+            first = last; // first element
+        }
+        publishHeader();
+        appended(newLast.position, count);
+    }
+
+    /** Counts (and indexes) the element that has just been added. */
+    private void appended(long position, int messages) {
+        if (index != null) {
+            index.append(appendedElements, position, appendedMessages);
+        }
+        appendedElements++;
+        appendedMessages += messages;
+    }
+
+    /**
+     * Encodes the non-null messages as a frame (including its length prefix).
+     * Returns null if there are no messages.
+     */
+    static byte[] encodeFrame(List<byte[]> messages) {
+        long frameLength = FrameScanner.FRAME_HEADER_LENGTH;
+        int count = 0;
+        for (byte[] data : messages) {
+            if (data != null) {
+                frameLength += Element.ELEM_HEADER_LEN + data.length;
+                count++;
+            }
+        }
+        if (count == 0) {
+            return null;
+        }
+        if (frameLength > Integer.MAX_VALUE - 8) {
+            throw new IllegalArgumentException("Batch too large: " + frameLength + " bytes");
+        }
+
+        // Length prefix, frame header and all messages in one buffer
+        byte[] frame = new byte[(int) frameLength];
+        writeInt(frame, 0, frame.length - Element.ELEM_HEADER_LEN);
+        writeInt(frame, 4, count);
+        int off = FrameScanner.FRAME_HEADER_LENGTH;
+        for (byte[] data : messages) {
+            if (data != null) {
+                writeInt(frame, off, data.length);
+                System.arraycopy(data, 0, frame, off + Element.ELEM_HEADER_LEN, data.length);
+                off += Element.ELEM_HEADER_LEN + data.length;
+            }
+        }
+        writeInt(frame, 8, frameChecksum(frame));
+        return frame;
     }
 
     /**
@@ -416,12 +910,9 @@ public final class QueueFile implements Closeable {
         long position = wasEmpty ? HEADER_LENGTH : wrapPosition(last.position + Element.ELEM_HEADER_LEN + last.length);
         Element newLast = new Element(position, count);
 
-        // Write length
+        // Write length and data
         writeInt(header, 0, count);
-        ringWrite(newLast.position, header, 0, Element.ELEM_HEADER_LEN);
-
-        // Write data
-        ringWrite(newLast.position + Element.ELEM_HEADER_LEN, data, offset, count);
+        ringWrite(newLast.position, header, data, offset, count);
 
         // Commit the addition. If wasEmpty, then first == last
         long firstPosition = wasEmpty ? newLast.position : first.position;
@@ -432,6 +923,8 @@ public final class QueueFile implements Closeable {
         if (wasEmpty) {
             first = last; // first element
         }
+        publishHeader();
+        appended(newLast.position, 1);
     }
 
     private long usedBytes() {
@@ -508,8 +1001,13 @@ public final class QueueFile implements Closeable {
         } else {
             writeHeader(newLength, elementCount, first.position, last.position);
         }
+        if (index != null && count > 0L) {
+            // the wrapped elements have moved behind the old end of the file
+            index.relocate(first.position, fileLength - HEADER_LENGTH);
+        }
 
         fileLength = newLength;
+        publishHeader();
 
         if (overwriteWithZeros) {
             ringErase(HEADER_LENGTH, count);
@@ -538,11 +1036,28 @@ public final class QueueFile implements Closeable {
     }
 
     public synchronized void forEachAccept(MessageConsumer consumer) throws IOException {
+        forEachAccept(consumer, DEFAULT_READ_AHEAD);
+    }
+
+    /**
+     * Passes all messages, eldest first, to the consumer without removing
+     * them. The elements are read {@code readAhead} bytes at a time and the
+     * kernel is asked to read the following window in the background while
+     * the consumer processes the current one, so a queue that isn't cached
+     * is drained at close to sequential disk bandwidth.
+     * 
+     * @param readAhead
+     *            the window in bytes, 0 reads element by element
+     */
+    public synchronized void forEachAccept(MessageConsumer consumer, int readAhead) throws IOException {
+        if (readAhead < 0) {
+            throw new IllegalArgumentException("readAhead: " + readAhead);
+        }
         if (consumer == null) {
             return;
         }
         checkOpen();
-        for (Iterator<byte[]> it = iterator(); it.hasNext(); /**/) {
+        for (Iterator<byte[]> it = iterator(readAhead); it.hasNext(); /**/) {
             try {
                 consumer.acceptMessage(it.next());
             } catch (Throwable t) {
@@ -563,8 +1078,26 @@ public final class QueueFile implements Closeable {
      * The iterator may throw an unchecked {@link RuntimeException} during
      * {@link Iterator#next()} or {@link Iterator#remove()}.
      */
-    private Iterator<byte[]> iterator() {
-        return new ElementIterator();
+    private Iterator<byte[]> iterator(int readAhead) {
+        if (readAhead > 0) {
+            return new ReadAheadIterator(readAhead);
+        }
+        return framed ? new MessageIterator() : new ElementIterator();
+    }
+
+    /**
+     * Starts reading a range of the ring buffer into the page cache. Only a
+     * hint, does nothing if {@link VectoredIO} isn't available.
+     */
+    private void ringReadAhead(long position, long length) {
+        if (fd < 0L) {
+            return;
+        }
+        position = wrapPosition(position);
+        long beforeEof = Math.min(length, fileLength - position);
+        if (VectoredIO.readAhead(fd, position, beforeEof) && length > beforeEof) {
+            VectoredIO.readAhead(fd, HEADER_LENGTH, length - beforeEof);
+        }
     }
 
     private final class ElementIterator implements Iterator<byte[]> {
@@ -653,9 +1186,444 @@ public final class QueueFile implements Closeable {
         }
     } // ElementIterator
 
-    /** Returns the number of elements in this queue. */
+    /** Iterates over the messages of a framed queue. Doesn't support removal. */
+    private final class MessageIterator implements Iterator<byte[]> {
+        /** Index of the frame to be read when the current one is exhausted. */
+        private int nextFrameIndex = 0;
+
+        /** Position of the frame to be read when the current one is exhausted. */
+        private long nextFramePosition = first.position;
+
+        /** The messages of the current frame. */
+        private byte[][] messages;
+
+        /** Index of the message to be returned by the subsequent call to next. */
+        private int nextMessageIndex;
+
+        int expectedModCount = modCount;
+
+        MessageIterator() {
+        }
+
+        private void checkForComodification() {
+            if (modCount != expectedModCount) {
+                throw new ConcurrentModificationException();
+            }
+        }
+
+        private void checkOpen() {
+            if (locked) {
+                throw new IllegalStateException("Closed : " + file);
+            }
+        }
+
+        @Override
+        public boolean hasNext() {
+            checkOpen();
+            checkForComodification();
+            return (messages != null && nextMessageIndex < messages.length) || nextFrameIndex != elementCount;
+        }
+
+        @Override
+        public byte[] next() {
+            if (!hasNext()) {
+                throw new NoSuchElementException();
+            }
+            if (messages == null || nextMessageIndex == messages.length) {
+                try {
+                    if (nextFrameIndex == 0) {
+                        // The head frame may be partially consumed
+                        messages = headMessages();
+                        nextMessageIndex = headConsumed;
+                        nextFramePosition = wrapPosition(first.position + Element.ELEM_HEADER_LEN + first.length);
+                    } else {
+                        byte[] frame = readFrame(nextFramePosition);
+                        messages = (frame == null) ? null : messages(frame);
+                        if (messages == null) {
+                            throw new IOException("Corrupt frame at position " + nextFramePosition + " in " + file);
+                        }
+                        nextMessageIndex = 0;
+                        nextFramePosition = wrapPosition(nextFramePosition + frame.length);
+                    }
+                    nextFrameIndex++;
+                } catch (IOException e) {
+                    throw new RuntimeException(e);
+                }
+            }
+            byte[] message = messages[nextMessageIndex++];
+            // The messages of the head frame are the cached ones
+            return (nextFrameIndex == 1) ? message.clone() : message;
+        }
+    } // MessageIterator
+
+    /**
+     * Iterates over the messages (of either format) with windowed reads: the
+     * elements are read a window at a time with one positional read (two if
+     * the ring wraps) and a read-ahead of the following window is requested
+     * right after each read. Doesn't support removal.
+     */
+    private final class ReadAheadIterator implements Iterator<byte[]> {
+        private final int window;
+
+        /** Elements read from the file, unparsed from off to end. */
+        private byte[] buffer;
+        private int off;
+        private int end;
+
+        /** Position of the next byte to read from the file. */
+        private long readPosition = first.position;
+
+        /** Number of bytes of the elements not read yet. */
+        private long unread = usedBytes() - HEADER_LENGTH;
+
+        /** Position of the element at off (for error reporting). */
+        private long elementPosition = first.position;
+
+        /** Index of the element to be parsed next. */
+        private int nextElementIndex = 0;
+
+        /** The messages of the current frame (framed queue). */
+        private byte[][] messages;
+
+        /** Index of the message to be returned by the subsequent call to next. */
+        private int nextMessageIndex;
+
+        int expectedModCount = modCount;
+
+        ReadAheadIterator(int window) {
+            this.window = window;
+            this.buffer = new byte[(int) Math.min(window, unread)];
+        }
+
+        private void checkForComodification() {
+            if (modCount != expectedModCount) {
+                throw new ConcurrentModificationException();
+            }
+        }
+
+        private void checkOpen() {
+            if (locked) {
+                throw new IllegalStateException("Closed : " + file);
+            }
+        }
+
+        @Override
+        public boolean hasNext() {
+            checkOpen();
+            checkForComodification();
+            return (messages != null && nextMessageIndex < messages.length) || nextElementIndex != elementCount;
+        }
+
+        @Override
+        public byte[] next() {
+            if (!hasNext()) {
+                throw new NoSuchElementException();
+            }
+            try {
+                if (!framed) {
+                    int length = nextElement();
+                    byte[] data = Arrays.copyOfRange(buffer, off + Element.ELEM_HEADER_LEN,
+                            off + Element.ELEM_HEADER_LEN + length);
+                    advance(length);
+                    return data;
+                }
+                if (messages == null || nextMessageIndex == messages.length) {
+                    int length = nextElement();
+                    byte[] frame = Arrays.copyOfRange(buffer, off, off + Element.ELEM_HEADER_LEN + length);
+                    byte[][] m = (length >= FrameScanner.FRAME_HEADER_LENGTH - Element.ELEM_HEADER_LEN
+                            && readInt(frame, 8) == frameChecksum(frame)) ? messages(frame) : null;
+                    if (m == null) {
+                        throw new IOException("Corrupt frame at position " + elementPosition + " in " + file);
+                    }
+                    // The head frame may be partially consumed
+                    nextMessageIndex = (nextElementIndex == 0) ? headConsumed : 0;
+                    messages = m;
+                    advance(length);
+                }
+                return messages[nextMessageIndex++];
+            } catch (IOException e) {
+                throw new RuntimeException(e);
+            }
+        }
+
+        /**
+         * Makes the next element available at off in the buffer and returns
+         * its data length.
+         */
+        private int nextElement() throws IOException {
+            ensure(Element.ELEM_HEADER_LEN);
+            int length = readInt(buffer, off);
+            if (length < 0 || length > fileLength - HEADER_LENGTH - Element.ELEM_HEADER_LEN) {
+                throw new IOException("Corrupt element at position " + elementPosition + " in " + file);
+            }
+            ensure(Element.ELEM_HEADER_LEN + length);
+            return length;
+        }
+
+        private void advance(int length) {
+            off += Element.ELEM_HEADER_LEN + length;
+            elementPosition = wrapPosition(elementPosition + Element.ELEM_HEADER_LEN + length);
+            nextElementIndex++;
+        }
+
+        /**
+         * Makes at least n unparsed bytes available in the buffer: moves the
+         * unparsed bytes to the front (into a larger buffer if an element
+         * doesn't fit), reads the next window behind them and requests the
+         * read-ahead of the window after that.
+         */
+        private void ensure(int n) throws IOException {
+            int kept = end - off;
+            if (kept >= n) {
+                return;
+            }
+            if (n > buffer.length) {
+                byte[] larger = new byte[n];
+                System.arraycopy(buffer, off, larger, 0, kept);
+                buffer = larger;
+            } else {
+                System.arraycopy(buffer, off, buffer, 0, kept);
+            }
+            off = 0;
+            end = kept;
+            int count = (int) Math.min(buffer.length - end, unread);
+            if (end + count < n) {
+                throw new IOException("Truncated element at position " + elementPosition + " in " + file);
+            }
+            ringRead(readPosition, buffer, end, count);
+            end += count;
+            readPosition = wrapPosition(readPosition + count);
+            unread -= count;
+            if (unread > 0L) {
+                ringReadAhead(readPosition, Math.min(window, unread));
+            }
+        }
+    } // ReadAheadIterator
+
+    /**
+     * Returns the number of elements in this queue (the number of messages
+     * for a framed queue).
+     */
     public int size() {
-        return elementCount;
+        return framed ? messageCount : elementCount;
+    }
+
+    /**
+     * Returns a consistent copy of the committed header without taking the
+     * lock of this queue (if {@link SeqLock} is available).
+     */
+    public Snapshot snapshot() {
+        if (snapshotAddress != 0L) {
+            long[] values = new long[SNAPSHOT_VALUES];
+            long sequence = SeqLock.read(snapshotAddress, values, SNAPSHOT_VALUES);
+            return new Snapshot(values, sequence);
+        }
+        synchronized (this) {
+            return new Snapshot(new long[] { fileLength, elementCount, first.position, last.position, headConsumed },
+                    publishedSequence);
+        }
+    }
+
+    /**
+     * Reads the eldest message without removing it. The read is optimistic
+     * and doesn't take the lock of this queue: the element is read at the
+     * position of a {@link #snapshot()} and the read is only accepted if no
+     * new header has been published meanwhile. After a few conflicting writes
+     * (or if the native support is missing) it falls back to the lock.
+     * 
+     * @return the eldest message or {@code null} if the queue is empty
+     */
+    public byte[] peekMessage() throws IOException {
+        if (snapshotAddress != 0L && fd >= 0L) {
+            long[] values = new long[SNAPSHOT_VALUES];
+            for (int attempt = 0; attempt < OPTIMISTIC_READS; ++attempt) {
+                long sequence = SeqLock.read(snapshotAddress, values, SNAPSHOT_VALUES);
+                checkOpen();
+                if (values[1] == 0L) {
+                    return null;
+                }
+                byte[] message;
+                try {
+                    message = readHead(values);
+                } catch (IOException e) {
+                    // e.g. the file has been truncated meanwhile
+                    message = null;
+                }
+                if (message != null && SeqLock.sequence(snapshotAddress) == sequence) {
+                    // the descriptor is only closed (and reused) after locked is set
+                    checkOpen();
+                    return message;
+                }
+            }
+        }
+        synchronized (this) {
+            return peek();
+        }
+    }
+
+    /**
+     * Reads the eldest message of a published header with positional reads.
+     * Returns null if the data is inconsistent (torn by a concurrent write).
+     */
+    private byte[] readHead(long[] values) throws IOException {
+        long fileLength = values[0];
+        long position = values[2];
+        if (fileLength <= HEADER_LENGTH || position < HEADER_LENGTH || position >= fileLength) {
+            return null;
+        }
+        byte[] prefix = new byte[Element.ELEM_HEADER_LEN];
+        snapshotRead(fileLength, position, prefix, 0, prefix.length);
+        int length = readInt(prefix, 0);
+        if (length < 0 || length > fileLength - HEADER_LENGTH - Element.ELEM_HEADER_LEN) {
+            return null;
+        }
+        if (!framed) {
+            byte[] data = new byte[length];
+            snapshotRead(fileLength, position + Element.ELEM_HEADER_LEN, data, 0, length);
+            return data;
+        }
+        if (length < FrameScanner.FRAME_HEADER_LENGTH - Element.ELEM_HEADER_LEN) {
+            return null;
+        }
+        byte[] frame = new byte[Element.ELEM_HEADER_LEN + length];
+        snapshotRead(fileLength, position, frame, 0, frame.length);
+        byte[][] messages = messages(frame);
+        int consumed = (int) values[4];
+        return (messages == null || consumed < 0 || consumed >= messages.length) ? null : messages[consumed];
+    }
+
+    /** {@link #ringRead} for a published file length with positional reads. */
+    private void snapshotRead(long fileLength, long position, byte[] buffer, int offset, int count)
+            throws IOException {
+        position = position < fileLength ? position : HEADER_LENGTH + position - fileLength;
+        if (position + count <= fileLength) {
+            VectoredIO.readFully(fd, position, buffer, offset, count);
+        } else {
+            int beforeEof = (int) (fileLength - position);
+            VectoredIO.readFully(fd, position, buffer, offset, beforeEof);
+            VectoredIO.readFully(fd, HEADER_LENGTH, buffer, offset + beforeEof, count - beforeEof);
+        }
+    }
+
+    /**
+     * Reads the message at index {@code k} (0 is the eldest message) without
+     * removing it. With a position index (see {@link Builder#indexStride})
+     * this reads less than {@code stride} length prefixes, otherwise it walks
+     * all elements before the message.
+     * 
+     * @throws IndexOutOfBoundsException
+     *             if {@code k < 0} or {@code k >= size()}
+     */
+    public synchronized byte[] get(int k) throws IOException {
+        checkOpen();
+        if (k < 0 || k >= size()) {
+            throw new IndexOutOfBoundsException("index: " + k + ", size: " + size());
+        }
+        long[] result = new long[LOCATE_VALUES];
+        long target = headMessageSeq() + headConsumed + k;
+        locate(target, result);
+        long position = result[0];
+        if (!framed) {
+            byte[] data = new byte[(int) result[3]];
+            ringRead(position + Element.ELEM_HEADER_LEN, data, 0, data.length);
+            return data;
+        }
+        byte[][] messages;
+        if (position == first.position) {
+            messages = headMessages();
+        } else {
+            byte[] frame = readFrame(position);
+            messages = (frame == null) ? null : messages(frame);
+        }
+        int i = (int) (target - result[2]);
+        if (messages == null || i >= messages.length) {
+            throw new IOException("Corrupt frame at position " + position + " in " + file);
+        }
+        return (position == first.position) ? messages[i].clone() : messages[i];
+    }
+
+    /**
+     * Removes up to {@code n} of the eldest messages without reading them,
+     * with a single header write. With a position index (see
+     * {@link Builder#indexStride}) only the element that becomes the new
+     * head has to be found.
+     * 
+     * @return the number of removed messages
+     */
+    public synchronized int skip(int n) throws IOException {
+        if (n < 0) {
+            throw new IllegalArgumentException("n: " + n);
+        }
+        checkOpen();
+        int skipped = Math.min(n, size());
+        if (skipped == 0) {
+            return 0;
+        }
+        if (skipped == size()) {
+            clear();
+            return skipped;
+        }
+        long[] result = new long[LOCATE_VALUES];
+        long target = headMessageSeq() + headConsumed + skipped;
+        locate(target, result);
+        long position = result[0];
+        int elements = (int) (result[1] - (appendedElements - elementCount));
+        if (elements > 0) {
+            long eraseLength = (position >= first.position) ? position - first.position
+                    : fileLength - first.position + position - HEADER_LENGTH;
+            advanceHead(elements, position, (int) result[3], eraseLength);
+        }
+        if (framed) {
+            headConsumed = (int) (target - result[2]);
+            messageCount -= skipped;
+            modCount++;
+            publishHeader();
+        }
+        return skipped;
+    }
+
+    /** The sequence number of the first message of the head element. */
+    private long headMessageSeq() {
+        return framed ? appendedMessages - messageCount - headConsumed : appendedElements - elementCount;
+    }
+
+    /**
+     * Finds the element that holds the message with the sequence number
+     * {@code target}, walking from the nearest index entry (or from the
+     * head). The result receives the position and the sequence number of the
+     * element, the sequence number of its first message and its data length.
+     */
+    private void locate(long target, long[] result) throws IOException {
+        long position = first.position;
+        long elementSeq = appendedElements - elementCount;
+        long messageSeq = headMessageSeq();
+        int entry = (index == null) ? -1 : framed ? index.floorByMessage(target) : index.floorByElement(target);
+        if (entry >= 0) {
+            position = index.position(entry);
+            elementSeq = index.elementSeq(entry);
+            messageSeq = index.messageSeq(entry);
+        }
+        for (;;) {
+            if (elementSeq >= appendedElements) {
+                throw new IOException("Message " + target + " not found in " + file);
+            }
+            ringRead(position, header, 0, framed ? 8 : Element.ELEM_HEADER_LEN);
+            int length = readInt(header, 0);
+            int messages = framed ? readInt(header, 4) : 1;
+            if (length < 0 || length > fileLength - HEADER_LENGTH - Element.ELEM_HEADER_LEN || messages <= 0) {
+                throw new IOException("Corrupt element at position " + position + " in " + file);
+            }
+            if (target < messageSeq + messages) {
+                result[0] = position;
+                result[1] = elementSeq;
+                result[2] = messageSeq;
+                result[3] = length;
+                return;
+            }
+            position = wrapPosition(position + Element.ELEM_HEADER_LEN + length);
+            elementSeq++;
+            messageSeq += messages;
+        }
     }
 
     public synchronized boolean removeNextMessage(MessageConsumer consumer) throws IOException {
@@ -672,12 +1640,200 @@ public final class QueueFile implements Closeable {
         return true;
     }
 
+    /**
+     * Passes up to {@code maxMessages} of the eldest messages (but not much
+     * more than {@code maxBytes} bytes, at least one message) as a single
+     * {@link Batch} to the consumer and removes them with a single header
+     * write once the consumer returns. If the consumer throws, nothing is
+     * removed.
+     * 
+     * @return the number of removed messages
+     */
+    public synchronized int removeMessages(int maxMessages, int maxBytes, BatchConsumer consumer)
+            throws IOException {
+        if (consumer == null) {
+            return 0;
+        }
+        Batch batch = peekMessages(maxMessages, maxBytes);
+        if (batch.size() == 0) {
+            return 0;
+        }
+        try {
+            consumer.acceptMessages(batch);
+        } catch (Throwable t) {
+            return 0;
+        }
+        removeBatch(batch);
+        return batch.size();
+    }
+
+    /**
+     * Reads up to {@code maxMessages} of the eldest messages without removing
+     * them. The batch stops before the message that would exceed
+     * {@code maxBytes} payload bytes, but contains at least one message if
+     * the queue isn't empty. The length prefixes of the elements are walked
+     * to size the read, then all messages are read with one positional read
+     * (two if the ring wraps) into one buffer.
+     */
+    public synchronized Batch peekMessages(int maxMessages, int maxBytes) throws IOException {
+        if (maxMessages <= 0 || maxBytes < 0) {
+            throw new IllegalArgumentException("maxMessages: " + maxMessages + ", maxBytes: " + maxBytes);
+        }
+        checkOpen();
+        if (isEmpty()) {
+            return Batch.EMPTY;
+        }
+        int n = Math.min(maxMessages, size());
+        byte[] buffer = new byte[batchWindow(n, maxBytes)];
+        ringRead(first.position, buffer, 0, buffer.length);
+        return framed ? frameBatch(buffer, n, maxBytes) : elementBatch(buffer, n, maxBytes);
+    }
+
+    /**
+     * The length of the eldest elements (frames) that hold a batch of up to
+     * maxMessages messages and maxBytes payload bytes, at least one element.
+     * The payload of the skipped messages of a partially removed head frame
+     * is unknown, so that frame doesn't count towards maxBytes.
+     */
+    private int batchWindow(int maxMessages, int maxBytes) throws IOException {
+        long position = first.position;
+        long window = 0L;
+        long bytes = 0L;
+        long messages = 0L;
+        for (int i = 0; i < elementCount; ++i) {
+            ringRead(position, header, 0, framed ? 8 : Element.ELEM_HEADER_LEN);
+            int length = readInt(header, 0);
+            if (length < 0 || length > fileLength - HEADER_LENGTH - Element.ELEM_HEADER_LEN) {
+                // corrupt, the split stops (or fails) there
+                break;
+            }
+            long payload = length;
+            int count = 1;
+            if (framed) {
+                count = readInt(header, 4);
+                payload = length - (FrameScanner.FRAME_HEADER_LENGTH - Element.ELEM_HEADER_LEN)
+                        - (long) Element.ELEM_HEADER_LEN * count;
+            }
+            long size = Element.ELEM_HEADER_LEN + (long) length;
+            if (i > 0 && (messages >= maxMessages || window + size > MAX_BATCH_BUFFER
+                    || (framed ? bytes > maxBytes : bytes + payload > maxBytes))) {
+                break;
+            }
+            window += size;
+            if (framed && i == 0) {
+                messages += count - headConsumed;
+                if (headConsumed == 0) {
+                    bytes += payload;
+                }
+            } else {
+                messages += count;
+                bytes += payload;
+            }
+            position = wrapPosition(position + size);
+        }
+        return (int) Math.max(window, Math.min(Element.ELEM_HEADER_LEN + (long) first.length, MAX_BATCH_BUFFER));
+    }
+
+    /** Splits the elements at the start of buffer into a batch. */
+    private Batch elementBatch(byte[] buffer, int maxMessages, int maxBytes) {
+        int[] offsets = new int[maxMessages];
+        int[] lengths = new int[maxMessages];
+        int count = 0;
+        long bytes = 0L;
+        int off = 0;
+        while (count < maxMessages && buffer.length - off >= Element.ELEM_HEADER_LEN) {
+            int length = readInt(buffer, off);
+            if (length < 0 || length > buffer.length - off - Element.ELEM_HEADER_LEN
+                    || (count > 0 && bytes + length > maxBytes)) {
+                break;
+            }
+            offsets[count] = off + Element.ELEM_HEADER_LEN;
+            lengths[count] = length;
+            count++;
+            bytes += length;
+            off += Element.ELEM_HEADER_LEN + length;
+        }
+        return new Batch(buffer, offsets, lengths, count, count, wrapPosition(first.position + off), 0, off);
+    }
+
+    /** Splits the verified frames at the start of buffer into a batch. */
+    private Batch frameBatch(byte[] buffer, int maxMessages, int maxBytes) throws IOException {
+        int[] offsets = new int[maxMessages];
+        int[] lengths = new int[maxMessages];
+        int count = 0;
+        long bytes = 0L;
+        int frames = 0;
+        int partial = 0;
+        int skip = headConsumed;
+        int off = 0;
+        frameLoop: while (frames < elementCount && buffer.length - off >= Element.ELEM_HEADER_LEN) {
+            int length = readInt(buffer, off);
+            if (length < FrameScanner.FRAME_HEADER_LENGTH - Element.ELEM_HEADER_LEN
+                    || length > buffer.length - off - Element.ELEM_HEADER_LEN) {
+                break;
+            }
+            int end = off + Element.ELEM_HEADER_LEN + length;
+            int crc = Crc32C.update(Crc32C.compute(buffer, off, 8), buffer, off + FrameScanner.FRAME_HEADER_LENGTH,
+                    end - off - FrameScanner.FRAME_HEADER_LENGTH);
+            int messages = readInt(buffer, off + 4);
+            if (crc != readInt(buffer, off + 8) || messages <= 0) {
+                throw new IOException(
+                        "Corrupt frame at position " + wrapPosition(first.position + off) + " in " + file);
+            }
+            int m = off + FrameScanner.FRAME_HEADER_LENGTH;
+            for (int i = 0; i < messages; ++i) {
+                int size = (end - m >= Element.ELEM_HEADER_LEN) ? readInt(buffer, m) : -1;
+                if (size < 0 || size > end - m - Element.ELEM_HEADER_LEN) {
+                    throw new IOException("Malformed frame at position " + wrapPosition(first.position + off) + " in "
+                            + file);
+                }
+                if (i >= skip) {
+                    if (count == maxMessages || (count > 0 && bytes + size > maxBytes)) {
+                        partial = i;
+                        break frameLoop;
+                    }
+                    offsets[count] = m + Element.ELEM_HEADER_LEN;
+                    lengths[count] = size;
+                    count++;
+                    bytes += size;
+                }
+                m += Element.ELEM_HEADER_LEN + size;
+            }
+            skip = 0;
+            frames++;
+            off = end;
+        }
+        return new Batch(buffer, offsets, lengths, count, frames, wrapPosition(first.position + off), partial, off);
+    }
+
+    /** Removes the messages of a batch that was just peeked. */
+    private void removeBatch(Batch batch) throws IOException {
+        if (batch.elements == elementCount) {
+            clear();
+            return;
+        }
+        if (batch.elements > 0) {
+            ringRead(batch.nextPosition, header, 0, Element.ELEM_HEADER_LEN);
+            advanceHead(batch.elements, batch.nextPosition, readInt(header, 0), batch.eraseLength);
+        }
+        if (framed) {
+            headConsumed = batch.partial;
+            messageCount -= batch.size;
+            modCount++;
+            publishHeader();
+        }
+    }
+
     /** Reads the eldest element. Returns null if the queue is empty. */
     private byte[] peek() throws IOException {
         checkOpen();
         if (isEmpty()) {
             return null;
         }
+        if (framed) {
+            // A copy: the head messages stay cached for the next peek/remove
+            return headMessages()[headConsumed].clone();
+        }
         int length = first.length;
         byte[] data = new byte[length];
         ringRead(first.position + Element.ELEM_HEADER_LEN, data, 0, length);
@@ -685,11 +1841,34 @@ public final class QueueFile implements Closeable {
     }
 
     /**
-     * Removes the eldest element.
+     * Removes the eldest element (the eldest message for a framed queue).
      */
     void remove() throws IOException {
         checkOpen();
-        remove(1);
+        if (framed) {
+            removeMessage();
+        } else {
+            remove(1);
+        }
+    }
+
+    /**
+     * Removes the eldest message of a framed queue. The head frame is only
+     * removed from the file once all its messages have been removed.
+     */
+    private void removeMessage() throws IOException {
+        if (isEmpty()) {
+            return;
+        }
+        int remaining = messageCount - 1;
+        if (headConsumed + 1 < headMessages().length) {
+            headConsumed++;
+            modCount++;
+            publishHeader();
+        } else {
+            remove(1);
+        }
+        messageCount = remaining;
     }
 
     /**
@@ -714,7 +1893,6 @@ public final class QueueFile implements Closeable {
                     "Cannot remove more elements (" + n + ") than present in queue (" + elementCount + ")");
         }
 
-        long eraseStartPosition = first.position;
         long eraseTotalLength = 0L;
 
         // Read the position and length of the new first element
@@ -727,11 +1905,28 @@ public final class QueueFile implements Closeable {
             newFirstLength = readInt(header, 0);
         }
 
+        advanceHead(n, newFirstPosition, newFirstLength, eraseTotalLength);
+    }
+
+    /**
+     * Commits the removal of the eldest {@code n < elementCount} elements
+     * with a single header write.
+     */
+    private void advanceHead(int n, long newFirstPosition, int newFirstLength, long eraseTotalLength)
+            throws IOException {
+        long eraseStartPosition = first.position;
+
         // Commit the header
         writeHeader(fileLength, elementCount - n, newFirstPosition, last.position);
         elementCount -= n;
         modCount++;
         first = new Element(newFirstPosition, newFirstLength);
+        headMessages = null;
+        headConsumed = 0;
+        publishHeader();
+        if (index != null) {
+            index.trim(appendedElements - elementCount);
+        }
 
         if (overwriteWithZeros) {
             ringErase(eraseStartPosition, eraseTotalLength);
@@ -744,20 +1939,29 @@ public final class QueueFile implements Closeable {
 
         // Commit the header
         writeHeader(INITIAL_LENGTH, 0, 0L, 0L);
+        long previousLength = fileLength;
+        elementCount = 0;
+        messageCount = 0;
+        headMessages = null;
+        headConsumed = 0;
+        first = Element.NULL;
+        last = Element.NULL;
+        fileLength = INITIAL_LENGTH;
+        publishHeader();
+        if (index != null) {
+            index.clear();
+        }
 
         if (overwriteWithZeros) {
             // Zero out data
-            raf.seek(HEADER_LENGTH);
-            raf.write(zeroBytes, 0, INITIAL_LENGTH - HEADER_LENGTH);
+            if (fd < 0L || !VectoredIO.zeroRange(fd, HEADER_LENGTH, INITIAL_LENGTH - HEADER_LENGTH)) {
+                raf.seek(HEADER_LENGTH);
+                raf.write(zeroBytes, 0, INITIAL_LENGTH - HEADER_LENGTH);
+            }
         }
-
-        elementCount = 0;
-        first = Element.NULL;
-        last = Element.NULL;
-        if (fileLength > INITIAL_LENGTH) {
+        if (previousLength > INITIAL_LENGTH) {
             setLength(INITIAL_LENGTH);
         }
-        fileLength = INITIAL_LENGTH;
         modCount++;
     }
 
@@ -800,10 +2004,144 @@ public final class QueueFile implements Closeable {
              + ", first=" + first
              + ", last=" + last
              + ", zero=" + overwriteWithZeros
+             + ", framed=" + framed
              + '}';
     }
     //@formatter:on
 
+    /**
+     * Messages read by {@link QueueFile#peekMessages(int, int)}: slices of
+     * one contiguous buffer. Message {@code i} is
+     * {@code buffer()[offset(i) .. offset(i) + length(i))}.
+     */
+    public static final class Batch {
+        static final Batch EMPTY = new Batch(new byte[0], new int[0], new int[0], 0, 0, 0L, 0, 0L);
+
+        private final byte[] buffer;
+        private final int[] offsets;
+        private final int[] lengths;
+        private final int size;
+
+        /** Number of elements (frames) that are completely contained. */
+        final int elements;
+
+        /** Position of the first element after them. */
+        final long nextPosition;
+
+        /** Messages taken from the (partially contained) next frame. */
+        final int partial;
+
+        /** Length of the completely contained elements. */
+        final long eraseLength;
+
+        Batch(byte[] buffer, int[] offsets, int[] lengths, int size, int elements, long nextPosition, int partial,
+                long eraseLength) {
+            this.buffer = buffer;
+            this.offsets = offsets;
+            this.lengths = lengths;
+            this.size = size;
+            this.elements = elements;
+            this.nextPosition = nextPosition;
+            this.partial = partial;
+            this.eraseLength = eraseLength;
+        }
+
+        /** The number of messages. */
+        public int size() {
+            return size;
+        }
+
+        /** The buffer that contains all messages (don't modify). */
+        public byte[] buffer() {
+            return buffer;
+        }
+
+        public int offset(int i) {
+            checkIndex(i);
+            return offsets[i];
+        }
+
+        public int length(int i) {
+            checkIndex(i);
+            return lengths[i];
+        }
+
+        /** A copy of message {@code i}. */
+        public byte[] message(int i) {
+            checkIndex(i);
+            return Arrays.copyOfRange(buffer, offsets[i], offsets[i] + lengths[i]);
+        }
+
+        private void checkIndex(int i) {
+            if (i < 0 || i >= size) {
+                throw new IndexOutOfBoundsException("index: " + i + ", size: " + size);
+            }
+        }
+
+        @Override
+        public String toString() {
+            return getClass().getSimpleName() + "[size=" + size + ", elements=" + elements + "]";
+        }
+    }
+
+    /** A consistent copy of the committed header, see {@link QueueFile#snapshot()}. */
+    public static final class Snapshot {
+        private final long fileLength;
+        private final int elementCount;
+        private final long firstPosition;
+        private final long lastPosition;
+        private final int headConsumed;
+        private final long sequence;
+
+        Snapshot(long[] values, long sequence) {
+            this.fileLength = values[0];
+            this.elementCount = (int) values[1];
+            this.firstPosition = values[2];
+            this.lastPosition = values[3];
+            this.headConsumed = (int) values[4];
+            this.sequence = sequence;
+        }
+
+        public long fileLength() {
+            return fileLength;
+        }
+
+        /** The number of elements (frames of a framed queue). */
+        public int elementCount() {
+            return elementCount;
+        }
+
+        /** The position of the eldest element (0 if the queue is empty). */
+        public long firstPosition() {
+            return firstPosition;
+        }
+
+        /** The position of the newest element (0 if the queue is empty). */
+        public long lastPosition() {
+            return lastPosition;
+        }
+
+        /** The number of removed messages of the head frame of a framed queue. */
+        public int headConsumed() {
+            return headConsumed;
+        }
+
+        /** Changes with every published header (always even). */
+        public long sequence() {
+            return sequence;
+        }
+
+        public boolean isEmpty() {
+            return elementCount == 0;
+        }
+
+        @Override
+        public String toString() {
+            return getClass().getSimpleName() + "[seq=" + sequence + ", size=" + elementCount + ", len=" + fileLength
+                    + ", first=" + firstPosition + ", last=" + lastPosition + "]";
+        }
+    }
+
     /** A pointer to an element. */
     static class Element {
         static final Element NULL = new Element(0L, 0);
@@ -839,6 +2177,7 @@ public final class QueueFile implements Closeable {
     /** Fluent API for creating {@link QueueFile} instances. */
     public static final class Builder {
         private final File file;
+        private int indexStride;
 
         /** Start constructing a new queue backed by the given file. */
         public Builder(File file) {
@@ -846,6 +2185,20 @@ public final class QueueFile implements Closeable {
             this.file = file;
         }
 
+        /**
+         * Keeps an in-memory index of the position of every {@code stride}-th
+         * element (rebuilt by a native walk on open), which makes
+         * {@link QueueFile#get(int)} and {@link QueueFile#skip(int)} walk less
+         * than {@code stride} elements. 0 (the default) disables the index.
+         */
+        public Builder indexStride(int stride) {
+            if (stride < 0) {
+                throw new IllegalArgumentException("stride: " + stride);
+            }
+            this.indexStride = stride;
+            return this;
+        }
+
         /**
          * Constructs a new queue backed by the given builder.
          */
@@ -866,10 +2219,25 @@ public final class QueueFile implements Closeable {
             return createQueueFile(raf, overwriteWithZeros);
         }
 
+        /**
+         * Constructs a new queue backed by the given builder.
+         * 
+         * @param overwriteWithZeros
+         *            whether to overwrite old data with zero bytes when
+         *            removing an element
+         * @param framed
+         *            whether a new file should use the framed (version 2)
+         *            format; an existing file keeps its format
+         */
+        public QueueFile build(boolean overwriteWithZeros, boolean framed) throws IOException {
+            RandomAccessFile raf = initializeFromFile(file, framed);
+            return createQueueFile(raf, overwriteWithZeros);
+        }
+
         private QueueFile createQueueFile(RandomAccessFile raf, boolean overwriteWithZeros) throws IOException {
             QueueFile qf = null;
             try {
-                qf = new QueueFile(file, raf, overwriteWithZeros);
+                qf = new QueueFile(file, raf, overwriteWithZeros, indexStride);
                 return qf;
             } finally {
                 if (qf == null) {
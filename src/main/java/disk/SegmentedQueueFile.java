@@ -0,0 +1,1121 @@
+package disk;
+
+import java.io.Closeable;
+import java.io.File;
+import java.io.FileNotFoundException;
+import java.io.IOException;
+import java.io.RandomAccessFile;
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.ConcurrentModificationException;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.Objects;
+import java.util.TreeMap;
+import java.util.logging.Logger;
+import java.util.regex.Pattern;
+
+import mmap.impl.Crc32C;
+import mmap.impl.FrameScanner;
+import mmap.impl.MMapUtils;
+import mmap.impl.VectoredIO;
+
+/**
+ * A FIFO queue of messages like a framed {@link QueueFile}, but stored in a
+ * rolling sequence of fixed-size segment files instead of a single ring
+ * buffer file. Frames are always appended to the tail segment; when a frame
+ * doesn't fit, a new segment is started. A segment is deleted as a whole
+ * once all its frames have been removed, so the queue never has to be
+ * expanded by copying data, and the page cache of consumed data is dropped
+ * together with the file.
+ *
+ * <p>
+ * The state of the queue is a small manifest file ({@link #file()}) whose
+ * single write commits an addition or removal. The segments live next to it
+ * and are named {@code <manifest name>.<segment number>}.
+ *
+ * <p>
+ * Frames have the format of a framed {@code QueueFile} (a CRC-32C protected
+ * batch of messages, see {@link #addMessages(List)}). On open, the frames are
+ * verified by a native scan and the queue is truncated at the first torn
+ * frame. Removals are persisted per frame: after a crash, the already
+ * consumed messages of a partially consumed head frame are delivered again.
+ *
+ * <p>
+ * Instead of being consumed destructively through
+ * {@link #removeNextMessage(MessageConsumer)}, a queue can be read by several
+ * independent, named {@link QueueCursor}s. Each cursor persists its own
+ * position, and a segment is only deleted once every cursor has committed a
+ * position past it.
+ */
+public final class SegmentedQueueFile implements Closeable {
+
+    private static final Logger logger = Logger.getLogger(SegmentedQueueFile.class.getName());
+
+    /**
+     * Leading bit set to 1 indicating a versioned manifest and the version of
+     * 1.
+     */
+    private static final int MANIFEST_VERSION = 0x80000001;
+
+    /** The manifest length in bytes. */
+    private static final int MANIFEST_LENGTH = 52;
+
+    /** The default segment size (64 MiB). */
+    public static final long DEFAULT_SEGMENT_SIZE = 64L * 1024 * 1024;
+
+    /** The smallest segment size (64 KiB). */
+    public static final long MIN_SEGMENT_SIZE = 64L * 1024;
+
+    /** Marks the end of the data in a segment that has been rolled over. */
+    private static final byte[] END_OF_SEGMENT = new byte[4];
+
+    /** Cursor files are named {@code <manifest name>.cursor.<cursor name>}. */
+    private static final String CURSOR_INFIX = ".cursor.";
+
+    /** Valid cursor names. */
+    private static final Pattern CURSOR_NAME = Pattern.compile("[A-Za-z0-9_-]{1,64}");
+
+    /**
+     * The manifest. Designed so that a modification isn't committed or
+     * visible until we write the manifest, which is much smaller than a
+     * disk sector.
+     *
+     * <pre>
+     * Manifest (52 bytes):
+     *   1 bit            Versioned indicator [1 = versioned]
+     *   31 bits          Version, 1
+     *   8 bytes          Segment size
+     *   8 bytes          Head segment number
+     *   8 bytes          Head frame offset in the head segment
+     *   8 bytes          Tail segment number
+     *   8 bytes          Tail offset (where the next frame goes)
+     *   4 bytes          Frame count
+     *   4 bytes          CRC-32C of the preceding 48 bytes
+     *
+     * Segment:
+     *   ...              Frames (see QueueFile), back to back from offset 0
+     *   4 bytes          Zero (if the segment has been rolled over and there
+     *                    is room for it)
+     * </pre>
+     */
+    private final RandomAccessFile manifest;
+
+    /**
+     * The raw file descriptor of {@link #manifest} for positional I/O or -1 if
+     * {@link VectoredIO} isn't available.
+     */
+    private final long fd;
+
+    /** Keep file around for error reporting. */
+    final File file;
+
+    /** The directory of the manifest and the segments. */
+    private final File directory;
+
+    /** The size of a new segment (a segment is larger if a frame requires it). */
+    private final long segmentSize;
+
+    /** Number of the head segment. */
+    private long firstSegment;
+
+    /** Offset of the head frame in the head segment. */
+    private long firstOffset;
+
+    /** Number of the tail segment. */
+    private long lastSegment;
+
+    /** Offset in the tail segment where the next frame goes. */
+    private long lastOffset;
+
+    /** Number of frames. */
+    private volatile int frameCount;
+
+    /** Number of messages (without the consumed messages of the head frame). */
+    private volatile int messageCount;
+
+    /** The head and the tail segment (identical while there is only one). */
+    private Segment head;
+    private Segment tail;
+
+    /** The messages of the head frame or null if not read yet. */
+    private byte[][] headMessages;
+
+    /** The length of the head frame (including its length prefix). */
+    private int headLength;
+
+    /** Number of messages of the head frame that have been removed. */
+    private int headConsumed;
+
+    /**
+     * The end of the committed frames, published after every manifest write
+     * so that cursors can read up to it without holding the lock.
+     */
+    private volatile Position end;
+
+    /** The committed positions of all cursors (open or not) by name. */
+    private final Map<String, Position> cursors = new TreeMap<>();
+
+    /** The open cursors by name. */
+    private final Map<String, QueueCursor> openCursors = new HashMap<>();
+
+    /** In-memory buffer. Big enough to hold the manifest. */
+    private final byte[] buffer = new byte[MANIFEST_LENGTH];
+
+    /**
+     * The number of times this queue has been structurally modified. Used by
+     * {@link #forEachAccept(MessageConsumer)} to guard against concurrent
+     * modification.
+     */
+    private int modCount = 0;
+
+    private volatile boolean locked;
+
+    static RandomAccessFile initializeFromFile(File file, long segmentSize) throws IOException {
+        if (!file.exists()) {
+            // Use a temp file so we don't leave a partially-initialized file
+            File tempFile = new File(file.getPath() + ".tmp");
+            byte[] manifest = new byte[MANIFEST_LENGTH];
+            encodeManifest(manifest, segmentSize, 0L, 0L, 0L, 0L, 0);
+            try (RandomAccessFile raf = open(tempFile)) {
+                raf.setLength(0L);
+                raf.write(manifest);
+            }
+            // A rename is atomic
+            if (!tempFile.renameTo(file)) {
+                throw new IOException("Rename failed!");
+            }
+        }
+
+        return open(file);
+    }
+
+    /** Opens a random access file that writes synchronously ("rwd"). */
+    private static RandomAccessFile open(File file) throws FileNotFoundException {
+        return new RandomAccessFile(file, "rwd");
+    }
+
+    SegmentedQueueFile(File file, RandomAccessFile manifest) throws IOException {
+        this.file = file;
+        this.manifest = manifest;
+        this.directory = file.getAbsoluteFile().getParentFile();
+        this.fd = VectoredIO.isAvailable() ? MMapUtils.getFileDescriptor(manifest.getFD()) : -1L;
+
+        if (manifest.length() < MANIFEST_LENGTH) {
+            throw new IOException("File is corrupt. Too small to contain a manifest. Length: " + manifest.length());
+        }
+        manifest.seek(0L);
+        manifest.readFully(buffer);
+
+        int version = QueueFile.readInt(buffer, 0) & 0x7FFFFFFF;
+        if (version != 1) {
+            throw new IOException("Unable to read version " + version + " format. Supported version is 1");
+        }
+        if (QueueFile.readInt(buffer, MANIFEST_LENGTH - 4) != Crc32C.compute(buffer, 0, MANIFEST_LENGTH - 4)) {
+            throw new IOException("Manifest is corrupt. Checksum mismatch in " + file);
+        }
+        segmentSize = QueueFile.readLong(buffer, 4);
+        firstSegment = QueueFile.readLong(buffer, 12);
+        firstOffset = QueueFile.readLong(buffer, 20);
+        lastSegment = QueueFile.readLong(buffer, 28);
+        lastOffset = QueueFile.readLong(buffer, 36);
+        frameCount = QueueFile.readInt(buffer, 44);
+
+        if (segmentSize < MIN_SEGMENT_SIZE) {
+            throw new IOException("Manifest is corrupt. Invalid segment size: " + segmentSize);
+        }
+        if (firstSegment < 0L || lastSegment < firstSegment || (firstOffset | lastOffset) < 0L || frameCount < 0) {
+            throw new IOException("Manifest is corrupt. Inconsistent segments (" + firstSegment + ", " + lastSegment
+                    + ") or offsets (" + firstOffset + ", " + lastOffset + ")");
+        }
+
+        deleteStaleSegments();
+        head = openSegment(firstSegment, frameCount == 0);
+        try {
+            tail = (lastSegment == firstSegment) ? head : openSegment(lastSegment, frameCount == 0);
+            recover();
+            end = new Position(lastSegment, lastOffset, 0);
+            loadCursors();
+        } catch (IOException e) {
+            closeSegments();
+            throw e;
+        }
+    }
+
+    /** Encodes the manifest including its checksum. */
+    private static void encodeManifest(byte[] manifest, long segmentSize, long firstSegment, long firstOffset,
+            long lastSegment, long lastOffset, int frameCount) {
+        QueueFile.writeInt(manifest, 0, MANIFEST_VERSION);
+        QueueFile.writeLong(manifest, 4, segmentSize);
+        QueueFile.writeLong(manifest, 12, firstSegment);
+        QueueFile.writeLong(manifest, 20, firstOffset);
+        QueueFile.writeLong(manifest, 28, lastSegment);
+        QueueFile.writeLong(manifest, 36, lastOffset);
+        QueueFile.writeInt(manifest, 44, frameCount);
+        QueueFile.writeInt(manifest, MANIFEST_LENGTH - 4, Crc32C.compute(manifest, 0, MANIFEST_LENGTH - 4));
+    }
+
+    /**
+     * Writes the manifest atomically. The arguments contain the updated
+     * values. It's up to the caller to update the class member variables
+     * *after* this call succeeds.
+     */
+    private void writeManifest(long firstSegment, long firstOffset, long lastSegment, long lastOffset,
+            int frameCount) throws IOException {
+        encodeManifest(buffer, segmentSize, firstSegment, firstOffset, lastSegment, lastOffset, frameCount);
+        if (fd >= 0L) {
+            // The file is opened with O_DSYNC ("rwd"), no RWF_DSYNC needed
+            VectoredIO.write(fd, 0L, buffer, 0, MANIFEST_LENGTH, false);
+        } else {
+            manifest.seek(0L);
+            manifest.write(buffer, 0, MANIFEST_LENGTH);
+        }
+    }
+
+    /**
+     * Verifies the frames and truncates the queue at the first torn or
+     * corrupt frame (e.g. a frame whose write was interrupted by a crash).
+     */
+    private void recover() throws IOException {
+        long[] result = new long[4];
+        int frames = 0;
+        long messages = 0L;
+        long validSegment = firstSegment;
+        long validOffset = firstOffset;
+        for (long number = firstSegment; number <= lastSegment && frames < frameCount; ++number) {
+            Segment segment = segment(number);
+            try {
+                long start = (number == firstSegment) ? firstOffset : 0L;
+                int found = scanSegment(segment, start, frameCount - frames, result);
+                frames += found;
+                messages += result[FrameScanner.MESSAGES];
+                long end = start;
+                if (found > 0) {
+                    end = result[FrameScanner.LAST_POSITION] + QueueFile.Element.ELEM_HEADER_LEN
+                            + result[FrameScanner.LAST_LENGTH];
+                    validSegment = number;
+                    validOffset = end;
+                }
+                if (frames < frameCount && !atSegmentEnd(segment, end, buffer)) {
+                    break; // corrupt frame in the middle of the queue
+                }
+            } finally {
+                release(segment);
+            }
+        }
+        if (frames < frameCount) {
+            logger.warning("Truncating " + file + " at torn frame " + frames + " of " + frameCount);
+            writeManifest(firstSegment, firstOffset, validSegment, validOffset, frames);
+            if (validSegment != lastSegment) {
+                Segment valid = (validSegment == firstSegment) ? head : openSegment(validSegment, false);
+                if (tail != head) {
+                    tail.close();
+                }
+                tail = valid;
+                long stale = lastSegment;
+                lastSegment = validSegment;
+                deleteSegments(validSegment + 1, stale + 1);
+            }
+            lastOffset = validOffset;
+            frameCount = frames;
+        }
+        messageCount = (int) messages;
+    }
+
+    /** Scans a segment natively or, if that isn't possible, in Java. */
+    private int scanSegment(Segment segment, long start, int maxFrames, long[] result) throws IOException {
+        int frames = -1;
+        if (FrameScanner.isAvailable()) {
+            frames = FrameScanner.scanSegment(MMapUtils.getFileDescriptor(segment.raf.getFD()), segment.length,
+                    start, maxFrames, result);
+        }
+        if (frames < 0) {
+            frames = scanFrames(segment, start, maxFrames, result);
+        }
+        return frames;
+    }
+
+    /** The Java equivalent of {@link FrameScanner#scanSegment}. */
+    private int scanFrames(Segment segment, long start, int maxFrames, long[] result) throws IOException {
+        long position = start;
+        int frames = 0;
+        long messages = 0L;
+        long lastPosition = 0L;
+        int lastLength = 0;
+        while (frames < maxFrames) {
+            byte[] frame = readFrame(segment, position, buffer);
+            byte[][] m = (frame == null) ? null : QueueFile.messages(frame);
+            if (m == null) {
+                break;
+            }
+            frames++;
+            messages += m.length;
+            lastPosition = position;
+            lastLength = frame.length - QueueFile.Element.ELEM_HEADER_LEN;
+            position += frame.length;
+        }
+        result[FrameScanner.FRAMES] = frames;
+        result[FrameScanner.MESSAGES] = messages;
+        result[FrameScanner.LAST_POSITION] = lastPosition;
+        result[FrameScanner.LAST_LENGTH] = lastLength;
+        return frames;
+    }
+
+    /**
+     * Reads the frame (including its length prefix) at position and verifies
+     * its checksum. Returns null if there is no valid frame.
+     *
+     * @param scratch
+     *            a buffer of at least 4 bytes
+     */
+    static byte[] readFrame(Segment segment, long position, byte[] scratch) throws IOException {
+        if (position < 0L || segment.length - position < FrameScanner.FRAME_HEADER_LENGTH) {
+            return null;
+        }
+        read(segment, position, scratch, 0, QueueFile.Element.ELEM_HEADER_LEN);
+        int length = QueueFile.readInt(scratch, 0);
+        if (length < FrameScanner.FRAME_HEADER_LENGTH - QueueFile.Element.ELEM_HEADER_LEN
+                || length > segment.length - position - QueueFile.Element.ELEM_HEADER_LEN) {
+            return null;
+        }
+        byte[] frame = new byte[QueueFile.Element.ELEM_HEADER_LEN + length];
+        read(segment, position, frame, 0, frame.length);
+        return (QueueFile.readInt(frame, 8) == QueueFile.frameChecksum(frame)) ? frame : null;
+    }
+
+    /** Whether no further frame can follow at position in the segment. */
+    static boolean atSegmentEnd(Segment segment, long position, byte[] scratch) throws IOException {
+        if (segment.length - position < FrameScanner.FRAME_HEADER_LENGTH) {
+            return true;
+        }
+        read(segment, position, scratch, 0, QueueFile.Element.ELEM_HEADER_LEN);
+        return QueueFile.readInt(scratch, 0) == 0;
+    }
+
+    /** The messages of the head frame. */
+    private byte[][] headMessages() throws IOException {
+        if (headMessages == null) {
+            byte[] frame = readFrame(head, firstOffset, buffer);
+            byte[][] messages = (frame == null) ? null : QueueFile.messages(frame);
+            if (messages == null) {
+                throw new IOException("Corrupt frame at offset " + firstOffset + " in " + head.file);
+            }
+            headMessages = messages;
+            headLength = frame.length;
+        }
+        return headMessages;
+    }
+
+    static void write(Segment segment, long position, byte[] b, int off, int len) throws IOException {
+        if (segment.fd >= 0L) {
+            // The segment is opened with O_DSYNC ("rwd"), no RWF_DSYNC needed
+            VectoredIO.write(segment.fd, position, b, off, len, false);
+        } else {
+            segment.raf.seek(position);
+            segment.raf.write(b, off, len);
+        }
+    }
+
+    static void read(Segment segment, long position, byte[] b, int off, int len) throws IOException {
+        if (segment.fd >= 0L) {
+            VectoredIO.readFully(segment.fd, position, b, off, len);
+        } else {
+            segment.raf.seek(position);
+            segment.raf.readFully(b, off, len);
+        }
+    }
+
+    /**
+     * Adds a message to the end of the queue.
+     *
+     * @param data
+     *            message to copy bytes from
+     */
+    public synchronized void addMessage(byte[] data) throws IOException {
+        if (data == null) {
+            return;
+        }
+        checkOpen();
+        append(QueueFile.encodeFrame(Collections.singletonList(data)));
+    }
+
+    /**
+     * Adds the given messages ({@code null} entries are skipped) atomically as
+     * a single frame with a single write to the end of the queue.
+     *
+     * @param messages
+     *            the messages to copy bytes from
+     */
+    public synchronized void addMessages(List<byte[]> messages) throws IOException {
+        if (messages == null) {
+            return;
+        }
+        checkOpen();
+        byte[] frame = QueueFile.encodeFrame(messages);
+        if (frame != null) {
+            append(frame);
+        }
+    }
+
+    /** Appends the frame to the tail segment (to a new one if it doesn't fit). */
+    private void append(byte[] frame) throws IOException {
+        if (frame.length > tail.length - lastOffset) {
+            roll(frame.length);
+        }
+        write(tail, lastOffset, frame, 0, frame.length);
+
+        // Commit the addition
+        long newLastOffset = lastOffset + frame.length;
+        writeManifest(firstSegment, firstOffset, lastSegment, newLastOffset, frameCount + 1);
+        lastOffset = newLastOffset;
+        frameCount++;
+        messageCount += QueueFile.readInt(frame, 4);
+        modCount++;
+        end = new Position(lastSegment, lastOffset, 0);
+    }
+
+    /**
+     * Starts a new tail segment that can hold at least {@code frameLength}
+     * bytes. The old tail segment is terminated first, so a scan can't run
+     * into stale data behind its last frame. An empty queue moves its head to
+     * the new segment and deletes the old one.
+     */
+    private void roll(int frameLength) throws IOException {
+        if (tail.length - lastOffset >= END_OF_SEGMENT.length) {
+            write(tail, lastOffset, END_OF_SEGMENT, 0, END_OF_SEGMENT.length);
+        }
+        long number = lastSegment + 1;
+        Segment next = createSegment(number, Math.max(segmentSize, frameLength));
+        boolean empty = (frameCount == 0);
+        try {
+            // Commit the new tail segment
+            writeManifest(empty ? number : firstSegment, empty ? 0L : firstOffset, number, 0L, frameCount);
+        } catch (IOException e) {
+            next.close();
+            if (!next.file.delete()) {
+                logger.warning("Couldn't delete " + next.file);
+            }
+            throw e;
+        }
+        Segment previous = tail;
+        tail = next;
+        lastSegment = number;
+        lastOffset = 0L;
+        end = new Position(lastSegment, lastOffset, 0);
+        if (empty) {
+            long oldFirst = firstSegment;
+            firstSegment = number;
+            firstOffset = 0L;
+            headMessages = null;
+            if (previous != head) {
+                previous.close();
+            }
+            head.close();
+            head = next;
+            deleteSegments(oldFirst, number);
+        } else if (previous != head) {
+            previous.close();
+        }
+    }
+
+    /** Returns true if this queue contains no messages. */
+    public boolean isEmpty() {
+        return frameCount == 0;
+    }
+
+    /** Returns the number of messages in this queue. */
+    public int size() {
+        return messageCount;
+    }
+
+    /** Returns the number of segment files of this queue. */
+    public synchronized int segmentCount() {
+        return (int) (lastSegment - firstSegment + 1L);
+    }
+
+    private void checkOpen() throws IOException {
+        if (locked) {
+            throw new ClosedQueueFileException("Closed : " + file);
+        }
+    }
+
+    /**
+     * Passes all messages from the eldest to the newest to the consumer
+     * without removing them.
+     */
+    public synchronized void forEachAccept(MessageConsumer consumer) throws IOException {
+        if (consumer == null) {
+            return;
+        }
+        checkOpen();
+        int expectedModCount = modCount;
+        Segment segment = head;
+        long position = firstOffset;
+        int skip = headConsumed;
+        try {
+            for (int i = 0; i < frameCount; ++i) {
+                if (segment.number < lastSegment && atSegmentEnd(segment, position, buffer)) {
+                    release(segment);
+                    segment = segment(segment.number + 1);
+                    position = 0L;
+                }
+                byte[] frame = readFrame(segment, position, buffer);
+                byte[][] messages = (frame == null) ? null : QueueFile.messages(frame);
+                if (messages == null) {
+                    throw new IOException("Corrupt frame at offset " + position + " in " + segment.file);
+                }
+                for (int j = skip; j < messages.length; ++j) {
+                    try {
+                        consumer.acceptMessage(messages[j]);
+                    } catch (Throwable t) {
+                        throw new IOException(t);
+                    }
+                    if (modCount != expectedModCount) {
+                        throw new ConcurrentModificationException();
+                    }
+                }
+                skip = 0;
+                position += frame.length;
+            }
+        } finally {
+            release(segment);
+        }
+    }
+
+    /**
+     * Removes the eldest message if the consumer accepts it.
+     *
+     * @throws IllegalStateException
+     *             if the queue has cursors (it is consumed through them)
+     */
+    public synchronized boolean removeNextMessage(MessageConsumer consumer) throws IOException {
+        if (consumer == null) {
+            return false;
+        }
+        if (!cursors.isEmpty()) {
+            throw new IllegalStateException("Queue " + file + " is consumed through the cursors " + cursors.keySet());
+        }
+        byte[] message = peek();
+        try {
+            consumer.acceptMessage(message);
+        } catch (Throwable t) {
+            return false;
+        }
+        remove();
+        return true;
+    }
+
+    /** Reads the eldest message. Returns null if the queue is empty. */
+    private byte[] peek() throws IOException {
+        checkOpen();
+        if (isEmpty()) {
+            return null;
+        }
+        return headMessages()[headConsumed];
+    }
+
+    /**
+     * Removes the eldest message. The head frame is only removed from the
+     * queue once all its messages have been removed.
+     */
+    private void remove() throws IOException {
+        checkOpen();
+        if (isEmpty()) {
+            return;
+        }
+        int remaining = messageCount - 1;
+        if (headConsumed + 1 < headMessages().length) {
+            headConsumed++;
+            modCount++;
+        } else {
+            removeFrame();
+        }
+        messageCount = remaining;
+    }
+
+    /**
+     * Removes the head frame. If the head moves on to the next segment, the
+     * old head segment is deleted.
+     */
+    private void removeFrame() throws IOException {
+        headMessages();
+        int remaining = frameCount - 1;
+        long newFirstSegment = firstSegment;
+        long newFirstOffset = firstOffset + headLength;
+        if (remaining == 0) {
+            newFirstSegment = lastSegment;
+            newFirstOffset = lastOffset;
+        } else if (firstSegment < lastSegment && atSegmentEnd(head, newFirstOffset, buffer)) {
+            newFirstSegment = firstSegment + 1;
+            newFirstOffset = 0L;
+        }
+
+        // Commit the removal
+        writeManifest(newFirstSegment, newFirstOffset, lastSegment, lastOffset, remaining);
+        if (newFirstSegment != firstSegment) {
+            Segment previous = head;
+            long oldFirst = firstSegment;
+            head = (newFirstSegment == lastSegment) ? tail : openSegment(newFirstSegment, false);
+            previous.close();
+            firstSegment = newFirstSegment;
+            deleteSegments(oldFirst, newFirstSegment);
+        }
+        firstOffset = newFirstOffset;
+        frameCount = remaining;
+        headMessages = null;
+        headConsumed = 0;
+        modCount++;
+    }
+
+    /**
+     * Opens the cursor with the given name. A cursor that doesn't exist yet is
+     * created at the head of the queue. Only one instance of a cursor can be
+     * open at a time.
+     *
+     * @param name
+     *            letters, digits, {@code '_'} and {@code '-'} (at most 64)
+     * @throws IllegalStateException
+     *             if the cursor is already open
+     */
+    public synchronized QueueCursor cursor(String name) throws IOException {
+        checkOpen();
+        checkCursorName(name);
+        if (openCursors.containsKey(name)) {
+            throw new IllegalStateException("Cursor " + name + " is already open");
+        }
+        File cursorFile = cursorFile(name);
+        Position position = cursors.get(name);
+        if (position == null) {
+            position = new Position(firstSegment, firstOffset, headConsumed);
+            QueueCursor.initialize(cursorFile, position);
+        }
+        QueueCursor cursor = new QueueCursor(this, name, cursorFile, position);
+        cursors.put(name, position);
+        openCursors.put(name, cursor);
+        return cursor;
+    }
+
+    /**
+     * Deletes the (closed) cursor with the given name. Data that only this
+     * cursor hadn't consumed yet is reclaimed.
+     *
+     * @throws IllegalStateException
+     *             if the cursor is open
+     */
+    public synchronized void deleteCursor(String name) throws IOException {
+        checkOpen();
+        if (openCursors.containsKey(name)) {
+            throw new IllegalStateException("Cursor " + name + " is open");
+        }
+        if (cursors.remove(name) != null) {
+            File cursorFile = cursorFile(name);
+            if (!cursorFile.delete()) {
+                throw new IOException("Couldn't delete " + cursorFile);
+            }
+            reclaim();
+        }
+    }
+
+    /** The names of all cursors of this queue (sorted). */
+    public synchronized List<String> cursorNames() {
+        return new ArrayList<>(cursors.keySet());
+    }
+
+    /** Called by a cursor after it has persisted a new position. */
+    synchronized void committed(String name, Position position) throws IOException {
+        checkOpen();
+        cursors.put(name, position);
+        reclaim();
+    }
+
+    /** Called by a cursor when it is closed. */
+    synchronized void closed(String name) {
+        openCursors.remove(name);
+    }
+
+    /** The end of the committed frames (doesn't need the lock). */
+    Position end() {
+        return end;
+    }
+
+    private static void checkCursorName(String name) {
+        if (name == null || !CURSOR_NAME.matcher(name).matches()) {
+            throw new IllegalArgumentException("Invalid cursor name: " + name);
+        }
+    }
+
+    private File cursorFile(String name) {
+        return new File(directory, file.getName() + CURSOR_INFIX + name);
+    }
+
+    /**
+     * Reads the positions of the persisted cursors. A position outside of
+     * the queue (behind a head that moved on to a new segment while the queue
+     * was empty, or past a torn tail) is clamped.
+     */
+    private void loadCursors() throws IOException {
+        String prefix = file.getName() + CURSOR_INFIX;
+        File[] files = directory.listFiles();
+        if (files == null) {
+            return;
+        }
+        Position head = new Position(firstSegment, firstOffset, 0);
+        for (File f : files) {
+            String name = f.getName();
+            if (!name.startsWith(prefix) || !CURSOR_NAME.matcher(name.substring(prefix.length())).matches()) {
+                continue;
+            }
+            Position position = QueueCursor.load(f);
+            if (position.before(head)) {
+                position = head;
+            } else if (end.before(position)) {
+                position = end;
+            }
+            cursors.put(name.substring(prefix.length()), position);
+        }
+        reclaim();
+    }
+
+    /**
+     * Moves the head of a queue with cursors to the committed position of the
+     * slowest cursor and deletes the segments before it.
+     */
+    private void reclaim() throws IOException {
+        Position min = null;
+        for (Position position : cursors.values()) {
+            if (min == null || position.before(min)) {
+                min = position;
+            }
+        }
+        if (min == null || !new Position(firstSegment, firstOffset, headConsumed).before(min)) {
+            return;
+        }
+
+        // Count the frames and messages between the head and min
+        int frames = 0;
+        long messages = 0L;
+        long number = firstSegment;
+        long position = firstOffset;
+        Segment segment = head;
+        try {
+            while (frames < frameCount && (number < min.segment || (number == min.segment && position < min.offset))) {
+                if (atSegmentEnd(segment, position, buffer)) {
+                    if (number >= lastSegment) {
+                        throw new IOException("Cursor position " + min + " is beyond the end of " + file);
+                    }
+                    release(segment);
+                    segment = segment(++number);
+                    position = 0L;
+                    continue;
+                }
+                read(segment, position, buffer, 0, 8);
+                frames++;
+                messages += QueueFile.readInt(buffer, 4);
+                position += QueueFile.Element.ELEM_HEADER_LEN + QueueFile.readInt(buffer, 0);
+            }
+            if (frames < frameCount && number < lastSegment && atSegmentEnd(segment, position, buffer)) {
+                number++;
+                position = 0L;
+            }
+        } finally {
+            release(segment);
+        }
+        int remaining = frameCount - frames;
+        int consumed = (remaining == 0) ? 0 : min.consumed;
+        if (remaining == 0) {
+            number = lastSegment;
+            position = lastOffset;
+        }
+
+        // Commit the new head
+        writeManifest(number, position, lastSegment, lastOffset, remaining);
+        if (number != firstSegment) {
+            Segment previous = head;
+            long oldFirst = firstSegment;
+            head = (number == lastSegment) ? tail : openSegment(number, false);
+            previous.close();
+            firstSegment = number;
+            deleteSegments(oldFirst, number);
+        }
+        messageCount = (int) (messageCount + headConsumed - messages - consumed);
+        firstOffset = position;
+        frameCount = remaining;
+        if (frames > 0) {
+            headMessages = null;
+        }
+        headConsumed = consumed;
+        modCount++;
+    }
+
+    File segmentFile(long number) {
+        return new File(directory, file.getName() + "." + number);
+    }
+
+    /** Creates (or recreates) a zero-filled segment. */
+    private Segment createSegment(long number, long length) throws IOException {
+        File segmentFile = segmentFile(number);
+        RandomAccessFile raf = open(segmentFile);
+        try {
+            raf.setLength(0L);
+            raf.setLength(length);
+            raf.getChannel().force(true);
+            return new Segment(number, segmentFile, raf);
+        } catch (IOException e) {
+            raf.close();
+            throw e;
+        }
+    }
+
+    private Segment openSegment(long number, boolean create) throws IOException {
+        File segmentFile = segmentFile(number);
+        if (!segmentFile.exists()) {
+            if (create) {
+                return createSegment(number, segmentSize);
+            }
+            throw new IOException("Missing segment " + segmentFile);
+        }
+        RandomAccessFile raf = open(segmentFile);
+        try {
+            return new Segment(number, segmentFile, raf);
+        } catch (IOException e) {
+            raf.close();
+            throw e;
+        }
+    }
+
+    /** The open head or tail segment or a newly opened one. */
+    private Segment segment(long number) throws IOException {
+        if (number == head.number) {
+            return head;
+        }
+        if (number == tail.number) {
+            return tail;
+        }
+        return openSegment(number, false);
+    }
+
+    /** Closes a segment returned by {@link #segment(long)} unless it is the head or tail. */
+    private void release(Segment segment) throws IOException {
+        if (segment != head && segment != tail) {
+            segment.close();
+        }
+    }
+
+    /** Deletes the segments {@code from} (inclusive) to {@code to} (exclusive). */
+    private void deleteSegments(long from, long to) {
+        for (long number = from; number < to; ++number) {
+            File segmentFile = segmentFile(number);
+            if (segmentFile.exists() && !segmentFile.delete()) {
+                logger.warning("Couldn't delete " + segmentFile);
+            }
+        }
+    }
+
+    /**
+     * Deletes segments that aren't part of the queue anymore (or not yet),
+     * left behind by a crash between a manifest write and a deletion.
+     */
+    private void deleteStaleSegments() {
+        String prefix = file.getName() + ".";
+        File[] files = directory.listFiles();
+        if (files == null) {
+            return;
+        }
+        for (File f : files) {
+            String name = f.getName();
+            if (!name.startsWith(prefix)) {
+                continue;
+            }
+            long number;
+            try {
+                number = Long.parseLong(name.substring(prefix.length()));
+            } catch (NumberFormatException e) {
+                continue;
+            }
+            if ((number < firstSegment || number > lastSegment) && !f.delete()) {
+                logger.warning("Couldn't delete " + f);
+            }
+        }
+    }
+
+    private void closeSegments() throws IOException {
+        if (tail != null && tail != head) {
+            tail.close();
+        }
+        if (head != null) {
+            head.close();
+        }
+    }
+
+    /** The manifest {@link File} of this queue. */
+    public File file() {
+        return file;
+    }
+
+    @Override
+    public void close() throws IOException {
+        List<QueueCursor> detached;
+        synchronized (this) {
+            if (locked) {
+                return;
+            }
+            locked = true;
+            detached = new ArrayList<>(openCursors.values());
+            openCursors.clear();
+        }
+        // Without the lock of the queue: a cursor calls back into the queue
+        // (commit, close) while it holds its own lock, which detach() takes
+        try {
+            for (QueueCursor cursor : detached) {
+                cursor.detach();
+            }
+        } finally {
+            synchronized (this) {
+                try {
+                    closeSegments();
+                } finally {
+                    manifest.close();
+                }
+            }
+        }
+    }
+
+    public boolean isClosed() {
+        return locked;
+    }
+
+    @Override
+    //@formatter:off
+    public synchronized String toString() {
+        return "SegmentedQueueFile{"
+             + "file=" + file
+             + ", locked=" + locked
+             + ", size=" + messageCount
+             + ", frames=" + frameCount
+             + ", segmentSize=" + segmentSize
+             + ", first=" + firstSegment + ":" + firstOffset
+             + ", last=" + lastSegment + ":" + lastOffset
+             + '}';
+    }
+    //@formatter:on
+
+    /**
+     * A read position: a frame and the number of its messages that have
+     * already been consumed.
+     */
+    static final class Position {
+        final long segment;
+        final long offset;
+        final int consumed;
+
+        Position(long segment, long offset, int consumed) {
+            this.segment = segment;
+            this.offset = offset;
+            this.consumed = consumed;
+        }
+
+        boolean before(Position other) {
+            if (segment != other.segment) {
+                return segment < other.segment;
+            }
+            if (offset != other.offset) {
+                return offset < other.offset;
+            }
+            return consumed < other.consumed;
+        }
+
+        @Override
+        public boolean equals(Object obj) {
+            if (!(obj instanceof Position)) {
+                return false;
+            }
+            Position other = (Position) obj;
+            return segment == other.segment && offset == other.offset && consumed == other.consumed;
+        }
+
+        @Override
+        public int hashCode() {
+            return Objects.hash(segment, offset, consumed);
+        }
+
+        @Override
+        public String toString() {
+            return segment + ":" + offset + "+" + consumed;
+        }
+    }
+
+    /** An open segment file. */
+    static final class Segment implements Closeable {
+        final long number;
+        final File file;
+        final RandomAccessFile raf;
+
+        /** The raw file descriptor or -1 if {@link VectoredIO} isn't available. */
+        final long fd;
+
+        /** The file length (fixed when the segment is created). */
+        final long length;
+
+        Segment(long number, File file, RandomAccessFile raf) throws IOException {
+            this.number = number;
+            this.file = file;
+            this.raf = raf;
+            this.fd = VectoredIO.isAvailable() ? MMapUtils.getFileDescriptor(raf.getFD()) : -1L;
+            this.length = raf.length();
+        }
+
+        @Override
+        public void close() throws IOException {
+            raf.close();
+        }
+
+        @Override
+        public String toString() {
+            return getClass().getSimpleName() + "[number=" + number + ", len=" + length + "]";
+        }
+    }
+
+    /** Fluent API for creating {@link SegmentedQueueFile} instances. */
+    public static final class Builder {
+        private final File file;
+
+        /** Start constructing a new queue with the given manifest file. */
+        public Builder(File file) {
+            Objects.requireNonNull(file, "file == null");
+            this.file = file;
+        }
+
+        /**
+         * Constructs a new queue with segments of
+         * {@link SegmentedQueueFile#DEFAULT_SEGMENT_SIZE}.
+         */
+        public SegmentedQueueFile build() throws IOException {
+            return build(DEFAULT_SEGMENT_SIZE);
+        }
+
+        /**
+         * Constructs a new queue backed by the given builder.
+         *
+         * @param segmentSize
+         *            the size of the segment files of a new queue (at least
+         *            {@link SegmentedQueueFile#MIN_SEGMENT_SIZE}); an existing
+         *            queue keeps its segment size
+         */
+        public SegmentedQueueFile build(long segmentSize) throws IOException {
+            if (segmentSize < MIN_SEGMENT_SIZE) {
+                throw new IllegalArgumentException("segmentSize: " + segmentSize);
+            }
+            RandomAccessFile raf = initializeFromFile(file, segmentSize);
+            SegmentedQueueFile qf = null;
+            try {
+                qf = new SegmentedQueueFile(file, raf);
+                return qf;
+            } finally {
+                if (qf == null) {
+                    raf.close();
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,545 @@
+
+#ifndef _JAVASOFT_JNI_H_
+#include <jni.h>
+#endif /* _JAVASOFT_JNI_H_ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined (__linux)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined (_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "native_codec.h"
+#include "native_region.h"
+#include "native_sdt.h"
+#include "native_stats.h"
+
+
+#ifdef _WIN64
+#define jlong_to_ptr(a) ((void*)(a))
+#define ptr_to_jlong(a) ((jlong)(a))
+#endif
+
+#ifdef __linux
+  #ifdef _LP64
+    #ifndef jlong_to_ptr
+      #define jlong_to_ptr(a) ((void*)(a))
+    #endif
+    #ifndef ptr_to_jlong
+      #define ptr_to_jlong(a) ((jlong)(a))
+    #endif
+  #else
+    #ifndef jlong_to_ptr
+      #define jlong_to_ptr(a) ((void*)(int)(a))
+    #endif
+    #ifndef ptr_to_jlong
+      #define ptr_to_jlong(a) ((jlong)(int)(a))
+    #endif
+  #endif
+#endif
+
+
+/*
+ * An LZ4 compatible block codec (raw blocks without frame header, see
+ * https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md). A block is
+ * a sequence of (literals, match) pairs; a match is an (offset, length)
+ * back reference of at most 64 KiB into the already decoded output or into
+ * a dictionary that logically precedes it.
+ */
+
+#define MIN_MATCH       4
+#define LAST_LITERALS   5   /* the last 5 bytes are always literals */
+#define MF_LIMIT        12  /* the last match starts 12 bytes before the end */
+#define MAX_DISTANCE    65535
+#define HASH_LOG        12
+#define HASH_SIZE       (1 << HASH_LOG)
+#define DICT_MAX        65536
+#define SKIP_TRIGGER    6   /* skip faster over incompressible data */
+#define ML_MASK         15
+#define RUN_MASK        15
+
+#define CODEC_MALFORMED (-1)
+#define CODEC_NO_MEMORY (-2)
+
+
+/*
+ * A prepared dictionary. Only the last 64 KiB can be referenced; the hash
+ * table of its positions is reused by every compress call.
+ */
+struct codec_dict {
+    uint32_t table[HASH_SIZE];
+    uint32_t length;
+    uint8_t data[DICT_MAX];
+};
+
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t read64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void write16le(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+}
+
+static inline uint32_t hash4(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - HASH_LOG);
+}
+
+/* Number of equal low-order bytes of two different 64-bit words */
+static inline unsigned equal_bytes(uint64_t diff) {
+#if defined (_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, diff);
+    return (unsigned) (index >> 3);
+#else
+    return (unsigned) (__builtin_ctzll(diff) >> 3);
+#endif
+}
+
+/* Length of the common prefix of ip and ref, ip stops at limit */
+static inline size_t common_length(const uint8_t* ip, const uint8_t* ref, const uint8_t* limit) {
+    const uint8_t* start = ip;
+    while (ip + 8 <= limit) {
+        uint64_t diff = read64(ip) ^ read64(ref);
+        if (diff != 0) {
+            return (size_t) (ip - start) + equal_bytes(diff);
+        }
+        ip += 8;
+        ref += 8;
+    }
+    while (ip < limit && *ip == *ref) {
+        ++ip;
+        ++ref;
+    }
+    return (size_t) (ip - start);
+}
+
+/* Writes a literal or match length continuation (the part >= 15) */
+static inline uint8_t* write_length(uint8_t* op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t) length;
+    return op;
+}
+
+
+/*
+ * Compresses src into dst (greedy parsing). Positions in the hash table
+ * are counted from the start of the dictionary, so that the dictionary
+ * and the input form one contiguous virtual stream. Returns the size of
+ * the block or 0 if it doesn't fit into dstCap bytes.
+ */
+static size_t block_compress(const codec_dict* dict, const uint8_t* src, size_t srcLen,
+        uint8_t* dst, size_t dstCap) {
+
+    uint32_t table[HASH_SIZE];
+    const uint8_t* dictData = NULL;
+    uint32_t dictLen = 0;
+    if (dict != NULL) {
+        memcpy(table, dict->table, sizeof(table));
+        dictLen = dict->length;
+        dictData = dict->data + (DICT_MAX - dictLen);
+    } else {
+        memset(table, 0, sizeof(table));
+    }
+
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* const iend = src + srcLen;
+    const uint8_t* const mflimit = iend - MF_LIMIT;
+    const uint8_t* const matchlimit = iend - LAST_LITERALS;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + dstCap;
+
+    if (srcLen >= MF_LIMIT + 1) {
+        for (;;) {
+            /* find a match */
+            const uint8_t* ref = NULL;
+            uint32_t refPos = 0;
+            uint32_t attempts = 1U << SKIP_TRIGGER;
+            for (;;) {
+                if (ip > mflimit) {
+                    goto last_literals;
+                }
+                uint32_t pos = dictLen + (uint32_t) (ip - src);
+                uint32_t sequence = read32(ip);
+                uint32_t h = hash4(sequence);
+                refPos = table[h];
+                table[h] = pos;
+                if (refPos < pos && pos - refPos <= MAX_DISTANCE) {
+                    if (refPos >= dictLen) {
+                        ref = src + (refPos - dictLen);
+                        if (read32(ref) == sequence) {
+                            break;
+                        }
+                    } else if (refPos + MIN_MATCH <= dictLen) {
+                        ref = dictData + refPos;
+                        if (read32(ref) == sequence) {
+                            break;
+                        }
+                    }
+                }
+                ip += attempts++ >> SKIP_TRIGGER;
+            }
+
+            /* extend the match backwards */
+            if (refPos >= dictLen) {
+                while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                    --ip;
+                    --ref;
+                    --refPos;
+                }
+            } else {
+                while (ip > anchor && ref > dictData && ip[-1] == ref[-1]) {
+                    --ip;
+                    --ref;
+                    --refPos;
+                }
+            }
+
+            /* match length */
+            size_t matchLen;
+            if (refPos >= dictLen) {
+                matchLen = MIN_MATCH + common_length(ip + MIN_MATCH, ref + MIN_MATCH, matchlimit);
+            } else {
+                /* the reference may run from the dictionary into the input */
+                const uint8_t* dictEnd = dictData + dictLen;
+                const uint8_t* limit = ip + (dictEnd - ref);
+                if (limit > matchlimit) {
+                    limit = matchlimit;
+                }
+                matchLen = MIN_MATCH + common_length(ip + MIN_MATCH, ref + MIN_MATCH, limit);
+                if (ip + matchLen == limit && limit < matchlimit) {
+                    matchLen += common_length(limit, src, matchlimit);
+                }
+            }
+
+            /* encode the sequence */
+            size_t litLen = (size_t) (ip - anchor);
+            if ((size_t) (oend - op) < 1 + (litLen / 255 + 1) + litLen + 2 + (matchLen / 255 + 1)) {
+                return 0;
+            }
+            uint8_t* token = op++;
+            if (litLen >= RUN_MASK) {
+                *token = RUN_MASK << 4;
+                op = write_length(op, litLen - RUN_MASK);
+            } else {
+                *token = (uint8_t) (litLen << 4);
+            }
+            memcpy(op, anchor, litLen);
+            op += litLen;
+            write16le(op, dictLen + (uint32_t) (ip - src) - refPos);
+            op += 2;
+            size_t ml = matchLen - MIN_MATCH;
+            if (ml >= ML_MASK) {
+                *token |= ML_MASK;
+                op = write_length(op, ml - ML_MASK);
+            } else {
+                *token |= (uint8_t) ml;
+            }
+
+            ip += matchLen;
+            anchor = ip;
+            if (ip > mflimit) {
+                break;
+            }
+            /* the position 2 bytes back is a cheap extra candidate */
+            table[hash4(read32(ip - 2))] = dictLen + (uint32_t) (ip - 2 - src);
+        }
+    }
+
+last_literals:
+    size_t litLen = (size_t) (iend - anchor);
+    if ((size_t) (oend - op) < 1 + (litLen / 255 + 1) + litLen) {
+        return 0;
+    }
+    if (litLen >= RUN_MASK) {
+        *op++ = RUN_MASK << 4;
+        op = write_length(op, litLen - RUN_MASK);
+    } else {
+        *op++ = (uint8_t) (litLen << 4);
+    }
+    memcpy(op, anchor, litLen);
+    op += litLen;
+    return (size_t) (op - dst);
+}
+
+
+/* Reads a length continuation, returns false on truncated input */
+static inline bool read_length(const uint8_t** ip, const uint8_t* iend, size_t* length) {
+    const uint8_t* p = *ip;
+    uint32_t b;
+    do {
+        if (p >= iend) {
+            return false;
+        }
+        b = *p++;
+        *length += b;
+    } while (b == 255);
+    *ip = p;
+    return true;
+}
+
+/*
+ * Decompresses a block. Every read and write is bounds checked, so
+ * malformed input can't touch memory outside of src, dst and the
+ * dictionary. Returns the decompressed size or CODEC_MALFORMED.
+ */
+static jint block_decompress(const codec_dict* dict, const uint8_t* src, size_t srcLen,
+        uint8_t* dst, size_t dstCap) {
+
+    const uint8_t* dictEnd = NULL;
+    size_t dictLen = 0;
+    if (dict != NULL) {
+        dictLen = dict->length;
+        dictEnd = dict->data + DICT_MAX;
+    }
+
+    const uint8_t* ip = src;
+    const uint8_t* const iend = src + srcLen;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + dstCap;
+
+    for (;;) {
+        if (ip >= iend) {
+            return CODEC_MALFORMED;
+        }
+        uint32_t token = *ip++;
+
+        /* literals */
+        size_t litLen = token >> 4;
+        if (litLen == RUN_MASK && !read_length(&ip, iend, &litLen)) {
+            return CODEC_MALFORMED;
+        }
+        if (litLen > (size_t) (iend - ip) || litLen > (size_t) (oend - op)) {
+            return CODEC_MALFORMED;
+        }
+        memcpy(op, ip, litLen);
+        ip += litLen;
+        op += litLen;
+        if (ip == iend) {
+            break; /* the last sequence has no match */
+        }
+
+        /* match */
+        if (iend - ip < 2) {
+            return CODEC_MALFORMED;
+        }
+        size_t offset = (size_t) ip[0] | ((size_t) ip[1] << 8);
+        ip += 2;
+        size_t matchLen = token & ML_MASK;
+        if (matchLen == ML_MASK && !read_length(&ip, iend, &matchLen)) {
+            return CODEC_MALFORMED;
+        }
+        matchLen += MIN_MATCH;
+        if (offset == 0 || matchLen > (size_t) (oend - op)) {
+            return CODEC_MALFORMED;
+        }
+
+        size_t produced = (size_t) (op - dst);
+        if (offset > produced) {
+            /* the reference starts in the dictionary */
+            size_t back = offset - produced;
+            if (back > dictLen) {
+                return CODEC_MALFORMED;
+            }
+            size_t n = (back < matchLen) ? back : matchLen;
+            memcpy(op, dictEnd - back, n);
+            op += n;
+            matchLen -= n;
+            const uint8_t* ref = dst;
+            while (matchLen-- > 0) {
+                *op++ = *ref++;
+            }
+        } else {
+            const uint8_t* ref = op - offset;
+            if (offset >= 8 && matchLen + 8 <= (size_t) (oend - op)) {
+                /* non-overlapping in 8 byte steps, may write up to 7 bytes beyond */
+                uint8_t* end = op + matchLen;
+                do {
+                    memcpy(op, ref, 8);
+                    op += 8;
+                    ref += 8;
+                } while (op < end);
+                op = end;
+            } else {
+                while (matchLen-- > 0) {
+                    *op++ = *ref++;
+                }
+            }
+        }
+    }
+    return (jint) (op - dst);
+}
+
+int codec_decompress(const void* dict, const uint8_t* src, size_t srcLen, uint8_t* dst, size_t dstCap) {
+    return block_decompress((const codec_dict*) dict, src, srcLen, dst, dstCap);
+}
+
+
+/*
+ * Pre-faults the (mapped) destination with MADV_POPULATE_WRITE (Linux 5.14+)
+ * so that the pages are allocated in one call instead of one write fault
+ * per page. Older kernels reject the advice, which is ignored.
+ */
+static void populate_write(jlong address, jlong length) {
+#if defined (__linux)
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+    long ps = sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t) address & ~((uintptr_t) ps - 1);
+    uintptr_t end = (uintptr_t) (address + length);
+    NATIVE_PROBE3(populate_entry, start, end - start, 0);
+    int result = madvise((void*) start, end - start, MADV_POPULATE_WRITE);
+    NATIVE_PROBE3(populate_return, start, end - start, (result == -1) ? -errno : 0);
+#else
+    (void) address;
+    (void) length;
+#endif
+}
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Class:     mmap_impl_BlockCodec
+ * Method:    compress0
+ * Signature: (JLjava/lang/Object;JILjava/lang/Object;JI)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_BlockCodec_compress0(JNIEnv* env, jclass,
+  jlong dict,
+  jobject src,
+  jlong srcOff,
+  jint srcLen,
+  jobject dst,
+  jlong dstOff,
+  jint dstCap) {
+
+    stats_scope stats(OP_BLOCK_COMPRESS, (src == NULL) ? srcOff : 0, srcLen);
+
+    pinned_region in(env, src, srcOff, JNI_ABORT);
+    if (!in.ok()) {
+        stats.fail(ENOMEM);
+        return CODEC_NO_MEMORY;
+    }
+    pinned_region out(env, dst, dstOff, 0);
+    if (!out.ok()) {
+        stats.fail(ENOMEM);
+        return CODEC_NO_MEMORY;
+    }
+
+    size_t result = block_compress((const codec_dict*) jlong_to_ptr(dict),
+        (const uint8_t*) in.get(), (size_t) srcLen, (uint8_t*) out.get(), (size_t) dstCap);
+    NATIVE_PROBE3(block_compress, srcLen, result, dict != 0);
+    return (jint) result;
+}
+
+/*
+ * Class:     mmap_impl_BlockCodec
+ * Method:    decompress0
+ * Signature: (JLjava/lang/Object;JILjava/lang/Object;JIZ)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_BlockCodec_decompress0(JNIEnv* env, jclass,
+  jlong dict,
+  jobject src,
+  jlong srcOff,
+  jint srcLen,
+  jobject dst,
+  jlong dstOff,
+  jint dstCap,
+  jboolean populate) {
+
+    stats_scope stats(OP_BLOCK_DECOMPRESS, (dst == NULL) ? dstOff : 0, srcLen);
+
+    if (populate && dst == NULL) {
+        populate_write(dstOff, dstCap);
+    }
+    pinned_region in(env, src, srcOff, JNI_ABORT);
+    if (!in.ok()) {
+        stats.fail(ENOMEM);
+        return CODEC_NO_MEMORY;
+    }
+    pinned_region out(env, dst, dstOff, 0);
+    if (!out.ok()) {
+        stats.fail(ENOMEM);
+        return CODEC_NO_MEMORY;
+    }
+
+    jint result = block_decompress((const codec_dict*) jlong_to_ptr(dict),
+        (const uint8_t*) in.get(), (size_t) srcLen, (uint8_t*) out.get(), (size_t) dstCap);
+    NATIVE_PROBE3(block_decompress, srcLen, result, dict != 0);
+    if (result < 0) {
+        stats.fail(EINVAL);
+    }
+    return result;
+}
+
+/*
+ * Class:     mmap_impl_BlockCodec
+ * Method:    createDictionary0
+ * Signature: ([BII)J
+ */
+JNIEXPORT jlong JNICALL
+Java_mmap_impl_BlockCodec_createDictionary0(JNIEnv* env, jclass,
+  jbyteArray data,
+  jint offset,
+  jint length) {
+
+    codec_dict* dict = (codec_dict*) calloc(1, sizeof(codec_dict));
+    if (dict == NULL) {
+        return 0;
+    }
+    if (length > DICT_MAX) {
+        offset += length - DICT_MAX;
+        length = DICT_MAX;
+    }
+    /* right-aligned, so that the dictionary ends where the input starts */
+    uint8_t* start = dict->data + (DICT_MAX - length);
+    env->GetByteArrayRegion(data, offset, length, (jbyte*) start);
+    dict->length = (uint32_t) length;
+    for (jint i = 0; i + MIN_MATCH <= length; ++i) {
+        dict->table[hash4(read32(start + i))] = (uint32_t) i;
+    }
+    return (jlong) (intptr_t) dict;
+}
+
+/*
+ * Class:     mmap_impl_BlockCodec
+ * Method:    freeDictionary0
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL
+Java_mmap_impl_BlockCodec_freeDictionary0(JNIEnv*, jclass,
+  jlong dict) {
+
+    free(jlong_to_ptr(dict));
+}
+
+#ifdef __cplusplus
+}
+#endif // #ifdef __cplusplus
@@ -0,0 +1,279 @@
+package mmap.impl;
+
+import java.nio.ByteBuffer;
+
+/**
+ * A native LZ4 compatible block codec (raw LZ4 blocks without frame header).
+ * Compression is greedy and fast; decompression runs at several GB/s per
+ * core and is bounds checked, so malformed input fails with an
+ * {@link IllegalArgumentException} instead of touching foreign memory.
+ * <p>
+ * Source and destination can be Java arrays, heap or direct buffers and
+ * native (e.g. mapped) addresses. Arrays are pinned for the duration of a
+ * call, so very large blocks should be compressed from or into native
+ * memory. A block doesn't store its decompressed length; callers have to
+ * record it themselves (or provide a large enough destination).
+ * <p>
+ * A {@link Dictionary} improves the compression ratio of small blocks
+ * (e.g. single queue records) that share content with a sample. The same
+ * dictionary has to be used for compression and decompression.
+ */
+public final class BlockCodec {
+
+    /**
+     * A prepared, immutable compression dictionary (only its last 64 KiB
+     * are used). A dictionary can be shared by any number of threads but
+     * must not be closed while it is still in use.
+     */
+    public static final class Dictionary implements AutoCloseable {
+        private volatile long handle;
+
+        public Dictionary(byte[] data) {
+            this(data, 0, data.length);
+        }
+
+        public Dictionary(byte[] data, int off, int len) {
+            checkRange(data.length, off, len);
+            handle = createDictionary0(data, off, len);
+            if (handle == 0L) {
+                throw new OutOfMemoryError("Dictionary");
+            }
+        }
+
+        long handle() {
+            long h = handle;
+            if (h == 0L) {
+                throw new IllegalStateException("Dictionary is closed");
+            }
+            return h;
+        }
+
+        @Override
+        public synchronized void close() {
+            long h = handle;
+            if (h != 0L) {
+                handle = 0L;
+                freeDictionary0(h);
+            }
+        }
+    }
+
+    /** The maximum length of the uncompressed input of a single block. */
+    public static final int MAX_INPUT_LENGTH = 0x7E000000;
+
+    /**
+     * Returns the maximum size of a compressed block for the given input
+     * length (incompressible input).
+     *
+     * @param length
+     *            the uncompressed length
+     * @return the size of the worst-case compressed block
+     */
+    public static int maxCompressedLength(int length) {
+        checkInputLength(length);
+        return length + length / 255 + 16;
+    }
+
+    // -- compression (all variants return 0 if the block doesn't fit into dst) --
+
+    public static int compress(byte[] src, int srcOff, int srcLen, byte[] dst, int dstOff, int dstLen) {
+        return compress(src, srcOff, srcLen, dst, dstOff, dstLen, null);
+    }
+
+    public static int compress(byte[] src, int srcOff, int srcLen, byte[] dst, int dstOff, int dstLen,
+            Dictionary dict) {
+        checkRange(src.length, srcOff, srcLen);
+        checkRange(dst.length, dstOff, dstLen);
+        checkInputLength(srcLen);
+        return compress0(handle(dict), src, srcOff, srcLen, dst, dstOff, dstLen);
+    }
+
+    /**
+     * Compresses the remaining bytes of {@code src} into the remaining space
+     * of {@code dst}. On success the position of {@code src} is advanced to
+     * its limit and the position of {@code dst} by the size of the block.
+     * Both buffers may be heap or direct buffers; a read-only heap
+     * {@code src} (which has no accessible array) is copied first.
+     */
+    public static int compress(ByteBuffer src, ByteBuffer dst) {
+        return compress(src, dst, null);
+    }
+
+    public static int compress(ByteBuffer src, ByteBuffer dst, Dictionary dict) {
+        int srcLen = src.remaining();
+        checkInputLength(srcLen);
+        checkWritable(dst);
+        ByteBuffer in = readable(src);
+        int size = compress0(handle(dict), base(in), offset(in), srcLen, base(dst), offset(dst), dst.remaining());
+        if (size > 0) {
+            src.position(src.limit());
+            dst.position(dst.position() + size);
+        }
+        return size;
+    }
+
+    public static int compress(long srcAddr, int srcLen, long dstAddr, int dstLen) {
+        return compress(srcAddr, srcLen, dstAddr, dstLen, null);
+    }
+
+    public static int compress(long srcAddr, int srcLen, long dstAddr, int dstLen, Dictionary dict) {
+        checkInputLength(srcLen);
+        checkLength(dstLen);
+        return compress0(handle(dict), null, srcAddr, srcLen, null, dstAddr, dstLen);
+    }
+
+    // -- decompression (all variants return the decompressed length) --
+
+    public static int decompress(byte[] src, int srcOff, int srcLen, byte[] dst, int dstOff, int dstLen) {
+        return decompress(src, srcOff, srcLen, dst, dstOff, dstLen, null);
+    }
+
+    public static int decompress(byte[] src, int srcOff, int srcLen, byte[] dst, int dstOff, int dstLen,
+            Dictionary dict) {
+        checkRange(src.length, srcOff, srcLen);
+        checkRange(dst.length, dstOff, dstLen);
+        return checkResult(decompress0(handle(dict), src, srcOff, srcLen, dst, dstOff, dstLen, false));
+    }
+
+    /**
+     * Decompresses the remaining bytes of {@code src} (exactly one block)
+     * into the remaining space of {@code dst}. On success the position of
+     * {@code src} is advanced to its limit and the position of {@code dst}
+     * by the decompressed length. A read-only heap {@code src} is copied
+     * first.
+     */
+    public static int decompress(ByteBuffer src, ByteBuffer dst) {
+        return decompress(src, dst, null);
+    }
+
+    public static int decompress(ByteBuffer src, ByteBuffer dst, Dictionary dict) {
+        checkWritable(dst);
+        ByteBuffer in = readable(src);
+        int size = checkResult(decompress0(handle(dict), base(in), offset(in), in.remaining(), base(dst),
+                offset(dst), dst.remaining(), false));
+        src.position(src.limit());
+        dst.position(dst.position() + size);
+        return size;
+    }
+
+    public static int decompress(long srcAddr, int srcLen, long dstAddr, int dstLen) {
+        return decompress(srcAddr, srcLen, dstAddr, dstLen, null);
+    }
+
+    public static int decompress(long srcAddr, int srcLen, long dstAddr, int dstLen, Dictionary dict) {
+        checkLength(srcLen);
+        checkLength(dstLen);
+        return checkResult(decompress0(handle(dict), null, srcAddr, srcLen, null, dstAddr, dstLen, false));
+    }
+
+    /**
+     * Decompresses a block of known decompressed {@code length} into a
+     * writable mapped region. The destination pages are pre-faulted for
+     * writing in a single call (Linux 5.14+) instead of taking one page
+     * fault per page.
+     *
+     * @throws IllegalArgumentException
+     *             if the block is malformed or doesn't decompress to exactly
+     *             {@code length} bytes
+     */
+    public static void decompressToMapped(byte[] src, int srcOff, int srcLen, long dstAddr, int length,
+            Dictionary dict) {
+        checkRange(src.length, srcOff, srcLen);
+        checkLength(length);
+        checkMappedResult(decompress0(handle(dict), src, srcOff, srcLen, null, dstAddr, length, true), length);
+    }
+
+    public static void decompressToMapped(long srcAddr, int srcLen, long dstAddr, int length, Dictionary dict) {
+        checkLength(srcLen);
+        checkLength(length);
+        checkMappedResult(decompress0(handle(dict), null, srcAddr, srcLen, null, dstAddr, length, true), length);
+    }
+
+    // utility methods
+
+    private static long handle(Dictionary dict) {
+        return (dict == null) ? 0L : dict.handle();
+    }
+
+    // the buffer itself or, for a read-only heap buffer, a copy of its remaining bytes
+    private static ByteBuffer readable(ByteBuffer buf) {
+        if (buf.isDirect() || buf.hasArray()) {
+            return buf;
+        }
+        byte[] copy = new byte[buf.remaining()];
+        buf.duplicate().get(copy);
+        return ByteBuffer.wrap(copy);
+    }
+
+    // the array of a heap buffer or null for a direct buffer
+    private static Object base(ByteBuffer buf) {
+        if (buf.isDirect()) {
+            return null;
+        }
+        if (!buf.hasArray()) {
+            throw new IllegalArgumentException("Read-only heap buffer");
+        }
+        return buf.array();
+    }
+
+    // the array offset of a heap buffer or the address of a direct buffer
+    private static long offset(ByteBuffer buf) {
+        if (buf.isDirect()) {
+            return Native.address(buf) + buf.position();
+        }
+        return buf.arrayOffset() + buf.position();
+    }
+
+    private static void checkWritable(ByteBuffer buf) {
+        if (buf.isReadOnly()) {
+            throw new IllegalArgumentException("Read-only destination buffer");
+        }
+    }
+
+    private static void checkRange(int arrayLength, int off, int len) {
+        if ((off | len) < 0 || len > arrayLength - off) {
+            throw new IndexOutOfBoundsException("off: " + off + ", len: " + len + ", length: " + arrayLength);
+        }
+    }
+
+    private static void checkLength(int len) {
+        if (len < 0) {
+            throw new IllegalArgumentException("len: " + len);
+        }
+    }
+
+    private static void checkInputLength(int len) {
+        if (len < 0 || len > MAX_INPUT_LENGTH) {
+            throw new IllegalArgumentException("len: " + len);
+        }
+    }
+
+    private static int checkResult(int size) {
+        if (size < 0) {
+            throw new IllegalArgumentException("Malformed block or destination too small");
+        }
+        return size;
+    }
+
+    private static void checkMappedResult(int size, int length) {
+        if (checkResult(size) != length) {
+            throw new IllegalArgumentException("Block decompressed to " + size + " bytes, expected " + length);
+        }
+    }
+
+    // native methods (array != null: offset is an array index, else an address)
+
+    private static native int compress0(long dict, Object src, long srcOff, int srcLen, Object dst, long dstOff,
+            int dstCap);
+
+    private static native int decompress0(long dict, Object src, long srcOff, int srcLen, Object dst, long dstOff,
+            int dstCap, boolean populate);
+
+    private static native long createDictionary0(byte[] data, int off, int len);
+
+    private static native void freeDictionary0(long dict);
+
+    private BlockCodec() {
+        throw new AssertionError();
+    }
+}
@@ -0,0 +1,248 @@
+
+#ifndef _JAVASOFT_JNI_H_
+#include <jni.h>
+#endif /* _JAVASOFT_JNI_H_ */
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "native_crc32c.h"
+#include "native_region.h"
+#include "native_sdt.h"
+#include "native_stats.h"
+
+#if (defined (__GNUC__) || defined (__clang__)) && defined (__x86_64__)
+#define CRC_SSE42 1
+#include <nmmintrin.h>
+#endif
+
+
+/*
+ * CRC-32C (Castagnoli polynomial, reflected) as used by iSCSI, ext4, Btrfs
+ * and java.util.zip.CRC32C.
+ *
+ * With SSE4.2 the crc32 instruction is run on three independent streams
+ * of CRC_LANE bytes each (the instruction has a latency of 3 cycles but a
+ * throughput of 1), and the three partial CRCs are combined by multiplying
+ * with x^(8 * CRC_LANE) modulo the polynomial. Without SSE4.2 a portable
+ * slicing-by-8 implementation is used.
+ */
+
+#define CRC32C_POLY 0x82f63b78U
+
+/* Bytes per stream of the interleaved SSE4.2 loop */
+#define CRC_LANE 4096
+
+
+static uint32_t crc_table[8][256];
+
+/* x^(2^n) mod P for n = 0..31 */
+static uint32_t x2n_table[32];
+
+/* x^(8 * CRC_LANE) and x^(16 * CRC_LANE) mod P */
+static uint32_t shift_lane;
+static uint32_t shift_2lane;
+
+
+/* a * b mod P (both in reflected bit order, a != 0) */
+static uint32_t multmodp(uint32_t a, uint32_t b) {
+    uint32_t m = 1U << 31;
+    uint32_t p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return p;
+}
+
+/* x^(n * 2^k) mod P */
+static uint32_t x2nmodp(size_t n, unsigned k) {
+    uint32_t p = 1U << 31; /* x^0 */
+    while (n) {
+        if (n & 1) {
+            p = multmodp(x2n_table[k & 31], p);
+        }
+        n >>= 1;
+        k++;
+    }
+    return p;
+}
+
+static int init_tables() {
+    for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; ++k) {
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        }
+        crc_table[0][n] = c;
+    }
+    for (uint32_t n = 0; n < 256; ++n) {
+        for (int k = 1; k < 8; ++k) {
+            uint32_t c = crc_table[k - 1][n];
+            crc_table[k][n] = (c >> 8) ^ crc_table[0][c & 0xff];
+        }
+    }
+    uint32_t p = 1U << 30; /* x^1 */
+    x2n_table[0] = p;
+    for (int n = 1; n < 32; ++n) {
+        x2n_table[n] = p = multmodp(p, p);
+    }
+    shift_lane = x2nmodp(CRC_LANE, 3);
+    shift_2lane = x2nmodp(2 * CRC_LANE, 3);
+#if defined (CRC_SSE42)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2") ? 1 : 0;
+#else
+    return 0;
+#endif
+}
+
+static const int use_hardware = init_tables();
+
+
+static inline uint64_t load_le64(const uint8_t* p) {
+    //@formatter:off
+    return  (uint64_t) p[0]
+         | ((uint64_t) p[1] << 8)
+         | ((uint64_t) p[2] << 16)
+         | ((uint64_t) p[3] << 24)
+         | ((uint64_t) p[4] << 32)
+         | ((uint64_t) p[5] << 40)
+         | ((uint64_t) p[6] << 48)
+         | ((uint64_t) p[7] << 56);
+    //@formatter:on
+}
+
+/* crc is the raw (not inverted) register in both implementations */
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t* p, size_t n) {
+    while (n != 0 && ((uintptr_t) p & 7) != 0) {
+        crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        n--;
+    }
+    while (n >= 8) {
+        uint64_t w = load_le64(p) ^ crc;
+        crc = crc_table[7][w & 0xff]
+            ^ crc_table[6][(w >> 8) & 0xff]
+            ^ crc_table[5][(w >> 16) & 0xff]
+            ^ crc_table[4][(w >> 24) & 0xff]
+            ^ crc_table[3][(w >> 32) & 0xff]
+            ^ crc_table[2][(w >> 40) & 0xff]
+            ^ crc_table[1][(w >> 48) & 0xff]
+            ^ crc_table[0][w >> 56];
+        p += 8;
+        n -= 8;
+    }
+    while (n != 0) {
+        crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        n--;
+    }
+    return crc;
+}
+
+#if defined (CRC_SSE42)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t* p, size_t n) {
+    while (n != 0 && ((uintptr_t) p & 7) != 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+        n--;
+    }
+    uint64_t c0 = crc;
+    while (n >= 3 * CRC_LANE) {
+        uint64_t c1 = 0;
+        uint64_t c2 = 0;
+        const uint8_t* end = p + CRC_LANE;
+        do {
+            uint64_t w0;
+            uint64_t w1;
+            uint64_t w2;
+            memcpy(&w0, p, 8);
+            memcpy(&w1, p + CRC_LANE, 8);
+            memcpy(&w2, p + 2 * CRC_LANE, 8);
+            c0 = _mm_crc32_u64(c0, w0);
+            c1 = _mm_crc32_u64(c1, w1);
+            c2 = _mm_crc32_u64(c2, w2);
+            p += 8;
+        } while (p < end);
+        c0 = multmodp(shift_2lane, (uint32_t) c0) ^ multmodp(shift_lane, (uint32_t) c1) ^ (uint32_t) c2;
+        p += 2 * CRC_LANE;
+        n -= 3 * CRC_LANE;
+    }
+    while (n >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        c0 = _mm_crc32_u64(c0, w);
+        p += 8;
+        n -= 8;
+    }
+    crc = (uint32_t) c0;
+    while (n != 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+        n--;
+    }
+    return crc;
+}
+#endif
+
+
+uint32_t crc32c_update(uint32_t crc, const void* p, size_t n) {
+    crc = ~crc;
+#if defined (CRC_SSE42)
+    if (use_hardware) {
+        return ~crc32c_hw(crc, (const uint8_t*) p, n);
+    }
+#endif
+    return ~crc32c_sw(crc, (const uint8_t*) p, n);
+}
+
+int crc32c_hardware() {
+    return use_hardware;
+}
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Class:     mmap_impl_Crc32C
+ * Method:    update0
+ * Signature: (ILjava/lang/Object;JJ)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_Crc32C_update0(JNIEnv* env, jclass,
+  jint crc,
+  jobject base,
+  jlong offset,
+  jlong length) {
+
+    stats_scope stats(OP_CRC32C, (base == NULL) ? offset : 0, length);
+
+    pinned_region in(env, base, offset, JNI_ABORT);
+    if (!in.ok()) {
+        stats.fail(ENOMEM);
+        return crc;
+    }
+    return (jint) crc32c_update((uint32_t) crc, in.get(), (size_t) length);
+}
+
+/*
+ * Class:     mmap_impl_Crc32C
+ * Method:    isHardware0
+ * Signature: ()Z
+ */
+JNIEXPORT jboolean JNICALL
+Java_mmap_impl_Crc32C_isHardware0(JNIEnv*, jclass) {
+    return use_hardware ? JNI_TRUE : JNI_FALSE;
+}
+
+#ifdef __cplusplus
+}
+#endif // #ifdef __cplusplus
@@ -0,0 +1,158 @@
+package mmap.impl;
+
+import java.nio.ByteBuffer;
+
+import sun.misc.Unsafe;
+
+/**
+ * Native CRC-32C (Castagnoli) checksums, bit-compatible with
+ * {@code java.util.zip.CRC32C} which isn't available on Java 8. Uses the
+ * SSE4.2 {@code crc32} instruction on three interleaved streams where
+ * available and a table-driven implementation otherwise. Without the
+ * native library (see {@link #isAvailable()}) a table-driven Java
+ * implementation computes the same checksums.
+ * <p>
+ * Checksums can be chained:
+ * {@code update(update(0, a, 0, a.length), b, 0, b.length)} is the
+ * checksum of {@code a} followed by {@code b}.
+ */
+public final class Crc32C {
+
+    /**
+     * Returns {@code true} if the native implementation is used (the library
+     * is loaded and {@code -Dmmap.impl.crc32c=false} isn't set).
+     */
+    public static boolean isAvailable() {
+        return AVAILABLE;
+    }
+
+    public static int compute(byte[] b, int off, int len) {
+        return update(0, b, off, len);
+    }
+
+    public static int update(int crc, byte[] b, int off, int len) {
+        checkRange(b.length, off, len);
+        if (len == 0) {
+            return crc;
+        }
+        return AVAILABLE ? update0(crc, b, off, len) : updateJava(crc, b, off, len);
+    }
+
+    /**
+     * Continues {@code crc} over {@code length} bytes of native (e.g. mapped)
+     * memory at {@code address}.
+     */
+    public static int update(int crc, long address, long length) {
+        if (length < 0L) {
+            throw new IllegalArgumentException("length: " + length);
+        }
+        if (length == 0L) {
+            return crc;
+        }
+        return AVAILABLE ? update0(crc, null, address, length) : updateJava(crc, address, length);
+    }
+
+    /**
+     * Continues {@code crc} over the remaining bytes of {@code buf} and
+     * advances its position to the limit.
+     */
+    public static int update(int crc, ByteBuffer buf) {
+        int pos = buf.position();
+        int len = buf.remaining();
+        if (buf.isDirect()) {
+            crc = update(crc, Native.address(buf) + pos, len);
+        } else if (buf.hasArray()) {
+            crc = update(crc, buf.array(), buf.arrayOffset() + pos, len);
+        } else {
+            byte[] b = new byte[len];
+            buf.duplicate().get(b);
+            crc = update(crc, b, 0, len);
+        }
+        buf.position(pos + len);
+        return crc;
+    }
+
+    public static boolean isHardwareAccelerated() {
+        return AVAILABLE && isHardware0();
+    }
+
+    // the Java implementation (slicing-by-8, the crc is kept inverted like in the native code)
+
+    private static int updateJava(int crc, byte[] b, int off, int len) {
+        final int[][] t = TABLE;
+        int c = ~crc;
+        int end = off + len;
+        for (; off <= end - 8; off += 8) {
+            int lo = c ^ ((b[off] & 0xff) | (b[off + 1] & 0xff) << 8 | (b[off + 2] & 0xff) << 16 | b[off + 3] << 24);
+            c = t[7][lo & 0xff] ^ t[6][(lo >>> 8) & 0xff] ^ t[5][(lo >>> 16) & 0xff] ^ t[4][lo >>> 24]
+                    ^ t[3][b[off + 4] & 0xff] ^ t[2][b[off + 5] & 0xff] ^ t[1][b[off + 6] & 0xff]
+                    ^ t[0][b[off + 7] & 0xff];
+        }
+        for (; off < end; ++off) {
+            c = (c >>> 8) ^ t[0][(c ^ b[off]) & 0xff];
+        }
+        return ~c;
+    }
+
+    private static int updateJava(int crc, long address, long length) {
+        final int[] t = TABLE[0];
+        final Unsafe unsafe = Native.unsafe();
+        int c = ~crc;
+        for (long end = address + length; address < end; ++address) {
+            c = (c >>> 8) ^ t[(c ^ unsafe.getByte(address)) & 0xff];
+        }
+        return ~c;
+    }
+
+    private static int[][] table() {
+        int[][] t = new int[8][256];
+        for (int i = 0; i < 256; ++i) {
+            int c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c >>> 1) ^ (POLY & -(c & 1));
+            }
+            t[0][i] = c;
+        }
+        for (int i = 0; i < 256; ++i) {
+            for (int k = 1; k < 8; ++k) {
+                t[k][i] = (t[k - 1][i] >>> 8) ^ t[0][t[k - 1][i] & 0xff];
+            }
+        }
+        return t;
+    }
+
+    private static void checkRange(int arrayLength, int off, int len) {
+        if ((off | len) < 0 || len > arrayLength - off) {
+            throw new IndexOutOfBoundsException("off: " + off + ", len: " + len + ", length: " + arrayLength);
+        }
+    }
+
+    // native methods (base != null: offset is a byte offset into the array, else an address)
+
+    private static native int update0(int crc, Object base, long offset, long length);
+
+    private static native boolean isHardware0();
+
+    private static boolean available() {
+        if (!Boolean.parseBoolean(System.getProperty("mmap.impl.crc32c", "true"))) {
+            return false;
+        }
+        try {
+            isHardware0();
+            return true;
+        } catch (UnsatisfiedLinkError e) {
+            return false;
+        }
+    }
+
+    /* The reflected Castagnoli polynomial */
+    private static final int POLY = 0x82f63b78;
+
+    private static final int[][] TABLE = table();
+
+    private static final boolean AVAILABLE = available();
+
+    private Crc32C() {
+        throw new AssertionError();
+    }
+}
@@ -0,0 +1,630 @@
+
+#ifndef _JAVASOFT_JNI_H_
+#include <jni.h>
+#endif /* _JAVASOFT_JNI_H_ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "native_region.h"
+#include "native_sdt.h"
+#include "native_stats.h"
+
+#if (defined (__GNUC__) || defined (__clang__)) && defined (__x86_64__)
+#define DICT_SIMD 1
+#include <immintrin.h>
+#if !defined (__clang__)
+/* GCC's AVX-512 intrinsics use self-initialized "undefined" vectors */
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#endif
+
+
+/*
+ * Dictionary encoding of low-cardinality columns: every value is replaced
+ * by an 8 or 16 bit code (native byte order) into a dictionary of distinct
+ * 4 or 8 byte values.
+ *
+ * Decoding and predicate evaluation are dispatched at runtime to scalar,
+ * AVX2 or AVX-512 kernels. The SIMD kernels are compiled with target
+ * attributes, so the library still runs on CPUs without AVX2. Codes that
+ * are out of the dictionary's range are clamped before the lookup (no
+ * out-of-bounds reads) and reported as an error.
+ */
+
+#define DICT_BAD_CODE   (-1)
+#define DICT_TOO_MANY   (-1)
+#define DICT_NO_MEMORY  (-2)
+
+/* Dispatch levels (same numbering as DictionaryCodec.isaLevel()) */
+#define ISA_SCALAR  0
+#define ISA_AVX2    1
+#define ISA_AVX512  2
+
+/* Kernel ids reported by the dispatch probe */
+#define KERNEL_SCALAR           0
+#define KERNEL_AVX2_GATHER      1
+#define KERNEL_AVX512_GATHER    2
+#define KERNEL_AVX512_PERMUTE   3
+#define KERNEL_AVX2_COMPARE     4
+#define KERNEL_AVX512_COMPARE   5
+
+
+static int detect_isa() {
+#if defined (DICT_SIMD)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+        return ISA_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return ISA_AVX2;
+    }
+#endif
+    return ISA_SCALAR;
+}
+
+static const int isa_supported = detect_isa();
+static int isa_level = isa_supported;
+
+
+/* -- decode -- */
+
+template <typename C, typename V>
+static bool decode_scalar(const C* codes, size_t n, const V* dict, uint32_t dictSize, V* out) {
+    bool ok = true;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t c = codes[i];
+        if (c >= dictSize) {
+            ok = false;
+            c = 0;
+        }
+        out[i] = dict[c];
+    }
+    return ok;
+}
+
+#if defined (DICT_SIMD)
+
+/* widens 8 codes to 32 bit lanes */
+template <typename C>
+__attribute__((target("avx2")))
+static inline __m256i widen8_avx2(const C* codes) {
+    if (sizeof(C) == 1) {
+        return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) codes));
+    }
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) codes));
+}
+
+/* widens 4 codes to 32 bit lanes */
+template <typename C>
+__attribute__((target("avx2")))
+static inline __m128i widen4_avx2(const C* codes) {
+    if (sizeof(C) == 1) {
+        uint32_t v;
+        memcpy(&v, codes, 4);
+        return _mm_cvtepu8_epi32(_mm_cvtsi32_si128((int) v));
+    }
+    return _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*) codes));
+}
+
+template <typename C>
+__attribute__((target("avx2")))
+static bool decode32_avx2(const C* codes, size_t n, const uint32_t* dict, uint32_t dictSize, uint32_t* out) {
+    const __m256i max = _mm256_set1_epi32((int) (dictSize - 1));
+    __m256i bad = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i idx = widen8_avx2(codes + i);
+        bad = _mm256_or_si256(bad, _mm256_cmpgt_epi32(idx, max));
+        idx = _mm256_min_epu32(idx, max);
+        __m256i v = _mm256_i32gather_epi32((const int*) dict, idx, 4);
+        _mm256_storeu_si256((__m256i*) (out + i), v);
+    }
+    bool ok = _mm256_testz_si256(bad, bad) != 0;
+    return decode_scalar(codes + i, n - i, dict, dictSize, out + i) && ok;
+}
+
+template <typename C>
+__attribute__((target("avx2")))
+static bool decode64_avx2(const C* codes, size_t n, const uint64_t* dict, uint32_t dictSize, uint64_t* out) {
+    const __m128i max = _mm_set1_epi32((int) (dictSize - 1));
+    __m128i bad = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i idx = widen4_avx2(codes + i);
+        bad = _mm_or_si128(bad, _mm_cmpgt_epi32(idx, max));
+        idx = _mm_min_epu32(idx, max);
+        __m256i v = _mm256_i32gather_epi64((const long long*) dict, idx, 8);
+        _mm256_storeu_si256((__m256i*) (out + i), v);
+    }
+    bool ok = _mm_testz_si128(bad, bad) != 0;
+    return decode_scalar(codes + i, n - i, dict, dictSize, out + i) && ok;
+}
+
+/*
+ * AVX-512: dictionaries that fit into one or two registers (up to 32 ints
+ * or 16 longs) are looked up with in-register permutes (vpermd / vpermt2d,
+ * vpermq / vpermt2q) instead of gathers.
+ */
+template <typename C>
+__attribute__((target("avx512f,avx512bw")))
+static bool decode32_avx512(const C* codes, size_t n, const uint32_t* dict, uint32_t dictSize, uint32_t* out,
+        bool permute) {
+    const __m512i max = _mm512_set1_epi32((int) (dictSize - 1));
+    __mmask16 bad = 0;
+    uint32_t table[32] = { 0 };
+    if (permute) {
+        memcpy(table, dict, dictSize * sizeof(uint32_t));
+    }
+    const __m512i t0 = _mm512_loadu_si512(table);
+    const __m512i t1 = _mm512_loadu_si512(table + 16);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i idx;
+        if (sizeof(C) == 1) {
+            idx = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*) (codes + i)));
+        } else {
+            idx = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*) (codes + i)));
+        }
+        bad |= _mm512_cmpgt_epu32_mask(idx, max);
+        idx = _mm512_min_epu32(idx, max);
+        __m512i v;
+        if (permute) {
+            v = _mm512_permutex2var_epi32(t0, idx, t1);
+        } else {
+            v = _mm512_i32gather_epi32(idx, (const void*) dict, 4);
+        }
+        _mm512_storeu_si512(out + i, v);
+    }
+    return decode_scalar(codes + i, n - i, dict, dictSize, out + i) && bad == 0;
+}
+
+template <typename C>
+__attribute__((target("avx512f,avx512bw")))
+static bool decode64_avx512(const C* codes, size_t n, const uint64_t* dict, uint32_t dictSize, uint64_t* out,
+        bool permute) {
+    const __m256i max = _mm256_set1_epi32((int) (dictSize - 1));
+    __m256i bad = _mm256_setzero_si256();
+    uint64_t table[16] = { 0 };
+    if (permute) {
+        memcpy(table, dict, dictSize * sizeof(uint64_t));
+    }
+    const __m512i t0 = _mm512_loadu_si512(table);
+    const __m512i t1 = _mm512_loadu_si512(table + 8);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i idx = widen8_avx2(codes + i);
+        bad = _mm256_or_si256(bad, _mm256_cmpgt_epi32(idx, max));
+        idx = _mm256_min_epu32(idx, max);
+        __m512i v;
+        if (permute) {
+            v = _mm512_permutex2var_epi64(t0, _mm512_cvtepu32_epi64(idx), t1);
+        } else {
+            v = _mm512_i32gather_epi64(idx, (const void*) dict, 8);
+        }
+        _mm512_storeu_si512(out + i, v);
+    }
+    bool ok = _mm256_testz_si256(bad, bad) != 0;
+    return decode_scalar(codes + i, n - i, dict, dictSize, out + i) && ok;
+}
+
+#endif /* DICT_SIMD */
+
+template <typename C>
+static bool decode_codes(const C* codes, size_t n, const void* dict, uint32_t dictSize, int valueSize, void* out,
+        int* kernel) {
+#if defined (DICT_SIMD)
+    if (isa_level >= ISA_AVX512) {
+        if (valueSize == 4) {
+            bool permute = dictSize <= 32;
+            *kernel = permute ? KERNEL_AVX512_PERMUTE : KERNEL_AVX512_GATHER;
+            return decode32_avx512(codes, n, (const uint32_t*) dict, dictSize, (uint32_t*) out, permute);
+        }
+        bool permute = dictSize <= 16;
+        *kernel = permute ? KERNEL_AVX512_PERMUTE : KERNEL_AVX512_GATHER;
+        return decode64_avx512(codes, n, (const uint64_t*) dict, dictSize, (uint64_t*) out, permute);
+    }
+    if (isa_level >= ISA_AVX2) {
+        *kernel = KERNEL_AVX2_GATHER;
+        if (valueSize == 4) {
+            return decode32_avx2(codes, n, (const uint32_t*) dict, dictSize, (uint32_t*) out);
+        }
+        return decode64_avx2(codes, n, (const uint64_t*) dict, dictSize, (uint64_t*) out);
+    }
+#endif
+    *kernel = KERNEL_SCALAR;
+    if (valueSize == 4) {
+        return decode_scalar(codes, n, (const uint32_t*) dict, dictSize, (uint32_t*) out);
+    }
+    return decode_scalar(codes, n, (const uint64_t*) dict, dictSize, (uint64_t*) out);
+}
+
+
+/* -- predicates (IN-list of codes to bitmap) -- */
+
+/* Sets bit i of the bitmap for every code contained in the set */
+template <typename C>
+static size_t match_scalar(const C* codes, size_t begin, size_t n, const uint64_t* set, uint64_t* bitmap) {
+    size_t matches = 0;
+    for (size_t i = begin; i < n; ++i) {
+        uint32_t c = codes[i];
+        uint64_t bit = (set[c >> 6] >> (c & 63)) & 1;
+        bitmap[i >> 6] |= bit << (i & 63);
+        matches += (size_t) bit;
+    }
+    return matches;
+}
+
+/* SIMD compares are used for IN-lists of up to this many codes */
+#define MATCH_SIMD_MAX 8
+
+#if defined (DICT_SIMD)
+
+template <typename C>
+__attribute__((target("avx2,popcnt")))
+static size_t match_avx2(const C* codes, size_t n, const uint32_t* targets, int count, uint64_t* bitmap,
+        size_t* done) {
+    __m256i t[MATCH_SIMD_MAX];
+    for (int k = 0; k < count; ++k) {
+        t[k] = (sizeof(C) == 1) ? _mm256_set1_epi8((char) targets[k]) : _mm256_set1_epi16((short) targets[k]);
+    }
+    uint32_t* words = (uint32_t*) bitmap; /* little-endian: 2 words per long */
+    size_t matches = 0;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        uint32_t mask;
+        if (sizeof(C) == 1) {
+            __m256i v = _mm256_loadu_si256((const __m256i*) (codes + i));
+            __m256i m = _mm256_setzero_si256();
+            for (int k = 0; k < count; ++k) {
+                m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, t[k]));
+            }
+            mask = (uint32_t) _mm256_movemask_epi8(m);
+        } else {
+            __m256i v0 = _mm256_loadu_si256((const __m256i*) (codes + i));
+            __m256i v1 = _mm256_loadu_si256((const __m256i*) (codes + i + 16));
+            __m256i m0 = _mm256_setzero_si256();
+            __m256i m1 = _mm256_setzero_si256();
+            for (int k = 0; k < count; ++k) {
+                m0 = _mm256_or_si256(m0, _mm256_cmpeq_epi16(v0, t[k]));
+                m1 = _mm256_or_si256(m1, _mm256_cmpeq_epi16(v1, t[k]));
+            }
+            /* 16 bit lanes to bytes, packs interleaves the 128 bit halves */
+            __m256i m = _mm256_permute4x64_epi64(_mm256_packs_epi16(m0, m1), 0xd8);
+            mask = (uint32_t) _mm256_movemask_epi8(m);
+        }
+        words[i >> 5] = mask;
+        matches += (size_t) _mm_popcnt_u32(mask);
+    }
+    *done = i;
+    return matches;
+}
+
+template <typename C>
+__attribute__((target("avx512f,avx512bw,popcnt")))
+static size_t match_avx512(const C* codes, size_t n, const uint32_t* targets, int count, uint64_t* bitmap,
+        size_t* done) {
+    __m512i t[MATCH_SIMD_MAX];
+    for (int k = 0; k < count; ++k) {
+        t[k] = (sizeof(C) == 1) ? _mm512_set1_epi8((char) targets[k]) : _mm512_set1_epi16((short) targets[k]);
+    }
+    size_t matches = 0;
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        uint64_t mask = 0;
+        if (sizeof(C) == 1) {
+            __m512i v = _mm512_loadu_si512(codes + i);
+            for (int k = 0; k < count; ++k) {
+                mask |= _mm512_cmpeq_epi8_mask(v, t[k]);
+            }
+        } else {
+            __m512i v0 = _mm512_loadu_si512(codes + i);
+            __m512i v1 = _mm512_loadu_si512(codes + i + 32);
+            uint32_t lo = 0;
+            uint32_t hi = 0;
+            for (int k = 0; k < count; ++k) {
+                lo |= _mm512_cmpeq_epi16_mask(v0, t[k]);
+                hi |= _mm512_cmpeq_epi16_mask(v1, t[k]);
+            }
+            mask = ((uint64_t) hi << 32) | lo;
+        }
+        bitmap[i >> 6] = mask;
+        matches += (size_t) _mm_popcnt_u64(mask);
+    }
+    *done = i;
+    return matches;
+}
+
+#endif /* DICT_SIMD */
+
+/*
+ * Evaluates "code IN (targets)" into the (zeroed) bitmap and returns the
+ * number of matches. The targets are given as a set (bitmap over all codes)
+ * and, for short lists, as an array for the SIMD compares.
+ */
+template <typename C>
+static size_t match_codes(const C* codes, size_t n, const uint64_t* set, const uint32_t* targets, int count,
+        uint64_t* bitmap, int* kernel) {
+    size_t done = 0;
+    size_t matches = 0;
+    *kernel = KERNEL_SCALAR;
+#if defined (DICT_SIMD)
+    if (count <= MATCH_SIMD_MAX) {
+        if (isa_level >= ISA_AVX512) {
+            *kernel = KERNEL_AVX512_COMPARE;
+            matches = match_avx512(codes, n, targets, count, bitmap, &done);
+        } else if (isa_level >= ISA_AVX2) {
+            *kernel = KERNEL_AVX2_COMPARE;
+            matches = match_avx2(codes, n, targets, count, bitmap, &done);
+        }
+    }
+#endif
+    return matches + match_scalar(codes, done, n, set, bitmap);
+}
+
+
+/* -- encode -- */
+
+static inline uint64_t load_value(const uint8_t* p, size_t i, int valueSize) {
+    if (valueSize == 4) {
+        uint32_t v;
+        memcpy(&v, p + 4 * i, 4);
+        return v;
+    }
+    uint64_t v;
+    memcpy(&v, p + 8 * i, 8);
+    return v;
+}
+
+static inline void store_value(uint8_t* p, size_t i, int valueSize, uint64_t v) {
+    if (valueSize == 4) {
+        uint32_t w = (uint32_t) v;
+        memcpy(p + 4 * i, &w, 4);
+    } else {
+        memcpy(p + 8 * i, &v, 8);
+    }
+}
+
+/*
+ * Builds the dictionary (in order of first occurrence) with an open
+ * addressing hash table and writes the codes. Returns the dictionary size
+ * or DICT_TOO_MANY if there are more than maxSize distinct values.
+ */
+static jint dict_encode(const uint8_t* src, size_t n, int valueSize, uint8_t* dict, uint32_t maxSize,
+        uint8_t* codes, int width, uint32_t* table, uint32_t mask) {
+    uint32_t size = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t v = load_value(src, i, valueSize);
+        uint32_t h = (uint32_t) ((v * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+        uint32_t code;
+        for (;;) {
+            uint32_t e = table[h];
+            if (e == 0) {
+                if (size == maxSize) {
+                    return DICT_TOO_MANY;
+                }
+                code = size++;
+                store_value(dict, code, valueSize, v);
+                table[h] = code + 1;
+                break;
+            }
+            if (load_value(dict, e - 1, valueSize) == v) {
+                code = e - 1;
+                break;
+            }
+            h = (h + 1) & mask;
+        }
+        if (width == 1) {
+            codes[i] = (uint8_t) code;
+        } else {
+            uint16_t c = (uint16_t) code;
+            memcpy(codes + 2 * i, &c, 2);
+        }
+    }
+    return (jint) size;
+}
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Class:     mmap_impl_DictionaryCodec
+ * Method:    encode0
+ * Signature: (Ljava/lang/Object;JIILjava/lang/Object;ILjava/lang/Object;JI)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_DictionaryCodec_encode0(JNIEnv* env, jclass,
+  jobject src,
+  jlong srcOff,
+  jint count,
+  jint valueSize,
+  jobject dict,
+  jint dictCap,
+  jobject codes,
+  jlong codesOff,
+  jint width) {
+
+    stats_scope stats(OP_DICT_ENCODE, (codes == NULL) ? codesOff : 0, (jlong) count * valueSize);
+
+    uint32_t maxSize = (uint32_t) dictCap;
+    if (maxSize > (1U << (8 * width))) {
+        maxSize = 1U << (8 * width);
+    }
+    uint32_t slots = 2;
+    while (slots < 2 * maxSize) {
+        slots <<= 1;
+    }
+    uint32_t* table = (uint32_t*) calloc(slots, sizeof(uint32_t));
+    if (table == NULL) {
+        stats.fail(ENOMEM);
+        return DICT_NO_MEMORY;
+    }
+
+    jint result = DICT_NO_MEMORY;
+    pinned_region in(env, src, srcOff, JNI_ABORT);
+    if (in.ok()) {
+        pinned_region d(env, dict, 0, 0);
+        if (d.ok()) {
+            pinned_region out(env, codes, codesOff, 0);
+            if (out.ok()) {
+                result = dict_encode((const uint8_t*) in.get(), (size_t) count, valueSize, (uint8_t*) d.get(),
+                    maxSize, (uint8_t*) out.get(), width, table, slots - 1);
+            }
+        }
+    }
+    free(table);
+    if (result == DICT_NO_MEMORY) {
+        stats.fail(ENOMEM);
+    }
+    NATIVE_PROBE3(dict_encode, count, valueSize, result);
+    return result;
+}
+
+/*
+ * Class:     mmap_impl_DictionaryCodec
+ * Method:    decode0
+ * Signature: (Ljava/lang/Object;JIILjava/lang/Object;IILjava/lang/Object;J)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_DictionaryCodec_decode0(JNIEnv* env, jclass,
+  jobject codes,
+  jlong codesOff,
+  jint count,
+  jint width,
+  jobject dict,
+  jint dictSize,
+  jint valueSize,
+  jobject dst,
+  jlong dstOff) {
+
+    stats_scope stats(OP_DICT_DECODE, (codes == NULL) ? codesOff : 0, (jlong) count * valueSize);
+
+    if (dictSize <= 0) {
+        if (count > 0) {
+            stats.fail(EINVAL);
+            return DICT_BAD_CODE;
+        }
+        return 0;
+    }
+    pinned_region in(env, codes, codesOff, JNI_ABORT);
+    if (!in.ok()) {
+        stats.fail(ENOMEM);
+        return DICT_NO_MEMORY;
+    }
+    pinned_region d(env, dict, 0, JNI_ABORT);
+    if (!d.ok()) {
+        stats.fail(ENOMEM);
+        return DICT_NO_MEMORY;
+    }
+    pinned_region out(env, dst, dstOff, 0);
+    if (!out.ok()) {
+        stats.fail(ENOMEM);
+        return DICT_NO_MEMORY;
+    }
+
+    int kernel;
+    bool ok;
+    if (width == 1) {
+        ok = decode_codes((const uint8_t*) in.get(), (size_t) count, d.get(), (uint32_t) dictSize, valueSize,
+            out.get(), &kernel);
+    } else {
+        ok = decode_codes((const uint16_t*) in.get(), (size_t) count, d.get(), (uint32_t) dictSize, valueSize,
+            out.get(), &kernel);
+    }
+    NATIVE_PROBE3(dispatch, OP_DICT_DECODE, kernel, count);
+    if (!ok) {
+        stats.fail(EINVAL);
+        return DICT_BAD_CODE;
+    }
+    return 0;
+}
+
+/*
+ * Class:     mmap_impl_DictionaryCodec
+ * Method:    match0
+ * Signature: (Ljava/lang/Object;JII[II[J)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_DictionaryCodec_match0(JNIEnv* env, jclass,
+  jobject codes,
+  jlong codesOff,
+  jint count,
+  jint width,
+  jintArray targets,
+  jint targetCount,
+  jlongArray bitmap) {
+
+    stats_scope stats(OP_DICT_MATCH, (codes == NULL) ? codesOff : 0, (jlong) count * width);
+
+    /* the set of target codes, as bitmap over all 2^(8 * width) codes */
+    size_t setWords = (width == 1) ? 4 : 1024;
+    uint64_t* set = (uint64_t*) calloc(setWords, sizeof(uint64_t));
+    uint32_t* list = (uint32_t*) malloc((targetCount > 0 ? targetCount : 1) * sizeof(uint32_t));
+    if (set == NULL || list == NULL) {
+        free(set);
+        free(list);
+        stats.fail(ENOMEM);
+        return DICT_NO_MEMORY;
+    }
+    env->GetIntArrayRegion(targets, 0, targetCount, (jint*) list);
+    uint32_t codeMask = (width == 1) ? 0xff : 0xffff;
+    int distinct = 0;
+    for (jint k = 0; k < targetCount; ++k) {
+        uint32_t c = list[k];
+        if (c > codeMask) {
+            continue; /* can't match */
+        }
+        if ((set[c >> 6] & (1ULL << (c & 63))) == 0) {
+            set[c >> 6] |= 1ULL << (c & 63);
+            list[distinct++] = c;
+        }
+    }
+
+    jint result = DICT_NO_MEMORY;
+    int kernel = KERNEL_SCALAR;
+    pinned_region in(env, codes, codesOff, JNI_ABORT);
+    if (in.ok()) {
+        pinned_region out(env, bitmap, 0, 0);
+        if (out.ok()) {
+            uint64_t* bits = (uint64_t*) out.get();
+            memset(bits, 0, (((size_t) count + 63) >> 6) * sizeof(uint64_t));
+            size_t matches;
+            if (width == 1) {
+                matches = match_codes((const uint8_t*) in.get(), (size_t) count, set, list, distinct, bits, &kernel);
+            } else {
+                matches = match_codes((const uint16_t*) in.get(), (size_t) count, set, list, distinct, bits, &kernel);
+            }
+            result = (jint) matches;
+        }
+    }
+    free(set);
+    free(list);
+    NATIVE_PROBE3(dispatch, OP_DICT_MATCH, kernel, count);
+    if (result < 0) {
+        stats.fail(ENOMEM);
+    }
+    return result;
+}
+
+/*
+ * Class:     mmap_impl_DictionaryCodec
+ * Method:    setIsaLevel0
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_DictionaryCodec_setIsaLevel0(JNIEnv*, jclass,
+  jint level) {
+
+    isa_level = (level < isa_supported) ? (level < ISA_SCALAR ? ISA_SCALAR : level) : isa_supported;
+    NATIVE_PROBE3(dispatch, -1, isa_level, isa_supported);
+    return isa_level;
+}
+
+#ifdef __cplusplus
+}
+#endif // #ifdef __cplusplus
@@ -0,0 +1,267 @@
+package mmap.impl;
+
+/**
+ * Native dictionary encoding of low-cardinality columns. Every value of a
+ * column is replaced by an 8 bit (up to 256 distinct values) or 16 bit (up
+ * to 65536 distinct values) code into a dictionary of the distinct values.
+ * Codes are stored in native byte order, either in a {@code byte[]} or in
+ * native (e.g. mapped) memory.
+ * <p>
+ * Decoding gathers the values of the codes straight into Java arrays.
+ * Predicates ({@code column = x}, {@code column IN (x, y, ...)}) are
+ * evaluated on the codes and produce a bitmap (in the layout of
+ * {@link java.util.BitSet#valueOf(long[])}), so filters never materialize
+ * values. Both are dispatched at runtime to AVX-512, AVX2 or scalar kernels;
+ * the system property {@code mmap.impl.dictionary.isa} ({@code scalar},
+ * {@code avx2}) caps the level.
+ * <p>
+ * {@code double} values are compared by their bit patterns.
+ */
+public final class DictionaryCodec {
+
+    /** The maximum number of distinct values (with 16 bit codes). */
+    public static final int MAX_CARDINALITY = 65536;
+
+    // -- encode (returns the dictionary size, or -1 if the column has more
+    // distinct values than dict.length or the code width allows) --
+
+    public static int encode(int[] src, int srcOff, int count, int[] dict, byte[] codes, int codesOff,
+            int codeWidth) {
+        checkRange(src.length, srcOff, count);
+        checkCodes(codes, codesOff, count, codeWidth);
+        return checkEncoded(encode0(src, (long) srcOff * 4L, count, 4, dict, dict.length, codes, codesOff, codeWidth));
+    }
+
+    public static int encode(long[] src, int srcOff, int count, long[] dict, byte[] codes, int codesOff,
+            int codeWidth) {
+        checkRange(src.length, srcOff, count);
+        checkCodes(codes, codesOff, count, codeWidth);
+        return checkEncoded(encode0(src, (long) srcOff * 8L, count, 8, dict, dict.length, codes, codesOff, codeWidth));
+    }
+
+    public static int encode(double[] src, int srcOff, int count, double[] dict, byte[] codes, int codesOff,
+            int codeWidth) {
+        checkRange(src.length, srcOff, count);
+        checkCodes(codes, codesOff, count, codeWidth);
+        return checkEncoded(encode0(src, (long) srcOff * 8L, count, 8, dict, dict.length, codes, codesOff, codeWidth));
+    }
+
+    public static int encode(int[] src, int srcOff, int count, int[] dict, long codesAddr, int codeWidth) {
+        checkRange(src.length, srcOff, count);
+        checkWidth(codeWidth);
+        return checkEncoded(encode0(src, (long) srcOff * 4L, count, 4, dict, dict.length, null, codesAddr, codeWidth));
+    }
+
+    public static int encode(long[] src, int srcOff, int count, long[] dict, long codesAddr, int codeWidth) {
+        checkRange(src.length, srcOff, count);
+        checkWidth(codeWidth);
+        return checkEncoded(encode0(src, (long) srcOff * 8L, count, 8, dict, dict.length, null, codesAddr, codeWidth));
+    }
+
+    public static int encode(double[] src, int srcOff, int count, double[] dict, long codesAddr, int codeWidth) {
+        checkRange(src.length, srcOff, count);
+        checkWidth(codeWidth);
+        return checkEncoded(encode0(src, (long) srcOff * 8L, count, 8, dict, dict.length, null, codesAddr, codeWidth));
+    }
+
+    // -- decode (from mapped codes) --
+
+    public static void decode(long codesAddr, int count, int codeWidth, int[] dict, int dictSize, int[] dst,
+            int dstOff) {
+        checkDecode(count, codeWidth, dict.length, dictSize, dst.length, dstOff);
+        checkResult(decode0(null, codesAddr, count, codeWidth, dict, dictSize, 4, dst, (long) dstOff * 4L));
+    }
+
+    public static void decode(long codesAddr, int count, int codeWidth, long[] dict, int dictSize, long[] dst,
+            int dstOff) {
+        checkDecode(count, codeWidth, dict.length, dictSize, dst.length, dstOff);
+        checkResult(decode0(null, codesAddr, count, codeWidth, dict, dictSize, 8, dst, (long) dstOff * 8L));
+    }
+
+    public static void decode(long codesAddr, int count, int codeWidth, double[] dict, int dictSize,
+            double[] dst, int dstOff) {
+        checkDecode(count, codeWidth, dict.length, dictSize, dst.length, dstOff);
+        checkResult(decode0(null, codesAddr, count, codeWidth, dict, dictSize, 8, dst, (long) dstOff * 8L));
+    }
+
+    // -- decode (from heap codes) --
+
+    public static void decode(byte[] codes, int codesOff, int count, int codeWidth, int[] dict, int dictSize,
+            int[] dst, int dstOff) {
+        checkCodes(codes, codesOff, count, codeWidth);
+        checkDecode(count, codeWidth, dict.length, dictSize, dst.length, dstOff);
+        checkResult(decode0(codes, codesOff, count, codeWidth, dict, dictSize, 4, dst, (long) dstOff * 4L));
+    }
+
+    public static void decode(byte[] codes, int codesOff, int count, int codeWidth, long[] dict, int dictSize,
+            long[] dst, int dstOff) {
+        checkCodes(codes, codesOff, count, codeWidth);
+        checkDecode(count, codeWidth, dict.length, dictSize, dst.length, dstOff);
+        checkResult(decode0(codes, codesOff, count, codeWidth, dict, dictSize, 8, dst, (long) dstOff * 8L));
+    }
+
+    public static void decode(byte[] codes, int codesOff, int count, int codeWidth, double[] dict, int dictSize,
+            double[] dst, int dstOff) {
+        checkCodes(codes, codesOff, count, codeWidth);
+        checkDecode(count, codeWidth, dict.length, dictSize, dst.length, dstOff);
+        checkResult(decode0(codes, codesOff, count, codeWidth, dict, dictSize, 8, dst, (long) dstOff * 8L));
+    }
+
+    // -- predicates --
+
+    /**
+     * Sets bit {@code i} of {@code bitmap} iff code {@code i} of the
+     * (mapped) column is one of {@code targets} and returns the number of
+     * matches. An equality predicate is an IN-list with one code. Use
+     * {@link #codeOf(long[], int, long)} and its overloads to translate
+     * values into codes (values that aren't in the dictionary can't match
+     * and are simply left out).
+     *
+     * @param codesAddr
+     *            address of the first code
+     * @param count
+     *            number of codes
+     * @param codeWidth
+     *            1 or 2 (bytes per code)
+     * @param targets
+     *            the codes to match
+     * @param bitmap
+     *            receives the result, must hold at least
+     *            {@code (count + 63) / 64} words
+     * @return the number of matching codes
+     */
+    public static int match(long codesAddr, int count, int codeWidth, int[] targets, long[] bitmap) {
+        checkMatch(count, codeWidth, bitmap);
+        return match0(null, codesAddr, count, codeWidth, targets, targets.length, bitmap);
+    }
+
+    public static int match(byte[] codes, int codesOff, int count, int codeWidth, int[] targets, long[] bitmap) {
+        checkCodes(codes, codesOff, count, codeWidth);
+        checkMatch(count, codeWidth, bitmap);
+        return match0(codes, codesOff, count, codeWidth, targets, targets.length, bitmap);
+    }
+
+    // the code of value or -1 if it isn't in the dictionary
+
+    public static int codeOf(int[] dict, int dictSize, int value) {
+        for (int i = 0; i < dictSize; ++i) {
+            if (dict[i] == value) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    public static int codeOf(long[] dict, int dictSize, long value) {
+        for (int i = 0; i < dictSize; ++i) {
+            if (dict[i] == value) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    public static int codeOf(double[] dict, int dictSize, double value) {
+        long bits = Double.doubleToRawLongBits(value);
+        for (int i = 0; i < dictSize; ++i) {
+            if (Double.doubleToRawLongBits(dict[i]) == bits) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * Returns the kernel level in use: 0 (scalar), 1 (AVX2) or 2 (AVX-512).
+     *
+     * @return the dispatch level of the decode and match kernels
+     */
+    public static int isaLevel() {
+        return ISA_LEVEL;
+    }
+
+    // utility methods
+
+    private static void checkRange(int arrayLength, int off, int len) {
+        if ((off | len) < 0 || len > arrayLength - off) {
+            throw new IndexOutOfBoundsException("off: " + off + ", len: " + len + ", length: " + arrayLength);
+        }
+    }
+
+    private static void checkWidth(int codeWidth) {
+        if (codeWidth != 1 && codeWidth != 2) {
+            throw new IllegalArgumentException("codeWidth: " + codeWidth);
+        }
+    }
+
+    private static void checkCodes(byte[] codes, int codesOff, int count, int codeWidth) {
+        checkWidth(codeWidth);
+        if (count < 0) {
+            throw new IllegalArgumentException("count: " + count);
+        }
+        checkRange(codes.length, codesOff, (int) Math.min((long) count * codeWidth, Integer.MAX_VALUE));
+    }
+
+    private static void checkDecode(int count, int codeWidth, int dictLength, int dictSize, int dstLength,
+            int dstOff) {
+        checkWidth(codeWidth);
+        checkRange(dictLength, 0, dictSize);
+        checkRange(dstLength, dstOff, count);
+    }
+
+    private static void checkMatch(int count, int codeWidth, long[] bitmap) {
+        checkWidth(codeWidth);
+        if (count < 0) {
+            throw new IllegalArgumentException("count: " + count);
+        }
+        if (bitmap.length < (count + 63L) / 64L) {
+            throw new IllegalArgumentException("bitmap too small: " + bitmap.length);
+        }
+    }
+
+    private static int checkEncoded(int size) {
+        if (size == NO_MEMORY) {
+            throw new OutOfMemoryError("DictionaryCodec.encode");
+        }
+        return size;
+    }
+
+    private static void checkResult(int result) {
+        if (result < 0) {
+            throw new IllegalArgumentException("Code out of dictionary range");
+        }
+    }
+
+    private static int isaLevel(String isa) {
+        if ("scalar".equalsIgnoreCase(isa)) {
+            return 0;
+        }
+        if ("avx2".equalsIgnoreCase(isa)) {
+            return 1;
+        }
+        return Integer.MAX_VALUE;
+    }
+
+    // native methods (array != null: offset is a byte offset into the array, else an address)
+
+    private static native int encode0(Object src, long srcOff, int count, int valueSize, Object dict, int dictCap,
+            Object codes, long codesOff, int codeWidth);
+
+    private static native int decode0(Object codes, long codesOff, int count, int codeWidth, Object dict,
+            int dictSize, int valueSize, Object dst, long dstOff);
+
+    private static native int match0(Object codes, long codesOff, int count, int codeWidth, int[] targets,
+            int targetCount, long[] bitmap);
+
+    // caps the dispatch level, returns the level in use
+    private static native int setIsaLevel0(int level);
+
+    // encode0 result if the hash table couldn't be allocated
+    private static final int NO_MEMORY = -2;
+
+    private static final int ISA_LEVEL = setIsaLevel0(isaLevel(System.getProperty("mmap.impl.dictionary.isa")));
+
+    private DictionaryCodec() {
+        throw new AssertionError();
+    }
+}
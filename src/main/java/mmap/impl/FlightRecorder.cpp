@@ -0,0 +1,210 @@
+
+#ifndef _JAVASOFT_JNI_H_
+#include <jni.h>
+#endif /* _JAVASOFT_JNI_H_ */
+
+#include <stdio.h>
+#include <chrono>
+#include <mutex>
+
+#include "native_stats.h"
+#include "native_recorder.h"
+
+
+/*
+ * A recorded event. The sequence number is odd while the event is being
+ * written, so that a concurrent dump can skip torn events (seqlock).
+ */
+struct recorder_slot {
+    std::atomic<uint64_t> seq;
+    std::atomic<uint64_t> time;
+    std::atomic<uint64_t> duration;
+    std::atomic<uint64_t> address;
+    std::atomic<uint64_t> length;
+    std::atomic<uint32_t> op;
+    std::atomic<uint32_t> err;
+};
+
+static recorder_slot ring[RECORDER_CAPACITY];
+
+/* Number of events ever written */
+static std::atomic<uint64_t> ring_head(0);
+
+/* Disarmed until FlightRecorder.setThreshold() is called */
+std::atomic<uint64_t> recorder_threshold(UINT64_MAX);
+
+/* Nanoseconds per native_ticks() unit */
+static double ns_per_tick = 0.0;
+static std::once_flag calibrated;
+
+
+static void calibrate() {
+#if defined (_MSC_VER) || defined (__x86_64__) || defined (__i386__)
+    typedef std::chrono::steady_clock clock;
+    clock::time_point t0 = clock::now();
+    uint64_t c0 = native_ticks();
+    clock::time_point t1;
+    do {
+        t1 = clock::now();
+    } while (t1 - t0 < std::chrono::milliseconds(5));
+    uint64_t c1 = native_ticks();
+    double ns = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    ns_per_tick = ns / (double) (c1 - c0);
+#else
+    ns_per_tick = 1.0;
+#endif
+}
+
+static uint64_t wall_clock_nanos() {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+
+void recorder_record(int op, jlong address, jlong length, uint64_t ticks, int err) {
+    uint64_t n = ring_head.fetch_add(1, std::memory_order_relaxed);
+    recorder_slot& s = ring[n & (RECORDER_CAPACITY - 1)];
+
+    s.seq.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.time.store(wall_clock_nanos(), std::memory_order_relaxed);
+    s.duration.store((uint64_t) (ticks * ns_per_tick), std::memory_order_relaxed);
+    s.address.store((uint64_t) address, std::memory_order_relaxed);
+    s.length.store((uint64_t) length, std::memory_order_relaxed);
+    s.op.store((uint32_t) op, std::memory_order_relaxed);
+    s.err.store((uint32_t) err, std::memory_order_relaxed);
+    s.seq.store(2 * n + 2, std::memory_order_release);
+}
+
+
+static unsigned char* put_long(unsigned char* p, uint64_t v) {
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        *p++ = (unsigned char) (v >> shift);
+    }
+    return p;
+}
+
+static unsigned char* put_int(unsigned char* p, uint32_t v) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        *p++ = (unsigned char) (v >> shift);
+    }
+    return p;
+}
+
+/*
+ * Copies the complete events from the ring into buf, oldest first, in
+ * the big-endian layout decoded by FlightRecorder.java. Returns the
+ * number of bytes written.
+ */
+static size_t recorder_snapshot(unsigned char* buf) {
+    uint64_t head = ring_head.load(std::memory_order_acquire);
+    uint64_t from = (head > RECORDER_CAPACITY) ? head - RECORDER_CAPACITY : 0;
+    unsigned char* p = buf;
+    for (uint64_t n = from; n < head; ++n) {
+        recorder_slot& s = ring[n & (RECORDER_CAPACITY - 1)];
+        uint64_t seq = s.seq.load(std::memory_order_acquire);
+        if (seq != 2 * n + 2) {
+            continue; // still being written or already overwritten
+        }
+        uint64_t time = s.time.load(std::memory_order_relaxed);
+        uint64_t duration = s.duration.load(std::memory_order_relaxed);
+        uint64_t address = s.address.load(std::memory_order_relaxed);
+        uint64_t length = s.length.load(std::memory_order_relaxed);
+        uint32_t op = s.op.load(std::memory_order_relaxed);
+        uint32_t err = s.err.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.seq.load(std::memory_order_relaxed) != seq) {
+            continue; // torn
+        }
+        p = put_long(p, time);
+        p = put_long(p, duration);
+        p = put_long(p, address);
+        p = put_long(p, length);
+        p = put_int(p, op);
+        p = put_int(p, err);
+        p = put_long(p, n);
+    }
+    return (size_t) (p - buf);
+}
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Class:     mmap_impl_FlightRecorder
+ * Method:    setThreshold0
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL
+Java_mmap_impl_FlightRecorder_setThreshold0(JNIEnv*, jclass,
+  jlong nanos) {
+
+    std::call_once(calibrated, calibrate);
+
+    uint64_t ticks = UINT64_MAX;
+    if (nanos >= 0) {
+        double t = (double) nanos / ns_per_tick;
+        if (t < (double) UINT64_MAX) {
+            ticks = (uint64_t) t;
+        }
+    }
+    // release: publishes ns_per_tick to the threads that see the threshold
+    recorder_threshold.store(ticks, std::memory_order_release);
+}
+
+/*
+ * Class:     mmap_impl_FlightRecorder
+ * Method:    dump0
+ * Signature: ()[B
+ */
+JNIEXPORT jbyteArray JNICALL
+Java_mmap_impl_FlightRecorder_dump0(JNIEnv* env, jclass) {
+
+    unsigned char* buf = new unsigned char[RECORDER_CAPACITY * RECORDER_EVENT_BYTES];
+    jsize size = (jsize) recorder_snapshot(buf);
+
+    jbyteArray result = env->NewByteArray(size);
+    if (result != NULL) {
+        env->SetByteArrayRegion(result, 0, size, (const jbyte*) buf);
+    }
+    delete[] buf;
+    return result;
+}
+
+/*
+ * Class:     mmap_impl_FlightRecorder
+ * Method:    dumpToFile0
+ * Signature: (Ljava/lang/String;)Z
+ */
+JNIEXPORT jboolean JNICALL
+Java_mmap_impl_FlightRecorder_dumpToFile0(JNIEnv* env, jclass,
+  jstring path) {
+
+    const char* name = env->GetStringUTFChars(path, NULL);
+    if (name == NULL) {
+        return JNI_FALSE; // OutOfMemoryError is pending
+    }
+    FILE* file = fopen(name, "wb");
+    env->ReleaseStringUTFChars(path, name);
+    if (file == NULL) {
+        return JNI_FALSE;
+    }
+
+    unsigned char* buf = new unsigned char[RECORDER_CAPACITY * RECORDER_EVENT_BYTES];
+    size_t size = recorder_snapshot(buf);
+    bool ok = fwrite(buf, 1, size, file) == size;
+    delete[] buf;
+
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    return ok ? JNI_TRUE : JNI_FALSE;
+}
+
+
+#ifdef __cplusplus
+}
+#endif // #ifdef __cplusplus
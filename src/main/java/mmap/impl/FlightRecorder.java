@@ -0,0 +1,200 @@
+package mmap.impl;
+
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.List;
+
+/**
+ * An in-memory flight recorder for slow native calls. Every native entry
+ * point of this package that takes at least {@link #threshold()} nanoseconds
+ * is written into a fixed-size ring buffer (the most recent 4096 events are
+ * kept), which can be inspected after a stall through {@link #events()} or
+ * dumped to a file.
+ * <p>
+ * The recorder is armed with the value of the system property
+ * {@code mmap.impl.recorder.thresholdNanos} (default: 10 ms) when this class
+ * is initialized and can be re-armed or disarmed at any time.
+ */
+public final class FlightRecorder {
+
+    /** A recorded slow native call. */
+    public static final class Event {
+        private final long time;
+        private final long duration;
+        private final long address;
+        private final long length;
+        private final int op;
+        private final int errno;
+        private final long sequence;
+
+        Event(long time, long duration, long address, long length, int op, int errno, long sequence) {
+            this.time = time;
+            this.duration = duration;
+            this.address = address;
+            this.length = length;
+            this.op = op;
+            this.errno = errno;
+            this.sequence = sequence;
+        }
+
+        /** Wall clock time (nanoseconds since the epoch) when the call ended. */
+        public long time() {
+            return time;
+        }
+
+        /** Duration of the call in nanoseconds. */
+        public long duration() {
+            return duration;
+        }
+
+        /** Start address of the native memory range. */
+        public long address() {
+            return address;
+        }
+
+        /** Length of the native memory range in bytes. */
+        public long length() {
+            return length;
+        }
+
+        /** The name of the native entry point (as in {@link NativeStats}). */
+        public String operation() {
+            return NativeStats.opName(op);
+        }
+
+        /** The error code of a failed call or 0 if the call succeeded. */
+        public int errno() {
+            return errno;
+        }
+
+        /** The running number of the event since the library was loaded. */
+        public long sequence() {
+            return sequence;
+        }
+
+        @Override
+        //@formatter:off
+        public String toString() {
+            return "Event{"
+                 + "seq=" + sequence
+                 + ", op=" + operation()
+                 + ", time=" + time
+                 + ", duration=" + duration
+                 + ", address=0x" + Long.toHexString(address)
+                 + ", length=" + length
+                 + ", errno=" + errno
+                 + '}';
+        }
+        //@formatter:on
+    }
+
+    /**
+     * Only record native calls that take at least {@code nanos} nanoseconds.
+     * A negative value disarms the recorder.
+     *
+     * @param nanos
+     *            the minimum duration of a recorded call
+     */
+    public static synchronized void setThreshold(long nanos) {
+        setThreshold0(nanos);
+        threshold = nanos;
+    }
+
+    /**
+     * Returns the current threshold in nanoseconds (negative if the recorder
+     * is disarmed).
+     *
+     * @return the minimum duration of a recorded call
+     */
+    public static synchronized long threshold() {
+        return threshold;
+    }
+
+    /**
+     * Returns the raw content of the ring, oldest event first. Every event
+     * occupies {@value #EVENT_BYTES} bytes in big-endian byte order:
+     *
+     * <pre>
+     *   8 bytes          Wall clock time (ns since the epoch)
+     *   8 bytes          Duration (ns)
+     *   8 bytes          Address
+     *   8 bytes          Length
+     *   4 bytes          Operation (native entry point number)
+     *   4 bytes          Error code
+     *   8 bytes          Sequence number
+     * </pre>
+     *
+     * @return the recorded events
+     */
+    public static byte[] dump() {
+        return dump0();
+    }
+
+    /**
+     * Writes the raw content of the ring (see {@link #dump()}) to the file
+     * with the given path.
+     *
+     * @param path
+     *            the path of the file to (over)write
+     * @throws IOException
+     *             if the file couldn't be written
+     */
+    public static void dump(String path) throws IOException {
+        if (!dumpToFile0(path)) {
+            throw new IOException("Couldn't write " + path);
+        }
+    }
+
+    /**
+     * Returns the recorded events, oldest event first.
+     *
+     * @return the recorded events
+     */
+    public static List<Event> events() {
+        return decode(dump0());
+    }
+
+    /**
+     * Decodes the events from the output of {@link #dump()} or from the
+     * content of a file written by {@link #dump(String)}.
+     *
+     * @param dump
+     *            the raw events
+     * @return the decoded events
+     */
+    public static List<Event> decode(byte[] dump) {
+        ByteBuffer buf = ByteBuffer.wrap(dump);
+        ArrayList<Event> events = new ArrayList<>(dump.length / EVENT_BYTES);
+        while (buf.remaining() >= EVENT_BYTES) {
+            long time = buf.getLong();
+            long duration = buf.getLong();
+            long address = buf.getLong();
+            long length = buf.getLong();
+            int op = buf.getInt();
+            int errno = buf.getInt();
+            long sequence = buf.getLong();
+            events.add(new Event(time, duration, address, length, op, errno, sequence));
+        }
+        return Collections.unmodifiableList(events);
+    }
+
+    private static native void setThreshold0(long nanos);
+
+    private static native byte[] dump0();
+
+    private static native boolean dumpToFile0(String path);
+
+    /** The size of a dumped event in bytes. */
+    public static final int EVENT_BYTES = 48;
+
+    private static long threshold = -1L;
+    static {
+        setThreshold(Long.getLong("mmap.impl.recorder.thresholdNanos", 10_000_000L));
+    }
+
+    private FlightRecorder() {
+        throw new AssertionError();
+    }
+}
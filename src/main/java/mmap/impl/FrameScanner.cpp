@@ -0,0 +1,381 @@
+
+#ifndef _JAVASOFT_JNI_H_
+#include <jni.h>
+#endif /* _JAVASOFT_JNI_H_ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if !defined (_WIN64)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "native_crc32c.h"
+#include "native_sdt.h"
+#include "native_stats.h"
+
+
+/*
+ * Recovery scan of a framed (version 2) QueueFile. The file is a 32 byte
+ * header followed by a ring buffer of frames that wraps from the end of the
+ * file back to the first byte after the header:
+ *
+ *   4 bytes   frame length L (bytes that follow this field)
+ *   4 bytes   message count (at least 1)
+ *   4 bytes   CRC-32C of the first 8 bytes and of the messages
+ *   L - 8     messages, each a 4 byte length followed by the data
+ *
+ * A segment file of a SegmentedQueueFile holds the same frames back to
+ * back from offset 0 without wrapping; the first zero length field (or the
+ * end of the file) ends the segment.
+ *
+ * All integers are big-endian. The scan maps the whole file read-only and
+ * follows the frames from the head position, verifying each frame's CRC
+ * and message structure, so a torn (partially written) frame is detected
+ * at memory bandwidth instead of one read(2) per element.
+ *
+ * The same walk (without verification) builds the position index of a
+ * QueueFile: the position of every stride-th element (of either format)
+ * and the number of messages before it.
+ */
+
+#define FRAME_HEADER 12
+
+/* Indices into the result array */
+#define RESULT_FRAMES    0
+#define RESULT_MESSAGES  1
+#define RESULT_LAST_POS  2
+#define RESULT_LAST_LEN  3
+#define RESULT_FIELDS    4
+
+
+static inline uint32_t be32(const uint8_t* p) {
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+/*
+ * The data region [header, length) of a mapped ring buffer file. A linear
+ * region (a segment) doesn't wrap; the frame checks keep all reads in it.
+ */
+struct ring {
+    const uint8_t* base;
+    uint64_t length;
+    uint64_t header;
+    bool linear;
+
+    uint64_t wrap(uint64_t pos) const {
+        return (pos < length || linear) ? pos : header + pos - length;
+    }
+
+    void read(uint64_t pos, uint8_t* dst, size_t n) const {
+        uint64_t before = length - pos;
+        if (n <= before) {
+            memcpy(dst, base + pos, n);
+        } else {
+            memcpy(dst, base + pos, (size_t) before);
+            memcpy(dst + before, base + header, (size_t) (n - before));
+        }
+    }
+
+    uint32_t crc(uint32_t c, uint64_t pos, uint64_t n) const {
+        uint64_t before = length - pos;
+        if (n <= before) {
+            return crc32c_update(c, base + pos, (size_t) n);
+        }
+        c = crc32c_update(c, base + pos, (size_t) before);
+        return crc32c_update(c, base + header, (size_t) (n - before));
+    }
+};
+
+
+/*
+ * Verifies the frame at pos (already wrapped). Returns its length L and
+ * its message count or false if the frame is torn or corrupt.
+ */
+static bool check_frame(const ring& r, uint64_t pos, uint32_t* frameLen, uint32_t* messages) {
+    if (pos < r.header || pos >= r.length || (r.linear && r.length - pos < FRAME_HEADER)) {
+        return false;
+    }
+    uint8_t h[FRAME_HEADER];
+    r.read(pos, h, FRAME_HEADER);
+    uint32_t len = be32(h);
+    uint32_t count = be32(h + 4);
+    if (count == 0 || len < FRAME_HEADER - 4 || (uint64_t) len + 4 > r.length - r.header) {
+        return false;
+    }
+    if (r.linear && (uint64_t) len + 4 > r.length - pos) {
+        return false;
+    }
+    uint32_t c = crc32c_update(0, h, 8);
+    c = r.crc(c, r.wrap(pos + FRAME_HEADER), len - 8);
+    if (c != be32(h + 8)) {
+        return false;
+    }
+    uint64_t remaining = len - 8;
+    uint64_t m = r.wrap(pos + FRAME_HEADER);
+    for (uint32_t k = 0; k < count; ++k) {
+        if (remaining < 4) {
+            return false;
+        }
+        uint8_t b[4];
+        r.read(m, b, 4);
+        uint32_t size = be32(b);
+        remaining -= 4;
+        if (size > remaining) {
+            return false;
+        }
+        remaining -= size;
+        m = r.wrap(m + 4 + size);
+    }
+    if (remaining != 0) {
+        return false;
+    }
+    *frameLen = len;
+    *messages = count;
+    return true;
+}
+
+/*
+ * Follows at most frameCount frames from first and stores the totals of
+ * the valid prefix in result. Returns the number of valid frames or -errno
+ * if the file can't be mapped.
+ */
+static jint scan_frames(jlong fd, jlong fileLength, jint headerLength, jlong first, jint frameCount,
+        bool linear, jlong* result) {
+
+    stats_scope stats(OP_FRAME_SCAN, 0, fileLength);
+
+#if defined (_WIN64)
+
+    /* Not implemented under Windows, QueueFile scans in Java */
+    stats.fail(ENOSYS);
+    return -ENOSYS;
+
+#else /* Linux / Unix */
+
+    struct stat st;
+    if (fstat((int) fd, &st) == -1) {
+        stats.fail(errno);
+        return -errno;
+    }
+    if ((uint64_t) st.st_size < (uint64_t) fileLength || fileLength <= headerLength || fileLength <= 0) {
+        stats.fail(EINVAL);
+        return -EINVAL;
+    }
+    void* a = mmap(NULL, (size_t) fileLength, PROT_READ, MAP_SHARED, (int) fd, 0);
+    if (a == MAP_FAILED) {
+        stats.fail(errno);
+        return -errno;
+    }
+    madvise(a, (size_t) fileLength, MADV_SEQUENTIAL);
+
+    ring r;
+    r.base = (const uint8_t*) a;
+    r.length = (uint64_t) fileLength;
+    r.header = (uint64_t) headerLength;
+    r.linear = linear;
+
+    jint frames = 0;
+    uint64_t messages = 0;
+    uint64_t pos = (uint64_t) first;
+    uint64_t lastPos = 0;
+    uint32_t lastLen = 0;
+    while (frames < frameCount) {
+        uint32_t len;
+        uint32_t count;
+        if (!check_frame(r, pos, &len, &count)) {
+            break;
+        }
+        ++frames;
+        messages += count;
+        lastPos = pos;
+        lastLen = len;
+        pos = r.wrap(pos + 4 + len);
+    }
+    munmap(a, (size_t) fileLength);
+
+    result[RESULT_FRAMES] = frames;
+    result[RESULT_MESSAGES] = (jlong) messages;
+    result[RESULT_LAST_POS] = (jlong) lastPos;
+    result[RESULT_LAST_LEN] = lastLen;
+    NATIVE_PROBE3(frame_scan, first, frameCount, frames);
+    return frames;
+
+#endif /* (_WIN64) */
+}
+
+
+/*
+ * Records the position of every stride-th of at most count elements from
+ * first and the number of messages (frames: the message count field,
+ * otherwise 1 per element) before it. Returns the number of elements
+ * walked (less than count at an implausible length) or -errno.
+ */
+static jint index_elements(jlong fd, jlong fileLength, jint headerLength, jlong first, jint count, jint stride,
+        bool framed, jlong* positions, jlong* messages) {
+
+    stats_scope stats(OP_FRAME_SCAN, 0, fileLength);
+
+#if defined (_WIN64)
+
+    /* Not implemented under Windows, QueueFile walks in Java */
+    stats.fail(ENOSYS);
+    return -ENOSYS;
+
+#else /* Linux / Unix */
+
+    struct stat st;
+    if (fstat((int) fd, &st) == -1) {
+        stats.fail(errno);
+        return -errno;
+    }
+    if ((uint64_t) st.st_size < (uint64_t) fileLength || fileLength <= headerLength || fileLength <= 0) {
+        stats.fail(EINVAL);
+        return -EINVAL;
+    }
+    void* a = mmap(NULL, (size_t) fileLength, PROT_READ, MAP_SHARED, (int) fd, 0);
+    if (a == MAP_FAILED) {
+        stats.fail(errno);
+        return -errno;
+    }
+    madvise(a, (size_t) fileLength, MADV_SEQUENTIAL);
+
+    ring r;
+    r.base = (const uint8_t*) a;
+    r.length = (uint64_t) fileLength;
+    r.header = (uint64_t) headerLength;
+    r.linear = false;
+
+    uint64_t pos = (uint64_t) first;
+    uint64_t before = 0;
+    jint i = 0;
+    for (; i < count; ++i) {
+        if (pos < r.header || pos >= r.length) {
+            break;
+        }
+        uint8_t h[8];
+        r.read(pos, h, framed ? 8 : 4);
+        uint32_t len = be32(h);
+        if ((uint64_t) len + 4 > r.length - r.header || (framed && len < FRAME_HEADER - 4)) {
+            break;
+        }
+        if (i % stride == 0) {
+            positions[i / stride] = (jlong) pos;
+            messages[i / stride] = (jlong) before;
+        }
+        before += framed ? be32(h + 4) : 1;
+        pos = r.wrap(pos + 4 + len);
+    }
+    munmap(a, (size_t) fileLength);
+
+    NATIVE_PROBE3(element_index, first, count, i);
+    return i;
+
+#endif /* (_WIN64) */
+}
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Class:     mmap_impl_FrameScanner
+ * Method:    scan0
+ * Signature: (JJIJI[J)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_FrameScanner_scan0(JNIEnv* env, jclass,
+  jlong fd,
+  jlong fileLength,
+  jint headerLength,
+  jlong first,
+  jint frameCount,
+  jlongArray result) {
+
+    jlong values[RESULT_FIELDS] = { 0, 0, 0, 0 };
+    jint frames = scan_frames(fd, fileLength, headerLength, first, frameCount, false, values);
+    if (frames >= 0) {
+        env->SetLongArrayRegion(result, 0, RESULT_FIELDS, values);
+    }
+    return frames;
+}
+
+/*
+ * Class:     mmap_impl_FrameScanner
+ * Method:    scanSegment0
+ * Signature: (JJJI[J)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_FrameScanner_scanSegment0(JNIEnv* env, jclass,
+  jlong fd,
+  jlong length,
+  jlong start,
+  jint maxFrames,
+  jlongArray result) {
+
+    jlong values[RESULT_FIELDS] = { 0, 0, 0, 0 };
+    jint frames = scan_frames(fd, length, 0, start, maxFrames, true, values);
+    if (frames >= 0) {
+        env->SetLongArrayRegion(result, 0, RESULT_FIELDS, values);
+    }
+    return frames;
+}
+
+/*
+ * Class:     mmap_impl_FrameScanner
+ * Method:    index0
+ * Signature: (JJIJIIZ[J[J)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_FrameScanner_index0(JNIEnv* env, jclass,
+  jlong fd,
+  jlong fileLength,
+  jint headerLength,
+  jlong first,
+  jint count,
+  jint stride,
+  jboolean framed,
+  jlongArray positions,
+  jlongArray messages) {
+
+    jint entries = (jint) (((jlong) count + stride - 1) / stride);
+    jlong* p = (jlong*) malloc(((size_t) entries + 1) * sizeof(jlong));
+    jlong* m = (jlong*) malloc(((size_t) entries + 1) * sizeof(jlong));
+    if (p == NULL || m == NULL) {
+        free(p);
+        free(m);
+        return -ENOMEM;
+    }
+    jint walked = index_elements(fd, fileLength, headerLength, first, count, stride, framed == JNI_TRUE, p, m);
+    if (walked > 0) {
+        jint filled = (jint) (((jlong) walked + stride - 1) / stride);
+        env->SetLongArrayRegion(positions, 0, filled, p);
+        env->SetLongArrayRegion(messages, 0, filled, m);
+    }
+    free(p);
+    free(m);
+    return walked;
+}
+
+/*
+ * Class:     mmap_impl_FrameScanner
+ * Method:    isSupported0
+ * Signature: ()Z
+ */
+JNIEXPORT jboolean JNICALL
+Java_mmap_impl_FrameScanner_isSupported0(JNIEnv*, jclass) {
+#if defined (_WIN64)
+    return JNI_FALSE;
+#else
+    return JNI_TRUE;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif // #ifdef __cplusplus
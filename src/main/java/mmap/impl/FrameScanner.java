@@ -0,0 +1,150 @@
+package mmap.impl;
+
+/**
+ * Native recovery scan of a framed ring buffer file (the version 2 format of
+ * {@code disk.QueueFile}). Each frame is
+ *
+ * <pre>
+ *   4 bytes          Frame length L (bytes that follow this field)
+ *   4 bytes          Message count (at least 1)
+ *   4 bytes          CRC-32C of the first 8 bytes and of the messages
+ *   L - 8 bytes      Messages (4 bytes length + data each)
+ * </pre>
+ *
+ * (all integers big-endian). The scan maps the whole file read-only and
+ * verifies frame after frame from the head position until the first torn or
+ * corrupt frame. Segment files ({@code disk.SegmentedQueueFile}) hold the
+ * same frames back to back without a header and without wrapping.
+ * <p>
+ * Not available on Windows or without the native library, see
+ * {@link #isAvailable()}; callers then walk the file in Java.
+ */
+public final class FrameScanner {
+
+    /** Length of the frame header (length, count and checksum). */
+    public static final int FRAME_HEADER_LENGTH = 12;
+
+    /** Index of the number of valid frames in the result array. */
+    public static final int FRAMES = 0;
+    /** Index of the total number of messages in the valid frames. */
+    public static final int MESSAGES = 1;
+    /** Index of the position of the last valid frame. */
+    public static final int LAST_POSITION = 2;
+    /** Index of the frame length L of the last valid frame. */
+    public static final int LAST_LENGTH = 3;
+
+    /**
+     * Returns {@code true} if the native scans can be used (the library is
+     * loaded, the platform is supported and
+     * {@code -Dmmap.impl.framescanner=false} isn't set).
+     */
+    public static boolean isAvailable() {
+        return AVAILABLE;
+    }
+
+    /**
+     * Verifies at most {@code frameCount} frames starting at {@code first}.
+     *
+     * @param fd
+     *            the raw file descriptor (see
+     *            {@link MMapUtils#getFileDescriptor(java.io.FileDescriptor)})
+     * @param fileLength
+     *            the ring buffer length (the data wraps from there back to
+     *            {@code headerLength})
+     * @param headerLength
+     *            the length of the file header
+     * @param first
+     *            position of the head frame
+     * @param frameCount
+     *            the number of frames recorded in the file header
+     * @param result
+     *            receives the totals of the valid prefix (at least 4 slots,
+     *            see {@link #FRAMES} etc.)
+     * @return the number of valid frames or a negative value if the native
+     *         scan isn't possible (e.g. on Windows)
+     */
+    public static int scan(long fd, long fileLength, int headerLength, long first, int frameCount, long[] result) {
+        if (result.length < 4) {
+            throw new IllegalArgumentException("result.length: " + result.length);
+        }
+        if (frameCount <= 0) {
+            result[FRAMES] = result[MESSAGES] = result[LAST_POSITION] = result[LAST_LENGTH] = 0L;
+            return 0;
+        }
+        return scan0(fd, fileLength, headerLength, first, frameCount, result);
+    }
+
+    /**
+     * Verifies at most {@code maxFrames} frames of a segment file starting at
+     * {@code start}. The scan ends at the end of the file, at a zero length
+     * field (the end of the written data) or at the first torn frame.
+     *
+     * @return the number of valid frames or a negative value if the native
+     *         scan isn't possible (e.g. on Windows)
+     */
+    public static int scanSegment(long fd, long length, long start, int maxFrames, long[] result) {
+        if (result.length < 4) {
+            throw new IllegalArgumentException("result.length: " + result.length);
+        }
+        if (maxFrames <= 0 || start >= length) {
+            result[FRAMES] = result[MESSAGES] = result[LAST_POSITION] = result[LAST_LENGTH] = 0L;
+            return 0;
+        }
+        return scanSegment0(fd, length, start, maxFrames, result);
+    }
+
+    /**
+     * Walks at most {@code count} elements of a ring buffer file (either
+     * version of {@code disk.QueueFile}) from {@code first} and records the
+     * position of every {@code stride}-th element in {@code positions} and
+     * the number of messages before it in {@code messages} (1 per element,
+     * the message count of each frame if {@code framed}). Lengths are only
+     * checked for plausibility, not verified.
+     *
+     * @return the number of elements walked or a negative value if the
+     *         native walk isn't possible (e.g. on Windows)
+     */
+    public static int index(long fd, long fileLength, int headerLength, long first, int count, int stride,
+            boolean framed, long[] positions, long[] messages) {
+        if (stride <= 0) {
+            throw new IllegalArgumentException("stride: " + stride);
+        }
+        int entries = (int) ((count + (long) stride - 1) / stride);
+        if (positions.length < entries || messages.length < entries) {
+            throw new IllegalArgumentException("entries: " + entries);
+        }
+        if (count <= 0) {
+            return 0;
+        }
+        return index0(fd, fileLength, headerLength, first, count, stride, framed, positions, messages);
+    }
+
+    private static boolean available() {
+        if (!Boolean.parseBoolean(System.getProperty("mmap.impl.framescanner", "true"))) {
+            return false;
+        }
+        try {
+            return isSupported0();
+        } catch (UnsatisfiedLinkError e) {
+            return false;
+        }
+    }
+
+    // native methods (return -errno on failure)
+
+    private static native int scan0(long fd, long fileLength, int headerLength, long first, int frameCount,
+            long[] result);
+
+    private static native int index0(long fd, long fileLength, int headerLength, long first, int count, int stride,
+            boolean framed, long[] positions, long[] messages);
+
+    private static native int scanSegment0(long fd, long length, long start, int maxFrames, long[] result);
+
+    private static native boolean isSupported0();
+
+    private static final boolean AVAILABLE = available();
+
+    private FrameScanner() {
+        throw new AssertionError();
+    }
+}
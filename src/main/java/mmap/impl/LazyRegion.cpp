@@ -0,0 +1,460 @@
+
+#ifndef _JAVASOFT_JNI_H_
+#include <jni.h>
+#endif /* _JAVASOFT_JNI_H_ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#if defined (__linux)
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+
+#include <atomic>
+#include <new>
+#include <thread>
+#endif
+
+#include "native_codec.h"
+#include "native_sdt.h"
+#include "native_stats.h"
+
+
+/*
+ * A read-only region whose content is decompressed on first touch. The
+ * backing file holds the region as a sequence of independently compressed
+ * blocks (raw BlockCodec blocks, optionally with a dictionary); the block
+ * table (file offset and stored length of every block) is passed in.
+ *
+ * The region is an anonymous private mapping registered with a
+ * userfaultfd(2) for missing pages. A handler thread reads the faults,
+ * decompresses the whole block of the faulting page into a scratch buffer
+ * and installs it atomically with UFFDIO_COPY, which also wakes the
+ * faulting thread. Readers see plain memory; the storage stays compressed.
+ * MMapUtils.unload (MADV_DONTNEED) drops the pages of a block, the next
+ * access decompresses it again. Pages that are still present when a block
+ * is installed (a partially dropped block) are skipped.
+ *
+ * A stored length of 0 is a block of zeros, a stored length equal to the
+ * block length is an uncompressed block. If a block can't be read or is
+ * malformed it is replaced by a mapping of an empty memfd, so that its
+ * access raises SIGBUS like the access of a truncated mapped file (the JVM
+ * turns that into an InternalError for Unsafe and buffer accesses) instead
+ * of blocking the reader forever.
+ *
+ * Creating a userfaultfd that handles kernel mode faults needs
+ * CAP_SYS_PTRACE or vm.unprivileged_userfaultfd=1; otherwise it falls back
+ * to UFFD_USER_MODE_ONLY (Linux 5.11+), then system calls that read from a
+ * block that isn't present fail with EFAULT. Linux only.
+ */
+
+#if defined (__linux) && defined (SYS_userfaultfd)
+
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+
+struct lazy_region {
+    uint8_t* base;
+    uint64_t length;            /* mapped (page rounded) */
+    uint64_t data_length;       /* uncompressed */
+    uint64_t block_size;
+    uint64_t blocks;
+    int64_t* offsets;
+    int32_t* lengths;
+    int fd;
+    const void* dict;
+    int uffd;
+    int stop_fd;                /* eventfd that stops the handler */
+    int hole_fd;                /* empty memfd, mapped over unreadable blocks */
+    uint8_t* scratch;           /* one decompressed block */
+    uint8_t* packed;            /* one stored block */
+    std::thread handler;
+    std::atomic<jlong> faults;
+    std::atomic<jlong> bytes;
+    std::atomic<jlong> failed;
+
+    lazy_region()
+        : base((uint8_t*) MAP_FAILED), length(0), data_length(0), block_size(0), blocks(0), offsets(NULL),
+          lengths(NULL), fd(-1), dict(NULL), uffd(-1), stop_fd(-1), hole_fd(-1), scratch(NULL), packed(NULL),
+          faults(0), bytes(0), failed(0) {
+    }
+
+    ~lazy_region() {
+        if (base != (uint8_t*) MAP_FAILED) {
+            munmap(base, (size_t) length);
+        }
+        int fds[] = { uffd, stop_fd, hole_fd };
+        for (int i = 0; i < 3; ++i) {
+            if (fds[i] >= 0) {
+                close(fds[i]);
+            }
+        }
+        free(offsets);
+        free(lengths);
+        free(scratch);
+        free(packed);
+    }
+};
+
+static uint64_t page_size() {
+    static uint64_t ps = (uint64_t) sysconf(_SC_PAGESIZE);
+    return ps;
+}
+
+/* Reads exactly count bytes at offset. Returns 0 or -errno. */
+static int pread_fully(int fd, void* buf, size_t count, off_t offset) {
+    char* p = (char*) buf;
+    while (count > 0) {
+        ssize_t n = pread(fd, p, count, offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (n == 0) {
+            return -EIO;
+        }
+        p += n;
+        count -= (size_t) n;
+        offset += n;
+    }
+    return 0;
+}
+
+/* Decompresses block i (ulen bytes) into the scratch buffer. Returns 0 or -errno. */
+static int fill(lazy_region* r, uint64_t i, uint64_t ulen, uint64_t len) {
+    int32_t stored = r->lengths[i];
+    int err = 0;
+    if (stored == 0 || ulen == 0) {
+        ulen = 0;
+    } else if ((uint64_t) stored == ulen) {
+        err = pread_fully(r->fd, r->scratch, (size_t) ulen, (off_t) r->offsets[i]);
+    } else {
+        err = pread_fully(r->fd, r->packed, (size_t) stored, (off_t) r->offsets[i]);
+        if (err == 0 && codec_decompress(r->dict, r->packed, (size_t) stored, r->scratch, (size_t) ulen)
+                != (int) ulen) {
+            err = -EINVAL;
+        }
+    }
+    memset(r->scratch + ulen, 0, (size_t) (len - ulen));
+    return err;
+}
+
+/* Installs the scratch buffer at [start, start + len). Returns 0 or -errno. */
+static int install(lazy_region* r, uint64_t start, uint64_t len) {
+    uint64_t done = 0;
+    while (done < len) {
+        struct uffdio_copy c;
+        c.dst = (uintptr_t) (r->base + start + done);
+        c.src = (uintptr_t) (r->scratch + done);
+        c.len = len - done;
+        c.mode = 0;
+        c.copy = 0;
+        if (ioctl(r->uffd, UFFDIO_COPY, &c) == 0) {
+            break;
+        }
+        int err = errno;
+        if (c.copy > 0) {
+            /* partially copied up to a present page */
+            done += (uint64_t) c.copy;
+        } else if (err == EEXIST) {
+            /* a page that is still present */
+            done += page_size();
+        } else if (err != EAGAIN) {
+            return -err;
+        }
+    }
+    /* the faulting page may have been one of the present ones */
+    struct uffdio_range range = { (uintptr_t) (r->base + start), len };
+    ioctl(r->uffd, UFFDIO_WAKE, &range);
+    return 0;
+}
+
+/* Makes the accesses of an unreadable block raise SIGBUS. */
+static void poison(lazy_region* r, uint64_t start, uint64_t len) {
+    void* p = mmap(r->base + start, (size_t) len, PROT_READ, MAP_SHARED | MAP_FIXED, r->hole_fd, 0);
+    if (p == MAP_FAILED) {
+        /* better zeros than a reader that blocks forever */
+        memset(r->scratch, 0, (size_t) len);
+        install(r, start, len);
+        return;
+    }
+    struct uffdio_range range = { (uintptr_t) (r->base + start), len };
+    ioctl(r->uffd, UFFDIO_WAKE, &range);
+}
+
+/* Resolves a missing page fault at address. */
+static void resolve(lazy_region* r, uint64_t address) {
+    uint64_t i = (address - (uintptr_t) r->base) / r->block_size;
+    uint64_t start = i * r->block_size;
+    uint64_t len = (r->length - start < r->block_size) ? r->length - start : r->block_size;
+    uint64_t ulen = 0;
+    if (start < r->data_length) {
+        ulen = (r->data_length - start < r->block_size) ? r->data_length - start : r->block_size;
+    }
+    stats_scope stats(OP_LAZY_FAULT, (jlong) (intptr_t) (r->base + start), (jlong) len);
+
+    /* counted before the install wakes the reader */
+    r->faults++;
+    int err = fill(r, i, ulen, len);
+    if (err == 0) {
+        r->bytes += (jlong) len;
+        err = install(r, start, len);
+    }
+    NATIVE_PROBE4(lazy_fault, r->base + start, i, len, err);
+    if (err == 0) {
+        return;
+    }
+    stats.fail(-err);
+    if (err != -ENOENT && err != -ESRCH) {
+        /* (ENOENT / ESRCH: the region or the process is going away) */
+        r->failed++;
+        poison(r, start, len);
+    }
+}
+
+static void handle_faults(lazy_region* r) {
+    struct pollfd fds[2];
+    fds[0].fd = r->uffd;
+    fds[0].events = POLLIN;
+    fds[1].fd = r->stop_fd;
+    fds[1].events = POLLIN;
+    for (;;) {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (fds[1].revents != 0) {
+            return;
+        }
+        struct uffd_msg msg;
+        ssize_t n = read(r->uffd, &msg, sizeof(msg));
+        if (n != (ssize_t) sizeof(msg)) {
+            if (n == -1 && (errno == EAGAIN || errno == EINTR)) {
+                continue;
+            }
+            return;
+        }
+        if (msg.event == UFFD_EVENT_PAGEFAULT) {
+            resolve(r, (uint64_t) msg.arg.pagefault.address);
+        }
+    }
+}
+
+static int open_userfaultfd() {
+    int fd = (int) syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+    if (fd == -1 && errno == EPERM) {
+        /* unprivileged: only faults from user mode (EINVAL before Linux 5.11) */
+        fd = (int) syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+        if (fd == -1 && errno == EINVAL) {
+            errno = EPERM;
+        }
+    }
+    return (fd == -1) ? -errno : fd;
+}
+
+/* Maps and registers the region and starts its handler. Returns 0 or -errno. */
+static int start(lazy_region* r) {
+    if ((r->uffd = open_userfaultfd()) < 0) {
+        return r->uffd;
+    }
+    struct uffdio_api api;
+    api.api = UFFD_API;
+    api.features = 0;
+    if (ioctl(r->uffd, UFFDIO_API, &api) == -1) {
+        return -errno;
+    }
+    if ((r->stop_fd = eventfd(0, EFD_CLOEXEC)) == -1) {
+        return -errno;
+    }
+    if ((r->hole_fd = (int) syscall(SYS_memfd_create, "lazy_region_hole", MFD_CLOEXEC)) == -1) {
+        return -errno;
+    }
+    void* p = mmap(NULL, (size_t) r->length, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        return -errno;
+    }
+    r->base = (uint8_t*) p;
+    struct uffdio_register reg;
+    reg.range.start = (uintptr_t) r->base;
+    reg.range.len = r->length;
+    reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+    if (ioctl(r->uffd, UFFDIO_REGISTER, &reg) == -1) {
+        return -errno;
+    }
+    if ((reg.ioctls & ((uint64_t) 1 << _UFFDIO_COPY)) == 0) {
+        return -EOPNOTSUPP;
+    }
+    try {
+        r->handler = std::thread(handle_faults, r);
+    } catch (...) {
+        return -EAGAIN;
+    }
+    return 0;
+}
+
+#endif /* __linux && SYS_userfaultfd */
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Class:     mmap_impl_LazyRegion
+ * Method:    open0
+ * Signature: (IJI[J[IJ)J
+ */
+JNIEXPORT jlong JNICALL
+Java_mmap_impl_LazyRegion_open0(JNIEnv* env, jclass,
+  jint fd,
+  jlong length,
+  jint blockSize,
+  jlongArray offsets,
+  jintArray lengths,
+  jlong dict) {
+
+#if defined (__linux) && defined (SYS_userfaultfd)
+    uint64_t ps = page_size();
+    if (fd < 0 || length <= 0 || blockSize <= 0 || ((uint64_t) blockSize & (ps - 1)) != 0) {
+        return -EINVAL;
+    }
+    lazy_region* r = new (std::nothrow) lazy_region();
+    if (r == NULL) {
+        return -ENOMEM;
+    }
+    r->fd = fd;
+    r->dict = (const void*) (intptr_t) dict;
+    r->data_length = (uint64_t) length;
+    r->length = ((uint64_t) length + ps - 1) & ~(ps - 1);
+    r->block_size = (uint64_t) blockSize;
+    r->blocks = (r->length + r->block_size - 1) / r->block_size;
+    r->offsets = (int64_t*) malloc((size_t) r->blocks * sizeof(int64_t));
+    r->lengths = (int32_t*) malloc((size_t) r->blocks * sizeof(int32_t));
+    r->scratch = (uint8_t*) malloc((size_t) r->block_size);
+    if (r->offsets == NULL || r->lengths == NULL || r->scratch == NULL) {
+        delete r;
+        return -ENOMEM;
+    }
+    env->GetLongArrayRegion(offsets, 0, (jsize) r->blocks, (jlong*) r->offsets);
+    env->GetIntArrayRegion(lengths, 0, (jsize) r->blocks, (jint*) r->lengths);
+    int32_t max = 0;
+    for (uint64_t i = 0; i < r->blocks; ++i) {
+        if (r->lengths[i] > max) {
+            max = r->lengths[i];
+        }
+    }
+    r->packed = (uint8_t*) malloc((size_t) max + 1);
+    if (r->packed == NULL) {
+        delete r;
+        return -ENOMEM;
+    }
+    int err = start(r);
+    if (err < 0) {
+        delete r;
+        return err;
+    }
+    return (jlong) (intptr_t) r;
+#else
+    return -ENOSYS;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_LazyRegion
+ * Method:    address0
+ * Signature: (J)J
+ */
+JNIEXPORT jlong JNICALL
+Java_mmap_impl_LazyRegion_address0(JNIEnv*, jclass,
+  jlong handle) {
+
+#if defined (__linux) && defined (SYS_userfaultfd)
+    return (jlong) (intptr_t) ((lazy_region*) (intptr_t) handle)->base;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_LazyRegion
+ * Method:    close0
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_LazyRegion_close0(JNIEnv*, jclass,
+  jlong handle) {
+
+#if defined (__linux) && defined (SYS_userfaultfd)
+    lazy_region* r = (lazy_region*) (intptr_t) handle;
+    uint64_t one = 1;
+    int err = 0;
+    if (write(r->stop_fd, &one, sizeof(one)) != (ssize_t) sizeof(one)) {
+        err = -errno;
+    } else {
+        r->handler.join();
+    }
+    if (err == 0) {
+        delete r;
+    }
+    return err;
+#else
+    return -ENOSYS;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_LazyRegion
+ * Method:    stats0
+ * Signature: (J[J)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_LazyRegion_stats0(JNIEnv* env, jclass,
+  jlong handle,
+  jlongArray result) {
+
+#if defined (__linux) && defined (SYS_userfaultfd)
+    lazy_region* r = (lazy_region*) (intptr_t) handle;
+    jlong s[3] = { r->faults.load(), r->bytes.load(), r->failed.load() };
+    env->SetLongArrayRegion(result, 0, 3, s);
+    return 0;
+#else
+    return -ENOSYS;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_LazyRegion
+ * Method:    isSupported0
+ * Signature: ()Z
+ */
+JNIEXPORT jboolean JNICALL
+Java_mmap_impl_LazyRegion_isSupported0(JNIEnv*, jclass) {
+#if defined (__linux) && defined (SYS_userfaultfd)
+    int fd = open_userfaultfd();
+    if (fd < 0) {
+        return JNI_FALSE;
+    }
+    close(fd);
+    return JNI_TRUE;
+#else
+    return JNI_FALSE;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif // #ifdef __cplusplus
@@ -0,0 +1,161 @@
+package mmap.impl;
+
+import java.io.FileDescriptor;
+import java.io.IOException;
+
+/**
+ * A read-only memory region backed by a compressed file whose pages are
+ * decompressed on first touch ({@code userfaultfd}). The file holds the
+ * region as independently compressed {@link BlockCodec} blocks of
+ * {@code blockSize} uncompressed bytes; the block table (file offset and
+ * stored length of each block) is kept by the caller, e.g. in a segment
+ * footer.
+ * <p>
+ * A native handler thread resolves the first access of a block by reading
+ * and decompressing it into place, readers use plain (Unsafe) accesses at
+ * {@link #address()}. {@link MMapUtils#unload(long, long)} drops blocks
+ * again; their next access decompresses them anew. A stored length of 0
+ * is a block of zeros and a stored length equal to the uncompressed length
+ * is a block that is stored uncompressed. The access of a block that can't
+ * be read or decompressed fails like the access of a truncated mapped file.
+ * <p>
+ * The region must not be accessed after {@link #close()}, and the file
+ * descriptor and the dictionary must stay open while the region is open.
+ * Linux only, see {@link #isAvailable()}.
+ */
+public final class LazyRegion implements AutoCloseable {
+
+    private final long length;
+    private final long address;
+    private long handle;
+
+    private LazyRegion(long handle, long length) {
+        this.handle = handle;
+        this.length = length;
+        this.address = address0(handle);
+    }
+
+    /**
+     * Returns {@code true} if lazy regions can be used (the library is
+     * loaded, the platform is Linux, a {@code userfaultfd} can be created
+     * and {@code -Dmmap.impl.lazy=false} isn't set).
+     */
+    public static boolean isAvailable() {
+        return AVAILABLE;
+    }
+
+    /**
+     * Opens a region of {@code length} uncompressed bytes.
+     *
+     * @param fd
+     *            the compressed file
+     * @param length
+     *            the uncompressed length
+     * @param blockSize
+     *            the uncompressed length of a block (a multiple of the page
+     *            size), the last block may be shorter
+     * @param blockOffsets
+     *            the file offset of each block
+     * @param blockLengths
+     *            the stored length of each block
+     * @param dict
+     *            the dictionary the blocks were compressed with or
+     *            {@code null}
+     * @throws IOException
+     *             if the region can't be created (e.g. missing privileges)
+     */
+    public static LazyRegion open(FileDescriptor fd, long length, int blockSize, long[] blockOffsets,
+            int[] blockLengths, BlockCodec.Dictionary dict) throws IOException {
+        if (length <= 0L || blockSize <= 0 || blockSize % Native.pageSize() != 0) {
+            throw new IllegalArgumentException("length: " + length + ", blockSize: " + blockSize);
+        }
+        long blocks = (length + blockSize - 1) / blockSize;
+        if (blocks > blockOffsets.length || blocks > blockLengths.length) {
+            throw new IllegalArgumentException("blocks: " + blocks);
+        }
+        for (int i = 0; i < blocks; ++i) {
+            int uncompressed = (int) Math.min(blockSize, length - (long) i * blockSize);
+            if (blockOffsets[i] < 0L || blockLengths[i] < 0
+                    || blockLengths[i] > BlockCodec.maxCompressedLength(uncompressed)) {
+                throw new IllegalArgumentException(
+                        "block " + i + ": offset " + blockOffsets[i] + ", length " + blockLengths[i]);
+            }
+        }
+        int rawFd = (int) MMapUtils.getFileDescriptor(fd);
+        long handle = open0(rawFd, length, blockSize, blockOffsets, blockLengths,
+                (dict == null) ? 0L : dict.handle());
+        if (handle < 0L) {
+            throw new IOException("userfaultfd region failed (errno " + -handle + ")");
+        }
+        return new LazyRegion(handle, length);
+    }
+
+    /** The address of the region. */
+    public long address() {
+        return address;
+    }
+
+    /** The uncompressed length of the region. */
+    public long length() {
+        return length;
+    }
+
+    /**
+     * The number of resolved faults, the number of decompressed bytes and
+     * the number of blocks that couldn't be decompressed.
+     */
+    public synchronized long[] stats() {
+        long[] s = new long[3];
+        if (stats0(handle(), s) < 0) {
+            throw new IllegalStateException("stats failed");
+        }
+        return s;
+    }
+
+    /** Stops the handler and unmaps the region. */
+    @Override
+    public synchronized void close() {
+        long h = handle;
+        if (h != 0L) {
+            int result = close0(h);
+            if (result < 0) {
+                throw new IllegalStateException("close failed (errno " + -result + ")");
+            }
+            handle = 0L;
+        }
+    }
+
+    private long handle() {
+        long h = handle;
+        if (h == 0L) {
+            throw new IllegalStateException("LazyRegion is closed");
+        }
+        return h;
+    }
+
+    private static boolean available() {
+        if (!Boolean.parseBoolean(System.getProperty("mmap.impl.lazy", "true"))) {
+            return false;
+        }
+        try {
+            return isSupported0();
+        } catch (UnsatisfiedLinkError e) {
+            return false;
+        }
+    }
+
+    // native methods (return -errno on failure)
+
+    private static native long open0(int fd, long length, int blockSize, long[] blockOffsets, int[] blockLengths,
+            long dict);
+
+    private static native long address0(long handle);
+
+    private static native int close0(long handle);
+
+    private static native int stats0(long handle, long[] result);
+
+    private static native boolean isSupported0();
+
+    private static final boolean AVAILABLE = available();
+}
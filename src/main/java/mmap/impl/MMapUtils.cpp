@@ -4,6 +4,7 @@
 #endif /* _JAVASOFT_JNI_H_ */
 
 #include <stdlib.h>
+#include <errno.h>
 
 #if defined (_WIN64)
 #include <windows.h>
@@ -12,6 +13,9 @@
 #include <stddef.h>
 #endif /* (_WIN64) */
 
+#include "native_sdt.h"
+#include "native_stats.h"
+
 
 #ifdef _WIN64
 #define jlong_to_ptr(a) ((void*)(a))
@@ -41,21 +45,10 @@
 typedef unsigned char mincore_vec_t;
 
 
-#ifdef __cplusplus
-extern "C" {
-#endif
+static jboolean is_loaded(jlong address, jlong length, jlong pageCount) {
 
+    stats_scope stats(OP_IS_LOADED, address, length);
 
-/*
- * Class:     mmap_impl_MMapUtils
- * Method:    isLoaded0
- * Signature: (JJJ)Z
- */
-JNIEXPORT jboolean JNICALL
-Java_mmap_impl_MMapUtils_isLoaded0(JNIEnv* env, jclass,
-  jlong address,
-  jlong length,
-  jlong pageCount) {
 #if defined (_WIN64)
 
     /* Information is not available under Windows */
@@ -70,11 +63,15 @@ Java_mmap_impl_MMapUtils_isLoaded0(JNIEnv* env, jclass,
     mincore_vec_t* vec = (mincore_vec_t*) malloc(numPages);
 
     if (vec == NULL) {
+        stats.fail(ENOMEM);
         return JNI_FALSE;
     }
 
+    NATIVE_PROBE3(mincore_entry, a, len, numPages);
     int result = mincore(a, len, vec);
+    NATIVE_PROBE3(mincore_return, a, len, (result == -1) ? -errno : 0);
     if (result == -1) {
+        stats.fail(errno);
         free(vec);
         return JNI_FALSE;
     }
@@ -93,21 +90,17 @@ Java_mmap_impl_MMapUtils_isLoaded0(JNIEnv* env, jclass,
 #endif /* (_WIN64) */
 }
 
-/*
- * Class:     mmap_impl_MMapUtils
- * Method:    load0
- * Signature: (JJ)Z
- */
-JNIEXPORT jboolean JNICALL
-Java_mmap_impl_MMapUtils_load0(JNIEnv* env, jclass,
-  jlong address,
-  jlong length) {
+static jboolean load(jlong address, jlong length) {
+
+    stats_scope stats(OP_LOAD, address, length);
+
 #if defined (_WIN64)
 
     WIN32_MEMORY_RANGE_ENTRY range = {(PVOID) jlong_to_ptr(address), (SIZE_T) length};
     // PrefetchVirtualMemory returns non-zero on success
     int result = PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
     if (result == 0) {
+        stats.fail((int) GetLastError());
         return JNI_FALSE;
     }
     return JNI_TRUE;
@@ -115,8 +108,11 @@ Java_mmap_impl_MMapUtils_load0(JNIEnv* env, jclass,
 #else /* Linux / Unix */
 
     char* a = (char*) jlong_to_ptr(address);
+    NATIVE_PROBE3(madvise_entry, a, length, MADV_WILLNEED);
     int result = madvise((caddr_t) a, (size_t) length, MADV_WILLNEED);
+    NATIVE_PROBE3(madvise_return, a, length, (result == -1) ? -errno : 0);
     if (result == -1) {
+        stats.fail(errno);
         return JNI_FALSE;
     }
     return JNI_TRUE;
@@ -124,15 +120,10 @@ Java_mmap_impl_MMapUtils_load0(JNIEnv* env, jclass,
 #endif /* (_WIN64) */
 }
 
-/*
- * Class:     mmap_impl_MMapUtils
- * Method:    unload0
- * Signature: (JJ)Z
- */
-JNIEXPORT jboolean JNICALL
-Java_mmap_impl_MMapUtils_unload0(JNIEnv* env, jclass,
-  jlong address,
-  jlong length) {
+static jboolean unload(jlong address, jlong length) {
+
+    stats_scope stats(OP_UNLOAD, address, length);
+
 #if defined (_WIN64)
 
     void* a = jlong_to_ptr(address);
@@ -148,13 +139,17 @@ Java_mmap_impl_MMapUtils_unload0(JNIEnv* env, jclass,
     if (result == 0) {
         return JNI_TRUE;
     }
+    stats.fail((int) GetLastError());
     return JNI_FALSE;
 
 #else /* Linux / Unix */
 
     char* a = (char*) jlong_to_ptr(address);
+    NATIVE_PROBE3(madvise_entry, a, length, MADV_DONTNEED);
     int result = madvise((caddr_t) a, (size_t) length, MADV_DONTNEED);
+    NATIVE_PROBE3(madvise_return, a, length, (result == -1) ? -errno : 0);
     if (result == -1) {
+        stats.fail(errno);
         return JNI_FALSE;
     }
     return JNI_TRUE;
@@ -162,16 +157,10 @@ Java_mmap_impl_MMapUtils_unload0(JNIEnv* env, jclass,
 #endif /* (_WIN64) */
 }
 
-/*
- * Class:     mmap_impl_MMapUtils
- * Method:    force0
- * Signature: (JJJ)Z
- */
-JNIEXPORT jboolean JNICALL
-Java_mmap_impl_MMapUtils_force0(JNIEnv* env, jclass,
-  jlong fd,
-  jlong address,
-  jlong length) {
+static jboolean force(jlong fd, jlong address, jlong length) {
+
+    stats_scope stats(OP_FORCE, address, length);
+
 #if defined (_WIN64)
 
     void* a = jlong_to_ptr(address);
@@ -205,6 +194,7 @@ Java_mmap_impl_MMapUtils_force0(JNIEnv* env, jclass,
     }
 
     if (result == 0) {
+        stats.fail((int) GetLastError());
         return JNI_FALSE;
     }
     return JNI_TRUE;
@@ -212,8 +202,11 @@ Java_mmap_impl_MMapUtils_force0(JNIEnv* env, jclass,
 #else /* Linux / Unix */
 
     void* a = jlong_to_ptr(address);
+    NATIVE_PROBE3(msync_entry, a, length, MS_SYNC);
     int result = msync(a, (size_t) length, MS_SYNC);
+    NATIVE_PROBE3(msync_return, a, length, (result == -1) ? -errno : 0);
     if (result == -1) {
+        stats.fail(errno);
         return JNI_FALSE;
     }
     return JNI_TRUE;
@@ -222,6 +215,98 @@ Java_mmap_impl_MMapUtils_force0(JNIEnv* env, jclass,
 }
 
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Class:     mmap_impl_MMapUtils
+ * Method:    isLoaded0
+ * Signature: (JJJ)Z
+ */
+JNIEXPORT jboolean JNICALL
+Java_mmap_impl_MMapUtils_isLoaded0(JNIEnv* env, jclass,
+  jlong address,
+  jlong length,
+  jlong pageCount) {
+    return is_loaded(address, length, pageCount);
+}
+
+/*
+ * Class:     mmap_impl_MMapUtils
+ * Method:    load0
+ * Signature: (JJ)Z
+ */
+JNIEXPORT jboolean JNICALL
+Java_mmap_impl_MMapUtils_load0(JNIEnv* env, jclass,
+  jlong address,
+  jlong length) {
+    return load(address, length);
+}
+
+/*
+ * Class:     mmap_impl_MMapUtils
+ * Method:    unload0
+ * Signature: (JJ)Z
+ */
+JNIEXPORT jboolean JNICALL
+Java_mmap_impl_MMapUtils_unload0(JNIEnv* env, jclass,
+  jlong address,
+  jlong length) {
+    return unload(address, length);
+}
+
+/*
+ * Class:     mmap_impl_MMapUtils
+ * Method:    force0
+ * Signature: (JJJ)Z
+ */
+JNIEXPORT jboolean JNICALL
+Java_mmap_impl_MMapUtils_force0(JNIEnv* env, jclass,
+  jlong fd,
+  jlong address,
+  jlong length) {
+    return force(fd, address, length);
+}
+
+
+/*
+ * Plain C entry points for java.lang.foreign downcalls (NativeFFM.java).
+ * They return 1 for JNI_TRUE and 0 for JNI_FALSE.
+ */
+
+JNIEXPORT jint JNICALL
+mmap_isLoaded(
+  jlong address,
+  jlong length,
+  jlong pageCount) {
+    return is_loaded(address, length, pageCount);
+}
+
+JNIEXPORT jint JNICALL
+mmap_load(
+  jlong address,
+  jlong length) {
+    return load(address, length);
+}
+
+JNIEXPORT jint JNICALL
+mmap_unload(
+  jlong address,
+  jlong length) {
+    return unload(address, length);
+}
+
+JNIEXPORT jint JNICALL
+mmap_force(
+  jlong fd,
+  jlong address,
+  jlong length) {
+    return force(fd, address, length);
+}
+
+
 #ifdef __cplusplus
 }
 #endif // #ifdef __cplusplus
@@ -34,7 +34,8 @@ public final class MMapUtils {
         if (pageCount > Integer.MAX_VALUE) {
             return false;
         }
-        return isLoaded0(mappingAddress(address, offset), length, pageCount);
+        long a = mappingAddress(address, offset);
+        return NativeFFM.AVAILABLE ? NativeFFM.isLoaded(a, length, pageCount) : isLoaded0(a, length, pageCount);
     }
 
     public static boolean loadAdvise(long address, long size) {
@@ -43,7 +44,8 @@ public final class MMapUtils {
         }
         long offset = mappingOffset(address);
         long length = mappingLength(offset, size);
-        return load0(mappingAddress(address, offset), length);
+        long a = mappingAddress(address, offset);
+        return NativeFFM.AVAILABLE ? NativeFFM.load(a, length) : load0(a, length);
     }
 
     public static boolean loadEnforce(long address, long size) {
@@ -81,7 +83,8 @@ public final class MMapUtils {
         }
         long offset = mappingOffset(address);
         long length = mappingLength(offset, size);
-        return unload0(mappingAddress(address, offset), length);
+        long a = mappingAddress(address, offset);
+        return NativeFFM.AVAILABLE ? NativeFFM.unload(a, length) : unload0(a, length);
     }
 
     public static boolean force(FileDescriptor fd, long address, long index, long length) {
@@ -92,10 +95,12 @@ public final class MMapUtils {
         if (Native.isWindows()) {
             rawfd = getFileDescriptor(fd);
         }
-        return force0(rawfd, mappingAddress(address, offset, index), mappingLength(offset, length));
+        long a = mappingAddress(address, offset, index);
+        long len = mappingLength(offset, length);
+        return NativeFFM.AVAILABLE ? NativeFFM.force(rawfd, a, len) : force0(rawfd, a, len);
     }
 
-    // native methods
+    // native methods (JNI, used if NativeFFM isn't available)
 
     private static native boolean isLoaded0(long address, long length, long pageCount);
 
@@ -153,7 +158,8 @@ public final class MMapUtils {
         return address & ~(pageSize - 1);
     }
 
-    private static long getFileDescriptor(FileDescriptor fd) {
+    // the raw fd (Linux / Unix) or HANDLE (Windows) of a FileDescriptor
+    public static long getFileDescriptor(FileDescriptor fd) {
         try {
             if (Native.isWindows()) {
                 return FD_WIN.getLong(fd);
@@ -0,0 +1,84 @@
+package mmap.impl;
+
+import java.io.FileInputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.util.Properties;
+import java.util.logging.Logger;
+
+/**
+ * Read-only access to the machine profile written by the native
+ * {@code machine_probe} tool (see {@code src/main/cpp/machine_probe}). The
+ * profile is loaded once from the file named by the system property
+ * {@code mmap.impl.machineProfile}. If the property isn't set or the file
+ * can't be read all lookups return their default values, so callers can
+ * always fall back to their built-in thresholds.
+ * <p>
+ * Some of the keys written by {@code machine_probe}:
+ *
+ * <pre>
+ *   isa.instrset                   same numbering as CPU.detectInstructionSet()
+ *   cache.l1d|l2|l3.bytes          used by the default read-ahead of disk.QueueFile
+ *   flops.fma_per_core             peak FLOP/s of one core
+ *   l1|l2|l3|dram.read_bytes_per_sec
+ *   l1|l2|l3|dram.latency_ns
+ *   roofline.ridge_flops_per_byte
+ *   mmap.fault_minor_ns_per_page   mmap.willneed_ns_per_page
+ *   mmap.mincore_ns_per_page       mmap.msync_ns_per_page
+ * </pre>
+ */
+public final class MachineProfile {
+
+    private static final Logger logger = Logger.getLogger(MachineProfile.class.getName());
+
+    /** Returns {@code true} if a machine profile has been loaded. */
+    public static boolean isPresent() {
+        return !PROFILE.isEmpty();
+    }
+
+    public static double getDouble(String key, double defaultValue) {
+        String value = PROFILE.getProperty(key);
+        if (value != null) {
+            try {
+                return Double.parseDouble(value.trim());
+            } catch (NumberFormatException ignore) {
+            }
+        }
+        return defaultValue;
+    }
+
+    public static long getLong(String key, long defaultValue) {
+        String value = PROFILE.getProperty(key);
+        if (value != null) {
+            try {
+                return Long.parseLong(value.trim());
+            } catch (NumberFormatException ignore) {
+            }
+        }
+        return defaultValue;
+    }
+
+    public static boolean getBoolean(String key, boolean defaultValue) {
+        String value = PROFILE.getProperty(key);
+        return (value == null) ? defaultValue : Boolean.parseBoolean(value.trim());
+    }
+
+    private static Properties load(String path) {
+        Properties profile = new Properties();
+        if (path != null) {
+            try (InputStream in = new FileInputStream(path)) {
+                profile.load(in);
+            } catch (IOException e) {
+                logger.warning("Can't read machine profile " + path + ": " + e);
+                profile.clear();
+            }
+        }
+        return profile;
+    }
+
+    private static final Properties PROFILE = load(System.getProperty("mmap.impl.machineProfile"));
+
+    private MachineProfile() {
+        throw new AssertionError();
+    }
+}
@@ -5,6 +5,9 @@
 
 #include <string.h>
 
+#include "native_sdt.h"
+#include "native_stats.h"
+
 
 #ifdef _WIN64
 #define jlong_to_ptr(a) ((void*)(a))
@@ -47,23 +50,89 @@
                               ((jlong) SWAPINT((jint) ((x) >> 32)) & 0xffffffff)))
 
 
+/* Byte-swapping copy kernels. The size is given in bytes. */
+
+static inline void swap_shorts(const jbyte* src, jbyte* dst, size_t size) {
+    const jshort* srcShort = (const jshort*) src;
+    const jshort* endShort = srcShort + (size / sizeof(jshort));
+    jshort* dstShort = (jshort*) dst;
+    while (srcShort < endShort) {
+        jshort tmpShort = *srcShort++;
+        *dstShort++ = SWAPSHORT(tmpShort);
+    }
+}
+
+static inline void swap_ints(const jbyte* src, jbyte* dst, size_t size) {
+    const jint* srcInt = (const jint*) src;
+    const jint* endInt = srcInt + (size / sizeof(jint));
+    jint* dstInt = (jint*) dst;
+    while (srcInt < endInt) {
+        jint tmpInt = *srcInt++;
+        *dstInt++ = SWAPINT(tmpInt);
+    }
+}
+
+static inline void swap_longs(const jbyte* src, jbyte* dst, size_t size) {
+    const jlong* srcLong = (const jlong*) src;
+    const jlong* endLong = srcLong + (size / sizeof(jlong));
+    jlong* dstLong = (jlong*) dst;
+    while (srcLong < endLong) {
+        jlong tmpLong = *srcLong++;
+        *dstLong++ = SWAPLONG(tmpLong);
+    }
+}
+
+typedef void (*swap_kernel)(const jbyte* src, jbyte* dst, size_t size);
+
+/*
+ * Address-to-address copy-swap. Both sides are off-heap, so nothing is
+ * pinned and the calling thread stays in native state for the whole copy,
+ * i.e. it neither holds up a safepoint nor the GC.
+ */
+static inline void copy_swap(native_op op, swap_kernel kernel, jlong srcAddr, jlong dstAddr, jlong length) {
+    stats_scope stats(op, dstAddr, length);
+    NATIVE_PROBE4(copyswap_entry, op, srcAddr, dstAddr, length);
+    kernel((const jbyte*) jlong_to_ptr(srcAddr), (jbyte*) jlong_to_ptr(dstAddr), (size_t) length);
+    NATIVE_PROBE3(copyswap_return, op, length, 0);
+}
+
+/* The address of a direct buffer plus pos, or 0 with a pending exception */
+static inline jlong buffer_address(JNIEnv* env, jobject buffer, jlong pos) {
+    jbyte* address = (jbyte*) env->GetDirectBufferAddress(buffer);
+    if (address == NULL) {
+        jclass iae = env->FindClass("java/lang/IllegalArgumentException");
+        if (iae != NULL) {
+            env->ThrowNew(iae, "not a direct buffer");
+        }
+        return 0;
+    }
+    return ptr_to_jlong(address + pos);
+}
+
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
+/*
+ * Class:     mmap_impl_Native
+ * Method:    copySwapFromShortArray
+ * Signature: (Ljava/lang/Object;JJJ)V
+ */
 JNIEXPORT void JNICALL
-Java_mmap_impl_Native_copySwapFromShortArray(JNIEnv* env, jobject,
+Java_mmap_impl_Native_copySwapFromShortArray(JNIEnv* env, jclass,
   jobject src,
   jlong srcPos,
   jlong dstAddr,
   jlong length) {
 
+    stats_scope stats(OP_COPY_SWAP_FROM_SHORT_ARRAY, dstAddr, length);
+    NATIVE_PROBE4(copyswap_entry, OP_COPY_SWAP_FROM_SHORT_ARRAY, srcPos, dstAddr, length);
+
     jbyte* bytes;
     size_t size;
 
-    jshort* dstShort = (jshort*) jlong_to_ptr(dstAddr);
-
     while (length > 0) {
 
         if (length > MBYTE) {
@@ -73,34 +142,42 @@ Java_mmap_impl_Native_copySwapFromShortArray(JNIEnv* env, jobject,
         }
 
         GETCRITICAL(bytes, env, src);
-
-        jshort* srcShort = (jshort*) (bytes + srcPos);
-        jshort* endShort = srcShort + (size / sizeof(jshort));
-        while (srcShort < endShort) {
-          jshort tmpShort = *srcShort++;
-          *dstShort++ = SWAPSHORT(tmpShort);
+        if (bytes == NULL) {
+            stats.fail();
+            NATIVE_PROBE3(copyswap_return, OP_COPY_SWAP_FROM_SHORT_ARRAY, stats.bytes() - length, -1);
+            return; // OutOfMemoryError is pending
         }
 
+        swap_shorts(bytes + srcPos, (jbyte*) jlong_to_ptr(dstAddr), size);
+
         RELEASECRITICAL(bytes, env, src, JNI_ABORT);
 
         length -= size;
         dstAddr += size;
         srcPos += size;
     }
+
+    NATIVE_PROBE3(copyswap_return, OP_COPY_SWAP_FROM_SHORT_ARRAY, stats.bytes(), 0);
 }
 
+/*
+ * Class:     mmap_impl_Native
+ * Method:    copySwapToShortArray
+ * Signature: (JLjava/lang/Object;JJ)V
+ */
 JNIEXPORT void JNICALL
-Java_mmap_impl_Native_copySwapToShortArray(JNIEnv* env, jobject,
+Java_mmap_impl_Native_copySwapToShortArray(JNIEnv* env, jclass,
   jlong srcAddr,
   jobject dst,
   jlong dstPos,
   jlong length) {
 
+    stats_scope stats(OP_COPY_SWAP_TO_SHORT_ARRAY, srcAddr, length);
+    NATIVE_PROBE4(copyswap_entry, OP_COPY_SWAP_TO_SHORT_ARRAY, srcAddr, dstPos, length);
+
     jbyte* bytes;
     size_t size;
 
-    jshort* srcShort = (jshort*) jlong_to_ptr(srcAddr);
-
     while (length > 0) {
 
         if (length > MBYTE) {
@@ -110,34 +187,42 @@ Java_mmap_impl_Native_copySwapToShortArray(JNIEnv* env, jobject,
         }
 
         GETCRITICAL(bytes, env, dst);
-
-        jshort* dstShort = (jshort*) (bytes + dstPos);
-        jshort* endShort = srcShort + (size / sizeof(jshort));
-        while (srcShort < endShort) {
-            jshort tmpShort = *srcShort++;
-            *dstShort++ = SWAPSHORT(tmpShort);
+        if (bytes == NULL) {
+            stats.fail();
+            NATIVE_PROBE3(copyswap_return, OP_COPY_SWAP_TO_SHORT_ARRAY, stats.bytes() - length, -1);
+            return; // OutOfMemoryError is pending
         }
 
+        swap_shorts((const jbyte*) jlong_to_ptr(srcAddr), bytes + dstPos, size);
+
         RELEASECRITICAL(bytes, env, dst, 0);
 
         length -= size;
         srcAddr += size;
         dstPos += size;
     }
+
+    NATIVE_PROBE3(copyswap_return, OP_COPY_SWAP_TO_SHORT_ARRAY, stats.bytes(), 0);
 }
 
+/*
+ * Class:     mmap_impl_Native
+ * Method:    copySwapFromIntArray
+ * Signature: (Ljava/lang/Object;JJJ)V
+ */
 JNIEXPORT void JNICALL
-Java_mmap_impl_Native_copySwapFromIntArray(JNIEnv* env, jobject,
+Java_mmap_impl_Native_copySwapFromIntArray(JNIEnv* env, jclass,
   jobject src,
   jlong srcPos,
   jlong dstAddr,
   jlong length) {
 
+    stats_scope stats(OP_COPY_SWAP_FROM_INT_ARRAY, dstAddr, length);
+    NATIVE_PROBE4(copyswap_entry, OP_COPY_SWAP_FROM_INT_ARRAY, srcPos, dstAddr, length);
+
     jbyte* bytes;
     size_t size;
 
-    jint* dstInt = (jint*) jlong_to_ptr(dstAddr);
-
     while (length > 0) {
 
         if (length > MBYTE) {
@@ -147,34 +232,42 @@ Java_mmap_impl_Native_copySwapFromIntArray(JNIEnv* env, jobject,
         }
 
         GETCRITICAL(bytes, env, src);
-
-        jint* srcInt = (jint*) (bytes + srcPos);
-        jint* endInt = srcInt + (size / sizeof(jint));
-        while (srcInt < endInt) {
-            jint tmpInt = *srcInt++;
-            *dstInt++ = SWAPINT(tmpInt);
+        if (bytes == NULL) {
+            stats.fail();
+            NATIVE_PROBE3(copyswap_return, OP_COPY_SWAP_FROM_INT_ARRAY, stats.bytes() - length, -1);
+            return; // OutOfMemoryError is pending
         }
 
+        swap_ints(bytes + srcPos, (jbyte*) jlong_to_ptr(dstAddr), size);
+
         RELEASECRITICAL(bytes, env, src, JNI_ABORT);
 
         length -= size;
         dstAddr += size;
         srcPos += size;
     }
+
+    NATIVE_PROBE3(copyswap_return, OP_COPY_SWAP_FROM_INT_ARRAY, stats.bytes(), 0);
 }
 
+/*
+ * Class:     mmap_impl_Native
+ * Method:    copySwapToIntArray
+ * Signature: (JLjava/lang/Object;JJ)V
+ */
 JNIEXPORT void JNICALL
-Java_mmap_impl_Native_copySwapToIntArray(JNIEnv* env, jobject,
+Java_mmap_impl_Native_copySwapToIntArray(JNIEnv* env, jclass,
   jlong srcAddr,
   jobject dst,
   jlong dstPos,
   jlong length) {
 
+    stats_scope stats(OP_COPY_SWAP_TO_INT_ARRAY, srcAddr, length);
+    NATIVE_PROBE4(copyswap_entry, OP_COPY_SWAP_TO_INT_ARRAY, srcAddr, dstPos, length);
+
     jbyte* bytes;
     size_t size;
 
-    jint* srcInt = (jint*) jlong_to_ptr(srcAddr);
-
     while (length > 0) {
 
         if (length > MBYTE) {
@@ -184,34 +277,42 @@ Java_mmap_impl_Native_copySwapToIntArray(JNIEnv* env, jobject,
         }
 
         GETCRITICAL(bytes, env, dst);
-
-        jint* dstInt = (jint*) (bytes + dstPos);
-        jint* endInt = srcInt + (size / sizeof(jint));
-        while (srcInt < endInt) {
-            jint tmpInt = *srcInt++;
-            *dstInt++ = SWAPINT(tmpInt);
+        if (bytes == NULL) {
+            stats.fail();
+            NATIVE_PROBE3(copyswap_return, OP_COPY_SWAP_TO_INT_ARRAY, stats.bytes() - length, -1);
+            return; // OutOfMemoryError is pending
         }
 
+        swap_ints((const jbyte*) jlong_to_ptr(srcAddr), bytes + dstPos, size);
+
         RELEASECRITICAL(bytes, env, dst, 0);
 
         length -= size;
         srcAddr += size;
         dstPos += size;
     }
+
+    NATIVE_PROBE3(copyswap_return, OP_COPY_SWAP_TO_INT_ARRAY, stats.bytes(), 0);
 }
 
+/*
+ * Class:     mmap_impl_Native
+ * Method:    copySwapFromLongArray
+ * Signature: (Ljava/lang/Object;JJJ)V
+ */
 JNIEXPORT void JNICALL
-Java_mmap_impl_Native_copySwapFromLongArray(JNIEnv* env, jobject,
+Java_mmap_impl_Native_copySwapFromLongArray(JNIEnv* env, jclass,
   jobject src,
   jlong srcPos,
   jlong dstAddr,
   jlong length) {
 
+    stats_scope stats(OP_COPY_SWAP_FROM_LONG_ARRAY, dstAddr, length);
+    NATIVE_PROBE4(copyswap_entry, OP_COPY_SWAP_FROM_LONG_ARRAY, srcPos, dstAddr, length);
+
     jbyte* bytes;
     size_t size;
 
-    jlong* dstLong = (jlong*) jlong_to_ptr(dstAddr);
-
     while (length > 0) {
 
         if (length > MBYTE) {
@@ -221,34 +322,42 @@ Java_mmap_impl_Native_copySwapFromLongArray(JNIEnv* env, jobject,
         }
 
         GETCRITICAL(bytes, env, src);
-
-        jlong* srcLong = (jlong*) (bytes + srcPos);
-        jlong* endLong = srcLong + (size / sizeof(jlong));
-        while (srcLong < endLong) {
-            jlong tmpLong = *srcLong++;
-            *dstLong++ = SWAPLONG(tmpLong);
+        if (bytes == NULL) {
+            stats.fail();
+            NATIVE_PROBE3(copyswap_return, OP_COPY_SWAP_FROM_LONG_ARRAY, stats.bytes() - length, -1);
+            return; // OutOfMemoryError is pending
         }
 
+        swap_longs(bytes + srcPos, (jbyte*) jlong_to_ptr(dstAddr), size);
+
         RELEASECRITICAL(bytes, env, src, JNI_ABORT);
 
         length -= size;
         dstAddr += size;
         srcPos += size;
     }
+
+    NATIVE_PROBE3(copyswap_return, OP_COPY_SWAP_FROM_LONG_ARRAY, stats.bytes(), 0);
 }
 
+/*
+ * Class:     mmap_impl_Native
+ * Method:    copySwapToLongArray
+ * Signature: (JLjava/lang/Object;JJ)V
+ */
 JNIEXPORT void JNICALL
-Java_mmap_impl_Native_copySwapToLongArray(JNIEnv* env, jobject,
+Java_mmap_impl_Native_copySwapToLongArray(JNIEnv* env, jclass,
   jlong srcAddr,
   jobject dst,
   jlong dstPos,
   jlong length) {
 
+    stats_scope stats(OP_COPY_SWAP_TO_LONG_ARRAY, srcAddr, length);
+    NATIVE_PROBE4(copyswap_entry, OP_COPY_SWAP_TO_LONG_ARRAY, srcAddr, dstPos, length);
+
     jbyte* bytes;
     size_t size;
 
-    jlong* srcLong = (jlong*) jlong_to_ptr(srcAddr);
-
     while (length > 0) {
 
         if (length > MBYTE) {
@@ -258,20 +367,311 @@ Java_mmap_impl_Native_copySwapToLongArray(JNIEnv* env, jobject,
         }
 
         GETCRITICAL(bytes, env, dst);
-
-        jlong* dstLong = (jlong*) (bytes + dstPos);
-        jlong* endLong = srcLong + (size / sizeof(jlong));
-        while (srcLong < endLong) {
-            jlong tmpLong = *srcLong++;
-            *dstLong++ = SWAPLONG(tmpLong);
+        if (bytes == NULL) {
+            stats.fail();
+            NATIVE_PROBE3(copyswap_return, OP_COPY_SWAP_TO_LONG_ARRAY, stats.bytes() - length, -1);
+            return; // OutOfMemoryError is pending
         }
 
+        swap_longs((const jbyte*) jlong_to_ptr(srcAddr), bytes + dstPos, size);
+
         RELEASECRITICAL(bytes, env, dst, 0);
 
         length -= size;
         srcAddr += size;
         dstPos += size;
     }
+
+    NATIVE_PROBE3(copyswap_return, OP_COPY_SWAP_TO_LONG_ARRAY, stats.bytes(), 0);
+}
+
+/*
+ * The array copy-swap functions above keep the names of the former public
+ * natives (older Java code and the prebuilt mmap_utils.dll use them), the
+ * Java class binds them to its private copySwap*Array0 methods instead.
+ */
+static JNINativeMethod copy_swap_natives[] = {
+    { (char*) "copySwapFromShortArray0", (char*) "(Ljava/lang/Object;JJJ)V",
+      (void*) Java_mmap_impl_Native_copySwapFromShortArray },
+    { (char*) "copySwapToShortArray0", (char*) "(JLjava/lang/Object;JJ)V",
+      (void*) Java_mmap_impl_Native_copySwapToShortArray },
+    { (char*) "copySwapFromIntArray0", (char*) "(Ljava/lang/Object;JJJ)V",
+      (void*) Java_mmap_impl_Native_copySwapFromIntArray },
+    { (char*) "copySwapToIntArray0", (char*) "(JLjava/lang/Object;JJ)V",
+      (void*) Java_mmap_impl_Native_copySwapToIntArray },
+    { (char*) "copySwapFromLongArray0", (char*) "(Ljava/lang/Object;JJJ)V",
+      (void*) Java_mmap_impl_Native_copySwapFromLongArray },
+    { (char*) "copySwapToLongArray0", (char*) "(JLjava/lang/Object;JJ)V",
+      (void*) Java_mmap_impl_Native_copySwapToLongArray },
+};
+
+/*
+ * Class:     mmap_impl_Native
+ * Method:    registerCopySwap0
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_Native_registerCopySwap0(JNIEnv* env, jclass cls) {
+
+    return env->RegisterNatives(cls, copy_swap_natives,
+        (jint) (sizeof(copy_swap_natives) / sizeof(copy_swap_natives[0])));
+}
+
+
+/*
+ * Class:     mmap_impl_Native
+ * Method:    copySwapShorts0
+ * Signature: (JJJ)V
+ */
+JNIEXPORT void JNICALL
+Java_mmap_impl_Native_copySwapShorts0(JNIEnv*, jclass,
+  jlong srcAddr,
+  jlong dstAddr,
+  jlong length) {
+
+    copy_swap(OP_COPY_SWAP_SHORTS, swap_shorts, srcAddr, dstAddr, length);
+}
+
+/*
+ * Class:     mmap_impl_Native
+ * Method:    copySwapFromShortBuffer0
+ * Signature: (Ljava/nio/ByteBuffer;JJJ)V
+ */
+JNIEXPORT void JNICALL
+Java_mmap_impl_Native_copySwapFromShortBuffer0(JNIEnv* env, jclass,
+  jobject src,
+  jlong srcPos,
+  jlong dstAddr,
+  jlong length) {
+
+    jlong srcAddr = buffer_address(env, src, srcPos);
+    if (srcAddr != 0) {
+        copy_swap(OP_COPY_SWAP_SHORTS, swap_shorts, srcAddr, dstAddr, length);
+    }
+}
+
+/*
+ * Class:     mmap_impl_Native
+ * Method:    copySwapToShortBuffer0
+ * Signature: (JLjava/nio/ByteBuffer;JJ)V
+ */
+JNIEXPORT void JNICALL
+Java_mmap_impl_Native_copySwapToShortBuffer0(JNIEnv* env, jclass,
+  jlong srcAddr,
+  jobject dst,
+  jlong dstPos,
+  jlong length) {
+
+    jlong dstAddr = buffer_address(env, dst, dstPos);
+    if (dstAddr != 0) {
+        copy_swap(OP_COPY_SWAP_SHORTS, swap_shorts, srcAddr, dstAddr, length);
+    }
+}
+
+/*
+ * Class:     mmap_impl_Native
+ * Method:    copySwapInts0
+ * Signature: (JJJ)V
+ */
+JNIEXPORT void JNICALL
+Java_mmap_impl_Native_copySwapInts0(JNIEnv*, jclass,
+  jlong srcAddr,
+  jlong dstAddr,
+  jlong length) {
+
+    copy_swap(OP_COPY_SWAP_INTS, swap_ints, srcAddr, dstAddr, length);
+}
+
+/*
+ * Class:     mmap_impl_Native
+ * Method:    copySwapFromIntBuffer0
+ * Signature: (Ljava/nio/ByteBuffer;JJJ)V
+ */
+JNIEXPORT void JNICALL
+Java_mmap_impl_Native_copySwapFromIntBuffer0(JNIEnv* env, jclass,
+  jobject src,
+  jlong srcPos,
+  jlong dstAddr,
+  jlong length) {
+
+    jlong srcAddr = buffer_address(env, src, srcPos);
+    if (srcAddr != 0) {
+        copy_swap(OP_COPY_SWAP_INTS, swap_ints, srcAddr, dstAddr, length);
+    }
+}
+
+/*
+ * Class:     mmap_impl_Native
+ * Method:    copySwapToIntBuffer0
+ * Signature: (JLjava/nio/ByteBuffer;JJ)V
+ */
+JNIEXPORT void JNICALL
+Java_mmap_impl_Native_copySwapToIntBuffer0(JNIEnv* env, jclass,
+  jlong srcAddr,
+  jobject dst,
+  jlong dstPos,
+  jlong length) {
+
+    jlong dstAddr = buffer_address(env, dst, dstPos);
+    if (dstAddr != 0) {
+        copy_swap(OP_COPY_SWAP_INTS, swap_ints, srcAddr, dstAddr, length);
+    }
+}
+
+/*
+ * Class:     mmap_impl_Native
+ * Method:    copySwapLongs0
+ * Signature: (JJJ)V
+ */
+JNIEXPORT void JNICALL
+Java_mmap_impl_Native_copySwapLongs0(JNIEnv*, jclass,
+  jlong srcAddr,
+  jlong dstAddr,
+  jlong length) {
+
+    copy_swap(OP_COPY_SWAP_LONGS, swap_longs, srcAddr, dstAddr, length);
+}
+
+/*
+ * Class:     mmap_impl_Native
+ * Method:    copySwapFromLongBuffer0
+ * Signature: (Ljava/nio/ByteBuffer;JJJ)V
+ */
+JNIEXPORT void JNICALL
+Java_mmap_impl_Native_copySwapFromLongBuffer0(JNIEnv* env, jclass,
+  jobject src,
+  jlong srcPos,
+  jlong dstAddr,
+  jlong length) {
+
+    jlong srcAddr = buffer_address(env, src, srcPos);
+    if (srcAddr != 0) {
+        copy_swap(OP_COPY_SWAP_LONGS, swap_longs, srcAddr, dstAddr, length);
+    }
+}
+
+/*
+ * Class:     mmap_impl_Native
+ * Method:    copySwapToLongBuffer0
+ * Signature: (JLjava/nio/ByteBuffer;JJ)V
+ */
+JNIEXPORT void JNICALL
+Java_mmap_impl_Native_copySwapToLongBuffer0(JNIEnv* env, jclass,
+  jlong srcAddr,
+  jobject dst,
+  jlong dstPos,
+  jlong length) {
+
+    jlong dstAddr = buffer_address(env, dst, dstPos);
+    if (dstAddr != 0) {
+        copy_swap(OP_COPY_SWAP_LONGS, swap_longs, srcAddr, dstAddr, length);
+    }
+}
+
+
+/*
+ * Plain C entry points for java.lang.foreign downcalls (NativeFFM.java).
+ * The array arguments are heap segments passed through a critical downcall,
+ * i.e. they point to the first array element. NativeFFM never passes more
+ * than Native.UNSAFE_COPY_THRESHOLD bytes at once, so there is no chunking.
+ */
+
+JNIEXPORT void JNICALL
+mmap_copySwapFromShortArray(jbyte* src,
+  jlong srcPos,
+  jlong dstAddr,
+  jlong length) {
+
+    stats_scope stats(OP_COPY_SWAP_FROM_SHORT_ARRAY, dstAddr, length);
+    NATIVE_PROBE4(copyswap_entry, OP_COPY_SWAP_FROM_SHORT_ARRAY, srcPos, dstAddr, length);
+    swap_shorts(src + srcPos, (jbyte*) jlong_to_ptr(dstAddr), (size_t) length);
+    NATIVE_PROBE3(copyswap_return, OP_COPY_SWAP_FROM_SHORT_ARRAY, length, 0);
+}
+
+JNIEXPORT void JNICALL
+mmap_copySwapToShortArray(jlong srcAddr,
+  jbyte* dst,
+  jlong dstPos,
+  jlong length) {
+
+    stats_scope stats(OP_COPY_SWAP_TO_SHORT_ARRAY, srcAddr, length);
+    NATIVE_PROBE4(copyswap_entry, OP_COPY_SWAP_TO_SHORT_ARRAY, srcAddr, dstPos, length);
+    swap_shorts((const jbyte*) jlong_to_ptr(srcAddr), dst + dstPos, (size_t) length);
+    NATIVE_PROBE3(copyswap_return, OP_COPY_SWAP_TO_SHORT_ARRAY, length, 0);
+}
+
+JNIEXPORT void JNICALL
+mmap_copySwapFromIntArray(jbyte* src,
+  jlong srcPos,
+  jlong dstAddr,
+  jlong length) {
+
+    stats_scope stats(OP_COPY_SWAP_FROM_INT_ARRAY, dstAddr, length);
+    NATIVE_PROBE4(copyswap_entry, OP_COPY_SWAP_FROM_INT_ARRAY, srcPos, dstAddr, length);
+    swap_ints(src + srcPos, (jbyte*) jlong_to_ptr(dstAddr), (size_t) length);
+    NATIVE_PROBE3(copyswap_return, OP_COPY_SWAP_FROM_INT_ARRAY, length, 0);
+}
+
+JNIEXPORT void JNICALL
+mmap_copySwapToIntArray(jlong srcAddr,
+  jbyte* dst,
+  jlong dstPos,
+  jlong length) {
+
+    stats_scope stats(OP_COPY_SWAP_TO_INT_ARRAY, srcAddr, length);
+    NATIVE_PROBE4(copyswap_entry, OP_COPY_SWAP_TO_INT_ARRAY, srcAddr, dstPos, length);
+    swap_ints((const jbyte*) jlong_to_ptr(srcAddr), dst + dstPos, (size_t) length);
+    NATIVE_PROBE3(copyswap_return, OP_COPY_SWAP_TO_INT_ARRAY, length, 0);
+}
+
+JNIEXPORT void JNICALL
+mmap_copySwapFromLongArray(jbyte* src,
+  jlong srcPos,
+  jlong dstAddr,
+  jlong length) {
+
+    stats_scope stats(OP_COPY_SWAP_FROM_LONG_ARRAY, dstAddr, length);
+    NATIVE_PROBE4(copyswap_entry, OP_COPY_SWAP_FROM_LONG_ARRAY, srcPos, dstAddr, length);
+    swap_longs(src + srcPos, (jbyte*) jlong_to_ptr(dstAddr), (size_t) length);
+    NATIVE_PROBE3(copyswap_return, OP_COPY_SWAP_FROM_LONG_ARRAY, length, 0);
+}
+
+JNIEXPORT void JNICALL
+mmap_copySwapToLongArray(jlong srcAddr,
+  jbyte* dst,
+  jlong dstPos,
+  jlong length) {
+
+    stats_scope stats(OP_COPY_SWAP_TO_LONG_ARRAY, srcAddr, length);
+    NATIVE_PROBE4(copyswap_entry, OP_COPY_SWAP_TO_LONG_ARRAY, srcAddr, dstPos, length);
+    swap_longs((const jbyte*) jlong_to_ptr(srcAddr), dst + dstPos, (size_t) length);
+    NATIVE_PROBE3(copyswap_return, OP_COPY_SWAP_TO_LONG_ARRAY, length, 0);
+}
+
+/* Address-to-address variants, linked as regular (non-critical) downcalls */
+
+JNIEXPORT void JNICALL
+mmap_copySwapShorts(jlong srcAddr,
+  jlong dstAddr,
+  jlong length) {
+
+    copy_swap(OP_COPY_SWAP_SHORTS, swap_shorts, srcAddr, dstAddr, length);
+}
+
+JNIEXPORT void JNICALL
+mmap_copySwapInts(jlong srcAddr,
+  jlong dstAddr,
+  jlong length) {
+
+    copy_swap(OP_COPY_SWAP_INTS, swap_ints, srcAddr, dstAddr, length);
+}
+
+JNIEXPORT void JNICALL
+mmap_copySwapLongs(jlong srcAddr,
+  jlong dstAddr,
+  jlong length) {
+
+    copy_swap(OP_COPY_SWAP_LONGS, swap_longs, srcAddr, dstAddr, length);
 }
 
 #ifdef __cplusplus
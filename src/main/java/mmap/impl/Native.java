@@ -1,6 +1,8 @@
 package mmap.impl;
 
 import java.lang.reflect.Method;
+import java.nio.Buffer;
+import java.nio.ByteBuffer;
 import sun.misc.Unsafe;
 
 /**
@@ -44,6 +46,15 @@ public final class Native {
 
     // -- Direct memory management --
 
+    // Returns the base address of a direct buffer (irrespective of its
+    // position)
+    public static long address(ByteBuffer buf) {
+        if (!buf.isDirect()) {
+            throw new IllegalArgumentException("Not a direct buffer");
+        }
+        return U.getLong(buf, BUFFER_ADDRESS);
+    }
+
     // These methods should be called whenever direct memory is allocated or
     // freed. They allow the user to control the amount of direct memory
     // which a process may access. All sizes are specified in bytes.
@@ -123,17 +134,244 @@ public final class Native {
         copySwapToShortArray(srcAddr, dst, dstPos, length);
     }
 
-    public static native void copySwapFromShortArray(Object src, long srcPos, long dstAddr, long length);
+    // The array copy-swap methods use the java.lang.foreign downcalls of
+    // NativeFFM when they are available (JDK 22+): they access the arrays in
+    // place, at most UNSAFE_COPY_THRESHOLD bytes per call, instead of pinning
+    // them in a JNI call. Otherwise they use the JNI natives below or, with a
+    // library that can't register them (an older mmap_utils.dll), Unsafe.
+
+    public static void copySwapFromShortArray(Object src, long srcPos, long dstAddr, long length) {
+        if (NativeFFM.AVAILABLE) {
+            while (length > 0L) {
+                long size = (length > UNSAFE_COPY_THRESHOLD) ? UNSAFE_COPY_THRESHOLD : length;
+                NativeFFM.copySwapFromShortArray(src, srcPos, dstAddr, size);
+                length -= size;
+                srcPos += size;
+                dstAddr += size;
+            }
+        } else if (JniCopySwap.AVAILABLE) {
+            copySwapFromShortArray0(src, srcPos, dstAddr, length);
+        } else {
+            copySwapFromArrayJava(src, srcPos, dstAddr, length, 2);
+        }
+    }
+
+    public static void copySwapToShortArray(long srcAddr, Object dst, long dstPos, long length) {
+        if (NativeFFM.AVAILABLE) {
+            while (length > 0L) {
+                long size = (length > UNSAFE_COPY_THRESHOLD) ? UNSAFE_COPY_THRESHOLD : length;
+                NativeFFM.copySwapToShortArray(srcAddr, dst, dstPos, size);
+                length -= size;
+                srcAddr += size;
+                dstPos += size;
+            }
+        } else if (JniCopySwap.AVAILABLE) {
+            copySwapToShortArray0(srcAddr, dst, dstPos, length);
+        } else {
+            copySwapToArrayJava(srcAddr, dst, dstPos, length, 2);
+        }
+    }
+
+    public static void copySwapFromIntArray(Object src, long srcPos, long dstAddr, long length) {
+        if (NativeFFM.AVAILABLE) {
+            while (length > 0L) {
+                long size = (length > UNSAFE_COPY_THRESHOLD) ? UNSAFE_COPY_THRESHOLD : length;
+                NativeFFM.copySwapFromIntArray(src, srcPos, dstAddr, size);
+                length -= size;
+                srcPos += size;
+                dstAddr += size;
+            }
+        } else if (JniCopySwap.AVAILABLE) {
+            copySwapFromIntArray0(src, srcPos, dstAddr, length);
+        } else {
+            copySwapFromArrayJava(src, srcPos, dstAddr, length, 4);
+        }
+    }
+
+    public static void copySwapToIntArray(long srcAddr, Object dst, long dstPos, long length) {
+        if (NativeFFM.AVAILABLE) {
+            while (length > 0L) {
+                long size = (length > UNSAFE_COPY_THRESHOLD) ? UNSAFE_COPY_THRESHOLD : length;
+                NativeFFM.copySwapToIntArray(srcAddr, dst, dstPos, size);
+                length -= size;
+                srcAddr += size;
+                dstPos += size;
+            }
+        } else if (JniCopySwap.AVAILABLE) {
+            copySwapToIntArray0(srcAddr, dst, dstPos, length);
+        } else {
+            copySwapToArrayJava(srcAddr, dst, dstPos, length, 4);
+        }
+    }
+
+    public static void copySwapFromLongArray(Object src, long srcPos, long dstAddr, long length) {
+        if (NativeFFM.AVAILABLE) {
+            while (length > 0L) {
+                long size = (length > UNSAFE_COPY_THRESHOLD) ? UNSAFE_COPY_THRESHOLD : length;
+                NativeFFM.copySwapFromLongArray(src, srcPos, dstAddr, size);
+                length -= size;
+                srcPos += size;
+                dstAddr += size;
+            }
+        } else if (JniCopySwap.AVAILABLE) {
+            copySwapFromLongArray0(src, srcPos, dstAddr, length);
+        } else {
+            copySwapFromArrayJava(src, srcPos, dstAddr, length, 8);
+        }
+    }
+
+    public static void copySwapToLongArray(long srcAddr, Object dst, long dstPos, long length) {
+        if (NativeFFM.AVAILABLE) {
+            while (length > 0L) {
+                long size = (length > UNSAFE_COPY_THRESHOLD) ? UNSAFE_COPY_THRESHOLD : length;
+                NativeFFM.copySwapToLongArray(srcAddr, dst, dstPos, size);
+                length -= size;
+                srcAddr += size;
+                dstPos += size;
+            }
+        } else if (JniCopySwap.AVAILABLE) {
+            copySwapToLongArray0(srcAddr, dst, dstPos, length);
+        } else {
+            copySwapToArrayJava(srcAddr, dst, dstPos, length, 8);
+        }
+    }
+
+    // Element by element, in the byte order opposite to the native one
+    private static void copySwapFromArrayJava(Object src, long srcPos, long dstAddr, long length, int size) {
+        long offset = U.arrayBaseOffset(src.getClass()) + srcPos;
+        for (long i = 0L; i <= length - size; i += size) {
+            if (size == 2) {
+                U.putShort(dstAddr + i, Short.reverseBytes(U.getShort(src, offset + i)));
+            } else if (size == 4) {
+                U.putInt(dstAddr + i, Integer.reverseBytes(U.getInt(src, offset + i)));
+            } else {
+                U.putLong(dstAddr + i, Long.reverseBytes(U.getLong(src, offset + i)));
+            }
+        }
+    }
+
+    private static void copySwapToArrayJava(long srcAddr, Object dst, long dstPos, long length, int size) {
+        long offset = U.arrayBaseOffset(dst.getClass()) + dstPos;
+        for (long i = 0L; i <= length - size; i += size) {
+            if (size == 2) {
+                U.putShort(dst, offset + i, Short.reverseBytes(U.getShort(srcAddr + i)));
+            } else if (size == 4) {
+                U.putInt(dst, offset + i, Integer.reverseBytes(U.getInt(srcAddr + i)));
+            } else {
+                U.putLong(dst, offset + i, Long.reverseBytes(U.getLong(srcAddr + i)));
+            }
+        }
+    }
+
+    // The JNI array copy-swap natives. Their C functions keep the exported
+    // names of the public methods above (Java_mmap_impl_Native_copySwapFromShortArray
+    // etc.), registerCopySwap0 binds them to these methods.
+
+    private static native void copySwapFromShortArray0(Object src, long srcPos, long dstAddr, long length);
+
+    private static native void copySwapToShortArray0(long srcAddr, Object dst, long dstPos, long length);
+
+    private static native void copySwapFromIntArray0(Object src, long srcPos, long dstAddr, long length);
+
+    private static native void copySwapToIntArray0(long srcAddr, Object dst, long dstPos, long length);
+
+    private static native void copySwapFromLongArray0(Object src, long srcPos, long dstAddr, long length);
+
+    private static native void copySwapToLongArray0(long srcAddr, Object dst, long dstPos, long length);
+
+    private static native int registerCopySwap0();
+
+    // Registers the JNI natives on first use (when the library has been loaded)
+    private static final class JniCopySwap {
+        static final boolean AVAILABLE = register();
+
+        private static boolean register() {
+            try {
+                return registerCopySwap0() == 0;
+            } catch (UnsatisfiedLinkError e) {
+                return false;
+            }
+        }
+    }
+
+    // Off-heap to off-heap copy-swap, e.g. from a direct buffer into a mapped
+    // file. Nothing is pinned and the native code runs without a critical
+    // section, so large transfers don't hold up safepoints or the GC. The
+    // ByteBuffer variants require a direct buffer; positions are relative to
+    // the buffer's base address (not its position()).
+
+    public static void copySwapShorts(long srcAddr, long dstAddr, long length) {
+        if (NativeFFM.AVAILABLE) {
+            NativeFFM.copySwapShorts(srcAddr, dstAddr, length);
+        } else {
+            copySwapShorts0(srcAddr, dstAddr, length);
+        }
+    }
+
+    public static void copySwapShorts(ByteBuffer src, long srcPos, long dstAddr, long length) {
+        copySwapFromShortBuffer0(checkDirect(src), srcPos, dstAddr, length);
+    }
+
+    public static void copySwapShorts(long srcAddr, ByteBuffer dst, long dstPos, long length) {
+        copySwapToShortBuffer0(srcAddr, checkDirect(dst), dstPos, length);
+    }
+
+    public static void copySwapInts(long srcAddr, long dstAddr, long length) {
+        if (NativeFFM.AVAILABLE) {
+            NativeFFM.copySwapInts(srcAddr, dstAddr, length);
+        } else {
+            copySwapInts0(srcAddr, dstAddr, length);
+        }
+    }
+
+    public static void copySwapInts(ByteBuffer src, long srcPos, long dstAddr, long length) {
+        copySwapFromIntBuffer0(checkDirect(src), srcPos, dstAddr, length);
+    }
+
+    public static void copySwapInts(long srcAddr, ByteBuffer dst, long dstPos, long length) {
+        copySwapToIntBuffer0(srcAddr, checkDirect(dst), dstPos, length);
+    }
+
+    public static void copySwapLongs(long srcAddr, long dstAddr, long length) {
+        if (NativeFFM.AVAILABLE) {
+            NativeFFM.copySwapLongs(srcAddr, dstAddr, length);
+        } else {
+            copySwapLongs0(srcAddr, dstAddr, length);
+        }
+    }
+
+    public static void copySwapLongs(ByteBuffer src, long srcPos, long dstAddr, long length) {
+        copySwapFromLongBuffer0(checkDirect(src), srcPos, dstAddr, length);
+    }
+
+    public static void copySwapLongs(long srcAddr, ByteBuffer dst, long dstPos, long length) {
+        copySwapToLongBuffer0(srcAddr, checkDirect(dst), dstPos, length);
+    }
+
+    private static ByteBuffer checkDirect(ByteBuffer buf) {
+        if (!buf.isDirect()) {
+            throw new IllegalArgumentException("Not a direct buffer");
+        }
+        return buf;
+    }
+
+    private static native void copySwapShorts0(long srcAddr, long dstAddr, long length);
+
+    private static native void copySwapFromShortBuffer0(ByteBuffer src, long srcPos, long dstAddr, long length);
+
+    private static native void copySwapToShortBuffer0(long srcAddr, ByteBuffer dst, long dstPos, long length);
+
+    private static native void copySwapInts0(long srcAddr, long dstAddr, long length);
 
-    public static native void copySwapToShortArray(long srcAddr, Object dst, long dstPos, long length);
+    private static native void copySwapFromIntBuffer0(ByteBuffer src, long srcPos, long dstAddr, long length);
 
-    public static native void copySwapFromIntArray(Object src, long srcPos, long dstAddr, long length);
+    private static native void copySwapToIntBuffer0(long srcAddr, ByteBuffer dst, long dstPos, long length);
 
-    public static native void copySwapToIntArray(long srcAddr, Object dst, long dstPos, long length);
+    private static native void copySwapLongs0(long srcAddr, long dstAddr, long length);
 
-    public static native void copySwapFromLongArray(Object src, long srcPos, long dstAddr, long length);
+    private static native void copySwapFromLongBuffer0(ByteBuffer src, long srcPos, long dstAddr, long length);
 
-    public static native void copySwapToLongArray(long srcAddr, Object dst, long dstPos, long length);
+    private static native void copySwapToLongBuffer0(long srcAddr, ByteBuffer dst, long dstPos, long length);
 
     private Native() {
         throw new AssertionError();
@@ -145,6 +383,7 @@ public final class Native {
     private static final boolean IS_WINDOWS;
     private static final Method RESERVE_MEMORY;
     private static final Method UNRESERVE_MEMORY;
+    private static final long BUFFER_ADDRESS;
     static {
         try {
             Class<?> clsNioBits = Class.forName("java.nio.Bits");
@@ -157,6 +396,7 @@ public final class Native {
             Method unreserveMemory = clsNioBits.getDeclaredMethod("unreserveMemory", Long.TYPE, Integer.TYPE);
             unreserveMemory.setAccessible(true);
             UNRESERVE_MEMORY = unreserveMemory;
+            BUFFER_ADDRESS = U.objectFieldOffset(Buffer.class.getDeclaredField("address"));
             IS_WINDOWS = System.getProperty("os.name").contains("Windows");
         } catch (Throwable t) {
             throw new ExceptionInInitializerError(t);
@@ -0,0 +1,367 @@
+package mmap.impl;
+
+import java.lang.invoke.MethodHandle;
+import java.lang.invoke.MethodHandles;
+import java.lang.invoke.MethodType;
+import java.lang.reflect.Array;
+import java.lang.reflect.Method;
+import java.util.Optional;
+import java.util.logging.Logger;
+
+/**
+ * {@code java.lang.foreign} (Panama) downcalls to the plain C entry points
+ * ({@code mmap_*}) that the native library exports next to its JNI functions.
+ * <p>
+ * On JDK 22 and later these replace the JNI calls of {@link Native} and
+ * {@link MMapUtils}: the array copy-swap kernels (at most
+ * {@link Native#UNSAFE_COPY_THRESHOLD} bytes per call) are linked as critical
+ * downcalls that skip the thread state transition and access the Java arrays
+ * in place (heap segments) instead of pinning them with
+ * {@code GetPrimitiveArrayCritical}. The off-heap copy-swap variants and the
+ * mmap calls ({@code mincore}, {@code madvise}, {@code msync}) work on ranges
+ * of any length, which would hold up safepoints in a critical downcall, and
+ * use regular downcalls.
+ * <p>
+ * If {@code java.lang.foreign} isn't available, the library symbols can't be
+ * found or the system property {@code mmap.impl.ffm} is {@code false},
+ * {@link #AVAILABLE} is {@code false} and the callers use JNI. The symbols are
+ * looked up in the libraries loaded by this class loader, or in the library
+ * named by the system property {@code mmap.impl.library}. The handles are
+ * built reflectively so that this class compiles and loads on Java 8.
+ */
+final class NativeFFM {
+
+    private static final Logger logger = Logger.getLogger(NativeFFM.class.getName());
+
+    // -- copy-swap (array variants: at most Native.UNSAFE_COPY_THRESHOLD bytes per call) --
+
+    static void copySwapFromShortArray(Object src, long srcPos, long dstAddr, long length) {
+        try {
+            COPY_SWAP_FROM_SHORT_ARRAY.invokeExact(heapSegment(src), srcPos, dstAddr, length);
+        } catch (Throwable t) {
+            throw rethrow(t);
+        }
+    }
+
+    static void copySwapToShortArray(long srcAddr, Object dst, long dstPos, long length) {
+        try {
+            COPY_SWAP_TO_SHORT_ARRAY.invokeExact(srcAddr, heapSegment(dst), dstPos, length);
+        } catch (Throwable t) {
+            throw rethrow(t);
+        }
+    }
+
+    static void copySwapFromIntArray(Object src, long srcPos, long dstAddr, long length) {
+        try {
+            COPY_SWAP_FROM_INT_ARRAY.invokeExact(heapSegment(src), srcPos, dstAddr, length);
+        } catch (Throwable t) {
+            throw rethrow(t);
+        }
+    }
+
+    static void copySwapToIntArray(long srcAddr, Object dst, long dstPos, long length) {
+        try {
+            COPY_SWAP_TO_INT_ARRAY.invokeExact(srcAddr, heapSegment(dst), dstPos, length);
+        } catch (Throwable t) {
+            throw rethrow(t);
+        }
+    }
+
+    static void copySwapFromLongArray(Object src, long srcPos, long dstAddr, long length) {
+        try {
+            COPY_SWAP_FROM_LONG_ARRAY.invokeExact(heapSegment(src), srcPos, dstAddr, length);
+        } catch (Throwable t) {
+            throw rethrow(t);
+        }
+    }
+
+    static void copySwapToLongArray(long srcAddr, Object dst, long dstPos, long length) {
+        try {
+            COPY_SWAP_TO_LONG_ARRAY.invokeExact(srcAddr, heapSegment(dst), dstPos, length);
+        } catch (Throwable t) {
+            throw rethrow(t);
+        }
+    }
+
+    static void copySwapShorts(long srcAddr, long dstAddr, long length) {
+        try {
+            COPY_SWAP_SHORTS.invokeExact(srcAddr, dstAddr, length);
+        } catch (Throwable t) {
+            throw rethrow(t);
+        }
+    }
+
+    static void copySwapInts(long srcAddr, long dstAddr, long length) {
+        try {
+            COPY_SWAP_INTS.invokeExact(srcAddr, dstAddr, length);
+        } catch (Throwable t) {
+            throw rethrow(t);
+        }
+    }
+
+    static void copySwapLongs(long srcAddr, long dstAddr, long length) {
+        try {
+            COPY_SWAP_LONGS.invokeExact(srcAddr, dstAddr, length);
+        } catch (Throwable t) {
+            throw rethrow(t);
+        }
+    }
+
+    // -- memory-mapped files --
+
+    static boolean isLoaded(long address, long length, long pageCount) {
+        try {
+            return (int) IS_LOADED.invokeExact(address, length, pageCount) != 0;
+        } catch (Throwable t) {
+            throw rethrow(t);
+        }
+    }
+
+    static boolean load(long address, long length) {
+        try {
+            return (int) LOAD.invokeExact(address, length) != 0;
+        } catch (Throwable t) {
+            throw rethrow(t);
+        }
+    }
+
+    static boolean unload(long address, long length) {
+        try {
+            return (int) UNLOAD.invokeExact(address, length) != 0;
+        } catch (Throwable t) {
+            throw rethrow(t);
+        }
+    }
+
+    static boolean force(long fd, long address, long length) {
+        try {
+            return (int) FORCE.invokeExact(fd, address, length) != 0;
+        } catch (Throwable t) {
+            throw rethrow(t);
+        }
+    }
+
+    // the heap segment (a java.lang.foreign.MemorySegment) of a primitive array
+    private static Object heapSegment(Object array) throws Throwable {
+        if (array instanceof short[]) {
+            return (Object) OF_SHORTS.invokeExact((short[]) array);
+        }
+        if (array instanceof char[]) {
+            return (Object) OF_CHARS.invokeExact((char[]) array);
+        }
+        if (array instanceof int[]) {
+            return (Object) OF_INTS.invokeExact((int[]) array);
+        }
+        if (array instanceof float[]) {
+            return (Object) OF_FLOATS.invokeExact((float[]) array);
+        }
+        if (array instanceof long[]) {
+            return (Object) OF_LONGS.invokeExact((long[]) array);
+        }
+        if (array instanceof double[]) {
+            return (Object) OF_DOUBLES.invokeExact((double[]) array);
+        }
+        if (array instanceof byte[]) {
+            return (Object) OF_BYTES.invokeExact((byte[]) array);
+        }
+        throw new IllegalArgumentException("Not a primitive array: " + array);
+    }
+
+    private static RuntimeException rethrow(Throwable t) {
+        if (t instanceof RuntimeException) {
+            return (RuntimeException) t;
+        }
+        if (t instanceof Error) {
+            throw (Error) t;
+        }
+        return new IllegalStateException(t);
+    }
+
+    /**
+     * Reflective access to the java.lang.foreign API (final since JDK 22).
+     */
+    private static final class Foreign {
+        final Class<?> memorySegment;
+        final Class<?> memoryLayout;
+        final Class<?> option;
+        final Object linker;
+        final Object lookup;
+        final Object address;
+        final Object javaInt;
+        final Object javaLong;
+        final Method find;
+        final Method of;
+        final Method ofVoid;
+        final Method downcallHandle;
+        final Method critical;
+
+        Foreign() throws ReflectiveOperationException {
+            Class<?> linkerClass = Class.forName("java.lang.foreign.Linker");
+            Class<?> lookupClass = Class.forName("java.lang.foreign.SymbolLookup");
+            Class<?> valueLayout = Class.forName("java.lang.foreign.ValueLayout");
+            Class<?> descriptor = Class.forName("java.lang.foreign.FunctionDescriptor");
+            memorySegment = Class.forName("java.lang.foreign.MemorySegment");
+            memoryLayout = Class.forName("java.lang.foreign.MemoryLayout");
+            option = Class.forName("java.lang.foreign.Linker$Option");
+            Class<?> layouts = Array.newInstance(memoryLayout, 0).getClass();
+            Class<?> options = Array.newInstance(option, 0).getClass();
+
+            critical = option.getMethod("critical", boolean.class);
+            linker = linkerClass.getMethod("nativeLinker").invoke(null);
+            String library = System.getProperty("mmap.impl.library");
+            if (library != null) {
+                Class<?> arena = Class.forName("java.lang.foreign.Arena");
+                Object global = arena.getMethod("global").invoke(null);
+                lookup = lookupClass.getMethod("libraryLookup", String.class, arena).invoke(null, library, global);
+            } else {
+                lookup = lookupClass.getMethod("loaderLookup").invoke(null);
+            }
+            find = lookupClass.getMethod("find", String.class);
+            of = descriptor.getMethod("of", memoryLayout, layouts);
+            ofVoid = descriptor.getMethod("ofVoid", layouts);
+            downcallHandle = linkerClass.getMethod("downcallHandle", memorySegment, descriptor, options);
+            address = valueLayout.getField("ADDRESS").get(null);
+            javaInt = valueLayout.getField("JAVA_INT").get(null);
+            javaLong = valueLayout.getField("JAVA_LONG").get(null);
+        }
+
+        /*
+         * Links the named function. A null result layout denotes a void
+         * function. The MemorySegment parameters of the returned handle are
+         * typed as Object.
+         */
+        MethodHandle downcall(String name, boolean isCritical, boolean heapAccess, Object result, Object... args)
+                throws Throwable {
+            Optional<?> symbol = (Optional<?>) find.invoke(lookup, name);
+            if (!symbol.isPresent()) {
+                throw new UnsatisfiedLinkError(name);
+            }
+            Object layouts = Array.newInstance(memoryLayout, args.length);
+            for (int i = 0; i < args.length; ++i) {
+                Array.set(layouts, i, args[i]);
+            }
+            Object fd = (result == null) ? ofVoid.invoke(null, layouts) : of.invoke(null, result, layouts);
+            Object options = Array.newInstance(option, isCritical ? 1 : 0);
+            if (isCritical) {
+                Array.set(options, 0, critical.invoke(null, heapAccess));
+            }
+            MethodHandle mh = (MethodHandle) downcallHandle.invoke(linker, symbol.get(), fd, options);
+            MethodType type = mh.type();
+            for (int i = 0; i < type.parameterCount(); ++i) {
+                if (type.parameterType(i) == memorySegment) {
+                    type = type.changeParameterType(i, Object.class);
+                }
+            }
+            return mh.asType(type);
+        }
+
+        // MemorySegment.ofArray(arrayClass) typed as (arrayClass)Object
+        MethodHandle ofArray(Class<?> arrayClass) throws ReflectiveOperationException {
+            MethodHandle mh = MethodHandles.publicLookup().findStatic(memorySegment, "ofArray",
+                    MethodType.methodType(memorySegment, arrayClass));
+            return mh.asType(MethodType.methodType(Object.class, arrayClass));
+        }
+    }
+
+    private static Foreign foreign() {
+        if (!Boolean.parseBoolean(System.getProperty("mmap.impl.ffm", "true"))) {
+            return null;
+        }
+        try {
+            return new Foreign();
+        } catch (Throwable t) {
+            // pre JDK 22, use JNI
+            return null;
+        }
+    }
+
+    private static MethodHandle copySwapFrom(String name) {
+        try {
+            return (FFM == null) ? null
+                    : FFM.downcall(name, true, true, null, FFM.address, FFM.javaLong, FFM.javaLong, FFM.javaLong);
+        } catch (Throwable t) {
+            logger.fine("Can't link " + name + ": " + t);
+            return null;
+        }
+    }
+
+    private static MethodHandle copySwapTo(String name) {
+        try {
+            return (FFM == null) ? null
+                    : FFM.downcall(name, true, true, null, FFM.javaLong, FFM.address, FFM.javaLong, FFM.javaLong);
+        } catch (Throwable t) {
+            logger.fine("Can't link " + name + ": " + t);
+            return null;
+        }
+    }
+
+    private static MethodHandle copySwap(String name) {
+        try {
+            return (FFM == null) ? null : FFM.downcall(name, false, false, null, FFM.javaLong, FFM.javaLong, FFM.javaLong);
+        } catch (Throwable t) {
+            logger.fine("Can't link " + name + ": " + t);
+            return null;
+        }
+    }
+
+    private static MethodHandle mmapCall(String name, int longArgs) {
+        try {
+            if (FFM == null) {
+                return null;
+            }
+            Object[] args = new Object[longArgs];
+            for (int i = 0; i < longArgs; ++i) {
+                args[i] = FFM.javaLong;
+            }
+            return FFM.downcall(name, false, false, FFM.javaInt, args);
+        } catch (Throwable t) {
+            logger.fine("Can't link " + name + ": " + t);
+            return null;
+        }
+    }
+
+    private static MethodHandle ofArray(Class<?> arrayClass) {
+        try {
+            return (FFM == null) ? null : FFM.ofArray(arrayClass);
+        } catch (Throwable t) {
+            return null;
+        }
+    }
+
+    private static final Foreign FFM = foreign();
+
+    private static final MethodHandle COPY_SWAP_FROM_SHORT_ARRAY = copySwapFrom("mmap_copySwapFromShortArray");
+    private static final MethodHandle COPY_SWAP_TO_SHORT_ARRAY = copySwapTo("mmap_copySwapToShortArray");
+    private static final MethodHandle COPY_SWAP_FROM_INT_ARRAY = copySwapFrom("mmap_copySwapFromIntArray");
+    private static final MethodHandle COPY_SWAP_TO_INT_ARRAY = copySwapTo("mmap_copySwapToIntArray");
+    private static final MethodHandle COPY_SWAP_FROM_LONG_ARRAY = copySwapFrom("mmap_copySwapFromLongArray");
+    private static final MethodHandle COPY_SWAP_TO_LONG_ARRAY = copySwapTo("mmap_copySwapToLongArray");
+    private static final MethodHandle COPY_SWAP_SHORTS = copySwap("mmap_copySwapShorts");
+    private static final MethodHandle COPY_SWAP_INTS = copySwap("mmap_copySwapInts");
+    private static final MethodHandle COPY_SWAP_LONGS = copySwap("mmap_copySwapLongs");
+
+    private static final MethodHandle IS_LOADED = mmapCall("mmap_isLoaded", 3);
+    private static final MethodHandle LOAD = mmapCall("mmap_load", 2);
+    private static final MethodHandle UNLOAD = mmapCall("mmap_unload", 2);
+    private static final MethodHandle FORCE = mmapCall("mmap_force", 3);
+
+    private static final MethodHandle OF_BYTES = ofArray(byte[].class);
+    private static final MethodHandle OF_SHORTS = ofArray(short[].class);
+    private static final MethodHandle OF_CHARS = ofArray(char[].class);
+    private static final MethodHandle OF_INTS = ofArray(int[].class);
+    private static final MethodHandle OF_FLOATS = ofArray(float[].class);
+    private static final MethodHandle OF_LONGS = ofArray(long[].class);
+    private static final MethodHandle OF_DOUBLES = ofArray(double[].class);
+
+    /** {@code true} if all downcall handles could be linked. */
+    static final boolean AVAILABLE = FFM != null && COPY_SWAP_FROM_SHORT_ARRAY != null
+            && COPY_SWAP_TO_SHORT_ARRAY != null && COPY_SWAP_FROM_INT_ARRAY != null && COPY_SWAP_TO_INT_ARRAY != null
+            && COPY_SWAP_FROM_LONG_ARRAY != null && COPY_SWAP_TO_LONG_ARRAY != null && COPY_SWAP_SHORTS != null
+            && COPY_SWAP_INTS != null && COPY_SWAP_LONGS != null && IS_LOADED != null
+            && LOAD != null && UNLOAD != null && FORCE != null && OF_BYTES != null && OF_SHORTS != null
+            && OF_CHARS != null && OF_INTS != null && OF_FLOATS != null && OF_LONGS != null && OF_DOUBLES != null;
+
+    private NativeFFM() {
+        throw new AssertionError();
+    }
+}
@@ -0,0 +1,119 @@
+
+#ifndef _JAVASOFT_JNI_H_
+#include <jni.h>
+#endif /* _JAVASOFT_JNI_H_ */
+
+#include <mutex>
+
+#include "native_stats.h"
+
+
+/*
+ * All live thread slots plus the totals of threads that have already
+ * terminated. Allocated once and never freed so that thread exit during
+ * process shutdown can't run into a destroyed registry.
+ */
+struct stats_registry {
+    std::mutex lock;
+    stats_slot* head;
+    uint64_t retired[OP_COUNT][STATS_FIELDS];
+};
+
+static stats_registry* registry() {
+    static stats_registry* r = new stats_registry();
+    return r;
+}
+
+/* Unregisters the slot of a terminating thread and keeps its counts */
+struct stats_slot_owner {
+    stats_slot* slot;
+
+    stats_slot_owner() : slot(NULL) {
+    }
+
+    ~stats_slot_owner() {
+        if (slot == NULL) {
+            return;
+        }
+        stats_registry* r = registry();
+        std::lock_guard<std::mutex> guard(r->lock);
+        for (int op = 0; op < OP_COUNT; ++op) {
+            for (int f = 0; f < STATS_FIELDS; ++f) {
+                r->retired[op][f] += slot->counters[op][f].load(std::memory_order_relaxed);
+            }
+        }
+        stats_slot** p = &r->head;
+        while (*p != slot) {
+            p = &(*p)->next;
+        }
+        *p = slot->next;
+        delete slot;
+    }
+};
+
+static thread_local stats_slot_owner owner;
+
+
+stats_slot* stats_thread_slot() {
+    stats_slot* slot = owner.slot;
+    if (slot != NULL) {
+        return slot;
+    }
+    slot = new stats_slot();
+    for (int op = 0; op < OP_COUNT; ++op) {
+        for (int f = 0; f < STATS_FIELDS; ++f) {
+            slot->counters[op][f].store(0, std::memory_order_relaxed);
+        }
+    }
+    stats_registry* r = registry();
+    {
+        std::lock_guard<std::mutex> guard(r->lock);
+        slot->next = r->head;
+        r->head = slot;
+    }
+    owner.slot = slot;
+    return slot;
+}
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Class:     mmap_impl_NativeStats
+ * Method:    snapshot0
+ * Signature: ()[J
+ */
+JNIEXPORT jlongArray JNICALL
+Java_mmap_impl_NativeStats_snapshot0(JNIEnv* env, jclass) {
+
+    jlong table[OP_COUNT * STATS_FIELDS];
+
+    stats_registry* r = registry();
+    {
+        std::lock_guard<std::mutex> guard(r->lock);
+        for (int op = 0; op < OP_COUNT; ++op) {
+            for (int f = 0; f < STATS_FIELDS; ++f) {
+                uint64_t sum = r->retired[op][f];
+                for (stats_slot* s = r->head; s != NULL; s = s->next) {
+                    sum += s->counters[op][f].load(std::memory_order_relaxed);
+                }
+                table[op * STATS_FIELDS + f] = (jlong) sum;
+            }
+        }
+    }
+
+    jlongArray result = env->NewLongArray(OP_COUNT * STATS_FIELDS);
+    if (result == NULL) {
+        return NULL; // OutOfMemoryError is pending
+    }
+    env->SetLongArrayRegion(result, 0, OP_COUNT * STATS_FIELDS, table);
+    return result;
+}
+
+
+#ifdef __cplusplus
+}
+#endif // #ifdef __cplusplus
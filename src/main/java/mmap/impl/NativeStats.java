@@ -0,0 +1,146 @@
+package mmap.impl;
+
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.List;
+
+/**
+ * Always-on per-function statistics of the native entry points in this
+ * package (number of calls, bytes processed, elapsed time stamp counter
+ * cycles and number of failed calls). The counters are cumulative since the
+ * native library was loaded; compute rates from the difference of two
+ * snapshots.
+ */
+public final class NativeStats {
+
+    /** The counters of a single native entry point. */
+    public static final class Entry {
+        private final String name;
+        private final long calls;
+        private final long bytes;
+        private final long cycles;
+        private final long errors;
+
+        Entry(String name, long calls, long bytes, long cycles, long errors) {
+            this.name = name;
+            this.calls = calls;
+            this.bytes = bytes;
+            this.cycles = cycles;
+            this.errors = errors;
+        }
+
+        /** The name of the native entry point. */
+        public String name() {
+            return name;
+        }
+
+        /** Number of calls. */
+        public long calls() {
+            return calls;
+        }
+
+        /** Number of bytes processed (the length argument of the calls). */
+        public long bytes() {
+            return bytes;
+        }
+
+        /**
+         * Time stamp counter cycles spent inside the calls (nanoseconds on
+         * platforms that don't have a time stamp counter).
+         */
+        public long cycles() {
+            return cycles;
+        }
+
+        /** Number of calls that failed. */
+        public long errors() {
+            return errors;
+        }
+
+        @Override
+        //@formatter:off
+        public String toString() {
+            return name
+                 + "[calls=" + calls
+                 + ", bytes=" + bytes
+                 + ", cycles=" + cycles
+                 + ", errors=" + errors
+                 + ']';
+        }
+        //@formatter:on
+    }
+
+    /**
+     * Returns the current counters of all native entry points, in a fixed
+     * order.
+     *
+     * @return a snapshot of the native call statistics
+     */
+    public static List<Entry> snapshot() {
+        long[] table = snapshot0();
+        int count = table.length / FIELDS;
+        ArrayList<Entry> entries = new ArrayList<>(count);
+        for (int i = 0; i < count; ++i) {
+            int j = i * FIELDS;
+            String name = opName(i);
+            entries.add(new Entry(name, table[j], table[j + 1], table[j + 2], table[j + 3]));
+        }
+        return Collections.unmodifiableList(entries);
+    }
+
+    // the name of the native entry point with the given native_op number
+    static String opName(int op) {
+        return (op >= 0 && op < OPS.length) ? OPS[op] : "op#" + op;
+    }
+
+    // returns FIELDS counters per entry point, in the order of OPS
+    private static native long[] snapshot0();
+
+    // number of counters per entry point: calls, bytes, cycles, errors
+    private static final int FIELDS = 4;
+
+    // must be kept in sync with the native_op enum in native_stats.h
+    //@formatter:off
+    private static final String[] OPS = {
+        "Native.copySwapFromShortArray",
+        "Native.copySwapToShortArray",
+        "Native.copySwapFromIntArray",
+        "Native.copySwapToIntArray",
+        "Native.copySwapFromLongArray",
+        "Native.copySwapToLongArray",
+        "MMapUtils.isLoaded0",
+        "MMapUtils.load0",
+        "MMapUtils.unload0",
+        "MMapUtils.force0",
+        "Native.copySwapShorts",
+        "Native.copySwapInts",
+        "Native.copySwapLongs",
+        "BlockCodec.compress",
+        "BlockCodec.decompress",
+        "TimeSeriesCodec.encodeDoubles",
+        "TimeSeriesCodec.decodeDoubles",
+        "TimeSeriesCodec.encodeTimestamps",
+        "TimeSeriesCodec.decodeTimestamps",
+        "DictionaryCodec.encode",
+        "DictionaryCodec.decode",
+        "DictionaryCodec.match",
+        "Crc32C.update",
+        "FrameScanner.scan",
+        "VectoredIO.pwritev",
+        "VectoredIO.preadv",
+        "VectoredIO.zeroRange",
+        "VectoredIO.readAhead",
+        "ResidencyManager.sample",
+        "ResidencyManager.advise",
+        "Smaps.query",
+        "LazyRegion.fault",
+        "Snapshot.create",
+        "SealedBuffer.transfer",
+        "Pbkdf2.derive"
+    };
+    //@formatter:on
+
+    private NativeStats() {
+        throw new AssertionError();
+    }
+}
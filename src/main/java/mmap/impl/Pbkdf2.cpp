@@ -0,0 +1,749 @@
+
+#ifndef _JAVASOFT_JNI_H_
+#include <jni.h>
+#endif /* _JAVASOFT_JNI_H_ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "native_sdt.h"
+#include "native_stats.h"
+
+#if (defined (__GNUC__) || defined (__clang__)) && defined (__x86_64__)
+#define KDF_X86 1
+#include <immintrin.h>
+#endif
+
+
+/*
+ * PBKDF2 (RFC 8018) with HMAC-SHA256 and HMAC-SHA512.
+ *
+ * All but the first iteration of an output block hash a single, fixed
+ * layout block: HMAC(P, U) = H(opad || H(ipad || U)) is two compressions
+ * that start from the key's precomputed ipad / opad states, the message
+ * is U followed by the padding. So the iterations run on words only, and
+ * independent output blocks (of one key or of many passwords) can be
+ * computed side by side in the lanes of a vector register ("multi-buffer"
+ * hashing: every lane runs the scalar algorithm on its own job):
+ *
+ *   SHA-256   AVX-512 16 lanes, SHA-NI 1 lane, AVX2 8 lanes, portable
+ *   SHA-512   AVX-512 8 lanes, AVX2 4 lanes, portable
+ *
+ * The SHA extensions (sha256rnds2) compute one SHA-256 lane faster than
+ * AVX2 computes eight, so AVX2 is only used for SHA-256 on CPUs without
+ * them. The lanes are GCC / clang vector extensions of the portable
+ * compression function, compiled for the target of the caller. The first
+ * iteration (hashing the salt and the block index) and long passwords
+ * use the scalar compression (SHA-NI or portable).
+ *
+ * The CPU features are read with cpuid (and xgetbv for the register state
+ * the OS saves), like instrset_detect.
+ */
+
+#define KDF_SHA256 0
+#define KDF_SHA512 1
+
+#define KDF_FEATURE_SHA_NI 1
+#define KDF_FEATURE_AVX2 2
+#define KDF_FEATURE_AVX512 4
+
+#if defined (__GNUC__) || defined (__clang__)
+#define KDF_INLINE inline __attribute__((always_inline))
+#else
+#define KDF_INLINE inline
+#endif
+
+
+/* ------------------------------ cpu features ------------------------------ */
+
+#if defined (KDF_X86)
+
+/* output[0] = eax, output[1] = ebx, output[2] = ecx, output[3] = edx */
+static inline void cpuid(int output[4], int functionnumber, int ecxleaf = 0) {
+    int a, b, c, d;
+    __asm("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(functionnumber), "c"(ecxleaf) : );
+    output[0] = a;
+    output[1] = b;
+    output[2] = c;
+    output[3] = d;
+}
+
+static inline uint64_t xgetbv(int ctr) {
+    uint32_t a, d;
+    __asm("xgetbv" : "=a"(a), "=d"(d) : "c"(ctr) : );
+    return ((uint64_t) d << 32) | a;
+}
+
+static int detect_features() {
+    int abcd[4] = {0, 0, 0, 0};
+    cpuid(abcd, 0);
+    if (abcd[0] < 7) {
+        return 0;
+    }
+    cpuid(abcd, 1);
+    bool sse41 = (abcd[2] & (1 << 19)) != 0;
+    bool osxsave = (abcd[2] & (1 << 27)) != 0;
+    bool avx = (abcd[2] & (1 << 28)) != 0;
+    uint64_t xcr0 = osxsave ? xgetbv(0) : 0;
+    cpuid(abcd, 7);
+    int features = 0;
+    if (sse41 && (abcd[1] & (1 << 29)) != 0) {
+        features |= KDF_FEATURE_SHA_NI;
+    }
+    if (avx && (xcr0 & 6) == 6 && (abcd[1] & (1 << 5)) != 0) {
+        features |= KDF_FEATURE_AVX2;
+        /* AVX512F and the opmask / zmm state */
+        if ((abcd[1] & (1 << 16)) != 0 && (xcr0 & 0xe0) == 0xe0) {
+            features |= KDF_FEATURE_AVX512;
+        }
+    }
+    return features;
+}
+
+#else
+
+static int detect_features() {
+    return 0;
+}
+
+#endif /* KDF_X86 */
+
+static const int cpu_features = detect_features();
+
+
+/* ------------------------------- hash state ------------------------------- */
+
+static const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t IV256[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const uint64_t K512[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+    0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+    0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+    0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+    0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+    0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+    0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+    0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+    0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+    0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+    0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+    0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+    0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+    0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+static const uint64_t IV512[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+/*
+ * The parameters of a hash: the rotations of the Sigma functions (big0,
+ * big1) and of the message schedule (small0, small1, whose third amount
+ * is a shift).
+ */
+struct sha256 {
+    typedef uint32_t word;
+    enum { BITS = 32, ROUNDS = 64, BLOCK = 64, DIGEST = 32 };
+    enum { BIG0_A = 2, BIG0_B = 13, BIG0_C = 22, BIG1_A = 6, BIG1_B = 11, BIG1_C = 25 };
+    enum { SMALL0_A = 7, SMALL0_B = 18, SMALL0_C = 3, SMALL1_A = 17, SMALL1_B = 19, SMALL1_C = 10 };
+    static const word* k() { return K256; }
+    static const word* iv() { return IV256; }
+};
+
+struct sha512 {
+    typedef uint64_t word;
+    enum { BITS = 64, ROUNDS = 80, BLOCK = 128, DIGEST = 64 };
+    enum { BIG0_A = 28, BIG0_B = 34, BIG0_C = 39, BIG1_A = 14, BIG1_B = 18, BIG1_C = 41 };
+    enum { SMALL0_A = 1, SMALL0_B = 8, SMALL0_C = 7, SMALL1_A = 19, SMALL1_B = 61, SMALL1_C = 6 };
+    static const word* k() { return K512; }
+    static const word* iv() { return IV512; }
+};
+
+/* macros rather than functions: vectors aren't passed by value across targets */
+#define KDF_ROTR(x, n) (((x) >> (int) (n)) | ((x) << (int) (H::BITS - (n))))
+#define KDF_BIG(x, r) (KDF_ROTR(x, H::r##_A) ^ KDF_ROTR(x, H::r##_B) ^ KDF_ROTR(x, H::r##_C))
+#define KDF_SMALL(x, r) (KDF_ROTR(x, H::r##_A) ^ KDF_ROTR(x, H::r##_B) ^ ((x) >> (int) H::r##_C))
+
+/*
+ * One compression of block (16 words, already in host order) into
+ * state. V is a word (one lane) or a vector of words (all lanes at once).
+ */
+template <typename H, typename V>
+static KDF_INLINE void compress(V* state, const V* block) {
+    const typename H::word* k = H::k();
+    V w[16];
+    for (int t = 0; t < 16; ++t) {
+        w[t] = block[t];
+    }
+    V a = state[0];
+    V b = state[1];
+    V c = state[2];
+    V d = state[3];
+    V e = state[4];
+    V f = state[5];
+    V g = state[6];
+    V h = state[7];
+    for (int t = 0; t < H::ROUNDS; ++t) {
+        if (t >= 16) {
+            w[t & 15] += KDF_SMALL(w[(t - 2) & 15], SMALL1) + w[(t - 7) & 15]
+                    + KDF_SMALL(w[(t - 15) & 15], SMALL0);
+        }
+        V t1 = h + KDF_BIG(e, BIG1) + ((e & f) ^ (~e & g)) + k[t] + w[t & 15];
+        V t2 = KDF_BIG(a, BIG0) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+#undef KDF_ROTR
+#undef KDF_BIG
+#undef KDF_SMALL
+
+static void compress256(uint32_t* state, const uint32_t* block) {
+    compress<sha256, uint32_t>(state, block);
+}
+
+static void compress512(uint64_t* state, const uint64_t* block) {
+    compress<sha512, uint64_t>(state, block);
+}
+
+#if defined (KDF_X86)
+
+/* Four rounds of the SHA extensions, k: the round constants */
+#define NI_ROUNDS(m, k)                                                      \
+    t = _mm_add_epi32(m, _mm_loadu_si128((const __m128i*) (k)));             \
+    s1 = _mm_sha256rnds2_epu32(s1, s0, t);                                   \
+    s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(t, 0x0e))
+
+/* The next four message words into m0 (m0..m3: the last 16 words) */
+#define NI_SCHEDULE(m0, m1, m2, m3)                                          \
+    m0 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(m0, m1),    \
+            _mm_alignr_epi8(m3, m2, 4)), m3)
+
+__attribute__((target("sha,sse4.1")))
+static void compress256_ni(uint32_t* state, const uint32_t* block) {
+    /* state as ABEF / CDGH */
+    __m128i t = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) state), 0xb1);
+    __m128i s1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) (state + 4)), 0x1b);
+    __m128i s0 = _mm_alignr_epi8(t, s1, 8);
+    s1 = _mm_blend_epi16(s1, t, 0xf0);
+    __m128i abef = s0;
+    __m128i cdgh = s1;
+
+    __m128i m0 = _mm_loadu_si128((const __m128i*) block);
+    __m128i m1 = _mm_loadu_si128((const __m128i*) (block + 4));
+    __m128i m2 = _mm_loadu_si128((const __m128i*) (block + 8));
+    __m128i m3 = _mm_loadu_si128((const __m128i*) (block + 12));
+    NI_ROUNDS(m0, K256);
+    NI_ROUNDS(m1, K256 + 4);
+    NI_ROUNDS(m2, K256 + 8);
+    NI_ROUNDS(m3, K256 + 12);
+    for (int i = 16; i < 64; i += 16) {
+        NI_SCHEDULE(m0, m1, m2, m3);
+        NI_ROUNDS(m0, K256 + i);
+        NI_SCHEDULE(m1, m2, m3, m0);
+        NI_ROUNDS(m1, K256 + i + 4);
+        NI_SCHEDULE(m2, m3, m0, m1);
+        NI_ROUNDS(m2, K256 + i + 8);
+        NI_SCHEDULE(m3, m0, m1, m2);
+        NI_ROUNDS(m3, K256 + i + 12);
+    }
+    s0 = _mm_add_epi32(s0, abef);
+    s1 = _mm_add_epi32(s1, cdgh);
+
+    /* back to ABCD / EFGH */
+    t = _mm_shuffle_epi32(s0, 0x1b);
+    s1 = _mm_shuffle_epi32(s1, 0xb1);
+    _mm_storeu_si128((__m128i*) state, _mm_blend_epi16(t, s1, 0xf0));
+    _mm_storeu_si128((__m128i*) (state + 4), _mm_alignr_epi8(s1, t, 8));
+}
+
+#undef NI_ROUNDS
+#undef NI_SCHEDULE
+
+#endif /* KDF_X86 */
+
+
+/* --------------------------------- HMAC ---------------------------------- */
+
+template <typename W>
+static inline W load_be(const uint8_t* p) {
+    W w = 0;
+    for (size_t i = 0; i < sizeof(W); ++i) {
+        w = (w << 8) | p[i];
+    }
+    return w;
+}
+
+template <typename W>
+static inline void store_be(uint8_t* p, W w) {
+    for (size_t i = sizeof(W); i > 0; --i) {
+        p[i - 1] = (uint8_t) w;
+        w >>= 8;
+    }
+}
+
+/* Clears secrets (a plain memset before free may be optimized away) */
+static void wipe(void* p, size_t n) {
+    volatile uint8_t* v = (volatile uint8_t*) p;
+    while (n-- > 0) {
+        *v++ = 0;
+    }
+}
+
+/*
+ * The state of an output block of a key: the key's ipad / opad states,
+ * the last U and the xor of all U (the result).
+ */
+template <typename W>
+struct kdf_job {
+    W ipad[8];
+    W opad[8];
+    W u[8];
+    W t[8];
+};
+
+template <typename H>
+struct hasher {
+    typedef typename H::word word;
+    typedef void (*compress_fn)(word* state, const word* block);
+
+    /* the block of one iteration: a digest, then the padding of BLOCK + DIGEST bytes */
+    static void set_padding(word* block) {
+        const int n = H::DIGEST / sizeof(word);
+        block[n] = (word) 0x80 << (H::BITS - 8);
+        for (int i = n + 1; i < 15; ++i) {
+            block[i] = 0;
+        }
+        block[15] = (word) (H::BLOCK + H::DIGEST) * 8;
+    }
+
+    /*
+     * Continues state (prefix bytes have been hashed) over n bytes at p and
+     * finishes the hash.
+     */
+    static void finish(compress_fn fn, word* state, uint64_t prefix, const uint8_t* p, size_t n) {
+        word block[16];
+        uint64_t total = prefix + n;
+        for (; n >= H::BLOCK; p += H::BLOCK, n -= H::BLOCK) {
+            for (int i = 0; i < 16; ++i) {
+                block[i] = load_be<word>(p + i * sizeof(word));
+            }
+            fn(state, block);
+        }
+        uint8_t last[2 * H::BLOCK];
+        memset(last, 0, sizeof(last));
+        memcpy(last, p, n);
+        last[n] = 0x80;
+        /* the length field is 8 (SHA-256) or 16 (SHA-512) bytes, the high bytes stay 0 */
+        size_t len = (n + 1 + 2 * sizeof(word) <= (size_t) H::BLOCK) ? H::BLOCK : 2 * H::BLOCK;
+        store_be<uint64_t>(last + len - 8, total * 8);
+        for (size_t off = 0; off < len; off += H::BLOCK) {
+            for (int i = 0; i < 16; ++i) {
+                block[i] = load_be<word>(last + off + i * sizeof(word));
+            }
+            fn(state, block);
+        }
+        wipe(last, sizeof(last));
+        wipe(block, sizeof(block));
+    }
+
+    /*
+     * Sets up the jobs of the output blocks 1..blocks of a key: the ipad /
+     * opad states and the first iteration. Returns 0 or -ENOMEM.
+     */
+    static int prepare(compress_fn fn, kdf_job<word>* jobs, int blocks, const uint8_t* password, size_t passwordLen,
+            const uint8_t* salt, size_t saltLen) {
+        uint8_t key[H::BLOCK];
+        memset(key, 0, sizeof(key));
+        if (passwordLen > (size_t) H::BLOCK) {
+            word digest[8];
+            memcpy(digest, H::iv(), sizeof(digest));
+            finish(fn, digest, 0, password, passwordLen);
+            for (int i = 0; i < 8; ++i) {
+                store_be<word>(key + i * sizeof(word), digest[i]);
+            }
+            wipe(digest, sizeof(digest));
+        } else if (passwordLen > 0) {
+            memcpy(key, password, passwordLen);
+        }
+        word ipad[8];
+        word opad[8];
+        word block[16];
+        memcpy(ipad, H::iv(), sizeof(ipad));
+        memcpy(opad, H::iv(), sizeof(opad));
+        for (int i = 0; i < 16; ++i) {
+            block[i] = load_be<word>(key + i * sizeof(word)) ^ (word) 0x3636363636363636ULL;
+        }
+        fn(ipad, block);
+        for (int i = 0; i < 16; ++i) {
+            block[i] = load_be<word>(key + i * sizeof(word)) ^ (word) 0x5c5c5c5c5c5c5c5cULL;
+        }
+        fn(opad, block);
+
+        /* U1 = HMAC(P, S || INT(i)) */
+        uint8_t* msg = (uint8_t*) malloc(saltLen + 4);
+        if (msg == NULL) {
+            wipe(key, sizeof(key));
+            return -ENOMEM;
+        }
+        if (saltLen > 0) {
+            memcpy(msg, salt, saltLen);
+        }
+        for (int b = 0; b < blocks; ++b) {
+            kdf_job<word>& job = jobs[b];
+            memcpy(job.ipad, ipad, sizeof(ipad));
+            memcpy(job.opad, opad, sizeof(opad));
+            store_be<uint32_t>(msg + saltLen, (uint32_t) (b + 1));
+            memcpy(block, ipad, sizeof(ipad));
+            finish(fn, block, H::BLOCK, msg, saltLen + 4);
+            set_padding(block);
+            memcpy(job.u, opad, sizeof(opad));
+            fn(job.u, block);
+            memcpy(job.t, job.u, sizeof(job.u));
+        }
+        wipe(key, sizeof(key));
+        wipe(ipad, sizeof(ipad));
+        wipe(opad, sizeof(opad));
+        wipe(block, sizeof(block));
+        free(msg);
+        return 0;
+    }
+};
+
+/*
+ * The iterations 2..iterations of the jobs, LANES jobs at a time (V: a
+ * word for one lane, a vector of LANES words otherwise). A partial group
+ * fills its spare lanes with copies of its first job.
+ */
+template <typename H, typename V, int LANES, void (*COMPRESS)(V*, const V*)>
+static KDF_INLINE void iterate(kdf_job<typename H::word>* jobs, size_t n, uint32_t iterations) {
+    typedef typename H::word word;
+    for (size_t first = 0; first < n; first += LANES) {
+        V ipad[8];
+        V opad[8];
+        V u[8];
+        V t[8];
+        V block[16];
+        V state[8];
+        /* the jobs in lanes (V holds LANES consecutive words) */
+        word lanes[4][8][LANES];
+        for (int lane = 0; lane < LANES; ++lane) {
+            const kdf_job<word>& job = jobs[(first + lane < n) ? first + lane : first];
+            for (int i = 0; i < 8; ++i) {
+                lanes[0][i][lane] = job.ipad[i];
+                lanes[1][i][lane] = job.opad[i];
+                lanes[2][i][lane] = job.u[i];
+                lanes[3][i][lane] = job.t[i];
+            }
+        }
+        memcpy(ipad, lanes[0], sizeof(ipad));
+        memcpy(opad, lanes[1], sizeof(opad));
+        memcpy(u, lanes[2], sizeof(u));
+        memcpy(t, lanes[3], sizeof(t));
+        word pad[16];
+        hasher<H>::set_padding(pad);
+        for (int i = 8; i < 16; ++i) {
+            for (int lane = 0; lane < LANES; ++lane) {
+                lanes[0][0][lane] = pad[i];
+            }
+            memcpy(&block[i], lanes[0][0], sizeof(V));
+        }
+        for (uint32_t it = 1; it < iterations; ++it) {
+            for (int i = 0; i < 8; ++i) {
+                block[i] = u[i];
+                state[i] = ipad[i];
+            }
+            COMPRESS(state, block);
+            for (int i = 0; i < 8; ++i) {
+                block[i] = state[i];
+                u[i] = opad[i];
+            }
+            COMPRESS(u, block);
+            for (int i = 0; i < 8; ++i) {
+                t[i] ^= u[i];
+            }
+        }
+        memcpy(lanes[3], t, sizeof(t));
+        for (int lane = 0; lane < LANES && first + lane < n; ++lane) {
+            for (int i = 0; i < 8; ++i) {
+                jobs[first + lane].t[i] = lanes[3][i][lane];
+            }
+        }
+        wipe(lanes, sizeof(lanes));
+        wipe(ipad, sizeof(ipad));
+        wipe(opad, sizeof(opad));
+        wipe(u, sizeof(u));
+        wipe(t, sizeof(t));
+        wipe(block, sizeof(block));
+        wipe(state, sizeof(state));
+    }
+}
+
+static void iterate256(kdf_job<uint32_t>* jobs, size_t n, uint32_t iterations) {
+    iterate<sha256, uint32_t, 1, compress256>(jobs, n, iterations);
+}
+
+static void iterate512(kdf_job<uint64_t>* jobs, size_t n, uint32_t iterations) {
+    iterate<sha512, uint64_t, 1, compress512>(jobs, n, iterations);
+}
+
+#if defined (KDF_X86)
+
+typedef uint32_t u32x8 __attribute__((vector_size(32)));
+typedef uint32_t u32x16 __attribute__((vector_size(64)));
+typedef uint64_t u64x4 __attribute__((vector_size(32)));
+typedef uint64_t u64x8 __attribute__((vector_size(64)));
+
+static void iterate256_ni(kdf_job<uint32_t>* jobs, size_t n, uint32_t iterations) {
+    iterate<sha256, uint32_t, 1, compress256_ni>(jobs, n, iterations);
+}
+
+__attribute__((target("avx2")))
+static void compress256_x8(u32x8* state, const u32x8* block) {
+    compress<sha256, u32x8>(state, block);
+}
+
+__attribute__((target("avx2")))
+static void iterate256_x8(kdf_job<uint32_t>* jobs, size_t n, uint32_t iterations) {
+    iterate<sha256, u32x8, 8, compress256_x8>(jobs, n, iterations);
+}
+
+__attribute__((target("avx512f")))
+static void compress256_x16(u32x16* state, const u32x16* block) {
+    compress<sha256, u32x16>(state, block);
+}
+
+__attribute__((target("avx512f")))
+static void iterate256_x16(kdf_job<uint32_t>* jobs, size_t n, uint32_t iterations) {
+    iterate<sha256, u32x16, 16, compress256_x16>(jobs, n, iterations);
+}
+
+__attribute__((target("avx2")))
+static void compress512_x4(u64x4* state, const u64x4* block) {
+    compress<sha512, u64x4>(state, block);
+}
+
+__attribute__((target("avx2")))
+static void iterate512_x4(kdf_job<uint64_t>* jobs, size_t n, uint32_t iterations) {
+    iterate<sha512, u64x4, 4, compress512_x4>(jobs, n, iterations);
+}
+
+__attribute__((target("avx512f")))
+static void compress512_x8(u64x8* state, const u64x8* block) {
+    compress<sha512, u64x8>(state, block);
+}
+
+__attribute__((target("avx512f")))
+static void iterate512_x8(kdf_job<uint64_t>* jobs, size_t n, uint32_t iterations) {
+    iterate<sha512, u64x8, 8, compress512_x8>(jobs, n, iterations);
+}
+
+#endif /* KDF_X86 */
+
+/*
+ * The widest lanes that are at least half used. Without AVX-512 the SHA
+ * extensions run a single SHA-256 lane faster than eight AVX2 lanes.
+ */
+static void iterate_jobs(kdf_job<uint32_t>* jobs, size_t n, uint32_t iterations) {
+#if defined (KDF_X86)
+    if ((cpu_features & KDF_FEATURE_AVX512) != 0 && n >= 8) {
+        iterate256_x16(jobs, n, iterations);
+        return;
+    }
+    if ((cpu_features & KDF_FEATURE_SHA_NI) != 0) {
+        iterate256_ni(jobs, n, iterations);
+        return;
+    }
+    if ((cpu_features & KDF_FEATURE_AVX2) != 0 && n >= 4) {
+        iterate256_x8(jobs, n, iterations);
+        return;
+    }
+#endif
+    iterate256(jobs, n, iterations);
+}
+
+static void iterate_jobs(kdf_job<uint64_t>* jobs, size_t n, uint32_t iterations) {
+#if defined (KDF_X86)
+    if ((cpu_features & KDF_FEATURE_AVX512) != 0 && n >= 4) {
+        iterate512_x8(jobs, n, iterations);
+        return;
+    }
+    if ((cpu_features & KDF_FEATURE_AVX2) != 0 && n >= 2) {
+        iterate512_x4(jobs, n, iterations);
+        return;
+    }
+#endif
+    iterate512(jobs, n, iterations);
+}
+
+/*
+ * Derives count keys of keyLength bytes each into keys. The password and
+ * the salt of key i end at passwordEnds[i] and saltEnds[i] (and start at
+ * the end of key i - 1). Returns 0 or -errno.
+ */
+template <typename H>
+static int derive(typename hasher<H>::compress_fn fn, const uint8_t* passwords, const jint* passwordEnds,
+        const uint8_t* salts, const jint* saltEnds, int count, uint32_t iterations, uint8_t* keys, int keyLength) {
+    typedef typename H::word word;
+    int blocks = (keyLength + H::DIGEST - 1) / H::DIGEST;
+    size_t n = (size_t) count * (size_t) blocks;
+    kdf_job<word>* jobs = (kdf_job<word>*) malloc(n * sizeof(kdf_job<word>));
+    if (jobs == NULL) {
+        return -ENOMEM;
+    }
+    int err = 0;
+    for (int i = 0; i < count && err == 0; ++i) {
+        size_t password = (i == 0) ? 0 : (size_t) passwordEnds[i - 1];
+        size_t salt = (i == 0) ? 0 : (size_t) saltEnds[i - 1];
+        err = hasher<H>::prepare(fn, jobs + (size_t) i * blocks, blocks, passwords + password,
+                (size_t) passwordEnds[i] - password, salts + salt, (size_t) saltEnds[i] - salt);
+    }
+    if (err == 0) {
+        iterate_jobs(jobs, n, iterations);
+        for (int i = 0; i < count; ++i) {
+            uint8_t block[H::DIGEST];
+            uint8_t* key = keys + (size_t) i * keyLength;
+            for (int b = 0; b < blocks; ++b) {
+                const kdf_job<word>& job = jobs[(size_t) i * blocks + b];
+                for (int w = 0; w < 8; ++w) {
+                    store_be<word>(block + w * sizeof(word), job.t[w]);
+                }
+                int len = (keyLength - b * H::DIGEST < H::DIGEST) ? keyLength - b * H::DIGEST : H::DIGEST;
+                memcpy(key + b * H::DIGEST, block, (size_t) len);
+            }
+            wipe(block, sizeof(block));
+        }
+    }
+    wipe(jobs, n * sizeof(kdf_job<word>));
+    free(jobs);
+    return err;
+}
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Class:     mmap_impl_Pbkdf2
+ * Method:    derive0
+ * Signature: (I[B[I[B[III[BI)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_Pbkdf2_derive0(JNIEnv* env, jclass,
+  jint hash,
+  jbyteArray passwords,
+  jintArray passwordEnds,
+  jbyteArray salts,
+  jintArray saltEnds,
+  jint count,
+  jint iterations,
+  jbyteArray keys,
+  jint keyLength) {
+
+    if ((hash != KDF_SHA256 && hash != KDF_SHA512) || count <= 0 || iterations <= 0 || keyLength <= 0) {
+        return -EINVAL;
+    }
+    stats_scope stats(OP_PBKDF2, 0, (jlong) count * keyLength);
+
+    /* copies rather than critical regions: a derivation can take many milliseconds */
+    jsize passwordLen = env->GetArrayLength(passwords);
+    jsize saltLen = env->GetArrayLength(salts);
+    size_t keysLen = (size_t) count * (size_t) keyLength;
+    size_t size = (size_t) passwordLen + (size_t) saltLen + 2 * sizeof(jint) * (size_t) count + keysLen;
+    uint8_t* buf = (uint8_t*) malloc(size + 1);
+    if (buf == NULL) {
+        stats.fail(ENOMEM);
+        return -ENOMEM;
+    }
+    jint* pwEnds = (jint*) buf;
+    jint* sEnds = pwEnds + count;
+    uint8_t* pw = (uint8_t*) (sEnds + count);
+    uint8_t* s = pw + passwordLen;
+    uint8_t* out = s + saltLen;
+    env->GetIntArrayRegion(passwordEnds, 0, count, pwEnds);
+    env->GetIntArrayRegion(saltEnds, 0, count, sEnds);
+    env->GetByteArrayRegion(passwords, 0, passwordLen, (jbyte*) pw);
+    env->GetByteArrayRegion(salts, 0, saltLen, (jbyte*) s);
+
+    int err = 0;
+    for (jint i = 0; i < count && err == 0; ++i) {
+        if (pwEnds[i] < ((i == 0) ? 0 : pwEnds[i - 1]) || pwEnds[i] > passwordLen
+                || sEnds[i] < ((i == 0) ? 0 : sEnds[i - 1]) || sEnds[i] > saltLen) {
+            err = -EINVAL;
+        }
+    }
+    if (err == 0) {
+        if (hash == KDF_SHA256) {
+#if defined (KDF_X86)
+            hasher<sha256>::compress_fn fn = (cpu_features & KDF_FEATURE_SHA_NI) ? compress256_ni : compress256;
+#else
+            hasher<sha256>::compress_fn fn = compress256;
+#endif
+            err = derive<sha256>(fn, pw, pwEnds, s, sEnds, count, (uint32_t) iterations, out, keyLength);
+        } else {
+            err = derive<sha512>(compress512, pw, pwEnds, s, sEnds, count, (uint32_t) iterations, out, keyLength);
+        }
+    }
+    if (err == 0) {
+        env->SetByteArrayRegion(keys, 0, (jsize) keysLen, (const jbyte*) out);
+    } else {
+        stats.fail(-err);
+    }
+    NATIVE_PROBE4(pbkdf2_derive, hash, count, iterations, err);
+    wipe(buf, size);
+    free(buf);
+    return err;
+}
+
+/*
+ * Class:     mmap_impl_Pbkdf2
+ * Method:    features0
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_Pbkdf2_features0(JNIEnv*, jclass) {
+    return cpu_features;
+}
+
+#ifdef __cplusplus
+}
+#endif // #ifdef __cplusplus
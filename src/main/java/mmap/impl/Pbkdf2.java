@@ -0,0 +1,126 @@
+package mmap.impl;
+
+import java.util.Arrays;
+
+/**
+ * Native PBKDF2 (RFC 8018) with HMAC-SHA256 or HMAC-SHA512. The keys are
+ * identical to those of the JCA {@code PBKDF2WithHmacSHA256} /
+ * {@code PBKDF2WithHmacSHA512} {@code SecretKeyFactory} for the UTF-8
+ * bytes of the password.
+ * <p>
+ * The iterations of independent keys (and of the output blocks of a key
+ * longer than the hash) run side by side in the lanes of AVX2 / AVX-512
+ * registers: with AVX-512 a batch of up to 8 SHA-512 or 16 SHA-256 keys
+ * ({@link #deriveAll(int, byte[][], byte[][], int, int)}) costs about as
+ * much as a single key. SHA-256 uses the SHA extensions where available,
+ * see {@link #features()}.
+ */
+public final class Pbkdf2 {
+
+    /** HMAC-SHA256 */
+    public static final int SHA256 = 0;
+    /** HMAC-SHA512 */
+    public static final int SHA512 = 1;
+
+    /** {@link #features()}: the SHA extensions */
+    public static final int SHA_NI = 1;
+    /** {@link #features()}: 8 SHA-256 or 4 SHA-512 lanes */
+    public static final int AVX2 = 2;
+    /** {@link #features()}: 16 SHA-256 or 8 SHA-512 lanes */
+    public static final int AVX512 = 4;
+
+    /**
+     * Returns {@code true} if the native implementation can be used (the
+     * library is loaded and {@code -Dmmap.impl.pbkdf2=false} isn't set).
+     */
+    public static boolean isAvailable() {
+        return AVAILABLE;
+    }
+
+    /** The CPU features in use, a combination of {@link #SHA_NI} etc. */
+    public static int features() {
+        return AVAILABLE ? features0() : 0;
+    }
+
+    /** Derives a key of {@code keyLength} bytes. */
+    public static byte[] derive(int hash, byte[] password, byte[] salt, int iterations, int keyLength) {
+        return deriveAll(hash, new byte[][] { password }, new byte[][] { salt }, iterations, keyLength)[0];
+    }
+
+    /**
+     * Derives a key of {@code keyLength} bytes for each password, the
+     * password {@code i} with {@code salts[i]}.
+     */
+    public static byte[][] deriveAll(int hash, byte[][] passwords, byte[][] salts, int iterations, int keyLength) {
+        int count = passwords.length;
+        if (hash < SHA256 || hash > SHA512 || iterations <= 0 || keyLength <= 0 || salts.length != count
+                || (long) count * keyLength > Integer.MAX_VALUE) {
+            throw new IllegalArgumentException("hash: " + hash + ", iterations: " + iterations + ", keyLength: "
+                    + keyLength + ", passwords: " + count + ", salts: " + salts.length);
+        }
+        byte[][] keys = new byte[count][];
+        if (count == 0) {
+            return keys;
+        }
+        int[] passwordEnds = new int[count];
+        int[] saltEnds = new int[count];
+        byte[] packedPasswords = new byte[pack(passwords, null, passwordEnds)];
+        byte[] packedSalts = new byte[pack(salts, null, saltEnds)];
+        pack(passwords, packedPasswords, passwordEnds);
+        pack(salts, packedSalts, saltEnds);
+        byte[] packedKeys = new byte[count * keyLength];
+        int result = derive0(hash, packedPasswords, passwordEnds, packedSalts, saltEnds, count, iterations,
+                packedKeys, keyLength);
+        Arrays.fill(packedPasswords, (byte) 0);
+        if (result < 0) {
+            throw new IllegalStateException("pbkdf2 failed (errno " + -result + ")");
+        }
+        for (int i = 0; i < count; ++i) {
+            keys[i] = Arrays.copyOfRange(packedKeys, i * keyLength, (i + 1) * keyLength);
+        }
+        Arrays.fill(packedKeys, (byte) 0);
+        return keys;
+    }
+
+    /* Copies the arrays into packed (if not null) and sets their ends, returns the total length */
+    private static int pack(byte[][] arrays, byte[] packed, int[] ends) {
+        long end = 0L;
+        for (int i = 0; i < arrays.length; ++i) {
+            byte[] b = arrays[i];
+            if (packed != null) {
+                System.arraycopy(b, 0, packed, (int) end, b.length);
+            }
+            end += b.length;
+            if (end > Integer.MAX_VALUE) {
+                throw new IllegalArgumentException("total length: " + end);
+            }
+            ends[i] = (int) end;
+        }
+        return (int) end;
+    }
+
+    private static boolean available() {
+        if (!Boolean.parseBoolean(System.getProperty("mmap.impl.pbkdf2", "true"))) {
+            return false;
+        }
+        try {
+            features0();
+            return true;
+        } catch (UnsatisfiedLinkError e) {
+            return false;
+        }
+    }
+
+    // native methods (return -errno on failure)
+
+    private static native int derive0(int hash, byte[] passwords, int[] passwordEnds, byte[] salts, int[] saltEnds,
+            int count, int iterations, byte[] keys, int keyLength);
+
+    private static native int features0();
+
+    private static final boolean AVAILABLE = available();
+
+    private Pbkdf2() {
+        throw new AssertionError();
+    }
+}
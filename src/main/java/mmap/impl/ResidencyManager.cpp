@@ -0,0 +1,1400 @@
+
+#ifndef _JAVASOFT_JNI_H_
+#include <jni.h>
+#endif /* _JAVASOFT_JNI_H_ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+
+#if !defined (_WIN64)
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "native_sdt.h"
+#include "native_stats.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* MMapUtils.cpp (MADV_WILLNEED / PrefetchVirtualMemory) */
+JNIEXPORT jint JNICALL mmap_load(jlong address, jlong length);
+#ifdef __cplusplus
+}
+#endif
+
+/*
+ * A registry of memory mappings that keeps the resident bytes of each
+ * mapping class (e.g. "index", "log", "scan") within a budget.
+ *
+ * Every mapping is divided into chunks (2 MiB by default). An enforcement
+ * pass samples the residency of all chunks with mincore(2) (a bounded
+ * vector per call) and tracks their access recency in passes ("epochs"):
+ * a chunk is recent if Java reported an access (touch) or if more of its
+ * pages became resident since the last pass (they were faulted in). If a
+ * class is over its budget, its least recently used resident chunks are
+ * evicted (MADV_COLD, MADV_PAGEOUT or MADV_DONTNEED, optionally followed by
+ * POSIX_FADV_DONTNEED on the file) until the class is below the low-water
+ * mark. If a class is below its budget, recently used chunks that aren't
+ * fully resident are prefetched with MADV_WILLNEED while the budget allows.
+ *
+ * Residency is that of the page cache (mincore(2) of a shared file mapping),
+ * so dropping the pages from the mapping alone doesn't lower it; the file
+ * cache is dropped as well if the mapping has a descriptor and drop_cache
+ * is set. Dirty pages can't be dropped, their writeback is started so that
+ * a later pass can drop them. MADV_COLD only moves pages to the inactive
+ * list, the kernel reclaims them under memory pressure; the next pass sees
+ * what is still resident. So an eviction doesn't change the sampled count of
+ * a chunk (pages that survive it aren't taken for new faults), the evicted
+ * bytes are credited when the next sample shows them gone.
+ * MADV_COLD / MADV_PAGEOUT fall back to MADV_DONTNEED on kernels older
+ * than 5.4.
+ *
+ * Faults only show the first access of a resident page. With access
+ * tracking enabled, every pass also reads the page table entries of the
+ * resident pages from /proc/self/pagemap to see which were used since the
+ * previous pass:
+ *
+ *   page_idle   the page frame's bit in /sys/kernel/mm/page_idle/bitmap
+ *               has been cleared by an access; the pass sets the idle bits
+ *               again (Linux 4.3+, CONFIG_IDLE_PAGE_TRACKING, needs
+ *               CAP_SYS_ADMIN because frame numbers are hidden otherwise)
+ *   unmap       the page is mapped again: the pass drops the page table
+ *               entries of shared mappings with MADV_DONTNEED (the pages
+ *               stay in the page cache, dirty ones stay dirty), so the next
+ *               access takes a minor fault ("hinting fault") that maps it.
+ *               Works unprivileged; private mappings are only tracked by
+ *               their residency because dropping their entries would
+ *               discard modified pages.
+ *
+ * (The accessed bits cleared through /proc/self/clear_refs can't be read
+ * back per page: /proc/kpageflags only shows PG_referenced and smaps only
+ * sums up a whole VMA.) The first pass after enabling counts every mapped
+ * page as accessed. The idle age of a chunk is the number of passes since
+ * its last access.
+ *
+ * Accesses reported with access0 also feed a stream detector per mapping
+ * that prefetches ahead of the streams it recognizes, so that a scan
+ * doesn't stall on every fault:
+ *
+ *   sequential  the access starts after the previous one of the stream and
+ *               at most SEQ_GAP after its end; the readahead window starts
+ *               at min_window and doubles up to max_window, the next window
+ *               is requested when less than half of the current one is left
+ *               ahead (like the kernel's asynchronous readahead)
+ *   strided     the access is exactly one stride (the distance between the
+ *               previous two accesses) after the previous one; the next 2 to
+ *               MAX_TARGETS targets are prefetched
+ *
+ * A stream prefetches after `trigger` hits. Accesses that continue no
+ * stream replace the least recently used one, so random lookups never
+ * prefetch. If less than a quarter of the last RANDOM_WINDOW accesses of a
+ * mapping continued a stream, the mapping is advised MADV_RANDOM (no more
+ * readahead around faults); it goes back to MADV_NORMAL once half of them
+ * do. Prefetches go through mmap_load (MADV_WILLNEED) outside of the lock
+ * and are throttled by a token bucket of max_rate bytes per second. They
+ * are hints: failures only show up in the OP_LOAD statistics.
+ *
+ * The registry lock guards the list of mappings, the policy, the access
+ * recency of the chunks and the class statistics; it is never held across
+ * a system call. An enforcement pass (one at a time, enforce_lock) pins the
+ * mappings of a class, samples and advises them without the lock and only
+ * takes it to apply the results. access0 pins its mapping and runs the
+ * stream detector under the lock of the mapping, so accesses of different
+ * mappings don't wait for each other. unregister0 waits until a mapping
+ * isn't pinned anymore: once it returns, no advice reaches the range (which
+ * the caller may unmap and the kernel reuse).
+ */
+
+#define MAX_CLASSES 16
+
+#define MIN_CHUNK_SHIFT 16
+#define MAX_CHUNK_SHIFT 30
+#define DEFAULT_CHUNK_SHIFT 21
+
+/* Pages per mincore(2) call */
+#define VEC_PAGES 4096
+
+/* Access tracking */
+#define ACCESS_FAULTS 0
+#define ACCESS_PAGE_IDLE 1
+#define ACCESS_UNMAP 2
+
+/* /proc/self/pagemap entry */
+#define PM_PRESENT ((uint64_t) 1 << 63)
+#define PM_PFN_MASK (((uint64_t) 1 << 55) - 1)
+
+/* Advice for the eviction of a chunk */
+#define EVICT_COLD 0
+#define EVICT_PAGEOUT 1
+#define EVICT_DONTNEED 2
+
+#if !defined (_WIN64)
+#ifndef MADV_COLD
+#define MADV_COLD 20
+#endif
+#ifndef MADV_PAGEOUT
+#define MADV_PAGEOUT 21
+#endif
+#endif
+
+/* Stream detection */
+#define MAX_STREAMS 8
+#define SEQ_GAP (64 * 1024)
+#define MAX_TARGETS 16
+#define RANDOM_WINDOW 256
+
+/* Set in the pins of a mapping that unregister0 has unlinked (and waits for) */
+#define UNLINKED 0x80000000U
+
+#define STREAM_NEW 0
+#define STREAM_SEQUENTIAL 1
+#define STREAM_STRIDED 2
+
+/* Per class statistics (in the order of ResidencyManager.Stats) */
+enum class_stat {
+    CS_BUDGET = 0,
+    CS_MAPPINGS,
+    CS_MAPPED,
+    CS_RESIDENT,
+    CS_EVICTED,
+    CS_PREFETCHED,
+    CS_PASSES,
+    CS_OVER_BUDGET,
+    CS_COUNT
+};
+
+/* Stream statistics (in the order of ResidencyManager.StreamStats) */
+enum stream_stat {
+    SS_ACCESSES = 0,
+    SS_HITS,
+    SS_STREAMS,
+    SS_PREFETCHES,
+    SS_PREFETCHED,
+    SS_THROTTLED,
+    SS_RANDOM,
+    SS_COUNT
+};
+
+
+/* resident and evicted are only used by the enforcement pass */
+struct chunk {
+    uint32_t resident;      /* resident pages at the last sample */
+    uint32_t last_access;   /* epoch of the last access, 0 = never (registry lock) */
+    uint32_t evicted;       /* resident pages when evicted since the last sample, 0 = none */
+};
+
+struct stream {
+    int kind;
+    uint32_t hits;
+    int64_t last;           /* offset of the last access */
+    int64_t last_end;       /* end of the last access */
+    int64_t stride;         /* candidate (STREAM_NEW) or confirmed stride */
+    int64_t ahead;          /* prefetched up to (sequential) or last prefetched target */
+    uint64_t window;        /* readahead window (sequential) */
+    uint64_t used;          /* access number of the last hit, 0 = free slot */
+};
+
+struct mapping {
+    mapping* next;
+    jlong id;
+    int cls;
+    uint8_t* address;       /* page aligned */
+    uint64_t length;
+    uint64_t misalign;      /* of the registered address */
+    int fd;                 /* a duplicate, -1 if the file cache isn't dropped */
+    bool shared;            /* MAP_SHARED (page table entries can be dropped) */
+    int64_t file_offset;    /* of address */
+    uint64_t chunks;
+    chunk* chunk_table;
+    /* passes and accesses using it without the registry lock (taken under it) | UNLINKED */
+    std::atomic<uint32_t> pins;
+    /* the stream detector (lock) */
+    std::mutex lock;
+    stream streams[MAX_STREAMS];
+    uint64_t accesses;
+    uint32_t window_accesses;
+    uint32_t window_hits;
+    bool random;            /* advised MADV_RANDOM */
+};
+
+/* Allocated once and never freed (see stats_registry) */
+struct residency_registry {
+    std::mutex lock;
+    std::mutex enforce_lock;            /* a pass, the policy and the tracking descriptors */
+    std::condition_variable unpinned;
+    mapping* head;
+    jlong next_id;
+    uint32_t epoch;
+    int chunk_shift;
+    int evict_advice;
+    int low_water;
+    int hot_epochs;
+    bool prefetch_hot;
+    bool drop_cache;
+    int access_tracking;
+    int pagemap_fd;
+    int idle_fd;
+    jlong stats[MAX_CLASSES][CS_COUNT];
+    /* stream detection */
+    uint32_t trigger;
+    uint64_t min_window;
+    uint64_t max_window;
+    jlong max_rate;         /* bytes per second, 0 = unlimited */
+    bool adapt_random;
+    std::mutex throttle;    /* tokens and refilled */
+    double tokens;
+    jlong refilled;         /* nanos */
+    std::atomic<jlong> stream_stats[SS_COUNT];
+
+    residency_registry()
+        : head(NULL), next_id(1), epoch(1), chunk_shift(DEFAULT_CHUNK_SHIFT), evict_advice(EVICT_COLD),
+          low_water(90), hot_epochs(2), prefetch_hot(false), drop_cache(false), access_tracking(ACCESS_FAULTS),
+          pagemap_fd(-1), idle_fd(-1), trigger(2), min_window(128 * 1024), max_window(2 * 1024 * 1024),
+          max_rate(0), adapt_random(true), tokens(0.0), refilled(0) {
+        for (int c = 0; c < MAX_CLASSES; ++c) {
+            for (int i = 0; i < CS_COUNT; ++i) {
+                stats[c][i] = 0;
+            }
+        }
+        for (int i = 0; i < SS_COUNT; ++i) {
+            stream_stats[i] = 0;
+        }
+    }
+};
+
+static residency_registry* residency() {
+    static residency_registry* r = new residency_registry();
+    return r;
+}
+
+
+#if !defined (_WIN64)
+
+static uint64_t page_size() {
+    static uint64_t ps = (uint64_t) sysconf(_SC_PAGESIZE);
+    return ps;
+}
+
+static mapping* find(residency_registry* r, jlong id) {
+    for (mapping* m = r->head; m != NULL; m = m->next) {
+        if (m->id == id) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+static uint64_t chunk_length(const residency_registry* r, const mapping* m, uint64_t i) {
+    uint64_t start = i << r->chunk_shift;
+    uint64_t len = (uint64_t) 1 << r->chunk_shift;
+    return (start + len <= m->length) ? len : m->length - start;
+}
+
+/* Reads exactly count bytes at offset. Returns 0 or -errno. */
+static int pread_fully(int fd, void* buf, size_t count, off_t offset) {
+    char* p = (char*) buf;
+    while (count > 0) {
+        ssize_t n = pread(fd, p, count, offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (n == 0) {
+            return -EIO;
+        }
+        p += n;
+        count -= (size_t) n;
+        offset += n;
+    }
+    return 0;
+}
+
+/* Sets the idle bits of mask in the bitmap word. Returns 0 or -errno. */
+static int set_idle(residency_registry* r, uint64_t word, uint64_t mask) {
+    if (mask == 0) {
+        return 0;
+    }
+    ssize_t n = pwrite(r->idle_fd, &mask, sizeof(mask), (off_t) (word * sizeof(uint64_t)));
+    return (n == (ssize_t) sizeof(mask)) ? 0 : (n < 0) ? -errno : -EIO;
+}
+
+/*
+ * Marks the chunks of the mapped resident pages p .. p + n - 1 that have
+ * been accessed since the previous pass in accessed. Returns 0 or -errno.
+ */
+static int track_access(residency_registry* r, const mapping* m, uint64_t p, uint64_t n, const unsigned char* vec,
+        int shift, uint8_t* accessed) {
+    uint64_t ps = page_size();
+    uint64_t entries[VEC_PAGES];
+    off_t where = (off_t) (((uintptr_t) m->address / ps + p) * sizeof(uint64_t));
+    int err = pread_fully(r->pagemap_fd, entries, (size_t) (n * sizeof(uint64_t)), where);
+    if (err != 0) {
+        return err;
+    }
+    uint64_t word = UINT64_MAX;
+    uint64_t bits = 0;
+    uint64_t mask = 0;
+    for (uint64_t k = 0; k < n; ++k) {
+        if (!(vec[k] & 1) || !(entries[k] & PM_PRESENT)) {
+            continue;
+        }
+        bool used = true;
+        if (r->access_tracking == ACCESS_PAGE_IDLE) {
+            uint64_t pfn = entries[k] & PM_PFN_MASK;
+            if (pfn == 0) {
+                /* frame numbers are hidden without CAP_SYS_ADMIN */
+                return -EPERM;
+            }
+            if (pfn / 64 != word) {
+                if (word != UINT64_MAX && (err = set_idle(r, word, mask)) != 0) {
+                    return err;
+                }
+                word = pfn / 64;
+                mask = 0;
+                if ((err = pread_fully(r->idle_fd, &bits, sizeof(bits), (off_t) (word * sizeof(uint64_t)))) != 0) {
+                    return err;
+                }
+            }
+            used = ((bits >> (pfn % 64)) & 1) == 0;
+            mask |= (uint64_t) 1 << (pfn % 64);
+        }
+        if (used) {
+            accessed[(p + k) >> shift] = 1;
+        }
+    }
+    return (word != UINT64_MAX) ? set_idle(r, word, mask) : 0;
+}
+
+static void close_tracking(residency_registry* r) {
+    int* fds[] = { &r->pagemap_fd, &r->idle_fd };
+    for (int i = 0; i < 2; ++i) {
+        if (*fds[i] >= 0) {
+            close(*fds[i]);
+            *fds[i] = -1;
+        }
+    }
+    r->access_tracking = ACCESS_FAULTS;
+}
+
+/*
+ * Whether all of [a, a + len) is covered by shared mappings (according to
+ * /proc/self/maps).
+ */
+static bool is_shared(uintptr_t a, uint64_t len) {
+    FILE* f = fopen("/proc/self/maps", "r");
+    if (f == NULL) {
+        return false;
+    }
+    uintptr_t covered = a;
+    uintptr_t end = a + (uintptr_t) len;
+    bool shared = true;
+    char line[512];
+    while (shared && covered < end && fgets(line, sizeof(line), f) != NULL) {
+        if (strchr(line, '\n') == NULL) {
+            /* skip the rest of a long line (path name) */
+            int c;
+            while ((c = fgetc(f)) != EOF && c != '\n') {
+            }
+        }
+        unsigned long lo;
+        unsigned long hi;
+        char perms[8];
+        if (sscanf(line, "%lx-%lx %7s", &lo, &hi, perms) != 3 || hi <= covered) {
+            continue;
+        }
+        if (lo > covered) {
+            /* a hole */
+            shared = false;
+        } else {
+            shared = (perms[3] == 's');
+            covered = hi;
+        }
+    }
+    fclose(f);
+    return shared && covered >= end;
+}
+
+/*
+ * Samples the resident pages of all chunks of a mapping and marks the
+ * chunks that gained pages (or, with access tracking, whose pages have
+ * been used) as accessed. The pages that chunks evicted by the previous
+ * pass lost are counted as evicted. Returns the resident bytes or -errno.
+ * The mapping is pinned; the registry lock is only taken for the chunk
+ * table.
+ */
+static jlong sample(residency_registry* r, mapping* m) {
+    stats_scope stats(OP_RESIDENCY_SAMPLE, (jlong) (intptr_t) m->address, (jlong) m->length);
+
+    uint64_t ps = page_size();
+    uint64_t pages = (m->length + ps - 1) / ps;
+    /* page number to chunk number */
+    int shift = r->chunk_shift - __builtin_ctzll(ps);
+
+    uint32_t* counts = (uint32_t*) calloc((size_t) m->chunks, sizeof(uint32_t));
+    uint8_t* accessed = (uint8_t*) calloc((size_t) m->chunks, 1);
+    unsigned char vec[VEC_PAGES];
+    if (counts == NULL || accessed == NULL) {
+        free(counts);
+        free(accessed);
+        stats.fail(ENOMEM);
+        return -ENOMEM;
+    }
+    for (uint64_t p = 0; p < pages; p += VEC_PAGES) {
+        uint64_t n = (pages - p < VEC_PAGES) ? pages - p : VEC_PAGES;
+        int err = (mincore(m->address + p * ps, (size_t) (n * ps), vec) == -1) ? -errno : 0;
+        if (err == 0 && r->access_tracking != ACCESS_FAULTS) {
+            err = track_access(r, m, p, n, vec, shift, accessed);
+        }
+        if (err != 0) {
+            free(counts);
+            free(accessed);
+            stats.fail(-err);
+            return err;
+        }
+        for (uint64_t k = 0; k < n; ++k) {
+            counts[(p + k) >> shift] += vec[k] & 1;
+        }
+    }
+    jlong resident = 0;
+    {
+        std::lock_guard<std::mutex> guard(r->lock);
+        for (uint64_t i = 0; i < m->chunks; ++i) {
+            chunk* c = &m->chunk_table[i];
+            if (counts[i] > c->resident || accessed[i]) {
+                c->last_access = r->epoch;
+            }
+            if (c->evicted != 0) {
+                if (counts[i] < c->evicted) {
+                    r->stats[m->cls][CS_EVICTED] += (jlong) (c->evicted - counts[i]) * (jlong) ps;
+                }
+                c->evicted = 0;
+            }
+            c->resident = counts[i];
+            resident += (jlong) counts[i] * (jlong) ps;
+        }
+    }
+    free(counts);
+    free(accessed);
+    if (r->access_tracking == ACCESS_UNMAP && m->shared) {
+        /* the next access of each page takes a (minor) hinting fault */
+        if (madvise(m->address, (size_t) m->length, MADV_DONTNEED) == -1) {
+            stats.fail(errno);
+            return -errno;
+        }
+    }
+    return resident;
+}
+
+static int madvise_evict(residency_registry* r, uint8_t* a, uint64_t len) {
+    static volatile int cold_supported = 1;
+    int advice = MADV_DONTNEED;
+    if (r->evict_advice != EVICT_DONTNEED && cold_supported) {
+        advice = (r->evict_advice == EVICT_PAGEOUT) ? MADV_PAGEOUT : MADV_COLD;
+    }
+    int result = madvise(a, (size_t) len, advice);
+    if (result == -1 && errno == EINVAL && advice != MADV_DONTNEED) {
+        /* Linux < 5.4 */
+        cold_supported = 0;
+        result = madvise(a, (size_t) len, MADV_DONTNEED);
+    }
+    return (result == -1) ? -errno : 0;
+}
+
+/*
+ * Evicts a chunk. Returns its resident bytes (those the advice applies to)
+ * or -errno. The sampled count is kept: what was actually freed shows in
+ * the next sample.
+ */
+static jlong evict(residency_registry* r, mapping* m, uint64_t i) {
+    uint64_t off = i << r->chunk_shift;
+    uint64_t len = chunk_length(r, m, i);
+    stats_scope stats(OP_RESIDENCY_ADVISE, (jlong) (intptr_t) (m->address + off), (jlong) len);
+
+    int err = madvise_evict(r, m->address + off, len);
+#if defined (POSIX_FADV_DONTNEED)
+    if (err == 0 && r->drop_cache && m->fd >= 0) {
+        off_t pos = (off_t) (m->file_offset + (int64_t) off);
+#if defined (__linux) && defined (SYNC_FILE_RANGE_WRITE)
+        /* dirty pages can't be dropped, start their writeback for the next pass */
+        sync_file_range(m->fd, pos, (off_t) len, SYNC_FILE_RANGE_WRITE);
+#endif
+        err = -posix_fadvise(m->fd, pos, (off_t) len, POSIX_FADV_DONTNEED);
+    }
+#endif
+    NATIVE_PROBE4(residency_evict, m->cls, m->address + off, len, err);
+    if (err < 0) {
+        stats.fail(-err);
+        return err;
+    }
+    chunk* c = &m->chunk_table[i];
+    c->evicted = c->resident;
+    return (jlong) c->resident * (jlong) page_size();
+}
+
+/* Prefetches a chunk. Returns the bytes that weren't resident or -errno. */
+static jlong prefetch(residency_registry* r, mapping* m, uint64_t i) {
+    uint64_t off = i << r->chunk_shift;
+    uint64_t len = chunk_length(r, m, i);
+    stats_scope stats(OP_RESIDENCY_ADVISE, (jlong) (intptr_t) (m->address + off), (jlong) len);
+
+    int err = (madvise(m->address + off, (size_t) len, MADV_WILLNEED) == -1) ? -errno : 0;
+    NATIVE_PROBE4(residency_prefetch, m->cls, m->address + off, len, err);
+    if (err < 0) {
+        stats.fail(-err);
+        return err;
+    }
+    uint64_t ps = page_size();
+    uint32_t pages = (uint32_t) ((len + ps - 1) / ps);
+    jlong bytes = (jlong) (pages - m->chunk_table[i].resident) * (jlong) ps;
+    m->chunk_table[i].resident = pages;
+    std::lock_guard<std::mutex> guard(r->lock);
+    r->stats[m->cls][CS_PREFETCHED] += bytes;
+    return bytes;
+}
+
+struct candidate {
+    uint32_t last_access;
+    mapping* m;
+    uint64_t index;
+};
+
+/* Least recently used first */
+static int by_recency(const void* a, const void* b) {
+    uint32_t x = ((const candidate*) a)->last_access;
+    uint32_t y = ((const candidate*) b)->last_access;
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+/*
+ * Collects the chunks of the pinned mappings of a class: the resident ones
+ * (evict) or the recently used ones that aren't fully resident (prefetch),
+ * sorted by recency. Called with the registry lock held. Returns the number
+ * of candidates or -ENOMEM.
+ */
+static jlong collect(residency_registry* r, mapping** pinned, jlong mappings, bool evict, candidate** result) {
+    uint64_t total = 0;
+    for (jlong k = 0; k < mappings; ++k) {
+        total += pinned[k]->chunks;
+    }
+    candidate* c = (candidate*) malloc((size_t) (total + 1) * sizeof(candidate));
+    if (c == NULL) {
+        return -ENOMEM;
+    }
+    uint64_t ps = page_size();
+    jlong n = 0;
+    for (jlong j = 0; j < mappings; ++j) {
+        mapping* m = pinned[j];
+        for (uint64_t i = 0; i < m->chunks; ++i) {
+            chunk* k = &m->chunk_table[i];
+            bool take;
+            if (evict) {
+                take = k->resident > 0;
+            } else {
+                uint32_t pages = (uint32_t) ((chunk_length(r, m, i) + ps - 1) / ps);
+                take = k->last_access != 0 && k->last_access + (uint32_t) r->hot_epochs >= r->epoch
+                        && k->resident < pages;
+            }
+            if (take) {
+                c[n].last_access = k->last_access;
+                c[n].m = m;
+                c[n].index = i;
+                ++n;
+            }
+        }
+    }
+    qsort(c, (size_t) n, sizeof(candidate), by_recency);
+    *result = c;
+    return n;
+}
+
+/*
+ * Releases a pinned mapping (without the registry lock). The mapping may be
+ * freed as soon as the last pin of an unlinked one is gone.
+ */
+static void unpin(residency_registry* r, mapping* m) {
+    if (--m->pins == UNLINKED) {
+        /* under the lock: unregister0 is either waiting or sees no pins */
+        std::lock_guard<std::mutex> guard(r->lock);
+        r->unpinned.notify_all();
+    }
+}
+
+/* One pass over the pinned mappings of a class. Returns the bytes advised for eviction or -errno. */
+static jlong enforce_pinned(residency_registry* r, int cls, mapping** pinned, jlong mappings) {
+    jlong resident = 0;
+    jlong mapped = 0;
+    for (jlong k = 0; k < mappings; ++k) {
+        jlong bytes = sample(r, pinned[k]);
+        if (bytes < 0) {
+            return bytes;
+        }
+        resident += bytes;
+        mapped += (jlong) pinned[k]->length;
+    }
+    jlong budget;
+    jlong target;
+    bool over;
+    candidate* c;
+    jlong n;
+    {
+        std::lock_guard<std::mutex> guard(r->lock);
+        jlong* s = r->stats[cls];
+        s[CS_MAPPINGS] = mappings;
+        s[CS_MAPPED] = mapped;
+        s[CS_RESIDENT] = resident;
+        s[CS_PASSES]++;
+        budget = s[CS_BUDGET];
+        if (mappings == 0 || budget <= 0) {
+            /* no budget: only sampled */
+            return 0;
+        }
+        over = resident > budget;
+        if (over) {
+            s[CS_OVER_BUDGET]++;
+        } else if (!r->prefetch_hot) {
+            return 0;
+        }
+        target = budget / 100 * r->low_water + budget % 100 * r->low_water / 100;
+        n = collect(r, pinned, mappings, over, &c);
+        if (n < 0) {
+            return n;
+        }
+    }
+
+    jlong evicted = 0;
+    if (over) {
+        for (jlong k = 0; k < n && resident > target; ++k) {
+            jlong bytes = evict(r, c[k].m, c[k].index);
+            if (bytes < 0) {
+                free(c);
+                return bytes;
+            }
+            resident -= bytes;
+            evicted += bytes;
+        }
+    } else {
+        /* most recently used first */
+        for (jlong k = n - 1; k >= 0; --k) {
+            mapping* m = c[k].m;
+            jlong missing = (jlong) chunk_length(r, m, c[k].index)
+                    - (jlong) m->chunk_table[c[k].index].resident * (jlong) page_size();
+            if (resident + missing > budget) {
+                break;
+            }
+            jlong bytes = prefetch(r, m, c[k].index);
+            if (bytes < 0) {
+                break;
+            }
+            resident += bytes;
+        }
+    }
+    free(c);
+    return evicted;
+}
+
+/*
+ * One pass over a class: pins its mappings, so that they can be sampled
+ * and advised without the registry lock. Returns the bytes advised for
+ * eviction or -errno.
+ */
+static jlong enforce_class(residency_registry* r, int cls) {
+    mapping** pinned;
+    jlong mappings = 0;
+    {
+        std::lock_guard<std::mutex> guard(r->lock);
+        for (mapping* m = r->head; m != NULL; m = m->next) {
+            if (m->cls == cls) {
+                ++mappings;
+            }
+        }
+        pinned = (mapping**) malloc((size_t) (mappings + 1) * sizeof(mapping*));
+        if (pinned == NULL) {
+            return -ENOMEM;
+        }
+        jlong k = 0;
+        for (mapping* m = r->head; m != NULL; m = m->next) {
+            if (m->cls == cls) {
+                m->pins++;
+                pinned[k++] = m;
+            }
+        }
+    }
+    jlong result = enforce_pinned(r, cls, pinned, mappings);
+    for (jlong k = 0; k < mappings; ++k) {
+        unpin(r, pinned[k]);
+    }
+    free(pinned);
+    return result;
+}
+
+/* Marks the chunks of [start, end) as used in the current epoch */
+static void touch_chunks(residency_registry* r, mapping* m, uint64_t start, uint64_t end) {
+    uint64_t last = ((end < m->length) ? end - 1 : m->length - 1) >> r->chunk_shift;
+    for (uint64_t i = start >> r->chunk_shift; i <= last; ++i) {
+        m->chunk_table[i].last_access = r->epoch;
+    }
+}
+
+struct prefetch_range {
+    int64_t start;
+    int64_t length;
+};
+
+/* The stream policy, copied under the registry lock for an access */
+struct stream_policy {
+    uint32_t trigger;
+    uint64_t min_window;
+    uint64_t max_window;
+    jlong max_rate;
+    bool adapt_random;
+};
+
+/* Takes bytes from the token bucket. Returns false if the rate is exceeded. */
+static bool take_tokens(residency_registry* r, const stream_policy* p, int64_t bytes) {
+    if (p->max_rate <= 0) {
+        return true;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    jlong now = (jlong) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    std::lock_guard<std::mutex> guard(r->throttle);
+    /* at most one second (or one maximum window) of burst */
+    double capacity = (double) ((p->max_rate > (jlong) p->max_window) ? p->max_rate : (jlong) p->max_window);
+    r->tokens += (double) (now - r->refilled) * (double) p->max_rate / 1e9;
+    if (r->tokens > capacity || r->refilled == 0) {
+        r->tokens = capacity;
+    }
+    r->refilled = now;
+    if (r->tokens < (double) bytes) {
+        r->stream_stats[SS_THROTTLED]++;
+        return false;
+    }
+    r->tokens -= (double) bytes;
+    return true;
+}
+
+/* Adds [start, end) of m to the ranges if the throttle allows it */
+static bool add_range(residency_registry* r, const stream_policy* p, const mapping* m, int64_t start, int64_t end,
+        prefetch_range* ranges, int* n) {
+    if (end > (int64_t) m->length) {
+        end = (int64_t) m->length;
+    }
+    if (start >= end || !take_tokens(r, p, end - start)) {
+        return false;
+    }
+    ranges[*n].start = start;
+    ranges[*n].length = end - start;
+    ++*n;
+    r->stream_stats[SS_PREFETCHES]++;
+    r->stream_stats[SS_PREFETCHED] += end - start;
+    return true;
+}
+
+/* The stream continued by an access at off or NULL */
+static stream* match(mapping* m, int64_t off) {
+    for (int i = 0; i < MAX_STREAMS; ++i) {
+        stream* s = &m->streams[i];
+        if (s->used == 0) {
+            continue;
+        }
+        bool seq = off > s->last && off <= s->last_end + SEQ_GAP;
+        bool strided = s->stride != 0 && off - s->last == s->stride;
+        if ((s->kind == STREAM_SEQUENTIAL && seq) || (s->kind == STREAM_STRIDED && strided)) {
+            return s;
+        }
+        if (s->kind == STREAM_NEW && (seq || strided)) {
+            s->kind = seq ? STREAM_SEQUENTIAL : STREAM_STRIDED;
+            return s;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Starts a new stream at off in the least recently used slot. Its candidate
+ * stride is the distance from the most recent access of the mapping.
+ */
+static void start_stream(mapping* m, int64_t off, int64_t end) {
+    stream* lru = &m->streams[0];
+    const stream* mru = NULL;
+    for (int i = 0; i < MAX_STREAMS; ++i) {
+        stream* s = &m->streams[i];
+        if (s->used < lru->used) {
+            lru = s;
+        }
+        if (s->used != 0 && (mru == NULL || s->used > mru->used)) {
+            mru = s;
+        }
+    }
+    lru->kind = STREAM_NEW;
+    lru->hits = 0;
+    lru->stride = (mru != NULL) ? off - mru->last : 0;
+    lru->last = off;
+    lru->last_end = end;
+    lru->ahead = 0;
+    lru->window = 0;
+    lru->used = m->accesses;
+}
+
+/*
+ * Feeds an access of [off, end) to the stream detector of m (called with
+ * the lock of m held). Stores the ranges to prefetch in ranges (at least
+ * MAX_TARGETS) and returns their number; *advice is set to MADV_RANDOM or
+ * MADV_NORMAL if the advice of the whole mapping should change, to -1
+ * otherwise.
+ */
+static int detect(residency_registry* r, const stream_policy* p, mapping* m, int64_t off, int64_t end,
+        prefetch_range* ranges, int* advice) {
+    std::atomic<jlong>* ss = r->stream_stats;
+    int n = 0;
+    *advice = -1;
+    ss[SS_ACCESSES]++;
+    m->accesses++;
+    m->window_accesses++;
+
+    stream* s = match(m, off);
+    if (s == NULL) {
+        start_stream(m, off, end);
+    } else {
+        m->window_hits++;
+        ss[SS_HITS]++;
+        s->last = off;
+        s->last_end = end;
+        s->used = m->accesses;
+        if (++s->hits == p->trigger) {
+            ss[SS_STREAMS]++;
+        }
+    }
+
+    if (s != NULL && s->hits >= p->trigger && s->kind == STREAM_SEQUENTIAL) {
+        if (s->ahead < end) {
+            /* the stream caught up (or started) */
+            s->ahead = end;
+        }
+        if ((uint64_t) (s->ahead - end) <= s->window / 2 && s->ahead < (int64_t) m->length) {
+            uint64_t window = (s->window == 0) ? p->min_window : s->window * 2;
+            if (window > p->max_window) {
+                window = p->max_window;
+            }
+            if (add_range(r, p, m, s->ahead, end + (int64_t) window, ranges, &n)) {
+                s->ahead = end + (int64_t) window;
+                s->window = window;
+            }
+        }
+    } else if (s != NULL && s->hits >= p->trigger) {
+        /* strided: ramp up from 2 targets */
+        uint32_t depth = s->hits - p->trigger + 2;
+        if (depth > MAX_TARGETS) {
+            depth = MAX_TARGETS;
+        }
+        if (s->ahead == 0) {
+            s->ahead = off;
+        }
+        for (uint32_t k = 1; k <= depth; ++k) {
+            int64_t t = off + (int64_t) k * s->stride;
+            if (t < 0 || t >= (int64_t) m->length) {
+                break;
+            }
+            if ((s->stride > 0) ? t <= s->ahead : t >= s->ahead) {
+                continue;
+            }
+            if (!add_range(r, p, m, t, t + (end - off), ranges, &n)) {
+                break;
+            }
+            s->ahead = t;
+        }
+    }
+
+    if (m->window_accesses == RANDOM_WINDOW) {
+        if (p->adapt_random && !m->random && m->window_hits * 4 < RANDOM_WINDOW) {
+            *advice = MADV_RANDOM;
+            m->random = true;
+            ss[SS_RANDOM]++;
+        } else if (m->random && (!p->adapt_random || m->window_hits * 2 >= RANDOM_WINDOW)) {
+            *advice = MADV_NORMAL;
+            m->random = false;
+            ss[SS_RANDOM]--;
+        }
+        m->window_accesses = 0;
+        m->window_hits = 0;
+    }
+    return n;
+}
+
+#endif /* !(_WIN64) */
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Class:     mmap_impl_ResidencyManager
+ * Method:    register0
+ * Signature: (IJJIJ)J
+ */
+JNIEXPORT jlong JNICALL
+Java_mmap_impl_ResidencyManager_register0(JNIEnv*, jclass,
+  jint cls,
+  jlong address,
+  jlong length,
+  jint fd,
+  jlong fileOffset) {
+
+#if defined (_WIN64)
+    return -ENOSYS;
+#else
+    if (cls < 0 || cls >= MAX_CLASSES || address == 0 || length <= 0) {
+        return -EINVAL;
+    }
+    residency_registry* r = residency();
+    uint64_t ps = page_size();
+    uint64_t misalign = (uint64_t) address & (ps - 1);
+
+    mapping* m = new (std::nothrow) mapping;
+    if (m == NULL) {
+        return -ENOMEM;
+    }
+    /* our own descriptor: the caller's may be closed and its number reused */
+    m->fd = -1;
+    if (fd >= 0 && (m->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0)) == -1) {
+        int err = errno;
+        delete m;
+        return -err;
+    }
+    m->cls = cls;
+    m->address = (uint8_t*) (intptr_t) (address - (jlong) misalign);
+    m->length = (uint64_t) length + misalign;
+    m->misalign = misalign;
+    m->file_offset = fileOffset - (int64_t) misalign;
+    m->shared = is_shared((uintptr_t) m->address, m->length);
+    m->pins = 0;
+    memset(m->streams, 0, sizeof(m->streams));
+    m->accesses = 0;
+    m->window_accesses = 0;
+    m->window_hits = 0;
+    m->random = false;
+
+    std::lock_guard<std::mutex> guard(r->lock);
+    m->chunks = (m->length + ((uint64_t) 1 << r->chunk_shift) - 1) >> r->chunk_shift;
+    m->chunk_table = (chunk*) calloc((size_t) m->chunks, sizeof(chunk));
+    if (m->chunk_table == NULL) {
+        if (m->fd >= 0) {
+            close(m->fd);
+        }
+        delete m;
+        return -ENOMEM;
+    }
+    m->id = r->next_id++;
+    m->next = r->head;
+    r->head = m;
+    return m->id;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_ResidencyManager
+ * Method:    unregister0
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_ResidencyManager_unregister0(JNIEnv*, jclass,
+  jlong id) {
+
+#if defined (_WIN64)
+    return -ENOSYS;
+#else
+    residency_registry* r = residency();
+    std::unique_lock<std::mutex> guard(r->lock);
+    for (mapping** p = &r->head; *p != NULL; p = &(*p)->next) {
+        mapping* m = *p;
+        if (m->id == id) {
+            *p = m->next;
+            /* a pass or an access may still sample or advise the range */
+            m->pins |= UNLINKED;
+            r->unpinned.wait(guard, [m] { return m->pins == UNLINKED; });
+            if (m->random) {
+                r->stream_stats[SS_RANDOM]--;
+            }
+            if (m->fd >= 0) {
+                close(m->fd);
+            }
+            free(m->chunk_table);
+            delete m;
+            return 0;
+        }
+    }
+    return -ENOENT;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_ResidencyManager
+ * Method:    touch0
+ * Signature: (JJJ)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_ResidencyManager_touch0(JNIEnv*, jclass,
+  jlong id,
+  jlong offset,
+  jlong length) {
+
+#if defined (_WIN64)
+    return -ENOSYS;
+#else
+    residency_registry* r = residency();
+    std::lock_guard<std::mutex> guard(r->lock);
+    mapping* m = find(r, id);
+    if (m == NULL) {
+        return -ENOENT;
+    }
+    /* offsets are relative to the registered (unaligned) address */
+    uint64_t start = (uint64_t) offset + m->misalign;
+    if (offset < 0 || start >= m->length) {
+        return -EINVAL;
+    }
+    touch_chunks(r, m, start, start + ((length > 0) ? (uint64_t) length : 1));
+    return 0;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_ResidencyManager
+ * Method:    access0
+ * Signature: (JJI)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_ResidencyManager_access0(JNIEnv*, jclass,
+  jlong id,
+  jlong offset,
+  jint length) {
+
+#if defined (_WIN64)
+    return -ENOSYS;
+#else
+    residency_registry* r = residency();
+    mapping* m;
+    uint64_t start;
+    uint64_t end;
+    stream_policy policy;
+    {
+        std::lock_guard<std::mutex> guard(r->lock);
+        m = find(r, id);
+        if (m == NULL) {
+            return -ENOENT;
+        }
+        /* offsets are relative to the registered (unaligned) address */
+        start = (uint64_t) offset + m->misalign;
+        if (offset < 0 || length < 0 || start >= m->length) {
+            return -EINVAL;
+        }
+        end = start + ((length > 0) ? (uint64_t) length : 1);
+        touch_chunks(r, m, start, end);
+        policy.trigger = r->trigger;
+        policy.min_window = r->min_window;
+        policy.max_window = r->max_window;
+        policy.max_rate = r->max_rate;
+        policy.adapt_random = r->adapt_random;
+        m->pins++;
+    }
+    prefetch_range ranges[MAX_TARGETS];
+    int n;
+    int advice;
+    {
+        std::lock_guard<std::mutex> guard(m->lock);
+        n = detect(r, &policy, m, (int64_t) start, (int64_t) ((end < m->length) ? end : m->length), ranges,
+                &advice);
+    }
+    /* the advice is issued without a lock, the pin keeps the mapping registered */
+    uint64_t ps = page_size();
+    for (int i = 0; i < n; ++i) {
+        uint64_t a = (uint64_t) ranges[i].start & ~(ps - 1);
+        uint64_t len = (uint64_t) ranges[i].start + (uint64_t) ranges[i].length - a;
+        NATIVE_PROBE4(stream_prefetch, id, m->address + a, len, n);
+        mmap_load((jlong) (intptr_t) (m->address + a), (jlong) len);
+    }
+    int err = 0;
+    if (advice >= 0) {
+        stats_scope stats(OP_RESIDENCY_ADVISE, (jlong) (intptr_t) m->address, (jlong) m->length);
+        if (madvise(m->address, (size_t) m->length, advice) == -1) {
+            err = -errno;
+            stats.fail(-err);
+        }
+    }
+    unpin(r, m);
+    return err;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_ResidencyManager
+ * Method:    setBudget0
+ * Signature: (IJ)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_ResidencyManager_setBudget0(JNIEnv*, jclass,
+  jint cls,
+  jlong bytes) {
+
+    if (cls < 0 || cls >= MAX_CLASSES || bytes < 0) {
+        return -EINVAL;
+    }
+    residency_registry* r = residency();
+    std::lock_guard<std::mutex> guard(r->lock);
+    r->stats[cls][CS_BUDGET] = bytes;
+    return 0;
+}
+
+/*
+ * Class:     mmap_impl_ResidencyManager
+ * Method:    setPolicy0
+ * Signature: (IIIIZZ)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_ResidencyManager_setPolicy0(JNIEnv*, jclass,
+  jint chunkShift,
+  jint evictAdvice,
+  jint lowWaterPercent,
+  jint hotEpochs,
+  jboolean prefetchHot,
+  jboolean dropCache) {
+
+    if (chunkShift < MIN_CHUNK_SHIFT || chunkShift > MAX_CHUNK_SHIFT || evictAdvice < EVICT_COLD
+            || evictAdvice > EVICT_DONTNEED || lowWaterPercent < 0 || lowWaterPercent > 100 || hotEpochs < 0) {
+        return -EINVAL;
+    }
+    residency_registry* r = residency();
+    std::lock_guard<std::mutex> pass(r->enforce_lock);
+    std::lock_guard<std::mutex> guard(r->lock);
+    if (chunkShift != r->chunk_shift && r->head != NULL) {
+        /* the chunk tables of the registered mappings would be invalid */
+        return -EBUSY;
+    }
+    r->chunk_shift = chunkShift;
+    r->evict_advice = evictAdvice;
+    r->low_water = lowWaterPercent;
+    r->hot_epochs = hotEpochs;
+    r->prefetch_hot = (prefetchHot == JNI_TRUE);
+    r->drop_cache = (dropCache == JNI_TRUE);
+    return 0;
+}
+
+/*
+ * Class:     mmap_impl_ResidencyManager
+ * Method:    setStreamPolicy0
+ * Signature: (IJJJZ)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_ResidencyManager_setStreamPolicy0(JNIEnv*, jclass,
+  jint triggerHits,
+  jlong minWindow,
+  jlong maxWindow,
+  jlong maxBytesPerSecond,
+  jboolean adaptRandom) {
+
+    if (triggerHits < 1 || minWindow <= 0 || maxWindow < minWindow || maxBytesPerSecond < 0) {
+        return -EINVAL;
+    }
+    residency_registry* r = residency();
+    std::lock_guard<std::mutex> guard(r->lock);
+    r->trigger = (uint32_t) triggerHits;
+    r->min_window = (uint64_t) minWindow;
+    r->max_window = (uint64_t) maxWindow;
+    r->max_rate = maxBytesPerSecond;
+    r->adapt_random = (adaptRandom == JNI_TRUE);
+    std::lock_guard<std::mutex> refill(r->throttle);
+    r->refilled = 0;
+    return 0;
+}
+
+/*
+ * Class:     mmap_impl_ResidencyManager
+ * Method:    enforce0
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL
+Java_mmap_impl_ResidencyManager_enforce0(JNIEnv*, jclass) {
+
+#if defined (_WIN64)
+    return -ENOSYS;
+#else
+    residency_registry* r = residency();
+    std::lock_guard<std::mutex> pass(r->enforce_lock);
+    jlong evicted = 0;
+    jlong error = 0;
+    for (int cls = 0; cls < MAX_CLASSES; ++cls) {
+        jlong result = enforce_class(r, cls);
+        if (result < 0) {
+            /* the other classes still get their pass */
+            error = result;
+        } else {
+            evicted += result;
+        }
+    }
+    std::lock_guard<std::mutex> guard(r->lock);
+    r->epoch++;
+    return (error < 0) ? error : evicted;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_ResidencyManager
+ * Method:    setAccessTracking0
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_ResidencyManager_setAccessTracking0(JNIEnv*, jclass,
+  jint mode) {
+
+#if defined (_WIN64)
+    return (mode == ACCESS_FAULTS) ? 0 : -ENOSYS;
+#else
+    if (mode < ACCESS_FAULTS || mode > ACCESS_UNMAP) {
+        return -EINVAL;
+    }
+    residency_registry* r = residency();
+    std::lock_guard<std::mutex> pass(r->enforce_lock);
+    std::lock_guard<std::mutex> guard(r->lock);
+    close_tracking(r);
+    if (mode == ACCESS_FAULTS) {
+        return 0;
+    }
+    int err = 0;
+    if ((r->pagemap_fd = open("/proc/self/pagemap", O_RDONLY)) == -1) {
+        err = -errno;
+    } else if (mode == ACCESS_PAGE_IDLE && (r->idle_fd = open("/sys/kernel/mm/page_idle/bitmap", O_RDWR)) == -1) {
+        err = -errno;
+    }
+    if (err == 0 && mode == ACCESS_PAGE_IDLE) {
+        /* are frame numbers visible? (a page of the stack is present) */
+        volatile uint64_t probe = 1;
+        uint64_t entry = 0;
+        off_t where = (off_t) ((uintptr_t) &probe / page_size() * sizeof(uint64_t));
+        err = pread_fully(r->pagemap_fd, &entry, sizeof(entry), where);
+        if (err == 0 && (entry & PM_PFN_MASK) == 0) {
+            err = -EPERM;
+        }
+    }
+    if (err != 0) {
+        close_tracking(r);
+        return err;
+    }
+    r->access_tracking = mode;
+    return 0;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_ResidencyManager
+ * Method:    idleAges0
+ * Signature: (J)[I
+ */
+JNIEXPORT jintArray JNICALL
+Java_mmap_impl_ResidencyManager_idleAges0(JNIEnv* env, jclass,
+  jlong id) {
+
+#if defined (_WIN64)
+    return NULL;
+#else
+    residency_registry* r = residency();
+    std::lock_guard<std::mutex> guard(r->lock);
+    mapping* m = find(r, id);
+    if (m == NULL) {
+        return NULL;
+    }
+    jint* ages = (jint*) malloc((size_t) (m->chunks + 1) * sizeof(jint));
+    if (ages == NULL) {
+        return NULL;
+    }
+    /* passes since the last access: 0 = accessed in the last pass (or since) */
+    uint32_t last_pass = r->epoch - 1;
+    for (uint64_t i = 0; i < m->chunks; ++i) {
+        uint32_t a = m->chunk_table[i].last_access;
+        ages[i] = (a == 0) ? -1 : (a >= last_pass) ? 0 : (jint) (last_pass - a);
+    }
+    jintArray result = env->NewIntArray((jsize) m->chunks);
+    if (result != NULL) {
+        env->SetIntArrayRegion(result, 0, (jsize) m->chunks, ages);
+    }
+    free(ages);
+    return result;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_ResidencyManager
+ * Method:    stats0
+ * Signature: (I[J)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_ResidencyManager_stats0(JNIEnv* env, jclass,
+  jint cls,
+  jlongArray result) {
+
+    if (cls < 0 || cls >= MAX_CLASSES) {
+        return -EINVAL;
+    }
+    residency_registry* r = residency();
+    jlong s[CS_COUNT];
+    {
+        std::lock_guard<std::mutex> guard(r->lock);
+        for (int i = 0; i < CS_COUNT; ++i) {
+            s[i] = r->stats[cls][i];
+        }
+    }
+    env->SetLongArrayRegion(result, 0, CS_COUNT, s);
+    return 0;
+}
+
+/*
+ * Class:     mmap_impl_ResidencyManager
+ * Method:    streamStats0
+ * Signature: ([J)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_ResidencyManager_streamStats0(JNIEnv* env, jclass,
+  jlongArray result) {
+
+    residency_registry* r = residency();
+    jlong s[SS_COUNT];
+    {
+        std::lock_guard<std::mutex> guard(r->lock);
+        for (int i = 0; i < SS_COUNT; ++i) {
+            s[i] = r->stream_stats[i];
+        }
+    }
+    env->SetLongArrayRegion(result, 0, SS_COUNT, s);
+    return 0;
+}
+
+/*
+ * Class:     mmap_impl_ResidencyManager
+ * Method:    isSupported0
+ * Signature: ()Z
+ */
+JNIEXPORT jboolean JNICALL
+Java_mmap_impl_ResidencyManager_isSupported0(JNIEnv*, jclass) {
+#if defined (_WIN64)
+    return JNI_FALSE;
+#else
+    return JNI_TRUE;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif // #ifdef __cplusplus
@@ -0,0 +1,495 @@
+package mmap.impl;
+
+import java.io.FileDescriptor;
+import java.io.IOException;
+import java.nio.MappedByteBuffer;
+
+/**
+ * Keeps the resident memory of registered memory mappings within a byte
+ * budget per mapping class (e.g. a class for hot indexes and one for
+ * scanned data), so that a large scan can't evict the hot data.
+ * <p>
+ * Each mapping is divided into chunks. Every {@link #enforce()} pass (run
+ * it periodically, e.g. once a second) samples the residency of all chunks
+ * with {@code mincore} and ages their access recency: a chunk counts as
+ * accessed if it was {@link #touch(long, long, long) touched} or gained
+ * resident pages since the previous pass. A class over its budget has its
+ * least recently used chunks evicted ({@code MADV_COLD},
+ * {@code MADV_PAGEOUT} or {@code MADV_DONTNEED}, optionally followed by
+ * {@code POSIX_FADV_DONTNEED} on the file) down to the low-water mark; a
+ * class under its budget can have its recently used chunks prefetched with
+ * {@code MADV_WILLNEED}.
+ * <p>
+ * A fault only shows the first access of a page. With
+ * {@link #setAccessTracking(int) access tracking} every pass also finds the
+ * resident pages that were used since the previous pass, so that
+ * {@link #idleAges(long)} (and the eviction order) rest on real accesses.
+ * <p>
+ * Accesses reported with {@link #access(long, long, int)} also feed a
+ * stream detector per mapping: sequential and strided streams are
+ * prefetched ahead with {@code MADV_WILLNEED} (the readahead window grows
+ * with the stream, throttled by {@link #setStreamPolicy}); a mapping whose
+ * accesses are mostly random is advised {@code MADV_RANDOM} so that its
+ * faults don't read ahead either.
+ * <p>
+ * Residency is that of the page cache. Mappings must be unregistered before
+ * they are unmapped. Not available on Windows, see {@link #isAvailable()}.
+ */
+public final class ResidencyManager {
+
+    /** The number of mapping classes. */
+    public static final int MAX_CLASSES = 16;
+
+    /** Evicts with {@code MADV_COLD}: the kernel reclaims the pages first. */
+    public static final int EVICT_COLD = 0;
+    /** Evicts with {@code MADV_PAGEOUT}: the pages are reclaimed right away. */
+    public static final int EVICT_PAGEOUT = 1;
+    /** Evicts with {@code MADV_DONTNEED}: the pages are unmapped right away. */
+    public static final int EVICT_DONTNEED = 2;
+
+    /** Accesses are only seen through faults (and touches). */
+    public static final int ACCESS_FAULTS = 0;
+    /**
+     * Accesses are read from the kernel's idle page tracking (needs
+     * {@code CONFIG_IDLE_PAGE_TRACKING} and {@code CAP_SYS_ADMIN}).
+     */
+    public static final int ACCESS_PAGE_IDLE = 1;
+    /**
+     * The page table entries of shared mappings are dropped after each pass
+     * and accesses show up as re-mapped pages (costs a minor fault per page
+     * and pass, works unprivileged).
+     */
+    public static final int ACCESS_UNMAP = 2;
+
+    /** The default chunk size: 2 MiB. */
+    public static final int DEFAULT_CHUNK_SHIFT = 21;
+
+    /** The statistics of a mapping class. */
+    public static final class Stats {
+        private final int mappingClass;
+        private final long budget;
+        private final long mappings;
+        private final long mapped;
+        private final long resident;
+        private final long evicted;
+        private final long prefetched;
+        private final long passes;
+        private final long overBudget;
+
+        Stats(int mappingClass, long[] s) {
+            this.mappingClass = mappingClass;
+            this.budget = s[0];
+            this.mappings = s[1];
+            this.mapped = s[2];
+            this.resident = s[3];
+            this.evicted = s[4];
+            this.prefetched = s[5];
+            this.passes = s[6];
+            this.overBudget = s[7];
+        }
+
+        public int mappingClass() {
+            return mappingClass;
+        }
+
+        /** The budget in bytes, 0 if the class has none. */
+        public long budget() {
+            return budget;
+        }
+
+        /** The number of registered mappings (at the last pass). */
+        public long mappings() {
+            return mappings;
+        }
+
+        /** The mapped bytes (at the last pass). */
+        public long mapped() {
+            return mapped;
+        }
+
+        /** The resident bytes sampled by the last pass. */
+        public long resident() {
+            return resident;
+        }
+
+        /**
+         * The total number of evicted bytes: the pages that evicted chunks
+         * had lost by the next pass (advised pages that stayed resident
+         * don't count).
+         */
+        public long evicted() {
+            return evicted;
+        }
+
+        /** The total number of prefetched bytes. */
+        public long prefetched() {
+            return prefetched;
+        }
+
+        /** The number of passes. */
+        public long passes() {
+            return passes;
+        }
+
+        /** The number of passes that found the class over its budget. */
+        public long overBudget() {
+            return overBudget;
+        }
+
+        @Override
+        //@formatter:off
+        public String toString() {
+            return "Stats{"
+                 + "class=" + mappingClass
+                 + ", budget=" + budget
+                 + ", mappings=" + mappings
+                 + ", mapped=" + mapped
+                 + ", resident=" + resident
+                 + ", evicted=" + evicted
+                 + ", prefetched=" + prefetched
+                 + ", passes=" + passes
+                 + ", overBudget=" + overBudget
+                 + '}';
+        }
+        //@formatter:on
+    }
+
+    /** The statistics of the stream detector (of all mappings). */
+    public static final class StreamStats {
+        private final long accesses;
+        private final long hits;
+        private final long streams;
+        private final long prefetches;
+        private final long prefetched;
+        private final long throttled;
+        private final long randomMappings;
+
+        StreamStats(long[] s) {
+            this.accesses = s[0];
+            this.hits = s[1];
+            this.streams = s[2];
+            this.prefetches = s[3];
+            this.prefetched = s[4];
+            this.throttled = s[5];
+            this.randomMappings = s[6];
+        }
+
+        /** The number of reported accesses. */
+        public long accesses() {
+            return accesses;
+        }
+
+        /** The number of accesses that continued a stream. */
+        public long hits() {
+            return hits;
+        }
+
+        /** The number of detected streams. */
+        public long streams() {
+            return streams;
+        }
+
+        /** The number of prefetched ranges. */
+        public long prefetches() {
+            return prefetches;
+        }
+
+        /** The total number of prefetched bytes. */
+        public long prefetched() {
+            return prefetched;
+        }
+
+        /** The number of prefetches that were dropped by the throttle. */
+        public long throttled() {
+            return throttled;
+        }
+
+        /** The number of mappings that are currently advised {@code MADV_RANDOM}. */
+        public long randomMappings() {
+            return randomMappings;
+        }
+
+        @Override
+        //@formatter:off
+        public String toString() {
+            return "StreamStats{"
+                 + "accesses=" + accesses
+                 + ", hits=" + hits
+                 + ", streams=" + streams
+                 + ", prefetches=" + prefetches
+                 + ", prefetched=" + prefetched
+                 + ", throttled=" + throttled
+                 + ", randomMappings=" + randomMappings
+                 + '}';
+        }
+        //@formatter:on
+    }
+
+    /**
+     * Returns {@code true} if the residency manager can be used (the
+     * library is loaded, the platform is supported and
+     * {@code -Dmmap.impl.residency=false} isn't set).
+     */
+    public static boolean isAvailable() {
+        return AVAILABLE;
+    }
+
+    /**
+     * Registers a mapping whose file cache isn't dropped on eviction.
+     *
+     * @return the id of the mapping
+     */
+    public static long register(int mappingClass, long address, long length) {
+        return register(mappingClass, address, length, null, 0L);
+    }
+
+    /**
+     * Registers a mapped buffer of the file {@code fd} that is mapped at
+     * {@code fileOffset}.
+     *
+     * @return the id of the mapping
+     */
+    public static long register(int mappingClass, MappedByteBuffer buffer, FileDescriptor fd, long fileOffset) {
+        return register(mappingClass, Native.address(buffer), buffer.capacity(), fd, fileOffset);
+    }
+
+    /**
+     * Registers a mapping. If {@code fd} isn't {@code null} the file cache
+     * of evicted chunks can be dropped as well; the manager keeps a
+     * duplicate of the descriptor until the mapping is unregistered, so
+     * {@code fd} may be closed in the meantime.
+     *
+     * @return the id of the mapping
+     */
+    public static long register(int mappingClass, long address, long length, FileDescriptor fd, long fileOffset) {
+        checkClass(mappingClass);
+        if (address == 0L || length <= 0L || fileOffset < 0L) {
+            throw new IllegalArgumentException(
+                    "address: " + address + ", length: " + length + ", fileOffset: " + fileOffset);
+        }
+        int rawFd = (fd == null || Native.isWindows()) ? -1 : (int) MMapUtils.getFileDescriptor(fd);
+        return check(register0(mappingClass, address, length, rawFd, fileOffset), "register");
+    }
+
+    /**
+     * Unregisters a mapping (before it is unmapped). Waits for a running
+     * {@link #enforce()} pass or {@link #access} that still advises the
+     * mapping.
+     */
+    public static void unregister(long id) {
+        check(unregister0(id), "unregister");
+    }
+
+    /**
+     * Records an access to {@code length} bytes at {@code offset} of a
+     * mapping (the chunks count as used in the current pass).
+     */
+    public static void touch(long id, long offset, long length) {
+        if (offset < 0L || length < 0L) {
+            throw new IllegalArgumentException("offset: " + offset + ", length: " + length);
+        }
+        check(touch0(id, offset, length), "touch");
+    }
+
+    /**
+     * Records an access to {@code length} bytes at {@code offset} of a
+     * mapping like {@link #touch(long, long, long)} and feeds it to the
+     * stream detector, which may prefetch ahead of the stream that the
+     * access continues.
+     */
+    public static void access(long id, long offset, int length) {
+        if (offset < 0L || length < 0) {
+            throw new IllegalArgumentException("offset: " + offset + ", length: " + length);
+        }
+        check(access0(id, offset, length), "access");
+    }
+
+    /** Sets the budget of a mapping class in bytes, 0 removes it. */
+    public static void setBudget(int mappingClass, long bytes) {
+        checkClass(mappingClass);
+        if (bytes < 0L) {
+            throw new IllegalArgumentException("bytes: " + bytes);
+        }
+        check(setBudget0(mappingClass, bytes), "setBudget");
+    }
+
+    /**
+     * Sets the policy of all classes.
+     *
+     * @param chunkShift
+     *            log2 of the chunk size (16 to 30); can only be changed while
+     *            no mapping is registered
+     * @param evictAdvice
+     *            {@link #EVICT_COLD}, {@link #EVICT_PAGEOUT} or
+     *            {@link #EVICT_DONTNEED}
+     * @param lowWaterPercent
+     *            a class over its budget is evicted down to this percentage
+     *            of the budget
+     * @param hotEpochs
+     *            a chunk accessed within this many passes is hot
+     * @param prefetchHot
+     *            whether hot chunks of a class under its budget are
+     *            prefetched
+     * @param dropCache
+     *            whether the file cache of evicted chunks is dropped as well
+     */
+    public static void setPolicy(int chunkShift, int evictAdvice, int lowWaterPercent, int hotEpochs,
+            boolean prefetchHot, boolean dropCache) {
+        check(setPolicy0(chunkShift, evictAdvice, lowWaterPercent, hotEpochs, prefetchHot, dropCache), "setPolicy");
+    }
+
+    /**
+     * Sets the policy of the stream detector (defaults: 2, 128 KiB, 2 MiB,
+     * unlimited, {@code true}).
+     *
+     * @param triggerHits
+     *            the number of accesses that must continue a stream before
+     *            it is prefetched
+     * @param minWindow
+     *            the first readahead window of a sequential stream in bytes
+     * @param maxWindow
+     *            the window doubles up to this many bytes
+     * @param maxBytesPerSecond
+     *            the maximum prefetch rate of all streams, 0 for no limit
+     * @param adaptRandom
+     *            whether mappings with mostly random accesses are advised
+     *            {@code MADV_RANDOM}
+     */
+    public static void setStreamPolicy(int triggerHits, long minWindow, long maxWindow, long maxBytesPerSecond,
+            boolean adaptRandom) {
+        check(setStreamPolicy0(triggerHits, minWindow, maxWindow, maxBytesPerSecond, adaptRandom),
+                "setStreamPolicy");
+    }
+
+    /**
+     * Sets how the accesses of resident pages are detected.
+     *
+     * @param mode
+     *            {@link #ACCESS_FAULTS}, {@link #ACCESS_PAGE_IDLE} or
+     *            {@link #ACCESS_UNMAP}
+     * @throws IOException
+     *             if the mode isn't supported (e.g. missing privileges); the
+     *             tracking falls back to {@link #ACCESS_FAULTS}
+     */
+    public static void setAccessTracking(int mode) throws IOException {
+        if (mode < ACCESS_FAULTS || mode > ACCESS_UNMAP) {
+            throw new IllegalArgumentException("mode: " + mode);
+        }
+        int result = setAccessTracking0(mode);
+        if (result < 0) {
+            throw new IOException("setAccessTracking(" + mode + ") failed (errno " + -result + ")");
+        }
+    }
+
+    /**
+     * The idle age of each chunk of a mapping: the number of passes since
+     * the chunk was last accessed (0 if it was accessed in the last pass or
+     * since) or -1 if no access has been seen.
+     */
+    public static int[] idleAges(long id) {
+        int[] ages = idleAges0(id);
+        if (ages == null) {
+            throw new IllegalStateException("idleAges failed (unknown mapping " + id + ")");
+        }
+        return ages;
+    }
+
+    /**
+     * Runs one pass over all classes.
+     *
+     * @return the number of bytes advised for eviction (the pages that
+     *         are actually freed show in {@link Stats#evicted()} after the
+     *         next pass)
+     * @throws IOException
+     *             if sampling or an advice failed (the other classes still
+     *             got their pass)
+     */
+    public static long enforce() throws IOException {
+        long result = enforce0();
+        if (result < 0L) {
+            throw new IOException("enforce failed (errno " + -result + ")");
+        }
+        return result;
+    }
+
+    /** The statistics of a mapping class. */
+    public static Stats stats(int mappingClass) {
+        checkClass(mappingClass);
+        long[] s = new long[STATS];
+        check(stats0(mappingClass, s), "stats");
+        return new Stats(mappingClass, s);
+    }
+
+    /** The statistics of the stream detector. */
+    public static StreamStats streamStats() {
+        long[] s = new long[STREAM_STATS];
+        check(streamStats0(s), "streamStats");
+        return new StreamStats(s);
+    }
+
+    private static void checkClass(int mappingClass) {
+        if (mappingClass < 0 || mappingClass >= MAX_CLASSES) {
+            throw new IllegalArgumentException("mappingClass: " + mappingClass);
+        }
+    }
+
+    private static long check(long result, String call) {
+        if (result < 0L) {
+            throw new IllegalStateException(call + " failed (errno " + -result + ")");
+        }
+        return result;
+    }
+
+    private static boolean available() {
+        if (!Boolean.parseBoolean(System.getProperty("mmap.impl.residency", "true"))) {
+            return false;
+        }
+        try {
+            return isSupported0();
+        } catch (UnsatisfiedLinkError e) {
+            return false;
+        }
+    }
+
+    // native methods (return -errno on failure)
+
+    private static native long register0(int mappingClass, long address, long length, int fd, long fileOffset);
+
+    private static native int unregister0(long id);
+
+    private static native int touch0(long id, long offset, long length);
+
+    private static native int access0(long id, long offset, int length);
+
+    private static native int setBudget0(int mappingClass, long bytes);
+
+    private static native int setPolicy0(int chunkShift, int evictAdvice, int lowWaterPercent, int hotEpochs,
+            boolean prefetchHot, boolean dropCache);
+
+    private static native int setStreamPolicy0(int triggerHits, long minWindow, long maxWindow,
+            long maxBytesPerSecond, boolean adaptRandom);
+
+    private static native long enforce0();
+
+    private static native int setAccessTracking0(int mode);
+
+    private static native int[] idleAges0(long id);
+
+    private static native int stats0(int mappingClass, long[] result);
+
+    private static native int streamStats0(long[] result);
+
+    private static native boolean isSupported0();
+
+    // number of statistics per class
+    private static final int STATS = 8;
+
+    // number of stream statistics
+    private static final int STREAM_STATS = 7;
+
+    private static final boolean AVAILABLE = available();
+
+    private ResidencyManager() {
+        throw new AssertionError();
+    }
+}
@@ -0,0 +1,418 @@
+
+#ifndef _JAVASOFT_JNI_H_
+#include <jni.h>
+#endif /* _JAVASOFT_JNI_H_ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#if defined (__linux)
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#endif
+
+#include "native_sdt.h"
+#include "native_stats.h"
+
+
+/*
+ * Immutable buffers that can be shared with other components and
+ * processes without a defensive copy.
+ *
+ * A buffer is a memfd that is filled through a writable shared mapping.
+ * Sealing unmaps it (F_SEAL_WRITE fails while a writable shared mapping
+ * exists), adds F_SEAL_WRITE, F_SEAL_SHRINK, F_SEAL_GROW and F_SEAL_SEAL
+ * and maps the buffer read-only. From then on nobody, including the
+ * creator, can change or resize the content, so a receiver only has to
+ * check the seals instead of copying.
+ *
+ * The descriptor is passed over a Unix domain socket as SCM_RIGHTS
+ * ancillary data (with a one byte payload). The receiver rejects
+ * descriptors that aren't sealed memfds (EPERM) and maps them read-only
+ * with the size from fstat(2). Linux 3.17+ only.
+ */
+
+#if defined (__linux) && defined (SYS_memfd_create)
+
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_GET_SEALS 1034
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#define F_SEAL_WRITE 0x0008
+#endif
+
+/* The seals a receiver insists on */
+#define IMMUTABLE (F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW)
+
+/* Room for the descriptors a misbehaving peer may send along (all closed) */
+#define MAX_RECEIVED_FDS 16
+
+struct sealed_buffer {
+    int fd;
+    uint8_t* base;          /* NULL for an empty buffer */
+    uint64_t size;
+    bool sealed;
+};
+
+/* Maps the buffer (read-only once sealed). Returns 0 or -errno. */
+static int map(sealed_buffer* b) {
+    b->base = NULL;
+    if (b->size == 0) {
+        return 0;
+    }
+    int prot = b->sealed ? PROT_READ : PROT_READ | PROT_WRITE;
+    void* p = mmap(NULL, (size_t) b->size, prot, MAP_SHARED, b->fd, 0);
+    if (p == MAP_FAILED) {
+        return -errno;
+    }
+    b->base = (uint8_t*) p;
+    return 0;
+}
+
+static void unmap(sealed_buffer* b) {
+    if (b->base != NULL) {
+        munmap(b->base, (size_t) b->size);
+        b->base = NULL;
+    }
+}
+
+static void release(sealed_buffer* b) {
+    unmap(b);
+    close(b->fd);
+    free(b);
+}
+
+#endif /* __linux && SYS_memfd_create */
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Class:     mmap_impl_SealedBuffer
+ * Method:    create0
+ * Signature: (J)J
+ */
+JNIEXPORT jlong JNICALL
+Java_mmap_impl_SealedBuffer_create0(JNIEnv*, jclass,
+  jlong size) {
+
+#if defined (__linux) && defined (SYS_memfd_create)
+    if (size < 0) {
+        return -EINVAL;
+    }
+    sealed_buffer* b = (sealed_buffer*) malloc(sizeof(sealed_buffer));
+    if (b == NULL) {
+        return -ENOMEM;
+    }
+    b->size = (uint64_t) size;
+    b->sealed = false;
+    b->fd = (int) syscall(SYS_memfd_create, "sealed_buffer", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (b->fd == -1) {
+        int err = errno;
+        free(b);
+        return -err;
+    }
+    int err = (ftruncate(b->fd, (off_t) size) == -1) ? -errno : map(b);
+    if (err < 0) {
+        close(b->fd);
+        free(b);
+        return err;
+    }
+    return (jlong) (intptr_t) b;
+#else
+    return -ENOSYS;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_SealedBuffer
+ * Method:    seal0
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_SealedBuffer_seal0(JNIEnv*, jclass,
+  jlong handle) {
+
+#if defined (__linux) && defined (SYS_memfd_create)
+    sealed_buffer* b = (sealed_buffer*) (intptr_t) handle;
+    if (b->sealed) {
+        return 0;
+    }
+    /* F_SEAL_WRITE fails with EBUSY while a writable shared mapping exists */
+    unmap(b);
+    int err = 0;
+    if (fcntl(b->fd, F_ADD_SEALS, IMMUTABLE | F_SEAL_SEAL) == -1) {
+        err = -errno;
+    } else {
+        b->sealed = true;
+    }
+    /* read-only if sealed, writable again otherwise */
+    int result = map(b);
+    NATIVE_PROBE3(sealed_seal, b->fd, b->size, err);
+    return (err < 0) ? err : result;
+#else
+    return -ENOSYS;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_SealedBuffer
+ * Method:    send0
+ * Signature: (JI)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_SealedBuffer_send0(JNIEnv*, jclass,
+  jlong handle,
+  jint socket) {
+
+#if defined (__linux) && defined (SYS_memfd_create)
+    sealed_buffer* b = (sealed_buffer*) (intptr_t) handle;
+    stats_scope stats(OP_SEALED_TRANSFER, (jlong) (intptr_t) b->base, (jlong) b->size);
+    if (!b->sealed) {
+        stats.fail(EPERM);
+        return -EPERM;
+    }
+    char payload = 'S';
+    struct iovec iov = { &payload, 1 };
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(c), &b->fd, sizeof(int));
+    ssize_t n;
+    do {
+        n = sendmsg(socket, &msg, MSG_NOSIGNAL);
+    } while (n == -1 && errno == EINTR);
+    int err = (n == -1) ? -errno : 0;
+    NATIVE_PROBE3(sealed_send, socket, b->size, err);
+    if (err < 0) {
+        stats.fail(-err);
+    }
+    return err;
+#else
+    return -ENOSYS;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_SealedBuffer
+ * Method:    receive0
+ * Signature: (I)J
+ */
+JNIEXPORT jlong JNICALL
+Java_mmap_impl_SealedBuffer_receive0(JNIEnv*, jclass,
+  jint socket) {
+
+#if defined (__linux) && defined (SYS_memfd_create)
+    stats_scope stats(OP_SEALED_TRANSFER, 0, 0);
+    char payload;
+    struct iovec iov = { &payload, 1 };
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(MAX_RECEIVED_FDS * sizeof(int))];
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    ssize_t n;
+    do {
+        n = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+    } while (n == -1 && errno == EINTR);
+    if (n <= 0) {
+        /* 0: the peer has closed the socket */
+        int err = (n == -1) ? errno : EPIPE;
+        stats.fail(err);
+        return -err;
+    }
+    /*
+     * Exactly one SCM_RIGHTS message with exactly one descriptor. Every
+     * other received descriptor is closed, and so is the one if there are
+     * more (or the kernel had to drop some: MSG_CTRUNC).
+     */
+    int fd = -1;
+    bool valid = (msg.msg_flags & MSG_CTRUNC) == 0;
+    for (struct cmsghdr* c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; ++i) {
+            int received;
+            memcpy(&received, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+            if (fd == -1 && c->cmsg_len == CMSG_LEN(sizeof(int))) {
+                fd = received;
+            } else {
+                close(received);
+                valid = false;
+            }
+        }
+    }
+    if (!valid || fd == -1) {
+        if (fd != -1) {
+            close(fd);
+        }
+        stats.fail(EBADMSG);
+        return -EBADMSG;
+    }
+
+    /* only a memfd has seals (EINVAL otherwise) */
+    int seals = fcntl(fd, F_GET_SEALS);
+    struct stat st;
+    int err = 0;
+    if (seals == -1 || (seals & IMMUTABLE) != IMMUTABLE) {
+        err = -EPERM;
+    } else if (fstat(fd, &st) == -1) {
+        err = -errno;
+    }
+    sealed_buffer* b = NULL;
+    if (err == 0 && (b = (sealed_buffer*) malloc(sizeof(sealed_buffer))) == NULL) {
+        err = -ENOMEM;
+    }
+    if (err == 0) {
+        b->fd = fd;
+        b->size = (uint64_t) st.st_size;
+        b->sealed = true;
+        err = map(b);
+    }
+    NATIVE_PROBE3(sealed_receive, socket, (err == 0) ? b->size : 0, err);
+    if (err < 0) {
+        free(b);
+        close(fd);
+        stats.fail(-err);
+        return err;
+    }
+    return (jlong) (intptr_t) b;
+#else
+    return -ENOSYS;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_SealedBuffer
+ * Method:    address0
+ * Signature: (J)J
+ */
+JNIEXPORT jlong JNICALL
+Java_mmap_impl_SealedBuffer_address0(JNIEnv*, jclass,
+  jlong handle) {
+
+#if defined (__linux) && defined (SYS_memfd_create)
+    return (jlong) (intptr_t) ((sealed_buffer*) (intptr_t) handle)->base;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_SealedBuffer
+ * Method:    size0
+ * Signature: (J)J
+ */
+JNIEXPORT jlong JNICALL
+Java_mmap_impl_SealedBuffer_size0(JNIEnv*, jclass,
+  jlong handle) {
+
+#if defined (__linux) && defined (SYS_memfd_create)
+    return (jlong) ((sealed_buffer*) (intptr_t) handle)->size;
+#else
+    return -ENOSYS;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_SealedBuffer
+ * Method:    close0
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL
+Java_mmap_impl_SealedBuffer_close0(JNIEnv*, jclass,
+  jlong handle) {
+
+#if defined (__linux) && defined (SYS_memfd_create)
+    release((sealed_buffer*) (intptr_t) handle);
+#endif
+}
+
+/*
+ * Class:     mmap_impl_SealedBuffer
+ * Method:    socketPair0
+ * Signature: ([I)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_SealedBuffer_socketPair0(JNIEnv* env, jclass,
+  jintArray result) {
+
+#if defined (__linux)
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == -1) {
+        return -errno;
+    }
+    jint r[2] = { fds[0], fds[1] };
+    env->SetIntArrayRegion(result, 0, 2, r);
+    return 0;
+#else
+    return -ENOSYS;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_SealedBuffer
+ * Method:    closeSocket0
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_SealedBuffer_closeSocket0(JNIEnv*, jclass,
+  jint socket) {
+
+#if defined (__linux)
+    return (close(socket) == -1) ? -errno : 0;
+#else
+    return -ENOSYS;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_SealedBuffer
+ * Method:    isSupported0
+ * Signature: ()Z
+ */
+JNIEXPORT jboolean JNICALL
+Java_mmap_impl_SealedBuffer_isSupported0(JNIEnv*, jclass) {
+#if defined (__linux) && defined (SYS_memfd_create)
+    return JNI_TRUE;
+#else
+    return JNI_FALSE;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif // #ifdef __cplusplus
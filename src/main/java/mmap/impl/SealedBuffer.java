@@ -0,0 +1,181 @@
+package mmap.impl;
+
+import java.io.IOException;
+
+/**
+ * An immutable shared memory buffer ({@code memfd}) that can be handed to
+ * other components and processes without a defensive copy.
+ * <p>
+ * The creator fills the buffer at {@link #address()} and then
+ * {@link #seal() seals} it ({@code F_SEAL_WRITE}, {@code F_SEAL_SHRINK},
+ * {@code F_SEAL_GROW} and {@code F_SEAL_SEAL}): from then on the content
+ * can't be changed or resized by anyone and the buffer is mapped
+ * read-only. A sealed buffer is {@link #send(int) sent} as a file
+ * descriptor over a Unix domain socket; the {@link #receive(int) receiver}
+ * verifies the seals and maps it read-only, so it can trust the content
+ * without copying it. Each side closes its own buffer, the memory is freed
+ * with the last mapping and descriptor.
+ * <p>
+ * Sockets are raw descriptors, e.g. from {@link #socketPair()} (a
+ * {@code SOCK_SEQPACKET} pair) or from the descriptor of a connected Unix
+ * domain socket channel. Linux only, see {@link #isAvailable()}.
+ */
+public final class SealedBuffer implements AutoCloseable {
+
+    private long handle;
+    private long address;
+    private final long size;
+    private boolean sealed;
+
+    private SealedBuffer(long handle, boolean sealed) {
+        this.handle = handle;
+        this.address = address0(handle);
+        this.size = size0(handle);
+        this.sealed = sealed;
+    }
+
+    /**
+     * Returns {@code true} if sealed buffers can be used (the library is
+     * loaded, the platform is Linux and {@code -Dmmap.impl.sealed=false}
+     * isn't set).
+     */
+    public static boolean isAvailable() {
+        return AVAILABLE;
+    }
+
+    /** Creates a writable buffer of {@code size} zero bytes. */
+    public static SealedBuffer create(long size) throws IOException {
+        if (size < 0L) {
+            throw new IllegalArgumentException("size: " + size);
+        }
+        return new SealedBuffer(check(create0(size), "memfd_create"), false);
+    }
+
+    /**
+     * Receives a sealed buffer from a Unix domain socket (blocks until one
+     * arrives).
+     *
+     * @throws IOException
+     *             if the receive fails, the peer has closed the socket
+     *             (errno 32) or the descriptor isn't a sealed buffer (errno
+     *             1)
+     */
+    public static SealedBuffer receive(int socket) throws IOException {
+        return new SealedBuffer(check(receive0(socket), "receive"), true);
+    }
+
+    /** A connected pair of Unix domain sockets (close-on-exec). */
+    public static int[] socketPair() throws IOException {
+        int[] fds = new int[2];
+        check(socketPair0(fds), "socketpair");
+        return fds;
+    }
+
+    /** Closes a socket of {@link #socketPair()}. */
+    public static void closeSocket(int socket) throws IOException {
+        check(closeSocket0(socket), "close");
+    }
+
+    /**
+     * The address of the buffer: writable until it is sealed, read-only
+     * afterwards (0 for an empty buffer). Changes when the buffer is
+     * sealed.
+     */
+    public synchronized long address() {
+        handle();
+        return address;
+    }
+
+    public long size() {
+        return size;
+    }
+
+    public synchronized boolean isSealed() {
+        return sealed;
+    }
+
+    /**
+     * Seals the buffer and maps it read-only. Writes through the previous
+     * {@link #address()} are no longer possible.
+     */
+    public synchronized void seal() throws IOException {
+        if (!sealed) {
+            int result = seal0(handle());
+            address = address0(handle);
+            check(result, "seal");
+            sealed = true;
+        }
+    }
+
+    /**
+     * Sends the descriptor of the sealed buffer over a Unix domain socket
+     * (the buffer stays open on this side).
+     */
+    public synchronized void send(int socket) throws IOException {
+        if (!sealed) {
+            throw new IllegalStateException("SealedBuffer isn't sealed");
+        }
+        check(send0(handle(), socket), "send");
+    }
+
+    /** Unmaps the buffer and closes its descriptor. */
+    @Override
+    public synchronized void close() {
+        long h = handle;
+        if (h != 0L) {
+            handle = 0L;
+            address = 0L;
+            close0(h);
+        }
+    }
+
+    private long handle() {
+        long h = handle;
+        if (h == 0L) {
+            throw new IllegalStateException("SealedBuffer is closed");
+        }
+        return h;
+    }
+
+    private static long check(long result, String call) throws IOException {
+        if (result < 0L) {
+            throw new IOException(call + " failed (errno " + -result + ")");
+        }
+        return result;
+    }
+
+    private static boolean available() {
+        if (!Boolean.parseBoolean(System.getProperty("mmap.impl.sealed", "true"))) {
+            return false;
+        }
+        try {
+            return isSupported0();
+        } catch (UnsatisfiedLinkError e) {
+            return false;
+        }
+    }
+
+    // native methods (return -errno on failure)
+
+    private static native long create0(long size);
+
+    private static native int seal0(long handle);
+
+    private static native int send0(long handle, int socket);
+
+    private static native long receive0(int socket);
+
+    private static native long address0(long handle);
+
+    private static native long size0(long handle);
+
+    private static native void close0(long handle);
+
+    private static native int socketPair0(int[] result);
+
+    private static native int closeSocket0(int socket);
+
+    private static native boolean isSupported0();
+
+    private static final boolean AVAILABLE = available();
+}
@@ -0,0 +1,149 @@
+
+#ifndef _JAVASOFT_JNI_H_
+#include <jni.h>
+#endif /* _JAVASOFT_JNI_H_ */
+
+#include <stdint.h>
+
+#if !defined (_WIN64)
+#include <sched.h>
+#endif
+
+
+/*
+ * A sequence lock over a small record of 64-bit values in native (e.g.
+ * mapped) memory:
+ *
+ *   8 bytes         sequence (odd while a write is in progress)
+ *   count * 8       values
+ *
+ * There must be a single writer at a time (callers serialize writers with
+ * their own lock); any number of readers take consistent snapshots without
+ * a lock and without writing to the shared cache line, so reads scale with
+ * the number of cores. All accesses are atomic so that the racy reads of a
+ * torn snapshot (which get discarded) are well-defined.
+ *
+ * Unlike the other native operations these aren't counted in NativeStats:
+ * the global counters would be the one contended cache line.
+ */
+
+#define MAX_VALUES 64
+
+/* Spins before a reader yields to a (descheduled) writer */
+#define SPINS_BEFORE_YIELD 64
+
+
+static inline void cpu_relax() {
+#if defined (__x86_64__) || defined (__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static inline void reader_backoff(int* spins) {
+    if (++*spins < SPINS_BEFORE_YIELD) {
+        cpu_relax();
+    } else {
+        *spins = 0;
+#if !defined (_WIN64)
+        sched_yield();
+#endif
+    }
+}
+
+static uint64_t seq_write(uint64_t* p, const jlong* values, jint count) {
+    uint64_t seq = __atomic_load_n(p, __ATOMIC_RELAXED);
+    __atomic_store_n(p, seq + 1, __ATOMIC_RELAXED);
+    /* the odd sequence must be visible before any of the values */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (jint i = 0; i < count; ++i) {
+        __atomic_store_n(p + 1 + i, (uint64_t) values[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(p, seq + 2, __ATOMIC_RELEASE);
+    return seq + 2;
+}
+
+static uint64_t seq_read(const uint64_t* p, jlong* values, jint count) {
+    int spins = 0;
+    for (;;) {
+        uint64_t s1 = __atomic_load_n(p, __ATOMIC_ACQUIRE);
+        if (s1 & 1) {
+            reader_backoff(&spins);
+            continue;
+        }
+        for (jint i = 0; i < count; ++i) {
+            values[i] = (jlong) __atomic_load_n(p + 1 + i, __ATOMIC_RELAXED);
+        }
+        /* the value loads must complete before the sequence is read again */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        uint64_t s2 = __atomic_load_n(p, __ATOMIC_RELAXED);
+        if (s1 == s2) {
+            return s1;
+        }
+        reader_backoff(&spins);
+    }
+}
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Class:     mmap_impl_SeqLock
+ * Method:    write0
+ * Signature: (J[JI)J
+ */
+JNIEXPORT jlong JNICALL
+Java_mmap_impl_SeqLock_write0(JNIEnv* env, jclass,
+  jlong address,
+  jlongArray values,
+  jint count) {
+
+    jlong v[MAX_VALUES];
+    env->GetLongArrayRegion(values, 0, count, v);
+    return (jlong) seq_write((uint64_t*) (intptr_t) address, v, count);
+}
+
+/*
+ * Class:     mmap_impl_SeqLock
+ * Method:    read0
+ * Signature: (J[JI)J
+ */
+JNIEXPORT jlong JNICALL
+Java_mmap_impl_SeqLock_read0(JNIEnv* env, jclass,
+  jlong address,
+  jlongArray values,
+  jint count) {
+
+    jlong v[MAX_VALUES];
+    jlong seq = (jlong) seq_read((const uint64_t*) (intptr_t) address, v, count);
+    env->SetLongArrayRegion(values, 0, count, v);
+    return seq;
+}
+
+/*
+ * Class:     mmap_impl_SeqLock
+ * Method:    sequence0
+ * Signature: (J)J
+ */
+JNIEXPORT jlong JNICALL
+Java_mmap_impl_SeqLock_sequence0(JNIEnv*, jclass,
+  jlong address) {
+
+    return (jlong) __atomic_load_n((const uint64_t*) (intptr_t) address, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Class:     mmap_impl_SeqLock
+ * Method:    isSupported0
+ * Signature: ()Z
+ */
+JNIEXPORT jboolean JNICALL
+Java_mmap_impl_SeqLock_isSupported0(JNIEnv*, jclass) {
+    return JNI_TRUE;
+}
+
+#ifdef __cplusplus
+}
+#endif // #ifdef __cplusplus
@@ -0,0 +1,107 @@
+package mmap.impl;
+
+/**
+ * A native sequence lock over a record of {@code long} values in native (or
+ * mapped) memory: an 8 byte sequence counter followed by the values. Writers
+ * (one at a time, serialized by the caller) bump the counter to an odd value,
+ * store the values and bump it to the next even value with ordered stores.
+ * Readers take a consistent snapshot without a lock by retrying until they
+ * saw the same even counter before and after reading the values; they never
+ * write to the shared memory, so reads scale with the number of cores.
+ * <p>
+ * The memory must be 8-byte aligned and {@link #size(int)} bytes long.
+ */
+public final class SeqLock {
+
+    /** The maximum number of values of a record. */
+    public static final int MAX_VALUES = 64;
+
+    /**
+     * Returns {@code true} if the native sequence lock can be used (the
+     * library is loaded and {@code -Dmmap.impl.seqlock=false} isn't set).
+     */
+    public static boolean isAvailable() {
+        return AVAILABLE;
+    }
+
+    /** The size in bytes of a record of {@code count} values. */
+    public static long size(int count) {
+        checkCount(count);
+        return 8L * (1 + count);
+    }
+
+    /**
+     * Publishes the first {@code count} values. Calls must be serialized by
+     * the caller.
+     *
+     * @return the new (even) sequence
+     */
+    public static long write(long address, long[] values, int count) {
+        checkArgs(address, values, count);
+        return write0(address, values, count);
+    }
+
+    /**
+     * Reads a consistent snapshot of {@code count} values into
+     * {@code values}.
+     *
+     * @return the (even) sequence of the snapshot
+     */
+    public static long read(long address, long[] values, int count) {
+        checkArgs(address, values, count);
+        return read0(address, values, count);
+    }
+
+    /** The current sequence (odd while a write is in progress). */
+    public static long sequence(long address) {
+        checkAddress(address);
+        return sequence0(address);
+    }
+
+    private static void checkArgs(long address, long[] values, int count) {
+        checkAddress(address);
+        checkCount(count);
+        if (count > values.length) {
+            throw new IndexOutOfBoundsException("count: " + count + ", length: " + values.length);
+        }
+    }
+
+    private static void checkAddress(long address) {
+        if (address == 0L || (address & 7L) != 0L) {
+            throw new IllegalArgumentException("address: " + address);
+        }
+    }
+
+    private static void checkCount(int count) {
+        if (count < 0 || count > MAX_VALUES) {
+            throw new IllegalArgumentException("count: " + count);
+        }
+    }
+
+    private static boolean available() {
+        if (!Boolean.parseBoolean(System.getProperty("mmap.impl.seqlock", "true"))) {
+            return false;
+        }
+        try {
+            return isSupported0();
+        } catch (UnsatisfiedLinkError e) {
+            return false;
+        }
+    }
+
+    // native methods
+
+    private static native long write0(long address, long[] values, int count);
+
+    private static native long read0(long address, long[] values, int count);
+
+    private static native long sequence0(long address);
+
+    private static native boolean isSupported0();
+
+    private static final boolean AVAILABLE = available();
+
+    private SeqLock() {
+        throw new AssertionError();
+    }
+}
@@ -0,0 +1,357 @@
+
+#ifndef _JAVASOFT_JNI_H_
+#include <jni.h>
+#endif /* _JAVASOFT_JNI_H_ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#if !defined (_WIN64)
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "native_sdt.h"
+#include "native_stats.h"
+
+
+/*
+ * Page state accounting of address ranges from /proc/self/smaps: the
+ * counters of all VMAs that overlap a range are summed up (a VMA is only
+ * counted as a whole, the kernel doesn't split its counters). Many ranges
+ * are answered by a single pass over the file, which is read with plain
+ * read(2) calls into a buffer and parsed in place.
+ *
+ * Reading a VMA's entry makes the kernel walk its page tables, which is
+ * what costs; the VMAs are listed in address order, so the pass stops at
+ * the first VMA past the last range and the later ones aren't walked.
+ * /proc/self/smaps_rollup (Linux 4.14+) holds the sums of all VMAs of the
+ * process.
+ *
+ * The counters are in bytes (the kB values of the file times 1024), in the
+ * order of the constants of Smaps.java. Counters the kernel doesn't report
+ * (older kernels, no THP) stay 0.
+ */
+
+/* Counters (in the order of Smaps.java) */
+enum smaps_field {
+    SF_VMAS = 0,
+    SF_SIZE,
+    SF_RSS,
+    SF_PSS,
+    SF_SHARED_CLEAN,
+    SF_SHARED_DIRTY,
+    SF_PRIVATE_CLEAN,
+    SF_PRIVATE_DIRTY,
+    SF_REFERENCED,
+    SF_ANONYMOUS,
+    SF_LAZY_FREE,
+    SF_ANON_HUGE_PAGES,
+    SF_FILE_PMD_MAPPED,
+    SF_SHARED_HUGETLB,
+    SF_PRIVATE_HUGETLB,
+    SF_SWAP,
+    SF_SWAP_PSS,
+    SF_LOCKED,
+    SF_COUNT
+};
+
+#if !defined (_WIN64)
+
+#define READ_BUFFER (64 * 1024)
+
+struct field_name {
+    const char* name;
+    size_t length;
+    smaps_field field;
+};
+
+#define FIELD(name, field) { name, sizeof(name) - 1, field }
+
+static const field_name FIELDS[] = {
+    FIELD("Size", SF_SIZE),
+    FIELD("Rss", SF_RSS),
+    FIELD("Pss", SF_PSS),
+    FIELD("Shared_Clean", SF_SHARED_CLEAN),
+    FIELD("Shared_Dirty", SF_SHARED_DIRTY),
+    FIELD("Private_Clean", SF_PRIVATE_CLEAN),
+    FIELD("Private_Dirty", SF_PRIVATE_DIRTY),
+    FIELD("Referenced", SF_REFERENCED),
+    FIELD("Anonymous", SF_ANONYMOUS),
+    FIELD("LazyFree", SF_LAZY_FREE),
+    FIELD("AnonHugePages", SF_ANON_HUGE_PAGES),
+    FIELD("FilePmdMapped", SF_FILE_PMD_MAPPED),
+    FIELD("Shared_Hugetlb", SF_SHARED_HUGETLB),
+    FIELD("Private_Hugetlb", SF_PRIVATE_HUGETLB),
+    FIELD("Swap", SF_SWAP),
+    FIELD("SwapPss", SF_SWAP_PSS),
+    FIELD("Locked", SF_LOCKED)
+};
+
+#undef FIELD
+
+/* Reads a file line by line (lines longer than the buffer are truncated) */
+struct line_reader {
+    int fd;
+    size_t start;
+    size_t end;
+    bool eof;
+    bool skip;              /* in the rest of a truncated line */
+    char buf[READ_BUFFER];
+};
+
+/* Returns the next line (without '\n', 0-terminated), NULL at the end or on errors (*err) */
+static char* next_line(line_reader* in, int* err) {
+    for (;;) {
+        char* nl = (char*) memchr(in->buf + in->start, '\n', in->end - in->start);
+        if (nl != NULL) {
+            char* line = in->buf + in->start;
+            *nl = '\0';
+            in->start = (size_t) (nl - in->buf) + 1;
+            if (in->skip) {
+                in->skip = false;
+                continue;
+            }
+            return line;
+        }
+        if (in->start == 0 && in->end == READ_BUFFER - 1) {
+            /* a line longer than the buffer: return its start, drop the rest */
+            in->buf[in->end] = '\0';
+            in->end = 0;
+            if (!in->skip) {
+                in->skip = true;
+                return in->buf;
+            }
+            continue;
+        }
+        if (in->eof) {
+            if (in->start == in->end || in->skip) {
+                return NULL;
+            }
+            /* the last line without '\n' (there is room for the terminator) */
+            char* line = in->buf + in->start;
+            in->buf[in->end] = '\0';
+            in->start = in->end;
+            return line;
+        }
+        memmove(in->buf, in->buf + in->start, in->end - in->start);
+        in->end -= in->start;
+        in->start = 0;
+        ssize_t n = read(in->fd, in->buf + in->end, READ_BUFFER - 1 - in->end);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            *err = -errno;
+            return NULL;
+        }
+        in->eof = (n == 0);
+        in->end += (size_t) n;
+    }
+}
+
+/* The counter of a "Name:   value kB" line or -1 */
+static int field_of(const char* line, const char** value) {
+    const char* colon = strchr(line, ':');
+    if (colon == NULL) {
+        return -1;
+    }
+    size_t len = (size_t) (colon - line);
+    for (size_t i = 0; i < sizeof(FIELDS) / sizeof(FIELDS[0]); ++i) {
+        if (FIELDS[i].length == len && memcmp(FIELDS[i].name, line, len) == 0) {
+            *value = colon + 1;
+            return FIELDS[i].field;
+        }
+    }
+    return -1;
+}
+
+/* A VMA header "start-end perms offset dev inode path" (lower case hex) */
+static bool parse_header(const char* line, uint64_t* lo, uint64_t* hi) {
+    char c = line[0];
+    if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+        return false;
+    }
+    char* p;
+    *lo = strtoull(line, &p, 16);
+    if (*p != '-') {
+        return false;
+    }
+    *hi = strtoull(p + 1, &p, 16);
+    return *p == ' ';
+}
+
+/*
+ * Sums up the counters of the VMAs in path that overlap each of the count
+ * ranges (start, end pairs) into result (SF_COUNT per range). Returns the
+ * number of matched VMAs or -errno.
+ */
+static jlong parse(const char* path, const uint64_t* ranges, jint count, jlong* result) {
+    line_reader* in = (line_reader*) malloc(sizeof(line_reader));
+    uint8_t* current = (uint8_t*) calloc((size_t) count + 1, 1);
+    if (in == NULL || current == NULL) {
+        free(in);
+        free(current);
+        return -ENOMEM;
+    }
+    in->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (in->fd == -1) {
+        int err = errno;
+        free(in);
+        free(current);
+        return -err;
+    }
+    in->start = in->end = 0;
+    in->eof = false;
+    in->skip = false;
+
+    uint64_t limit = 0;
+    for (jint i = 0; i < count; ++i) {
+        if (ranges[2 * i + 1] > limit) {
+            limit = ranges[2 * i + 1];
+        }
+    }
+    int err = 0;
+    jlong vmas = 0;
+    bool matched = false;
+    char* line;
+    while ((line = next_line(in, &err)) != NULL) {
+        uint64_t lo;
+        uint64_t hi;
+        if (parse_header(line, &lo, &hi)) {
+            if (lo >= limit) {
+                /* past the last range, don't make the kernel walk the rest */
+                break;
+            }
+            matched = false;
+            for (jint i = 0; i < count; ++i) {
+                current[i] = lo < ranges[2 * i + 1] && hi > ranges[2 * i];
+                if (current[i]) {
+                    result[(size_t) i * SF_COUNT + SF_VMAS]++;
+                    matched = true;
+                }
+            }
+            vmas += matched;
+            continue;
+        }
+        const char* value;
+        int f;
+        if (!matched || (f = field_of(line, &value)) < 0) {
+            continue;
+        }
+        char* unit;
+        jlong v = (jlong) strtoull(value, &unit, 10);
+        while (*unit == ' ') {
+            ++unit;
+        }
+        if (unit[0] == 'k' && unit[1] == 'B') {
+            v *= 1024;
+        }
+        for (jint i = 0; i < count; ++i) {
+            if (current[i]) {
+                result[(size_t) i * SF_COUNT + f] += v;
+            }
+        }
+    }
+    close(in->fd);
+    free(in);
+    free(current);
+    return (err != 0) ? err : vmas;
+}
+
+#endif /* !(_WIN64) */
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Class:     mmap_impl_Smaps
+ * Method:    query0
+ * Signature: ([JI[J)J
+ */
+JNIEXPORT jlong JNICALL
+Java_mmap_impl_Smaps_query0(JNIEnv* env, jclass,
+  jlongArray ranges,
+  jint count,
+  jlongArray result) {
+
+#if defined (_WIN64)
+    return -ENOSYS;
+#else
+    jlong* r = (jlong*) malloc(((size_t) count * 2 + 1) * sizeof(jlong));
+    jlong* sums = (jlong*) calloc((size_t) count * SF_COUNT + 1, sizeof(jlong));
+    if (r == NULL || sums == NULL) {
+        free(r);
+        free(sums);
+        return -ENOMEM;
+    }
+    env->GetLongArrayRegion(ranges, 0, count * 2, r);
+    uint64_t* bounds = (uint64_t*) r;
+    jlong bytes = 0;
+    for (jint i = 0; i < count; ++i) {
+        /* address, length to start, end */
+        bytes += r[2 * i + 1];
+        bounds[2 * i + 1] = (uint64_t) r[2 * i] + (uint64_t) r[2 * i + 1];
+    }
+    stats_scope stats(OP_SMAPS, (count > 0) ? r[0] : 0, bytes);
+    jlong vmas = parse("/proc/self/smaps", bounds, count, sums);
+    NATIVE_PROBE3(smaps_query, count, bytes, vmas);
+    if (vmas >= 0) {
+        env->SetLongArrayRegion(result, 0, count * SF_COUNT, sums);
+    } else {
+        stats.fail((int) -vmas);
+    }
+    free(r);
+    free(sums);
+    return vmas;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_Smaps
+ * Method:    rollup0
+ * Signature: ([J)J
+ */
+JNIEXPORT jlong JNICALL
+Java_mmap_impl_Smaps_rollup0(JNIEnv* env, jclass,
+  jlongArray result) {
+
+#if defined (_WIN64)
+    return -ENOSYS;
+#else
+    stats_scope stats(OP_SMAPS, 0, 0);
+    const uint64_t all[2] = { 0, UINT64_MAX };
+    jlong sums[SF_COUNT] = { 0 };
+    jlong vmas = parse("/proc/self/smaps_rollup", all, 1, sums);
+    NATIVE_PROBE3(smaps_query, 0, 0, vmas);
+    if (vmas < 0) {
+        stats.fail((int) -vmas);
+        return vmas;
+    }
+    env->SetLongArrayRegion(result, 0, SF_COUNT, sums);
+    return vmas;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_Smaps
+ * Method:    isSupported0
+ * Signature: ()Z
+ */
+JNIEXPORT jboolean JNICALL
+Java_mmap_impl_Smaps_isSupported0(JNIEnv*, jclass) {
+#if defined (__linux)
+    return JNI_TRUE;
+#else
+    return JNI_FALSE;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif // #ifdef __cplusplus
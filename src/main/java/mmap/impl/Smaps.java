@@ -0,0 +1,158 @@
+package mmap.impl;
+
+import java.io.IOException;
+import java.nio.MappedByteBuffer;
+
+/**
+ * Resident, dirty, swapped, huge page backed and shared bytes of mapped
+ * address ranges, read from {@code /proc/self/smaps} by a native parser.
+ * <p>
+ * The kernel keeps the counters per VMA (virtual memory area, usually one
+ * per mapping), so a range is accounted with all VMAs that overlap it. Many
+ * ranges are answered by one pass over the file (see
+ * {@link #query(long[], int, long[])}), which stops after the VMA of the
+ * highest range; it is meant to be called every few seconds, e.g. from a
+ * metrics exporter. {@link #rollup()} returns the sums of the whole process
+ * from {@code /proc/self/smaps_rollup}.
+ * <p>
+ * All counters are in bytes, see {@link #SIZE} etc. for their positions in
+ * the result arrays. Linux only, see {@link #isAvailable()}.
+ */
+public final class Smaps {
+
+    /** Index of the number of VMAs that have been summed up. */
+    public static final int VMAS = 0;
+    /** Index of the mapped bytes. */
+    public static final int SIZE = 1;
+    /** Index of the resident bytes. */
+    public static final int RSS = 2;
+    /** Index of the proportional set size (shared pages divided by their mappers). */
+    public static final int PSS = 3;
+    /** Index of the clean resident bytes that are mapped by other processes too. */
+    public static final int SHARED_CLEAN = 4;
+    /** Index of the dirty resident bytes that are mapped by other processes too. */
+    public static final int SHARED_DIRTY = 5;
+    /** Index of the clean resident bytes that are only mapped by this process. */
+    public static final int PRIVATE_CLEAN = 6;
+    /** Index of the dirty resident bytes that are only mapped by this process. */
+    public static final int PRIVATE_DIRTY = 7;
+    /** Index of the bytes that are marked as referenced. */
+    public static final int REFERENCED = 8;
+    /** Index of the anonymous bytes (e.g. copied-on-write pages of a private mapping). */
+    public static final int ANONYMOUS = 9;
+    /** Index of the bytes that have been freed with {@code MADV_FREE}. */
+    public static final int LAZY_FREE = 10;
+    /** Index of the anonymous bytes backed by transparent huge pages. */
+    public static final int ANON_HUGE_PAGES = 11;
+    /** Index of the file bytes mapped by huge page table entries. */
+    public static final int FILE_PMD_MAPPED = 12;
+    /** Index of the shared hugetlbfs bytes. */
+    public static final int SHARED_HUGETLB = 13;
+    /** Index of the private hugetlbfs bytes. */
+    public static final int PRIVATE_HUGETLB = 14;
+    /** Index of the swapped out bytes. */
+    public static final int SWAP = 15;
+    /** Index of the proportional swapped out bytes. */
+    public static final int SWAP_PSS = 16;
+    /** Index of the locked ({@code mlock}) bytes. */
+    public static final int LOCKED = 17;
+
+    /** The number of counters per range. */
+    public static final int FIELDS = 18;
+
+    /**
+     * Returns {@code true} if the smaps accounting can be used (the library
+     * is loaded, the platform is Linux and {@code -Dmmap.impl.smaps=false}
+     * isn't set).
+     */
+    public static boolean isAvailable() {
+        return AVAILABLE;
+    }
+
+    /**
+     * The counters of the VMAs that overlap {@code length} bytes at
+     * {@code address}.
+     *
+     * @return {@link #FIELDS} counters (all 0 if nothing is mapped there)
+     * @throws IOException
+     *             if {@code /proc/self/smaps} can't be read
+     */
+    public static long[] query(long address, long length) throws IOException {
+        long[] result = new long[FIELDS];
+        query(new long[] { address, length }, 1, result);
+        return result;
+    }
+
+    /** The counters of the VMAs of a mapped buffer. */
+    public static long[] query(MappedByteBuffer buffer) throws IOException {
+        return query(Native.address(buffer), buffer.capacity());
+    }
+
+    /**
+     * The counters of {@code count} ranges in one pass.
+     *
+     * @param ranges
+     *            address and length of each range
+     * @param result
+     *            receives {@link #FIELDS} counters per range
+     * @return the number of distinct VMAs that overlap any of the ranges
+     * @throws IOException
+     *             if {@code /proc/self/smaps} can't be read
+     */
+    public static int query(long[] ranges, int count, long[] result) throws IOException {
+        if (count < 0 || ranges.length < 2L * count || result.length < (long) FIELDS * count) {
+            throw new IllegalArgumentException("count: " + count);
+        }
+        for (int i = 0; i < count; ++i) {
+            if (ranges[2 * i] < 0L || ranges[2 * i + 1] < 0L) {
+                throw new IllegalArgumentException(
+                        "address: " + ranges[2 * i] + ", length: " + ranges[2 * i + 1]);
+            }
+        }
+        return (int) check(query0(ranges, count, result), "query");
+    }
+
+    /**
+     * The counters of all VMAs of the process (Linux 4.14+).
+     *
+     * @throws IOException
+     *             if {@code /proc/self/smaps_rollup} can't be read
+     */
+    public static long[] rollup() throws IOException {
+        long[] result = new long[FIELDS];
+        check(rollup0(result), "rollup");
+        return result;
+    }
+
+    private static long check(long result, String call) throws IOException {
+        if (result < 0L) {
+            throw new IOException(call + " failed (errno " + -result + ")");
+        }
+        return result;
+    }
+
+    private static boolean available() {
+        if (!Boolean.parseBoolean(System.getProperty("mmap.impl.smaps", "true"))) {
+            return false;
+        }
+        try {
+            return isSupported0();
+        } catch (UnsatisfiedLinkError e) {
+            return false;
+        }
+    }
+
+    // native methods (return -errno on failure)
+
+    private static native long query0(long[] ranges, int count, long[] result);
+
+    private static native long rollup0(long[] result);
+
+    private static native boolean isSupported0();
+
+    private static final boolean AVAILABLE = available();
+
+    private Smaps() {
+        throw new AssertionError();
+    }
+}
@@ -0,0 +1,360 @@
+
+#ifndef _JAVASOFT_JNI_H_
+#include <jni.h>
+#endif /* _JAVASOFT_JNI_H_ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#if defined (__linux)
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#endif
+
+#include "native_sdt.h"
+#include "native_stats.h"
+
+
+/*
+ * Point-in-time snapshots of a file range for readers that must not see
+ * the writes that continue on the shared mapping of the file.
+ *
+ * A MAP_PRIVATE mapping of the file isn't a snapshot: its pages are only
+ * copied when the private mapping itself writes them, every other page
+ * still shows the page cache and therefore the writers' changes. So the
+ * range is cloned into an anonymous file that is mapped read-only:
+ *
+ *   reflink     FICLONERANGE into an O_TMPFILE in the directory of the
+ *               file (btrfs, XFS with reflink, bcachefs, ...): the clone
+ *               shares the extents, only the blocks the writers modify
+ *               afterwards are copied. Dirty pages of the source are
+ *               written back first, the clone is atomic with respect to
+ *               writes.
+ *   copy        copy_file_range(2) into the O_TMPFILE (in-kernel copy,
+ *               server side copy on NFS / SMB).
+ *   memory      the range is read into a memfd (tmpfs pages).
+ *
+ * The copy modes cost the whole range and are only consistent if the
+ * writers are quiesced while the snapshot is taken. The temporary file has
+ * no name, its space is released when the snapshot is closed (munmap and
+ * close) - or when the process dies. Linux only.
+ */
+
+#define SNAPSHOT_REFLINK 0
+#define SNAPSHOT_COPY 1
+#define SNAPSHOT_MEMORY 2
+
+#if defined (__linux)
+
+#ifndef O_TMPFILE
+#define O_TMPFILE (020000000 | O_DIRECTORY)
+#endif
+
+#ifndef FICLONERANGE
+struct file_clone_range {
+    int64_t src_fd;
+    uint64_t src_offset;
+    uint64_t src_length;
+    uint64_t dest_offset;
+};
+#define FICLONERANGE _IOW(0x94, 13, struct file_clone_range)
+#endif
+
+struct snapshot {
+    int fd;
+    int mode;
+    uint8_t* base;          /* page aligned */
+    uint64_t length;        /* mapped */
+    uint64_t misalign;      /* of the requested offset */
+};
+
+static uint64_t page_size() {
+    static uint64_t ps = (uint64_t) sysconf(_SC_PAGESIZE);
+    return ps;
+}
+
+/* An unnamed file in the directory of fd. Returns the descriptor or -errno. */
+static int open_tmpfile(int fd) {
+    char link[64];
+    char path[4096];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+    ssize_t n = readlink(link, path, sizeof(path) - 1);
+    if (n <= 0) {
+        return (n == -1) ? -errno : -ENOENT;
+    }
+    path[n] = '\0';
+    char* slash = strrchr(path, '/');
+    if (slash == NULL || strstr(path, " (deleted)") != NULL) {
+        return -ENOENT;
+    }
+    if (slash == path) {
+        slash[1] = '\0';
+    } else {
+        slash[0] = '\0';
+    }
+    int tmp = open(path, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    return (tmp == -1) ? -errno : tmp;
+}
+
+/* Copies [offset, offset + len) from src to the same offset of dst. Returns 0 or -errno. */
+static int copy_range(int src, int dst, uint64_t offset, uint64_t len) {
+#if defined (SYS_copy_file_range)
+    loff_t in = (loff_t) offset;
+    loff_t out = (loff_t) offset;
+    while (len > 0) {
+        ssize_t n = syscall(SYS_copy_file_range, src, &in, dst, &out, (size_t) len, 0);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (n == 0) {
+            /* the end of the file */
+            break;
+        }
+        len -= (uint64_t) n;
+    }
+    return 0;
+#else
+    return -ENOSYS;
+#endif
+}
+
+/* Reads [offset, offset + len) of src to the same offset of dst. Returns 0 or -errno. */
+static int read_range(int src, int dst, uint64_t offset, uint64_t len) {
+    const size_t chunk = 1024 * 1024;
+    char* buf = (char*) malloc(chunk);
+    if (buf == NULL) {
+        return -ENOMEM;
+    }
+    int err = 0;
+    while (len > 0 && err == 0) {
+        ssize_t n = pread(src, buf, (len < chunk) ? (size_t) len : chunk, (off_t) offset);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            err = (n == -1) ? -errno : 0;
+            break;
+        }
+        for (ssize_t done = 0; done < n && err == 0;) {
+            ssize_t w = pwrite(dst, buf + done, (size_t) (n - done), (off_t) offset + done);
+            if (w == -1) {
+                err = (errno == EINTR) ? 0 : -errno;
+            } else {
+                done += w;
+            }
+        }
+        offset += (uint64_t) n;
+        len -= (uint64_t) n;
+    }
+    free(buf);
+    return err;
+}
+
+/*
+ * Clones [offset, offset + len) of src (page aligned, the end within the
+ * file or at its end) into a new file of the same size, with the first
+ * mode up to max_mode that works. Returns the descriptor (*mode is set) or
+ * -errno.
+ */
+static int clone_range(int src, uint64_t offset, uint64_t len, uint64_t file_size, int max_mode, int* mode) {
+    int tmp = open_tmpfile(src);
+    if (tmp >= 0 && ftruncate(tmp, (off_t) file_size) == -1) {
+        int err = errno;
+        close(tmp);
+        tmp = -err;
+    }
+    if (tmp >= 0) {
+        struct file_clone_range range;
+        range.src_fd = src;
+        range.src_offset = offset;
+        /* 0: to the end of the file (whose size needn't be block aligned) */
+        range.src_length = (offset + len >= file_size) ? 0 : len;
+        range.dest_offset = offset;
+        *mode = SNAPSHOT_REFLINK;
+        if (ioctl(tmp, FICLONERANGE, &range) == 0) {
+            return tmp;
+        }
+        *mode = SNAPSHOT_COPY;
+        if (max_mode >= SNAPSHOT_COPY && copy_range(src, tmp, offset, len) == 0) {
+            return tmp;
+        }
+        close(tmp);
+    }
+    if (max_mode < SNAPSHOT_MEMORY) {
+        return -EOPNOTSUPP;
+    }
+    *mode = SNAPSHOT_MEMORY;
+#if defined (SYS_memfd_create)
+    int mem = (int) syscall(SYS_memfd_create, "snapshot", MFD_CLOEXEC);
+    if (mem == -1) {
+        return -errno;
+    }
+    int err = (ftruncate(mem, (off_t) file_size) == -1) ? -errno : read_range(src, mem, offset, len);
+    if (err == 0) {
+        return mem;
+    }
+    close(mem);
+    return err;
+#else
+    return -ENOSYS;
+#endif
+}
+
+#endif /* __linux */
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Class:     mmap_impl_Snapshot
+ * Method:    create0
+ * Signature: (IJJI)J
+ */
+JNIEXPORT jlong JNICALL
+Java_mmap_impl_Snapshot_create0(JNIEnv*, jclass,
+  jint fd,
+  jlong offset,
+  jlong length,
+  jint maxMode) {
+
+#if defined (__linux)
+    if (fd < 0 || offset < 0 || length <= 0 || maxMode < SNAPSHOT_REFLINK || maxMode > SNAPSHOT_MEMORY) {
+        return -EINVAL;
+    }
+    stats_scope stats(OP_SNAPSHOT, offset, length);
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        stats.fail(errno);
+        return -errno;
+    }
+    uint64_t ps = page_size();
+    uint64_t misalign = (uint64_t) offset & (ps - 1);
+    uint64_t start = (uint64_t) offset - misalign;
+    uint64_t end = (uint64_t) offset + (uint64_t) length;
+    if (end > (uint64_t) st.st_size) {
+        stats.fail(EINVAL);
+        return -EINVAL;
+    }
+    /* whole pages (within the file) */
+    uint64_t aligned_end = (end + ps - 1) & ~(ps - 1);
+    if (aligned_end > (uint64_t) st.st_size) {
+        aligned_end = (uint64_t) st.st_size;
+    }
+
+    snapshot* s = (snapshot*) malloc(sizeof(snapshot));
+    if (s == NULL) {
+        stats.fail(ENOMEM);
+        return -ENOMEM;
+    }
+    int mode = SNAPSHOT_REFLINK;
+    s->fd = clone_range(fd, start, aligned_end - start, (uint64_t) st.st_size, maxMode, &mode);
+    if (s->fd < 0) {
+        jlong err = s->fd;
+        free(s);
+        stats.fail((int) -err);
+        return err;
+    }
+    s->mode = mode;
+    s->misalign = misalign;
+    s->length = end - start;
+    void* p = mmap(NULL, (size_t) s->length, PROT_READ, MAP_SHARED, s->fd, (off_t) start);
+    if (p == MAP_FAILED) {
+        int err = errno;
+        close(s->fd);
+        free(s);
+        stats.fail(err);
+        return -err;
+    }
+    s->base = (uint8_t*) p;
+    NATIVE_PROBE4(snapshot_create, fd, start, s->length, mode);
+    return (jlong) (intptr_t) s;
+#else
+    return -ENOSYS;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_Snapshot
+ * Method:    address0
+ * Signature: (J)J
+ */
+JNIEXPORT jlong JNICALL
+Java_mmap_impl_Snapshot_address0(JNIEnv*, jclass,
+  jlong handle) {
+
+#if defined (__linux)
+    snapshot* s = (snapshot*) (intptr_t) handle;
+    return (jlong) (intptr_t) (s->base + s->misalign);
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_Snapshot
+ * Method:    mode0
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_Snapshot_mode0(JNIEnv*, jclass,
+  jlong handle) {
+
+#if defined (__linux)
+    return ((snapshot*) (intptr_t) handle)->mode;
+#else
+    return -ENOSYS;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_Snapshot
+ * Method:    close0
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_Snapshot_close0(JNIEnv*, jclass,
+  jlong handle) {
+
+#if defined (__linux)
+    snapshot* s = (snapshot*) (intptr_t) handle;
+    int err = (munmap(s->base, (size_t) s->length) == -1) ? -errno : 0;
+    /* the last reference of the unnamed file: its blocks are freed */
+    close(s->fd);
+    free(s);
+    return err;
+#else
+    return -ENOSYS;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_Snapshot
+ * Method:    isSupported0
+ * Signature: ()Z
+ */
+JNIEXPORT jboolean JNICALL
+Java_mmap_impl_Snapshot_isSupported0(JNIEnv*, jclass) {
+#if defined (__linux)
+    return JNI_TRUE;
+#else
+    return JNI_FALSE;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif // #ifdef __cplusplus
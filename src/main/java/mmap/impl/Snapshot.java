@@ -0,0 +1,127 @@
+package mmap.impl;
+
+import java.io.FileDescriptor;
+import java.io.IOException;
+
+/**
+ * A read-only point-in-time image of a file range: readers of the snapshot
+ * don't see the writes that continue on the file (and its shared mapping).
+ * <p>
+ * The range is cloned into an unnamed temporary file next to the file
+ * ({@code FICLONERANGE}, on file systems with reflinks only the blocks that
+ * are modified afterwards cost space, and the clone is atomic), or copied
+ * with {@code copy_file_range}, or read into a {@code memfd}, see
+ * {@link #REFLINK} etc. The copying modes cost the whole range and are
+ * only consistent if the writers are paused while the snapshot is taken.
+ * A {@code MAP_PRIVATE} mapping of the file isn't used: its unmodified
+ * pages keep showing the writers' changes.
+ * <p>
+ * {@link #close()} releases the mapping and the space of the clone right
+ * away; the snapshot must not be accessed afterwards. Linux only, see
+ * {@link #isAvailable()}.
+ */
+public final class Snapshot implements AutoCloseable {
+
+    /** The range shares the file's blocks (copy-on-write, atomic). */
+    public static final int REFLINK = 0;
+    /** The range has been copied into a temporary file. */
+    public static final int COPY = 1;
+    /** The range has been copied into memory ({@code memfd}). */
+    public static final int MEMORY = 2;
+
+    private final long length;
+    private final long address;
+    private final int mode;
+    private long handle;
+
+    private Snapshot(long handle, long length) {
+        this.handle = handle;
+        this.length = length;
+        this.address = address0(handle);
+        this.mode = mode0(handle);
+    }
+
+    /**
+     * Returns {@code true} if snapshots can be used (the library is loaded,
+     * the platform is Linux and {@code -Dmmap.impl.snapshot=false} isn't
+     * set).
+     */
+    public static boolean isAvailable() {
+        return AVAILABLE;
+    }
+
+    /**
+     * Takes a snapshot of {@code length} bytes at {@code offset} of a file
+     * with the cheapest mode that works.
+     *
+     * @param maxMode
+     *            the most expensive acceptable mode, {@link #REFLINK} fails
+     *            rather than copying the range
+     * @throws IOException
+     *             if the range can't be cloned with a mode up to
+     *             {@code maxMode} (errno 95 if the file system can't)
+     */
+    public static Snapshot create(FileDescriptor fd, long offset, long length, int maxMode) throws IOException {
+        if (offset < 0L || length <= 0L || maxMode < REFLINK || maxMode > MEMORY) {
+            throw new IllegalArgumentException(
+                    "offset: " + offset + ", length: " + length + ", maxMode: " + maxMode);
+        }
+        long handle = create0((int) MMapUtils.getFileDescriptor(fd), offset, length, maxMode);
+        if (handle < 0L) {
+            throw new IOException("snapshot failed (errno " + -handle + ")");
+        }
+        return new Snapshot(handle, length);
+    }
+
+    /** The address of the first byte of the range. */
+    public long address() {
+        return address;
+    }
+
+    public long length() {
+        return length;
+    }
+
+    /** How the snapshot has been taken, see {@link #REFLINK} etc. */
+    public int mode() {
+        return mode;
+    }
+
+    /** Unmaps the snapshot and frees the clone. */
+    @Override
+    public synchronized void close() {
+        long h = handle;
+        if (h != 0L) {
+            handle = 0L;
+            int result = close0(h);
+            if (result < 0) {
+                throw new IllegalStateException("close failed (errno " + -result + ")");
+            }
+        }
+    }
+
+    private static boolean available() {
+        if (!Boolean.parseBoolean(System.getProperty("mmap.impl.snapshot", "true"))) {
+            return false;
+        }
+        try {
+            return isSupported0();
+        } catch (UnsatisfiedLinkError e) {
+            return false;
+        }
+    }
+
+    // native methods (return -errno on failure)
+
+    private static native long create0(int fd, long offset, long length, int maxMode);
+
+    private static native long address0(long handle);
+
+    private static native int mode0(long handle);
+
+    private static native int close0(long handle);
+
+    private static native boolean isSupported0();
+
+    private static final boolean AVAILABLE = available();
+}
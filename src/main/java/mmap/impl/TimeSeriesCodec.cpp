@@ -0,0 +1,532 @@
+
+#ifndef _JAVASOFT_JNI_H_
+#include <jni.h>
+#endif /* _JAVASOFT_JNI_H_ */
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined (_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "native_region.h"
+#include "native_sdt.h"
+#include "native_stats.h"
+
+
+/*
+ * Time series compression in the style of Facebook's Gorilla (VLDB 2015).
+ *
+ * A block is a big-endian header (value count, payload size in bytes; both
+ * 32 bit) followed by an MSB-first bit stream. Blocks can be concatenated
+ * and decoded in one call.
+ *
+ * Values (doubles): the first value raw, then per value the XOR with its
+ * predecessor:
+ *   '0'                          XOR is 0
+ *   '10' <meaningful bits>       fits into the previous leading/trailing window
+ *   '11' <5 bit leading zeros> <6 bit length (0 = 64)> <meaningful bits>
+ *
+ * Timestamps (longs): the first timestamp and the first delta raw, then the
+ * zigzag-encoded delta-of-delta with a prefix code:
+ *   '0'                          0
+ *   '10'    + 7 bits             < 2^7
+ *   '110'   + 9 bits             < 2^9
+ *   '1110'  + 12 bits            < 2^12
+ *   '11110' + 32 bits            < 2^32
+ *   '11111' + 64 bits            otherwise
+ */
+
+#define TS_HEADER 8
+#define TS_MALFORMED (-1)
+#define TS_NO_MEMORY (-2)
+
+
+static inline unsigned clz64(uint64_t x) {
+#if defined (_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, x);
+    return 63 - (unsigned) index;
+#else
+    return (unsigned) __builtin_clzll(x);
+#endif
+}
+
+static inline unsigned ctz64(uint64_t x) {
+#if defined (_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return (unsigned) index;
+#else
+    return (unsigned) __builtin_ctzll(x);
+#endif
+}
+
+static inline uint64_t load64be(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined (_MSC_VER)
+    return _byteswap_uint64(v);
+#else
+    return __builtin_bswap64(v);
+#endif
+}
+
+static inline void store32be(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t) (v >> 24);
+    p[1] = (uint8_t) (v >> 16);
+    p[2] = (uint8_t) (v >> 8);
+    p[3] = (uint8_t) v;
+}
+
+static inline uint32_t load32be(const uint8_t* p) {
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static inline uint64_t zigzag(int64_t v) {
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v) {
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+
+/* MSB-first bit writer; sets overflow instead of writing beyond end */
+struct bit_writer {
+    uint8_t* p;
+    uint8_t* end;
+    uint64_t acc;
+    unsigned n;
+    bool overflow;
+
+    bit_writer(uint8_t* start, uint8_t* limit)
+        : p(start), end(limit), acc(0), n(0), overflow(false) {
+    }
+
+    /* 0 < count <= 32, value has no bits above count */
+    inline void put32(uint64_t value, unsigned count) {
+        acc = (acc << count) | value;
+        n += count;
+        while (n >= 8) {
+            n -= 8;
+            if (p < end) {
+                *p++ = (uint8_t) (acc >> n);
+            } else {
+                overflow = true;
+            }
+        }
+    }
+
+    /* 0 < count <= 64 */
+    inline void put(uint64_t value, unsigned count) {
+        if (count > 32) {
+            put32(value >> 32, count - 32);
+            put32(value & 0xffffffffULL, 32);
+        } else {
+            put32(value, count);
+        }
+    }
+
+    /* pads the last byte with zeros, returns false on overflow */
+    bool flush() {
+        if (n > 0) {
+            put32(0, 8 - n);
+        }
+        return !overflow;
+    }
+};
+
+/*
+ * MSB-first bit reader. peek() returns at least 57 valid bits left-aligned
+ * with a single unaligned load (except for the last 8 bytes of the
+ * stream), so the decoders don't branch on the bit position.
+ */
+struct bit_reader {
+    const uint8_t* p;
+    size_t bytes;
+    size_t pos;
+
+    bit_reader(const uint8_t* start, size_t length)
+        : p(start), bytes(length), pos(0) {
+    }
+
+    inline uint64_t peek() const {
+        size_t i = pos >> 3;
+        uint64_t w;
+        if (i + 8 <= bytes) {
+            w = load64be(p + i);
+        } else {
+            uint8_t tail[8] = { 0 };
+            if (i < bytes) {
+                memcpy(tail, p + i, bytes - i);
+            }
+            w = load64be(tail);
+        }
+        return w << (pos & 7);
+    }
+
+    /* 0 < count <= 57 */
+    inline uint64_t read(unsigned count) {
+        uint64_t v = peek() >> (64 - count);
+        pos += count;
+        return v;
+    }
+
+    /* 0 < count <= 64 */
+    inline uint64_t read_long(unsigned count) {
+        if (count > 57) {
+            uint64_t hi = read(count - 32);
+            return (hi << 32) | read(32);
+        }
+        return read(count);
+    }
+
+    /* true if no bit beyond the end of the stream has been consumed */
+    inline bool ok() const {
+        return pos <= bytes * 8;
+    }
+};
+
+
+static inline uint64_t double_bits(const uint8_t* src, size_t i) {
+    uint64_t v;
+    memcpy(&v, src + i * 8, 8);
+    return v;
+}
+
+/* Encodes count values, returns the block size or 0 if it doesn't fit */
+static size_t encode_doubles(const uint8_t* src, uint32_t count, uint8_t* dst, size_t dstCap) {
+    if (dstCap < TS_HEADER) {
+        return 0;
+    }
+    bit_writer w(dst + TS_HEADER, dst + dstCap);
+    if (count > 0) {
+        uint64_t prev = double_bits(src, 0);
+        w.put(prev, 64);
+        unsigned leading = 65;
+        unsigned trailing = 0;
+        for (uint32_t i = 1; i < count && !w.overflow; ++i) {
+            uint64_t bits = double_bits(src, i);
+            uint64_t x = bits ^ prev;
+            prev = bits;
+            if (x == 0) {
+                w.put32(0, 1);
+                continue;
+            }
+            unsigned lz = clz64(x);
+            unsigned tz = ctz64(x);
+            if (lz > 31) {
+                lz = 31;
+            }
+            if (leading <= lz && trailing <= tz) {
+                w.put32(2, 2);
+                w.put(x >> trailing, 64 - leading - trailing);
+            } else {
+                unsigned len = 64 - lz - tz;
+                w.put32(3, 2);
+                w.put32(lz, 5);
+                w.put32(len & 63, 6);
+                w.put(x >> tz, len);
+                leading = lz;
+                trailing = tz;
+            }
+        }
+    }
+    if (!w.flush()) {
+        return 0;
+    }
+    size_t payload = (size_t) (w.p - (dst + TS_HEADER));
+    store32be(dst, count);
+    store32be(dst + 4, (uint32_t) payload);
+    return TS_HEADER + payload;
+}
+
+static bool decode_doubles(bit_reader& r, uint32_t count, uint8_t* dst) {
+    if (count == 0) {
+        return true;
+    }
+    uint64_t prev = r.read_long(64);
+    memcpy(dst, &prev, 8);
+    unsigned leading = 0;
+    unsigned trailing = 0;
+    for (uint32_t i = 1; i < count; ++i) {
+        uint64_t control = r.peek() >> 62;
+        if (control < 2) {
+            r.pos += 1; /* '0': repeat */
+        } else {
+            r.pos += 2;
+            if (control == 3) {
+                uint64_t header = r.read(11);
+                leading = (unsigned) (header >> 6);
+                unsigned len = (unsigned) (header & 63);
+                if (len == 0) {
+                    len = 64;
+                }
+                if (leading + len > 64) {
+                    return false;
+                }
+                trailing = 64 - leading - len;
+            }
+            unsigned len = 64 - leading - trailing;
+            prev ^= r.read_long(len) << trailing;
+        }
+        memcpy(dst + (size_t) i * 8, &prev, 8);
+    }
+    return r.ok();
+}
+
+/* prefix length and payload bits of the delta-of-delta code, by leading ones */
+static const unsigned dod_prefix[6] = { 1, 2, 3, 4, 5, 5 };
+static const unsigned dod_bits[6] = { 0, 7, 9, 12, 32, 64 };
+
+static inline void put_dod(bit_writer& w, int64_t dod) {
+    uint64_t zz = zigzag(dod);
+    if (zz == 0) {
+        w.put32(0, 1);
+    } else if (zz < (1U << 7)) {
+        w.put32((2U << 7) | zz, 9);
+    } else if (zz < (1U << 9)) {
+        w.put32((6U << 9) | zz, 12);
+    } else if (zz < (1U << 12)) {
+        w.put32((14U << 12) | zz, 16);
+    } else if (zz < (1ULL << 32)) {
+        w.put32(30, 5);
+        w.put32(zz, 32);
+    } else {
+        w.put32(31, 5);
+        w.put(zz, 64);
+    }
+}
+
+static size_t encode_timestamps(const uint8_t* src, uint32_t count, uint8_t* dst, size_t dstCap) {
+    if (dstCap < TS_HEADER) {
+        return 0;
+    }
+    bit_writer w(dst + TS_HEADER, dst + dstCap);
+    if (count > 0) {
+        int64_t prev;
+        memcpy(&prev, src, 8);
+        w.put((uint64_t) prev, 64);
+        if (count > 1) {
+            int64_t t;
+            memcpy(&t, src + 8, 8);
+            int64_t delta = (int64_t) ((uint64_t) t - (uint64_t) prev);
+            w.put((uint64_t) delta, 64);
+            prev = t;
+            for (uint32_t i = 2; i < count && !w.overflow; ++i) {
+                memcpy(&t, src + (size_t) i * 8, 8);
+                int64_t d = (int64_t) ((uint64_t) t - (uint64_t) prev);
+                put_dod(w, (int64_t) ((uint64_t) d - (uint64_t) delta));
+                delta = d;
+                prev = t;
+            }
+        }
+    }
+    if (!w.flush()) {
+        return 0;
+    }
+    size_t payload = (size_t) (w.p - (dst + TS_HEADER));
+    store32be(dst, count);
+    store32be(dst + 4, (uint32_t) payload);
+    return TS_HEADER + payload;
+}
+
+static bool decode_timestamps(bit_reader& r, uint32_t count, uint8_t* dst) {
+    if (count == 0) {
+        return true;
+    }
+    uint64_t t = r.read_long(64);
+    memcpy(dst, &t, 8);
+    if (count == 1) {
+        return r.ok();
+    }
+    uint64_t delta = r.read_long(64);
+    t += delta;
+    memcpy(dst + 8, &t, 8);
+    for (uint32_t i = 2; i < count; ++i) {
+        uint64_t w = r.peek();
+        unsigned ones = clz64(~w | (1ULL << 58)); /* leading ones, at most 5 */
+        r.pos += dod_prefix[ones];
+        unsigned bits = dod_bits[ones];
+        if (bits != 0) {
+            delta += (uint64_t) unzigzag(r.read_long(bits));
+        }
+        t += delta;
+        memcpy(dst + (size_t) i * 8, &t, 8);
+    }
+    return r.ok();
+}
+
+typedef bool (*block_decoder)(bit_reader& r, uint32_t count, uint8_t* dst);
+
+/*
+ * Decodes all concatenated blocks of src into dst (8 byte values).
+ * Returns the number of values or TS_MALFORMED.
+ */
+static jint decode_blocks(block_decoder decoder, const uint8_t* src, size_t srcLen, uint8_t* dst, size_t dstCap) {
+    size_t total = 0;
+    size_t i = 0;
+    while (i < srcLen) {
+        if (srcLen - i < TS_HEADER) {
+            return TS_MALFORMED;
+        }
+        uint32_t count = load32be(src + i);
+        uint32_t payload = load32be(src + i + 4);
+        i += TS_HEADER;
+        if (payload > srcLen - i || count > dstCap - total) {
+            return TS_MALFORMED;
+        }
+        bit_reader r(src + i, payload);
+        if (!decoder(r, count, dst + total * 8)) {
+            return TS_MALFORMED;
+        }
+        i += payload;
+        total += count;
+    }
+    return (jint) total;
+}
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Class:     mmap_impl_TimeSeriesCodec
+ * Method:    encodeDoubles0
+ * Signature: (Ljava/lang/Object;JILjava/lang/Object;JI)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_TimeSeriesCodec_encodeDoubles0(JNIEnv* env, jclass,
+  jobject src,
+  jlong srcOff,
+  jint count,
+  jobject dst,
+  jlong dstOff,
+  jint dstCap) {
+
+    stats_scope stats(OP_ENCODE_DOUBLES, (src == NULL) ? srcOff : 0, (jlong) count * 8);
+
+    pinned_region in(env, src, srcOff, JNI_ABORT);
+    if (!in.ok()) {
+        stats.fail(ENOMEM);
+        return TS_NO_MEMORY;
+    }
+    pinned_region out(env, dst, dstOff, 0);
+    if (!out.ok()) {
+        stats.fail(ENOMEM);
+        return TS_NO_MEMORY;
+    }
+    size_t size = encode_doubles((const uint8_t*) in.get(), (uint32_t) count, (uint8_t*) out.get(), (size_t) dstCap);
+    NATIVE_PROBE3(ts_encode, OP_ENCODE_DOUBLES, count, size);
+    return (jint) size;
+}
+
+/*
+ * Class:     mmap_impl_TimeSeriesCodec
+ * Method:    decodeDoubles0
+ * Signature: (Ljava/lang/Object;JILjava/lang/Object;JI)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_TimeSeriesCodec_decodeDoubles0(JNIEnv* env, jclass,
+  jobject src,
+  jlong srcOff,
+  jint srcLen,
+  jobject dst,
+  jlong dstOff,
+  jint dstCap) {
+
+    stats_scope stats(OP_DECODE_DOUBLES, (src == NULL) ? srcOff : 0, srcLen);
+
+    pinned_region in(env, src, srcOff, JNI_ABORT);
+    if (!in.ok()) {
+        stats.fail(ENOMEM);
+        return TS_NO_MEMORY;
+    }
+    pinned_region out(env, dst, dstOff, 0);
+    if (!out.ok()) {
+        stats.fail(ENOMEM);
+        return TS_NO_MEMORY;
+    }
+    jint result = decode_blocks(decode_doubles, (const uint8_t*) in.get(), (size_t) srcLen,
+        (uint8_t*) out.get(), (size_t) dstCap);
+    NATIVE_PROBE3(ts_decode, OP_DECODE_DOUBLES, srcLen, result);
+    if (result < 0) {
+        stats.fail(EINVAL);
+    }
+    return result;
+}
+
+/*
+ * Class:     mmap_impl_TimeSeriesCodec
+ * Method:    encodeTimestamps0
+ * Signature: (Ljava/lang/Object;JILjava/lang/Object;JI)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_TimeSeriesCodec_encodeTimestamps0(JNIEnv* env, jclass,
+  jobject src,
+  jlong srcOff,
+  jint count,
+  jobject dst,
+  jlong dstOff,
+  jint dstCap) {
+
+    stats_scope stats(OP_ENCODE_TIMESTAMPS, (src == NULL) ? srcOff : 0, (jlong) count * 8);
+
+    pinned_region in(env, src, srcOff, JNI_ABORT);
+    if (!in.ok()) {
+        stats.fail(ENOMEM);
+        return TS_NO_MEMORY;
+    }
+    pinned_region out(env, dst, dstOff, 0);
+    if (!out.ok()) {
+        stats.fail(ENOMEM);
+        return TS_NO_MEMORY;
+    }
+    size_t size = encode_timestamps((const uint8_t*) in.get(), (uint32_t) count, (uint8_t*) out.get(), (size_t) dstCap);
+    NATIVE_PROBE3(ts_encode, OP_ENCODE_TIMESTAMPS, count, size);
+    return (jint) size;
+}
+
+/*
+ * Class:     mmap_impl_TimeSeriesCodec
+ * Method:    decodeTimestamps0
+ * Signature: (Ljava/lang/Object;JILjava/lang/Object;JI)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_TimeSeriesCodec_decodeTimestamps0(JNIEnv* env, jclass,
+  jobject src,
+  jlong srcOff,
+  jint srcLen,
+  jobject dst,
+  jlong dstOff,
+  jint dstCap) {
+
+    stats_scope stats(OP_DECODE_TIMESTAMPS, (src == NULL) ? srcOff : 0, srcLen);
+
+    pinned_region in(env, src, srcOff, JNI_ABORT);
+    if (!in.ok()) {
+        stats.fail(ENOMEM);
+        return TS_NO_MEMORY;
+    }
+    pinned_region out(env, dst, dstOff, 0);
+    if (!out.ok()) {
+        stats.fail(ENOMEM);
+        return TS_NO_MEMORY;
+    }
+    jint result = decode_blocks(decode_timestamps, (const uint8_t*) in.get(), (size_t) srcLen,
+        (uint8_t*) out.get(), (size_t) dstCap);
+    NATIVE_PROBE3(ts_decode, OP_DECODE_TIMESTAMPS, srcLen, result);
+    if (result < 0) {
+        stats.fail(EINVAL);
+    }
+    return result;
+}
+
+#ifdef __cplusplus
+}
+#endif // #ifdef __cplusplus
@@ -0,0 +1,149 @@
+package mmap.impl;
+
+/**
+ * Native compression of time series columns in the style of Facebook's
+ * Gorilla: XOR encoding for {@code double} values and delta-of-delta
+ * encoding for {@code long} timestamps. Regularly sampled metrics typically
+ * shrink by an order of magnitude.
+ * <p>
+ * An encoded block starts with an 8 byte big-endian header (number of
+ * values, payload size in bytes) followed by the bit stream. Blocks can be
+ * concatenated; the decode methods decode all blocks of the given range in
+ * one call and return the total number of values.
+ * <p>
+ * Sources and destinations are Java arrays or native (e.g. mapped)
+ * addresses. Off-heap columns hold 8 byte values in native byte order.
+ * Arrays are pinned for the duration of a call.
+ */
+public final class TimeSeriesCodec {
+
+    /**
+     * Returns the maximum size of a block that encodes {@code count} values
+     * (doubles or timestamps).
+     *
+     * @param count
+     *            the number of values
+     * @return the worst-case size of the encoded block
+     */
+    public static int maxEncodedLength(int count) {
+        if (count < 0) {
+            throw new IllegalArgumentException("count: " + count);
+        }
+        // header, 2 raw values, worst case 77 bits per value
+        long max = HEADER + 16L + (count * 77L + 7L) / 8L;
+        if (max > Integer.MAX_VALUE) {
+            throw new IllegalArgumentException("count too large: " + count);
+        }
+        return (int) max;
+    }
+
+    // -- doubles (all encode variants return 0 if the block doesn't fit into dst) --
+
+    public static int encodeDoubles(double[] src, int srcOff, int count, byte[] dst, int dstOff, int dstLen) {
+        checkRange(src.length, srcOff, count);
+        checkRange(dst.length, dstOff, dstLen);
+        return encodeDoubles0(src, (long) srcOff * 8L, count, dst, dstOff, dstLen);
+    }
+
+    public static int encodeDoubles(long srcAddr, int count, long dstAddr, int dstLen) {
+        checkLength(count);
+        checkLength(dstLen);
+        return encodeDoubles0(null, srcAddr, count, null, dstAddr, dstLen);
+    }
+
+    public static int decodeDoubles(byte[] src, int srcOff, int srcLen, double[] dst, int dstOff) {
+        checkRange(src.length, srcOff, srcLen);
+        checkRange(dst.length, dstOff, 0);
+        return checkResult(decodeDoubles0(src, srcOff, srcLen, dst, (long) dstOff * 8L, dst.length - dstOff));
+    }
+
+    /**
+     * Decodes the blocks in the native (e.g. mapped) range
+     * {@code [srcAddr, srcAddr + srcLen)} straight into {@code dst}.
+     */
+    public static int decodeDoubles(long srcAddr, int srcLen, double[] dst, int dstOff) {
+        checkLength(srcLen);
+        checkRange(dst.length, dstOff, 0);
+        return checkResult(decodeDoubles0(null, srcAddr, srcLen, dst, (long) dstOff * 8L, dst.length - dstOff));
+    }
+
+    public static int decodeDoubles(long srcAddr, int srcLen, long dstAddr, int dstCount) {
+        checkLength(srcLen);
+        checkLength(dstCount);
+        return checkResult(decodeDoubles0(null, srcAddr, srcLen, null, dstAddr, dstCount));
+    }
+
+    // -- timestamps --
+
+    public static int encodeTimestamps(long[] src, int srcOff, int count, byte[] dst, int dstOff, int dstLen) {
+        checkRange(src.length, srcOff, count);
+        checkRange(dst.length, dstOff, dstLen);
+        return encodeTimestamps0(src, (long) srcOff * 8L, count, dst, dstOff, dstLen);
+    }
+
+    public static int encodeTimestamps(long srcAddr, int count, long dstAddr, int dstLen) {
+        checkLength(count);
+        checkLength(dstLen);
+        return encodeTimestamps0(null, srcAddr, count, null, dstAddr, dstLen);
+    }
+
+    public static int decodeTimestamps(byte[] src, int srcOff, int srcLen, long[] dst, int dstOff) {
+        checkRange(src.length, srcOff, srcLen);
+        checkRange(dst.length, dstOff, 0);
+        return checkResult(decodeTimestamps0(src, srcOff, srcLen, dst, (long) dstOff * 8L, dst.length - dstOff));
+    }
+
+    public static int decodeTimestamps(long srcAddr, int srcLen, long[] dst, int dstOff) {
+        checkLength(srcLen);
+        checkRange(dst.length, dstOff, 0);
+        return checkResult(decodeTimestamps0(null, srcAddr, srcLen, dst, (long) dstOff * 8L, dst.length - dstOff));
+    }
+
+    public static int decodeTimestamps(long srcAddr, int srcLen, long dstAddr, int dstCount) {
+        checkLength(srcLen);
+        checkLength(dstCount);
+        return checkResult(decodeTimestamps0(null, srcAddr, srcLen, null, dstAddr, dstCount));
+    }
+
+    // utility methods
+
+    private static void checkRange(int arrayLength, int off, int len) {
+        if ((off | len) < 0 || len > arrayLength - off) {
+            throw new IndexOutOfBoundsException("off: " + off + ", len: " + len + ", length: " + arrayLength);
+        }
+    }
+
+    private static void checkLength(int len) {
+        if (len < 0) {
+            throw new IllegalArgumentException("len: " + len);
+        }
+    }
+
+    private static int checkResult(int count) {
+        if (count < 0) {
+            throw new IllegalArgumentException("Malformed block or destination too small");
+        }
+        return count;
+    }
+
+    // native methods (array != null: offset is a byte offset into the
+    // array, else an address; dstCap is the capacity in values for decode
+    // and in bytes for encode)
+
+    private static native int encodeDoubles0(Object src, long srcOff, int count, Object dst, long dstOff, int dstCap);
+
+    private static native int decodeDoubles0(Object src, long srcOff, int srcLen, Object dst, long dstOff, int dstCap);
+
+    private static native int encodeTimestamps0(Object src, long srcOff, int count, Object dst, long dstOff,
+            int dstCap);
+
+    private static native int decodeTimestamps0(Object src, long srcOff, int srcLen, Object dst, long dstOff,
+            int dstCap);
+
+    // size of the block header in bytes
+    private static final int HEADER = 8;
+
+    private TimeSeriesCodec() {
+        throw new AssertionError();
+    }
+}
@@ -0,0 +1,391 @@
+
+#ifndef _JAVASOFT_JNI_H_
+#include <jni.h>
+#endif /* _JAVASOFT_JNI_H_ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#if !defined (_WIN64)
+#include <sys/uio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#include "native_sdt.h"
+#include "native_stats.h"
+
+
+/*
+ * Positional vectored I/O on a raw file descriptor: a list of segments
+ * (byte arrays or native memory) is written with a single pwritev2(2) or
+ * read with a single preadv(2) at an explicit file offset, so there is no
+ * lseek(2) and no per-segment system call. Partial transfers are resumed.
+ *
+ * Writes can be made durable with RWF_DSYNC (Linux 4.7+), which replaces a
+ * separate fdatasync(2). On older kernels (or C libraries without
+ * pwritev2) the write falls back to pwritev(2) followed by fdatasync(2).
+ *
+ * Ranges of a file can be zeroed without writing zeros through
+ * fallocate(2) with FALLOC_FL_ZERO_RANGE (Linux 3.15+; the blocks stay
+ * allocated, so later writes into the range can't fail with ENOSPC).
+ *
+ * Read-ahead hints start asynchronous reads of a range into the page cache
+ * (readahead(2) on Linux, posix_fadvise(2) POSIX_FADV_WILLNEED elsewhere),
+ * so a sequential reader finds the next window cached when it gets there.
+ *
+ * Array segments aren't pinned: a transfer may block for a synchronous
+ * disk write (O_DSYNC files, RWF_DSYNC), and a GetPrimitiveArrayCritical
+ * region would hold off the garbage collector for that time. They are
+ * copied through a bounce buffer of at most BOUNCE_SIZE bytes instead;
+ * larger transfers take several system calls (a durable write then ends
+ * with one fdatasync(2)). Native memory segments are used in place.
+ */
+
+/* Linux' IOV_MAX */
+#define MAX_SEGMENTS 1024
+
+/* The maximum number of array bytes copied per system call */
+#define BOUNCE_SIZE (1024 * 1024)
+
+
+#if !defined (_WIN64)
+
+/* 0 once pwritev2 / RWF_DSYNC turned out to be unsupported */
+static volatile int rwf_dsync_supported = 1;
+
+static ssize_t write_segments(int fd, const struct iovec* iov, int count, off_t offset, bool dsync,
+        bool* needSync) {
+#if defined (RWF_DSYNC)
+    if (dsync && rwf_dsync_supported) {
+        ssize_t n = pwritev2(fd, iov, count, offset, RWF_DSYNC);
+        if (n >= 0 || (errno != ENOSYS && errno != EOPNOTSUPP)) {
+            return n;
+        }
+        rwf_dsync_supported = 0;
+    }
+#endif
+    if (dsync) {
+        *needSync = true;
+    }
+    return pwritev(fd, iov, count, offset);
+}
+
+/*
+ * Transfers all segments starting at offset. Returns the number of bytes
+ * transferred (less than requested only for a read at the end of file) or
+ * -errno.
+ */
+static jlong transfer(bool write, int fd, struct iovec* iov, int count, off_t offset, bool dsync) {
+    jlong done = 0;
+    bool needSync = false;
+    while (count > 0) {
+        ssize_t n = write ? write_segments(fd, iov, count, offset, dsync, &needSync)
+                          : preadv(fd, iov, count, offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (n == 0) {
+            break; /* end of file (read) or nothing left but empty segments */
+        }
+        done += n;
+        offset += n;
+        while (count > 0 && (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    if (needSync && fdatasync(fd) == -1) {
+        return -errno;
+    }
+    return done;
+}
+
+#endif /* !(_WIN64) */
+
+
+/* An array segment (or a part of it) in the bounce buffer */
+struct bounced {
+    jobject array;
+    jlong offset;           /* in the array */
+    size_t length;
+    char* buf;
+    jlong at;               /* offset within the batch */
+};
+
+/*
+ * Runs the transfer of the segments, array segments are copied through a
+ * bounce buffer. bases[i] == null means offsets[i] is an address. Returns
+ * the number of bytes transferred or -errno.
+ */
+static jlong vectored_io(JNIEnv* env, bool write, jlong fd, jlong position, jobjectArray bases,
+        jlongArray offsets, jintArray lengths, jint count, jboolean dsync) {
+
+#if defined (_WIN64)
+
+    /* Not implemented under Windows, callers fall back to RandomAccessFile */
+    stats_scope stats(write ? OP_PWRITEV : OP_PREADV, position, 0);
+    stats.fail(ENOSYS);
+    return -ENOSYS;
+
+#else /* Linux / Unix */
+
+    if (count < 0 || count > MAX_SEGMENTS) {
+        stats_scope stats(write ? OP_PWRITEV : OP_PREADV, position, 0);
+        stats.fail(EINVAL);
+        return -EINVAL;
+    }
+    jlong offs[MAX_SEGMENTS];
+    jint lens[MAX_SEGMENTS];
+    env->GetLongArrayRegion(offsets, 0, count, offs);
+    env->GetIntArrayRegion(lengths, 0, count, lens);
+    jlong total = 0;
+    for (jint i = 0; i < count; ++i) {
+        total += lens[i];
+    }
+
+    stats_scope stats(write ? OP_PWRITEV : OP_PREADV, position, total);
+
+    jobject* arrays = (jobject*) malloc((count + 1) * sizeof(jobject));
+    bounced* pieces = (bounced*) malloc((count + 1) * sizeof(bounced));
+    struct iovec* iov = (struct iovec*) malloc((count + 1) * sizeof(struct iovec));
+    if (arrays == NULL || pieces == NULL || iov == NULL || env->EnsureLocalCapacity(count) != 0) {
+        free(arrays);
+        free(pieces);
+        free(iov);
+        stats.fail(ENOMEM);
+        return -ENOMEM;
+    }
+    jlong arrayBytes = 0;
+    for (jint i = 0; i < count; ++i) {
+        arrays[i] = env->GetObjectArrayElement(bases, i);
+        if (arrays[i] != NULL) {
+            arrayBytes += lens[i];
+        }
+    }
+    size_t bounceSize = (arrayBytes < BOUNCE_SIZE) ? (size_t) arrayBytes : BOUNCE_SIZE;
+    char* bounce = (bounceSize > 0) ? (char*) malloc(bounceSize) : NULL;
+
+    jlong result = (bounceSize > 0 && bounce == NULL) ? -ENOMEM : 0;
+    jlong done = 0;
+    bool syncAtEnd = false;
+    jint seg = 0;
+    jlong segDone = 0;
+    /* a batch: the segments (parts of arrays) that fit into the bounce buffer */
+    while (result == 0 && seg < count) {
+        bool first = (done == 0 && seg == 0 && segDone == 0);
+        int n = 0;
+        int bouncedCount = 0;
+        size_t used = 0;
+        jlong batch = 0;
+        while (seg < count) {
+            size_t len = (size_t) (lens[seg] - segDone);
+            if (len == 0) {
+                ++seg;
+                segDone = 0;
+                continue;
+            }
+            if (arrays[seg] == NULL) {
+                iov[n].iov_base = (char*) (intptr_t) offs[seg] + segDone;
+            } else {
+                if (used == bounceSize) {
+                    break;
+                }
+                if (len > bounceSize - used) {
+                    len = bounceSize - used;
+                }
+                bounced& b = pieces[bouncedCount++];
+                b.array = arrays[seg];
+                b.offset = offs[seg] + segDone;
+                b.length = len;
+                b.buf = bounce + used;
+                b.at = batch;
+                if (write) {
+                    env->GetByteArrayRegion((jbyteArray) b.array, (jsize) b.offset, (jsize) len, (jbyte*) b.buf);
+                }
+                iov[n].iov_base = b.buf;
+                used += len;
+            }
+            iov[n].iov_len = len;
+            ++n;
+            batch += (jlong) len;
+            segDone += (jlong) len;
+            if (segDone == lens[seg]) {
+                ++seg;
+                segDone = 0;
+            }
+        }
+        if (n == 0) {
+            break;
+        }
+        /* RWF_DSYNC only covers its own write, several batches are synced together */
+        bool single = first && seg == count;
+        syncAtEnd = syncAtEnd || (dsync == JNI_TRUE && !single);
+        jlong r = transfer(write, (int) fd, iov, n, (off_t) (position + done), dsync == JNI_TRUE && single);
+        if (r < 0) {
+            result = r;
+            break;
+        }
+        if (!write) {
+            for (int k = 0; k < bouncedCount; ++k) {
+                const bounced& b = pieces[k];
+                jlong avail = r - b.at;
+                if (avail > 0) {
+                    jsize len = (jsize) ((avail < (jlong) b.length) ? avail : (jlong) b.length);
+                    env->SetByteArrayRegion((jbyteArray) b.array, (jsize) b.offset, len, (const jbyte*) b.buf);
+                }
+            }
+        }
+        done += r;
+        if (r < batch) {
+            /* end of file (read) */
+            break;
+        }
+    }
+    if (result == 0 && syncAtEnd && fdatasync((int) fd) == -1) {
+        result = -errno;
+    }
+    if (result == 0) {
+        result = done;
+    }
+    for (jint i = 0; i < count; ++i) {
+        env->DeleteLocalRef(arrays[i]);
+    }
+    free(bounce);
+    free(arrays);
+    free(pieces);
+    free(iov);
+
+    NATIVE_PROBE4(vectored_io, fd, position, total, result);
+    if (result < 0) {
+        stats.fail((int) -result);
+    }
+    return result;
+
+#endif /* (_WIN64) */
+}
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Class:     mmap_impl_VectoredIO
+ * Method:    pwritev0
+ * Signature: (JJ[Ljava/lang/Object;[J[IIZ)J
+ */
+JNIEXPORT jlong JNICALL
+Java_mmap_impl_VectoredIO_pwritev0(JNIEnv* env, jclass,
+  jlong fd,
+  jlong position,
+  jobjectArray bases,
+  jlongArray offsets,
+  jintArray lengths,
+  jint count,
+  jboolean dsync) {
+
+    return vectored_io(env, true, fd, position, bases, offsets, lengths, count, dsync);
+}
+
+/*
+ * Class:     mmap_impl_VectoredIO
+ * Method:    preadv0
+ * Signature: (JJ[Ljava/lang/Object;[J[II)J
+ */
+JNIEXPORT jlong JNICALL
+Java_mmap_impl_VectoredIO_preadv0(JNIEnv* env, jclass,
+  jlong fd,
+  jlong position,
+  jobjectArray bases,
+  jlongArray offsets,
+  jintArray lengths,
+  jint count) {
+
+    return vectored_io(env, false, fd, position, bases, offsets, lengths, count, JNI_FALSE);
+}
+
+/*
+ * Class:     mmap_impl_VectoredIO
+ * Method:    zeroRange0
+ * Signature: (JJJ)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_VectoredIO_zeroRange0(JNIEnv*, jclass,
+  jlong fd,
+  jlong position,
+  jlong length) {
+
+    stats_scope stats(OP_ZERO_RANGE, position, length);
+
+#if defined (__linux) && defined (FALLOC_FL_ZERO_RANGE)
+    int result = fallocate((int) fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE, (off_t) position, (off_t) length);
+    NATIVE_PROBE4(zero_range, fd, position, length, (result == -1) ? -errno : 0);
+    if (result == -1) {
+        stats.fail(errno);
+        return -errno;
+    }
+    return 0;
+#else
+    /* Callers write zeros instead */
+    stats.fail(EOPNOTSUPP);
+    return -EOPNOTSUPP;
+#endif
+}
+
+/*
+ * Class:     mmap_impl_VectoredIO
+ * Method:    readAhead0
+ * Signature: (JJJ)I
+ */
+JNIEXPORT jint JNICALL
+Java_mmap_impl_VectoredIO_readAhead0(JNIEnv*, jclass,
+  jlong fd,
+  jlong position,
+  jlong length) {
+
+    stats_scope stats(OP_READ_AHEAD, position, length);
+
+#if defined (__linux)
+    int err = (readahead((int) fd, (off_t) position, (size_t) length) == -1) ? errno : 0;
+#elif !defined (_WIN64)
+    int err = posix_fadvise((int) fd, (off_t) position, (off_t) length, POSIX_FADV_WILLNEED);
+#else
+    /* Only a hint, callers read without it */
+    int err = EOPNOTSUPP;
+#endif
+    NATIVE_PROBE4(read_ahead, fd, position, length, -err);
+    if (err != 0) {
+        stats.fail(err);
+        return -err;
+    }
+    return 0;
+}
+
+/*
+ * Class:     mmap_impl_VectoredIO
+ * Method:    isSupported0
+ * Signature: ()Z
+ */
+JNIEXPORT jboolean JNICALL
+Java_mmap_impl_VectoredIO_isSupported0(JNIEnv*, jclass) {
+#if defined (_WIN64)
+    return JNI_FALSE;
+#else
+    return JNI_TRUE;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif // #ifdef __cplusplus
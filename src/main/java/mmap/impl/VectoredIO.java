@@ -0,0 +1,186 @@
+package mmap.impl;
+
+import java.io.EOFException;
+import java.io.IOException;
+
+/**
+ * Native positional vectored I/O ({@code pwritev2} / {@code preadv}) on a
+ * raw file descriptor. A list of segments is transferred at an explicit file
+ * position with one system call and without moving the file pointer, so a
+ * length prefix, its payload and further records don't need a seek and a
+ * write each. Writes can optionally be made durable with {@code RWF_DSYNC}
+ * instead of a separate {@code fdatasync}.
+ * <p>
+ * A segment is either a {@code byte[]} (the offset is an index into the
+ * array; the array isn't pinned, its bytes are copied through a bounded
+ * native buffer) or {@code null} (the offset is a native address, used in
+ * place). The raw descriptor of a
+ * {@code RandomAccessFile} is {@link MMapUtils#getFileDescriptor(java.io.FileDescriptor)}.
+ * Not available on Windows, see {@link #isAvailable()}.
+ */
+public final class VectoredIO {
+
+    /** The maximum number of segments per call ({@code IOV_MAX}). */
+    public static final int MAX_SEGMENTS = 1024;
+
+    /**
+     * Returns {@code true} if the native vectored I/O can be used (the
+     * library is loaded, the platform is supported and
+     * {@code -Dmmap.impl.vectored=false} isn't set).
+     */
+    public static boolean isAvailable() {
+        return AVAILABLE;
+    }
+
+    /**
+     * Writes the {@code count} segments back to back at {@code position}.
+     *
+     * @param dsync
+     *            whether the data (and the metadata needed to read it) has
+     *            to be on stable storage when the method returns
+     * @throws IOException
+     *             if the write fails or is short (the file system is full)
+     */
+    public static void write(long fd, long position, Object[] bases, long[] offsets, int[] lengths, int count,
+            boolean dsync) throws IOException {
+        long total = checkSegments(position, bases, offsets, lengths, count);
+        long n = checkResult(pwritev0(fd, position, bases, offsets, lengths, count, dsync), "pwritev");
+        if (n != total) {
+            throw new IOException("Wrote " + n + " of " + total + " bytes at position " + position);
+        }
+    }
+
+    public static void write(long fd, long position, byte[] b, int off, int len, boolean dsync) throws IOException {
+        checkRange(b.length, off, len);
+        write(fd, position, new Object[] { b }, new long[] { off }, new int[] { len }, 1, dsync);
+    }
+
+    /**
+     * Reads into the {@code count} segments from {@code position} on.
+     *
+     * @return the number of bytes read, less than the total length of the
+     *         segments only at the end of the file
+     * @throws IOException
+     *             if the read fails
+     */
+    public static long read(long fd, long position, Object[] bases, long[] offsets, int[] lengths, int count)
+            throws IOException {
+        checkSegments(position, bases, offsets, lengths, count);
+        return checkResult(preadv0(fd, position, bases, offsets, lengths, count), "preadv");
+    }
+
+    public static void readFully(long fd, long position, byte[] b, int off, int len) throws IOException {
+        checkRange(b.length, off, len);
+        long n = read(fd, position, new Object[] { b }, new long[] { off }, new int[] { len }, 1);
+        if (n != len) {
+            throw new EOFException("Read " + n + " of " + len + " bytes at position " + position);
+        }
+    }
+
+    /**
+     * Zeroes {@code length} bytes of the file at {@code position} without
+     * writing them ({@code fallocate(FALLOC_FL_ZERO_RANGE)}; the blocks stay
+     * allocated).
+     *
+     * @return {@code false} if the file system (or platform) doesn't support
+     *         it, the caller then has to write zeros itself
+     */
+    public static boolean zeroRange(long fd, long position, long length) {
+        if ((position | length) < 0L) {
+            throw new IllegalArgumentException("position: " + position + ", length: " + length);
+        }
+        return (length == 0L) || zeroRange0(fd, position, length) == 0;
+    }
+
+    /**
+     * Starts reading {@code length} bytes of the file at {@code position}
+     * into the page cache without waiting for them ({@code readahead}, or
+     * {@code posix_fadvise(POSIX_FADV_WILLNEED)}).
+     *
+     * @return {@code false} if the hint isn't supported (it's only a hint,
+     *         the caller can simply read without it)
+     */
+    public static boolean readAhead(long fd, long position, long length) {
+        if ((position | length) < 0L) {
+            throw new IllegalArgumentException("position: " + position + ", length: " + length);
+        }
+        return (length == 0L) || readAhead0(fd, position, length) == 0;
+    }
+
+    // utility methods
+
+    /* Returns the total length of the segments */
+    private static long checkSegments(long position, Object[] bases, long[] offsets, int[] lengths, int count) {
+        if (position < 0L) {
+            throw new IllegalArgumentException("position: " + position);
+        }
+        if (count < 0 || count > MAX_SEGMENTS || count > bases.length || count > offsets.length
+                || count > lengths.length) {
+            throw new IllegalArgumentException("count: " + count);
+        }
+        long total = 0L;
+        for (int i = 0; i < count; ++i) {
+            Object base = bases[i];
+            if (base == null) {
+                if (lengths[i] < 0) {
+                    throw new IllegalArgumentException("length: " + lengths[i]);
+                }
+            } else if (base instanceof byte[]) {
+                long off = offsets[i];
+                int length = ((byte[]) base).length;
+                if (off < 0L || off > length) {
+                    throw new IndexOutOfBoundsException("off: " + off + ", length: " + length);
+                }
+                checkRange(length, (int) off, lengths[i]);
+            } else {
+                throw new IllegalArgumentException("Not a byte[]: " + base.getClass().getName());
+            }
+            total += lengths[i];
+        }
+        return total;
+    }
+
+    private static void checkRange(int arrayLength, int off, int len) {
+        if ((off | len) < 0 || len > arrayLength - off) {
+            throw new IndexOutOfBoundsException("off: " + off + ", len: " + len + ", length: " + arrayLength);
+        }
+    }
+
+    private static long checkResult(long result, String call) throws IOException {
+        if (result < 0L) {
+            throw new IOException(call + " failed (errno " + -result + ")");
+        }
+        return result;
+    }
+
+    private static boolean available() {
+        if (!Boolean.parseBoolean(System.getProperty("mmap.impl.vectored", "true"))) {
+            return false;
+        }
+        try {
+            return isSupported0();
+        } catch (UnsatisfiedLinkError e) {
+            return false;
+        }
+    }
+
+    // native methods (return the number of bytes transferred or -errno)
+
+    private static native long pwritev0(long fd, long position, Object[] bases, long[] offsets, int[] lengths,
+            int count, boolean dsync);
+
+    private static native long preadv0(long fd, long position, Object[] bases, long[] offsets, int[] lengths,
+            int count);
+
+    private static native int zeroRange0(long fd, long position, long length);
+
+    private static native int readAhead0(long fd, long position, long length);
+
+    private static native boolean isSupported0();
+
+    private static final boolean AVAILABLE = available();
+
+    private VectoredIO() {
+        throw new AssertionError();
+    }
+}
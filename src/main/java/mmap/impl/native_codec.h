@@ -0,0 +1,23 @@
+/* -------------------------------------------------------------------- */
+/* native_codec.h :                                                     */
+/* The LZ4 compatible block decoder shared by the native entry points   */
+/* that decompress data outside of a BlockCodec call (e.g. the fault    */
+/* handler of LazyRegion). BlockCodec.cpp owns the implementation.      */
+/* -------------------------------------------------------------------- */
+
+#ifndef NATIVE_CODEC_H
+#define NATIVE_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+ * Decompresses the raw block src into dst (bounds checked, see
+ * BlockCodec.decompress). dict is the handle of a BlockCodec.Dictionary or
+ * NULL. Returns the decompressed length or a negative value if the block is
+ * malformed or doesn't fit.
+ */
+int codec_decompress(const void* dict, const uint8_t* src, size_t srcLen, uint8_t* dst, size_t dstCap);
+
+#endif /* NATIVE_CODEC_H */
@@ -0,0 +1,25 @@
+/* -------------------------------------------------------------------- */
+/* native_crc32c.h :                                                    */
+/* CRC-32C (Castagnoli) shared by the native entry points that verify   */
+/* data. Crc32C.cpp owns the implementation: SSE4.2 crc32 instructions  */
+/* (three interleaved streams) when available, slicing-by-8 otherwise.  */
+/* -------------------------------------------------------------------- */
+
+#ifndef NATIVE_CRC32C_H
+#define NATIVE_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+ * Continues the CRC-32C crc over n bytes at p. Chaining works like zlib's
+ * crc32(): crc32c_update(crc32c_update(0, a), b) is the CRC of a || b and
+ * the result is identical to java.util.zip.CRC32C (Java 9+).
+ */
+uint32_t crc32c_update(uint32_t crc, const void* p, size_t n);
+
+/* 1 if the SSE4.2 implementation is in use, 0 otherwise */
+int crc32c_hardware();
+
+#endif /* NATIVE_CRC32C_H */
@@ -0,0 +1,34 @@
+/* -------------------------------------------------------------------- */
+/* native_recorder.h :                                                  */
+/* In-memory flight recorder for slow native calls. Calls that take     */
+/* longer than a threshold are written into a fixed-size lock-free ring */
+/* that can be dumped afterwards (FlightRecorder.java). Calls below the */
+/* threshold only pay for a single load and a compare.                  */
+/* -------------------------------------------------------------------- */
+
+#ifndef NATIVE_RECORDER_H
+#define NATIVE_RECORDER_H
+
+#ifndef _JAVASOFT_JNI_H_
+#include <jni.h>
+#endif /* _JAVASOFT_JNI_H_ */
+
+#include <stdint.h>
+#include <atomic>
+
+
+/* Number of events kept in the ring (a power of 2) */
+#define RECORDER_CAPACITY 4096
+
+/* Size of a dumped event in bytes */
+#define RECORDER_EVENT_BYTES 48
+
+
+/* Minimum duration (in native_ticks() units) of a recorded call */
+extern std::atomic<uint64_t> recorder_threshold;
+
+/* Writes an event into the ring. Only called for slow calls. */
+void recorder_record(int op, jlong address, jlong length, uint64_t ticks, int err);
+
+
+#endif /* NATIVE_RECORDER_H */
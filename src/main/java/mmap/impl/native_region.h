@@ -0,0 +1,63 @@
+/* -------------------------------------------------------------------- */
+/* native_region.h :                                                    */
+/* A byte region passed from Java as (Object base, long offset) in the  */
+/* style of Unsafe: either a primitive array that is pinned with        */
+/* GetPrimitiveArrayCritical (offset is a byte offset into the array)   */
+/* or native memory (base == null, offset is an absolute address).      */
+/* -------------------------------------------------------------------- */
+
+#ifndef NATIVE_REGION_H
+#define NATIVE_REGION_H
+
+#ifndef _JAVASOFT_JNI_H_
+#include <jni.h>
+#endif /* _JAVASOFT_JNI_H_ */
+
+#include <stdint.h>
+
+
+class pinned_region {
+public:
+    /*
+     * Pins the array (if any). The release mode is JNI_ABORT for regions
+     * that are only read and 0 for regions that are written.
+     */
+    pinned_region(JNIEnv* env, jobject base, jlong offset, jint mode)
+        : env_(env), base_(base), array_(NULL), mode_(mode), address_(NULL) {
+        if (base == NULL) {
+            address_ = (jbyte*) (intptr_t) offset;
+        } else {
+            array_ = (jbyte*) env->GetPrimitiveArrayCritical((jarray) base, NULL);
+            if (array_ != NULL) {
+                address_ = array_ + offset;
+            }
+        }
+    }
+
+    ~pinned_region() {
+        if (array_ != NULL) {
+            env_->ReleasePrimitiveArrayCritical((jarray) base_, array_, mode_);
+        }
+    }
+
+    /* false if the array couldn't be pinned (OutOfMemoryError is pending) */
+    bool ok() const {
+        return address_ != NULL;
+    }
+
+    jbyte* get() const {
+        return address_;
+    }
+
+private:
+    pinned_region(const pinned_region&);
+    pinned_region& operator=(const pinned_region&);
+
+    JNIEnv* env_;
+    jobject base_;
+    jbyte* array_;
+    jint mode_;
+    jbyte* address_;
+};
+
+#endif /* NATIVE_REGION_H */
@@ -0,0 +1,75 @@
+/* -------------------------------------------------------------------- */
+/* native_sdt.h :                                                       */
+/* USDT (user-level statically defined tracing) probes for the native   */
+/* code of the mmap.impl package. The probe sites are emitted in the    */
+/* SystemTap <sys/sdt.h> note format, so bpftrace, perf and SystemTap   */
+/* can attach to them, but there is no dependency on systemtap-sdt-dev. */
+/* A probe site is a single nop while no tracer is attached. On other   */
+/* platforms the probes expand to nothing.                              */
+/*                                                                      */
+/*   bpftrace -e 'usdt:./libmmap_utils.so:mmap_impl:msync_return        */
+/*                { printf("%d\n", arg2); }'                            */
+/* -------------------------------------------------------------------- */
+
+#ifndef NATIVE_SDT_H
+#define NATIVE_SDT_H
+
+#include <stdint.h>
+
+
+#if defined (__linux) && (defined (__GNUC__) || defined (__clang__)) \
+    && (defined (__x86_64__) || defined (__aarch64__))
+
+/* All arguments are passed as signed 8 byte values */
+#define SDT_ARG(x) ((int64_t) (intptr_t) (x))
+
+/*
+ * The nop marks the probe address. The note records that address, the
+ * link-time address of the _.stapsdt.base anchor (to compute prelink
+ * adjustments), no semaphore, the provider, the probe name and an
+ * argument descriptor of the form "-8@<operand>" per argument.
+ */
+#define SDT_PROBE_(name, args, ...)                                          \
+    __asm__ __volatile__ (                                                   \
+        "990: nop\n"                                                         \
+        ".pushsection .note.stapsdt,\"?\",\"note\"\n"                        \
+        ".balign 4\n"                                                        \
+        ".4byte 992f-991f,994f-993f,3\n"                                     \
+        "991: .asciz \"stapsdt\"\n"                                          \
+        "992: .balign 4\n"                                                   \
+        "993: .8byte 990b\n"                                                 \
+        ".8byte _.stapsdt.base\n"                                            \
+        ".8byte 0\n"                                                         \
+        ".asciz \"mmap_impl\"\n"                                             \
+        ".asciz \"" #name "\"\n"                                             \
+        ".asciz \"" args "\"\n"                                              \
+        "994: .balign 4\n"                                                   \
+        ".popsection\n"                                                      \
+        ".ifndef _.stapsdt.base\n"                                           \
+        ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+        ".weak _.stapsdt.base\n"                                             \
+        ".hidden _.stapsdt.base\n"                                           \
+        "_.stapsdt.base: .space 1\n"                                         \
+        ".size _.stapsdt.base, 1\n"                                          \
+        ".popsection\n"                                                      \
+        ".endif\n"                                                           \
+        :: __VA_ARGS__)
+
+#define NATIVE_PROBE3(name, a1, a2, a3)                                      \
+    SDT_PROBE_(name, "-8@%0 -8@%1 -8@%2",                                    \
+        "nor" (SDT_ARG(a1)), "nor" (SDT_ARG(a2)), "nor" (SDT_ARG(a3)))
+
+#define NATIVE_PROBE4(name, a1, a2, a3, a4)                                  \
+    SDT_PROBE_(name, "-8@%0 -8@%1 -8@%2 -8@%3",                              \
+        "nor" (SDT_ARG(a1)), "nor" (SDT_ARG(a2)), "nor" (SDT_ARG(a3)),        \
+        "nor" (SDT_ARG(a4)))
+
+#else /* no USDT support */
+
+#define NATIVE_PROBE3(name, a1, a2, a3)
+#define NATIVE_PROBE4(name, a1, a2, a3, a4)
+
+#endif /* USDT support */
+
+
+#endif /* NATIVE_SDT_H */
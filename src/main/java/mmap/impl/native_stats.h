@@ -0,0 +1,163 @@
+/* -------------------------------------------------------------------- */
+/* native_stats.h :                                                     */
+/* Always-on call statistics (calls, bytes, cycles, errors) for the     */
+/* native entry points of the mmap.impl package. Every thread counts    */
+/* into its own slot, so the hot path is a handful of plain adds.       */
+/* NativeStats.cpp owns the slot registry and the JNI snapshot call.    */
+/* -------------------------------------------------------------------- */
+
+#ifndef NATIVE_STATS_H
+#define NATIVE_STATS_H
+
+#ifndef _JAVASOFT_JNI_H_
+#include <jni.h>
+#endif /* _JAVASOFT_JNI_H_ */
+
+#include <stdint.h>
+#include <atomic>
+
+#include "native_recorder.h"
+
+#if defined (_MSC_VER)
+#include <intrin.h>
+#elif defined (__x86_64__) || defined (__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+
+/*
+ * The counted native entry points. The order must be kept in sync with
+ * the OPS table in NativeStats.java. New entries are appended at the end.
+ */
+enum native_op {
+    OP_COPY_SWAP_FROM_SHORT_ARRAY = 0,
+    OP_COPY_SWAP_TO_SHORT_ARRAY,
+    OP_COPY_SWAP_FROM_INT_ARRAY,
+    OP_COPY_SWAP_TO_INT_ARRAY,
+    OP_COPY_SWAP_FROM_LONG_ARRAY,
+    OP_COPY_SWAP_TO_LONG_ARRAY,
+    OP_IS_LOADED,
+    OP_LOAD,
+    OP_UNLOAD,
+    OP_FORCE,
+    OP_COPY_SWAP_SHORTS,
+    OP_COPY_SWAP_INTS,
+    OP_COPY_SWAP_LONGS,
+    OP_BLOCK_COMPRESS,
+    OP_BLOCK_DECOMPRESS,
+    OP_ENCODE_DOUBLES,
+    OP_DECODE_DOUBLES,
+    OP_ENCODE_TIMESTAMPS,
+    OP_DECODE_TIMESTAMPS,
+    OP_DICT_ENCODE,
+    OP_DICT_DECODE,
+    OP_DICT_MATCH,
+    OP_CRC32C,
+    OP_FRAME_SCAN,
+    OP_PWRITEV,
+    OP_PREADV,
+    OP_ZERO_RANGE,
+    OP_READ_AHEAD,
+    OP_RESIDENCY_SAMPLE,
+    OP_RESIDENCY_ADVISE,
+    OP_SMAPS,
+    OP_LAZY_FAULT,
+    OP_SNAPSHOT,
+    OP_SEALED_TRANSFER,
+    OP_PBKDF2,
+    OP_COUNT
+};
+
+/* Number of counters per native_op: calls, bytes, cycles, errors */
+#define STATS_FIELDS 4
+
+
+/*
+ * Read the time stamp counter. On platforms without a TSC the
+ * monotonic clock (in nanoseconds) is used instead.
+ */
+static inline uint64_t native_ticks() {
+#if defined (_MSC_VER) || defined (__x86_64__) || defined (__i386__)
+    return (uint64_t) __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+
+/*
+ * The counters of one thread. Only the owning thread ever writes to a
+ * slot, the relaxed atomics merely keep concurrent snapshots tear-free.
+ */
+struct stats_slot {
+    std::atomic<uint64_t> counters[OP_COUNT][STATS_FIELDS];
+    stats_slot* next;
+};
+
+/* Returns the slot of the calling thread, registering it on first use */
+stats_slot* stats_thread_slot();
+
+
+static inline void stats_add(std::atomic<uint64_t>& counter, uint64_t value) {
+    // single writer: a plain load / store pair instead of a locked RMW
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+static inline void stats_record(native_op op, uint64_t bytes, uint64_t cycles, bool error) {
+    std::atomic<uint64_t>* c = stats_thread_slot()->counters[op];
+    stats_add(c[0], 1);
+    stats_add(c[1], bytes);
+    stats_add(c[2], cycles);
+    if (error) {
+        stats_add(c[3], 1);
+    }
+}
+
+
+/*
+ * Records one call of a native entry point when it goes out of scope and
+ * hands it to the flight recorder if it was slow. Call fail() on the
+ * error paths.
+ */
+class stats_scope {
+public:
+    stats_scope(native_op op, jlong address, jlong bytes)
+        : op_(op), address_(address), bytes_((uint64_t) bytes), start_(native_ticks()),
+          error_(false), errno_(0) {
+    }
+
+    ~stats_scope() {
+        uint64_t ticks = native_ticks() - start_;
+        stats_record(op_, bytes_, ticks, error_);
+        if (ticks >= recorder_threshold.load(std::memory_order_acquire)) {
+            recorder_record(op_, address_, (jlong) bytes_, ticks, errno_);
+        }
+    }
+
+    void fail(int err = 0) {
+        error_ = true;
+        errno_ = err;
+    }
+
+    jlong bytes() const {
+        return (jlong) bytes_;
+    }
+
+private:
+    stats_scope(const stats_scope&);
+    stats_scope& operator=(const stats_scope&);
+
+    const native_op op_;
+    const jlong address_;
+    const uint64_t bytes_;
+    const uint64_t start_;
+    bool error_;
+    int errno_;
+};
+
+
+#endif /* NATIVE_STATS_H */
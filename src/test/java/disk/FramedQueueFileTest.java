@@ -0,0 +1,255 @@
+package disk;
+
+import static org.assertj.core.api.Assertions.assertThat;
+
+import java.io.File;
+import java.io.IOException;
+import java.io.RandomAccessFile;
+import java.nio.charset.StandardCharsets;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+
+import org.junit.Before;
+import org.junit.Rule;
+import org.junit.Test;
+import org.junit.rules.TemporaryFolder;
+
+public final class FramedQueueFileTest {
+
+    /** The length of the QueueFile header, the first frame follows it. */
+    private static final int HEADER_LENGTH = 32;
+
+    @Rule
+    public TemporaryFolder folder = new TemporaryFolder();
+
+    private File file;
+
+    @Before
+    public void setUp() {
+        file = new File(folder.getRoot(), "framed.queue");
+    }
+
+    static byte[] message(int i) {
+        StringBuilder sb = new StringBuilder("message ").append(i);
+        for (int k = 0; k < i % 7; ++k) {
+            sb.append(' ').append(k);
+        }
+        return sb.toString().getBytes(StandardCharsets.UTF_8);
+    }
+
+    static List<byte[]> messages(int from, int to) {
+        List<byte[]> messages = new ArrayList<>();
+        for (int i = from; i < to; ++i) {
+            messages.add(message(i));
+        }
+        return messages;
+    }
+
+    private QueueFile open() throws IOException {
+        return new QueueFile.Builder(file).build(false, true);
+    }
+
+    @Test
+    public void testAddPeekRemove() throws IOException {
+        try (QueueFile queue = open()) {
+            assertThat(queue.isEmpty()).isTrue();
+            assertThat(queue.peekMessage()).isNull();
+            queue.addMessage(message(0));
+            queue.addMessages(messages(1, 4));
+            queue.addMessage(message(4));
+            assertThat(queue.size()).isEqualTo(5);
+
+            List<byte[]> removed = new ArrayList<>();
+            for (int i = 0; i < 5; ++i) {
+                assertThat(queue.peekMessage()).isEqualTo(message(i));
+                assertThat(queue.removeNextMessage(removed::add)).isTrue();
+                assertThat(queue.size()).isEqualTo(4 - i);
+            }
+            assertThat(removed).hasSize(5);
+            for (int i = 0; i < 5; ++i) {
+                assertThat(removed.get(i)).isEqualTo(message(i));
+            }
+            assertThat(queue.isEmpty()).isTrue();
+            assertThat(queue.peekMessage()).isNull();
+        }
+    }
+
+    @Test
+    public void testRejectedMessageStaysInQueue() throws IOException {
+        try (QueueFile queue = open()) {
+            queue.addMessages(messages(0, 2));
+            assertThat(queue.removeNextMessage(m -> {
+                throw new IllegalStateException("not now");
+            })).isFalse();
+            assertThat(queue.size()).isEqualTo(2);
+            assertThat(queue.peekMessage()).isEqualTo(message(0));
+        }
+    }
+
+    @Test
+    public void testPeekedMessageIsACopy() throws IOException {
+        try (QueueFile queue = open()) {
+            queue.addMessages(messages(0, 2));
+            Arrays.fill(queue.peekMessage(), (byte) 0);
+            assertThat(queue.removeNextMessage(m -> {
+                Arrays.fill(m, (byte) 0);
+                throw new IllegalStateException("not now");
+            })).isFalse();
+            assertThat(queue.peekMessage()).isEqualTo(message(0));
+        }
+    }
+
+    @Test
+    public void testBatchDequeue() throws IOException {
+        try (QueueFile queue = open()) {
+            for (int i = 0; i < 10; ++i) {
+                queue.addMessage(message(i));
+            }
+            // a single frame of five messages
+            queue.addMessages(messages(10, 15));
+            assertThat(queue.size()).isEqualTo(15);
+
+            // a rejected batch isn't removed
+            assertThat(queue.removeMessages(4, Integer.MAX_VALUE, b -> {
+                throw new IllegalStateException("not now");
+            })).isEqualTo(0);
+            assertThat(queue.size()).isEqualTo(15);
+
+            List<byte[]> received = new ArrayList<>();
+            BatchConsumer collect = batch -> {
+                for (int i = 0; i < batch.size(); ++i) {
+                    received.add(batch.message(i));
+                }
+            };
+            assertThat(queue.removeMessages(4, Integer.MAX_VALUE, collect)).isEqualTo(4);
+            // six single frames and the first two messages of the batch frame
+            assertThat(queue.removeMessages(8, Integer.MAX_VALUE, collect)).isEqualTo(8);
+            assertThat(received).hasSize(12);
+            for (int i = 0; i < 12; ++i) {
+                assertThat(received.get(i)).isEqualTo(message(i));
+            }
+            assertThat(queue.size()).isEqualTo(3);
+            assertThat(queue.peekMessage()).isEqualTo(message(12));
+
+            // at least one message, even if it exceeds maxBytes
+            QueueFile.Batch batch = queue.peekMessages(100, 0);
+            assertThat(batch.size()).isEqualTo(1);
+            assertThat(batch.message(0)).isEqualTo(message(12));
+
+            batch = queue.peekMessages(100, Integer.MAX_VALUE);
+            assertThat(batch.size()).isEqualTo(3);
+            for (int i = 0; i < 3; ++i) {
+                byte[] m = message(12 + i);
+                assertThat(batch.length(i)).isEqualTo(m.length);
+                assertThat(Arrays.copyOfRange(batch.buffer(), batch.offset(i), batch.offset(i) + batch.length(i)))
+                        .isEqualTo(m);
+            }
+            assertThat(queue.size()).isEqualTo(3);
+        }
+    }
+
+    @Test
+    public void testTornFrameIsTruncatedOnOpen() throws IOException {
+        List<byte[]> first = messages(0, 1);
+        List<byte[]> second = messages(1, 3);
+        List<byte[]> third = messages(3, 6);
+        try (QueueFile queue = open()) {
+            queue.addMessages(first);
+            queue.addMessages(second);
+            queue.addMessages(third);
+        }
+        // the write of the third frame didn't complete: its end is still zero
+        long thirdEnd = HEADER_LENGTH + QueueFile.encodeFrame(first).length + QueueFile.encodeFrame(second).length
+                + QueueFile.encodeFrame(third).length;
+        try (RandomAccessFile raf = new RandomAccessFile(file, "rw")) {
+            raf.seek(thirdEnd - 5);
+            raf.write(new byte[5]);
+        }
+
+        try (QueueFile queue = open()) {
+            assertThat(queue.size()).isEqualTo(3);
+            for (int i = 0; i < 3; ++i) {
+                assertThat(queue.get(i)).isEqualTo(message(i));
+            }
+            // the queue keeps working after the truncation
+            queue.addMessage(message(6));
+            assertThat(queue.size()).isEqualTo(4);
+            assertThat(queue.get(3)).isEqualTo(message(6));
+        }
+        try (QueueFile queue = open()) {
+            assertThat(queue.size()).isEqualTo(4);
+            assertThat(queue.peekMessage()).isEqualTo(message(0));
+        }
+    }
+
+    @Test
+    public void testCorruptHeadFrameEmptiesQueue() throws IOException {
+        try (QueueFile queue = open()) {
+            queue.addMessages(messages(0, 3));
+            queue.addMessage(message(3));
+        }
+        try (RandomAccessFile raf = new RandomAccessFile(file, "rw")) {
+            // flip a payload byte of the first frame, its checksum doesn't match anymore
+            long position = HEADER_LENGTH + QueueFile.encodeFrame(messages(0, 3)).length - 1;
+            raf.seek(position);
+            int b = raf.read();
+            raf.seek(position);
+            raf.write(b ^ 0xff);
+        }
+        try (QueueFile queue = open()) {
+            assertThat(queue.isEmpty()).isTrue();
+            assertThat(queue.size()).isEqualTo(0);
+        }
+    }
+
+    @Test
+    public void testIndexedGetAndSkipMatchLinearWalk() throws IOException {
+        File linearFile = new File(folder.getRoot(), "linear.queue");
+        List<byte[]> expected = new ArrayList<>();
+        try (QueueFile indexed = new QueueFile.Builder(file).indexStride(3).build(false, true);
+                QueueFile linear = new QueueFile.Builder(linearFile).build(false, true)) {
+            int next = 0;
+            for (int i = 0; i < 40; ++i) {
+                // frames of 1 to 4 messages
+                List<byte[]> frame = messages(next, next + 1 + i % 4);
+                next += frame.size();
+                indexed.addMessages(frame);
+                linear.addMessages(frame);
+                expected.addAll(frame);
+            }
+            assertThat(indexed.size()).isEqualTo(expected.size());
+            assertGetMatches(indexed, linear, expected);
+
+            // skip into the middle of a frame, then past a few more frames
+            assertThat(indexed.skip(5)).isEqualTo(5);
+            assertThat(linear.skip(5)).isEqualTo(5);
+            expected.subList(0, 5).clear();
+            assertGetMatches(indexed, linear, expected);
+            // to the end of a frame (1 + 2 + ... messages), removals are persisted per frame
+            assertThat(indexed.skip(16)).isEqualTo(16);
+            assertThat(linear.skip(16)).isEqualTo(16);
+            expected.subList(0, 16).clear();
+            assertGetMatches(indexed, linear, expected);
+        }
+        // the index is rebuilt on open
+        try (QueueFile indexed = new QueueFile.Builder(file).indexStride(3).build(false, true);
+                QueueFile linear = new QueueFile.Builder(linearFile).build(false, true)) {
+            assertGetMatches(indexed, linear, expected);
+            int remaining = expected.size();
+            assertThat(indexed.skip(remaining + 10)).isEqualTo(remaining);
+            assertThat(indexed.isEmpty()).isTrue();
+        }
+    }
+
+    private static void assertGetMatches(QueueFile indexed, QueueFile linear, List<byte[]> expected)
+            throws IOException {
+        assertThat(indexed.size()).isEqualTo(expected.size());
+        assertThat(linear.size()).isEqualTo(expected.size());
+        for (int k = 0; k < expected.size(); ++k) {
+            assertThat(indexed.get(k)).as("message %d", k).isEqualTo(expected.get(k));
+            assertThat(linear.get(k)).as("message %d", k).isEqualTo(expected.get(k));
+        }
+        assertThat(indexed.peekMessage()).isEqualTo(expected.get(0));
+    }
+}
@@ -0,0 +1,87 @@
+package disk;
+
+import static org.assertj.core.api.Assertions.assertThat;
+
+import org.junit.Test;
+
+public final class PositionIndexTest {
+
+    /** Element {@code seq} at position {@code 100 * seq}, with {@code seq % 3 + 1} messages. */
+    private static PositionIndex index(int stride, int elements) {
+        PositionIndex index = new PositionIndex(stride);
+        long messageSeq = 0L;
+        for (int seq = 0; seq < elements; ++seq) {
+            index.append(seq, 100L * seq, messageSeq);
+            messageSeq += seq % 3 + 1;
+        }
+        return index;
+    }
+
+    /** The message sequence number of the first message of element {@code seq}, by a linear walk. */
+    private static long firstMessage(int seq) {
+        long messageSeq = 0L;
+        for (int k = 0; k < seq; ++k) {
+            messageSeq += k % 3 + 1;
+        }
+        return messageSeq;
+    }
+
+    @Test
+    public void testFloorMatchesLinearWalk() {
+        // 25 entries, the arrays grow past their initial 16 slots
+        PositionIndex index = index(4, 100);
+        assertThat(index.size()).isEqualTo(25);
+        for (int seq = 0; seq < 100; ++seq) {
+            int entry = index.floorByElement(seq);
+            assertThat(index.elementSeq(entry)).isEqualTo(seq - seq % 4);
+            assertThat(index.position(entry)).isEqualTo(100L * (seq - seq % 4));
+            assertThat(index.messageSeq(entry)).isEqualTo(firstMessage(seq - seq % 4));
+
+            // every message of the element maps to an entry at or before it
+            for (long m = firstMessage(seq); m < firstMessage(seq + 1); ++m) {
+                entry = index.floorByMessage(m);
+                assertThat(index.elementSeq(entry)).isEqualTo(seq - seq % 4);
+            }
+        }
+    }
+
+    @Test
+    public void testTrimAndAppendWrapAround() {
+        PositionIndex index = index(4, 64);
+        index.trim(30);
+        // the entries of elements 32, 36, ... remain
+        assertThat(index.size()).isEqualTo(8);
+        assertThat(index.floorByElement(31)).isEqualTo(-1);
+        assertThat(index.floorByMessage(firstMessage(31))).isEqualTo(-1);
+        assertThat(index.elementSeq(index.floorByElement(33))).isEqualTo(32L);
+
+        // new entries reuse the freed slots at the start of the arrays
+        long messageSeq = firstMessage(64);
+        for (int seq = 64; seq < 96; ++seq) {
+            index.append(seq, 100L * seq, messageSeq);
+            messageSeq += seq % 3 + 1;
+        }
+        assertThat(index.size()).isEqualTo(16);
+        for (int seq = 32; seq < 96; ++seq) {
+            int entry = index.floorByElement(seq);
+            assertThat(index.position(entry)).isEqualTo(100L * (seq - seq % 4));
+            assertThat(index.elementSeq(index.floorByMessage(firstMessage(seq)))).isEqualTo(seq - seq % 4);
+        }
+    }
+
+    @Test
+    public void testRelocateMovesWrappedPositions() {
+        PositionIndex index = index(2, 10);
+        index.relocate(500L, 4096L);
+        for (int seq = 0; seq < 10; seq += 2) {
+            long expected = (100L * seq < 500L) ? 100L * seq + 4096L : 100L * seq;
+            assertThat(index.position(index.floorByElement(seq))).isEqualTo(expected);
+        }
+    }
+
+    @Test(expected = IllegalStateException.class)
+    public void testGapIsRejected() {
+        PositionIndex index = index(4, 8);
+        index.append(12L, 1200L, 20L);
+    }
+}
@@ -0,0 +1,135 @@
+package disk;
+
+import static disk.FramedQueueFileTest.message;
+import static disk.FramedQueueFileTest.messages;
+import static org.assertj.core.api.Assertions.assertThat;
+
+import java.io.File;
+import java.io.IOException;
+import java.util.concurrent.atomic.AtomicReference;
+
+import org.junit.Before;
+import org.junit.Rule;
+import org.junit.Test;
+import org.junit.rules.TemporaryFolder;
+
+public final class QueueCursorTest {
+
+    @Rule
+    public TemporaryFolder folder = new TemporaryFolder();
+
+    private File file;
+
+    @Before
+    public void setUp() {
+        file = new File(folder.getRoot(), "cursor.queue");
+    }
+
+    private SegmentedQueueFile open() throws IOException {
+        return new SegmentedQueueFile.Builder(file).build(SegmentedQueueFile.MIN_SEGMENT_SIZE);
+    }
+
+    @Test
+    public void testRewindReturnsToTheCommittedPosition() throws IOException {
+        try (SegmentedQueueFile queue = open(); QueueCursor cursor = queue.cursor("reader")) {
+            queue.addMessage(message(0));
+            queue.addMessages(messages(1, 4));
+
+            assertThat(cursor.poll()).isEqualTo(message(0));
+            assertThat(cursor.poll()).isEqualTo(message(1));
+            cursor.rewind();
+            assertThat(cursor.poll()).isEqualTo(message(0));
+            cursor.commit();
+
+            assertThat(cursor.poll()).isEqualTo(message(1));
+            assertThat(cursor.poll()).isEqualTo(message(2));
+            cursor.rewind();
+            assertThat(cursor.poll()).isEqualTo(message(1));
+            assertThat(queue.size()).isEqualTo(3);
+        }
+    }
+
+    @Test
+    public void testReopenedCursorContinuesAfterTheCommit() throws IOException {
+        try (SegmentedQueueFile queue = open()) {
+            try (QueueCursor cursor = queue.cursor("reader")) {
+                queue.addMessage(message(0));
+                // a frame of three messages
+                queue.addMessages(messages(1, 4));
+                queue.addMessage(message(4));
+
+                assertThat(cursor.poll()).isEqualTo(message(0));
+                assertThat(cursor.poll()).isEqualTo(message(1));
+                // in the middle of the second frame
+                cursor.commit();
+                assertThat(queue.size()).isEqualTo(3);
+                // read, but not committed
+                assertThat(cursor.poll()).isEqualTo(message(2));
+                assertThat(cursor.poll()).isEqualTo(message(3));
+            }
+            // a new instance starts at the committed position
+            try (QueueCursor cursor = queue.cursor("reader")) {
+                assertThat(cursor.poll()).isEqualTo(message(2));
+            }
+        }
+
+        try (SegmentedQueueFile queue = open()) {
+            assertThat(queue.cursorNames()).containsExactly("reader");
+            assertThat(queue.size()).isEqualTo(3);
+            try (QueueCursor cursor = queue.cursor("reader")) {
+                for (int i = 2; i < 5; ++i) {
+                    assertThat(cursor.poll()).isEqualTo(message(i));
+                }
+                assertThat(cursor.poll()).isNull();
+                cursor.commit();
+            }
+            assertThat(queue.isEmpty()).isTrue();
+
+            // a new cursor starts at the head of the queue
+            queue.addMessage(message(5));
+            try (QueueCursor cursor = queue.cursor("late")) {
+                assertThat(cursor.poll()).isEqualTo(message(5));
+            }
+        }
+    }
+
+    @Test(expected = IllegalStateException.class)
+    public void testCursorCanOnlyBeOpenedOnce() throws IOException {
+        try (SegmentedQueueFile queue = open(); QueueCursor cursor = queue.cursor("reader")) {
+            queue.cursor("reader");
+        }
+    }
+
+    @Test(expected = IllegalArgumentException.class)
+    public void testInvalidCursorName() throws IOException {
+        try (SegmentedQueueFile queue = open()) {
+            queue.cursor("no/slashes");
+        }
+    }
+
+    @Test
+    public void testClosingTheQueueDetachesCommittingCursors() throws Exception {
+        SegmentedQueueFile queue = open();
+        QueueCursor cursor = queue.cursor("reader");
+        queue.addMessages(messages(0, 1000));
+        AtomicReference<Throwable> failure = new AtomicReference<>();
+        Thread committer = new Thread(() -> {
+            try {
+                while (cursor.poll() != null) {
+                    cursor.commit();
+                }
+            } catch (ClosedQueueFileException e) {
+                // the queue has been closed meanwhile
+            } catch (Throwable t) {
+                failure.set(t);
+            }
+        });
+        committer.start();
+        queue.close();
+        committer.join();
+
+        assertThat(failure.get()).isNull();
+        assertThat(cursor.isClosed()).isTrue();
+        cursor.close();
+    }
+}
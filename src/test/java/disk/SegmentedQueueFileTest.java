@@ -0,0 +1,162 @@
+package disk;
+
+import static disk.FramedQueueFileTest.message;
+import static disk.FramedQueueFileTest.messages;
+import static org.assertj.core.api.Assertions.assertThat;
+
+import java.io.File;
+import java.io.IOException;
+import java.io.RandomAccessFile;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+
+import org.junit.Before;
+import org.junit.Rule;
+import org.junit.Test;
+import org.junit.rules.TemporaryFolder;
+
+public final class SegmentedQueueFileTest {
+
+    /** Payload length: 15 single message frames fit into a segment of MIN_SEGMENT_SIZE. */
+    private static final int PAYLOAD_LENGTH = 4096;
+
+    @Rule
+    public TemporaryFolder folder = new TemporaryFolder();
+
+    private File file;
+
+    @Before
+    public void setUp() {
+        file = new File(folder.getRoot(), "segmented.queue");
+    }
+
+    private SegmentedQueueFile open() throws IOException {
+        return new SegmentedQueueFile.Builder(file).build(SegmentedQueueFile.MIN_SEGMENT_SIZE);
+    }
+
+    private static byte[] payload(int i) {
+        byte[] data = new byte[PAYLOAD_LENGTH];
+        Arrays.fill(data, (byte) i);
+        QueueFile.writeInt(data, 0, i);
+        return data;
+    }
+
+    private static void poll(QueueCursor cursor, int from, int to) throws IOException {
+        for (int i = from; i < to; ++i) {
+            assertThat(cursor.poll()).as("message %d", i).isEqualTo(payload(i));
+        }
+    }
+
+    @Test
+    public void testAddAndRemoveAcrossSegments() throws IOException {
+        try (SegmentedQueueFile queue = open()) {
+            for (int i = 0; i < 40; ++i) {
+                queue.addMessage(payload(i));
+            }
+            assertThat(queue.size()).isEqualTo(40);
+            assertThat(queue.segmentCount()).isEqualTo(3);
+
+            List<byte[]> removed = new ArrayList<>();
+            for (int i = 0; i < 16; ++i) {
+                assertThat(queue.removeNextMessage(removed::add)).isTrue();
+            }
+            // the first segment has been consumed and deleted
+            assertThat(queue.segmentCount()).isEqualTo(2);
+            assertThat(queue.segmentFile(0L).exists()).isFalse();
+            assertThat(queue.size()).isEqualTo(24);
+        }
+        try (SegmentedQueueFile queue = open()) {
+            List<byte[]> remaining = new ArrayList<>();
+            queue.forEachAccept(remaining::add);
+            assertThat(remaining).hasSize(24);
+            for (int i = 0; i < 24; ++i) {
+                assertThat(remaining.get(i)).isEqualTo(payload(16 + i));
+            }
+        }
+    }
+
+    @Test
+    public void testSegmentsAreReclaimedBehindTheSlowestCursor() throws IOException {
+        try (SegmentedQueueFile queue = open(); QueueCursor a = queue.cursor("a"); QueueCursor b = queue.cursor("b")) {
+            for (int i = 0; i < 40; ++i) {
+                queue.addMessage(payload(i));
+            }
+            // frames 0-14, 15-29 and 30-39
+            assertThat(queue.segmentCount()).isEqualTo(3);
+            assertThat(queue.cursorNames()).containsExactly("a", "b");
+
+            poll(a, 0, 20);
+            a.commit();
+            // b hasn't read anything yet
+            assertThat(queue.segmentCount()).isEqualTo(3);
+            assertThat(queue.size()).isEqualTo(40);
+
+            poll(b, 0, 16);
+            b.commit();
+            assertThat(queue.segmentCount()).isEqualTo(2);
+            assertThat(queue.segmentFile(0L).exists()).isFalse();
+            assertThat(queue.size()).isEqualTo(24);
+
+            poll(b, 16, 40);
+            assertThat(b.poll()).isNull();
+            b.commit();
+            // a is still in the second segment
+            assertThat(queue.segmentCount()).isEqualTo(2);
+            assertThat(queue.size()).isEqualTo(20);
+
+            poll(a, 20, 40);
+            assertThat(a.poll()).isNull();
+            a.commit();
+            assertThat(queue.segmentCount()).isEqualTo(1);
+            assertThat(queue.segmentFile(1L).exists()).isFalse();
+            assertThat(queue.isEmpty()).isTrue();
+        }
+    }
+
+    @Test
+    public void testQueueWithCursorsCanOnlyBeConsumedThroughThem() throws IOException {
+        try (SegmentedQueueFile queue = open(); QueueCursor cursor = queue.cursor("only")) {
+            queue.addMessage(payload(0));
+            try {
+                queue.removeNextMessage(m -> {
+                });
+                throw new AssertionError("removeNextMessage() with a cursor");
+            } catch (IllegalStateException expected) {
+                // consumed through the cursor
+            }
+            assertThat(cursor.poll()).isEqualTo(payload(0));
+        }
+    }
+
+    @Test
+    public void testTruncatedSegmentIsRecovered() throws IOException {
+        List<byte[]> third = messages(3, 6);
+        try (SegmentedQueueFile queue = open()) {
+            queue.addMessage(message(0));
+            queue.addMessages(messages(1, 3));
+            queue.addMessages(third);
+        }
+        // the segment file ends in the middle of the third frame
+        File segment = new File(folder.getRoot(), file.getName() + ".0");
+        long end = QueueFile.encodeFrame(messages(0, 1)).length + QueueFile.encodeFrame(messages(1, 3)).length
+                + QueueFile.encodeFrame(third).length;
+        try (RandomAccessFile raf = new RandomAccessFile(segment, "rw")) {
+            raf.setLength(end - 3);
+        }
+
+        try (SegmentedQueueFile queue = open()) {
+            assertThat(queue.size()).isEqualTo(3);
+            queue.addMessage(message(6));
+        }
+        try (SegmentedQueueFile queue = open()) {
+            List<byte[]> all = new ArrayList<>();
+            queue.forEachAccept(all::add);
+            assertThat(all).hasSize(4);
+            for (int i = 0; i < 3; ++i) {
+                assertThat(all.get(i)).isEqualTo(message(i));
+            }
+            assertThat(all.get(3)).isEqualTo(message(6));
+        }
+    }
+}
@@ -0,0 +1,121 @@
+package mmap.impl;
+
+import static org.assertj.core.api.Assertions.assertThat;
+
+import java.io.File;
+import java.io.IOException;
+import java.io.RandomAccessFile;
+import java.nio.MappedByteBuffer;
+import java.nio.channels.FileChannel;
+import java.nio.file.Files;
+
+import org.junit.After;
+import org.junit.Assume;
+import org.junit.Before;
+import org.junit.Rule;
+import org.junit.Test;
+import org.junit.rules.TemporaryFolder;
+
+public final class ResidencyManagerTest {
+
+    private static final int MB = 1 << 20;
+    private static final int CLASS = 1;
+
+    /** In the build directory: java.io.tmpdir is often a tmpfs, whose pages can't be dropped. */
+    @Rule
+    public TemporaryFolder folder = new TemporaryFolder(new File("target"));
+
+    private File file;
+    private RandomAccessFile raf;
+    private MappedByteBuffer buffer;
+    private long id;
+    private long evictedBefore;
+
+    @Before
+    public void setUp() throws IOException {
+        Assume.assumeTrue(ResidencyManager.isAvailable());
+        file = new File(folder.getRoot(), "residency.bin");
+        raf = new RandomAccessFile(file, "rw");
+        raf.setLength(16 * MB);
+        buffer = raf.getChannel().map(FileChannel.MapMode.READ_ONLY, 0L, 16 * MB);
+    }
+
+    @After
+    public void tearDown() throws IOException {
+        if (id != 0L) {
+            ResidencyManager.unregister(id);
+        }
+        if (raf != null) {
+            ResidencyManager.setBudget(CLASS, 0L);
+            ResidencyManager.setPolicy(ResidencyManager.DEFAULT_CHUNK_SHIFT, ResidencyManager.EVICT_COLD, 90, 2,
+                    false, false);
+            raf.close();
+        }
+    }
+
+    private void register(int evictAdvice, boolean dropCache) throws IOException {
+        if (dropCache) {
+            // dropping the cache of a tmpfs file is a no-op
+            Assume.assumeFalse("tmpfs".equals(Files.getFileStore(file.toPath()).type()));
+        }
+        ResidencyManager.setPolicy(ResidencyManager.DEFAULT_CHUNK_SHIFT, evictAdvice, 90, 2, false, dropCache);
+        buffer.load();
+        id = ResidencyManager.register(CLASS, buffer, raf.getFD(), 0L);
+        ResidencyManager.setBudget(CLASS, 8 * MB);
+        // the statistics are cumulative
+        evictedBefore = ResidencyManager.stats(CLASS).evicted();
+    }
+
+    private long evicted() {
+        return ResidencyManager.stats(CLASS).evicted() - evictedBefore;
+    }
+
+    // the touched chunks (6 and 7 of 8) must never become the least recently used ones
+    private void assertTouchedChunksStayHot() throws IOException {
+        for (int pass = 1; pass <= 4; ++pass) {
+            if (pass >= 2) {
+                ResidencyManager.touch(id, 12 * MB, 4 * MB);
+            }
+            ResidencyManager.enforce();
+            int[] ages = ResidencyManager.idleAges(id);
+            assertThat(ages).hasSize(8);
+            if (pass >= 2) {
+                assertThat(ages[6]).isEqualTo(0);
+                assertThat(ages[7]).isEqualTo(0);
+                for (int i = 0; i < 6; ++i) {
+                    assertThat(ages[i]).as("chunk %d in pass %d", i, pass).isEqualTo(pass - 1);
+                }
+            }
+        }
+    }
+
+    @Test
+    public void testEvictionKeepsOrderWhilePagesStayCached() throws IOException {
+        // MADV_COLD without dropping the file cache: the pages stay resident
+        register(ResidencyManager.EVICT_COLD, false);
+        assertTouchedChunksStayHot();
+        ResidencyManager.Stats stats = ResidencyManager.stats(CLASS);
+        assertThat(stats.resident()).isLessThanOrEqualTo(16L * MB);
+        assertThat(evicted()).isLessThanOrEqualTo(10L * MB);
+    }
+
+    @Test
+    public void testEvictionWithDroppedCache() throws IOException {
+        register(ResidencyManager.EVICT_DONTNEED, true);
+        assertTouchedChunksStayHot();
+        ResidencyManager.Stats stats = ResidencyManager.stats(CLASS);
+        // 90% of the 8 MiB budget: five chunks of 2 MiB are dropped in the first pass
+        assertThat(evicted()).isEqualTo(10L * MB);
+        assertThat(stats.resident()).isEqualTo(6L * MB);
+    }
+
+    @Test
+    public void testDescriptorMayBeClosedWhileRegistered() throws IOException {
+        register(ResidencyManager.EVICT_DONTNEED, true);
+        // the manager drops the file cache through its own descriptor
+        raf.getChannel().close();
+        ResidencyManager.enforce();
+        ResidencyManager.enforce();
+        assertThat(evicted()).isEqualTo(10L * MB);
+    }
+}